@@ -0,0 +1,104 @@
+##
+# Extract the in-memory debug log of a TDX guest from a memory dump.
+#
+# The dump is a raw image of guest physical memory, for example created with
+# the "pmemsave" monitor command of QEMU for a debug TD, or read from /dev/mem
+# inside the guest. The log header (TDX_DEBUG_LOG in
+# OvmfPkg/Include/Guid/TdxDebugLog.h) is located by its signature, unless its
+# address is given.
+#
+# Copyright (c) 2021, Intel Corporation. All rights reserved.<BR>
+# SPDX-License-Identifier: BSD-2-Clause-Patent
+#
+##
+
+from __future__ import print_function
+import argparse
+import struct
+import sys
+
+__prog__        = 'TdxDebugLogDump'
+__copyright__   = 'Copyright (c) 2021, Intel Corporation. All rights reserved.'
+__description__ = 'Extract the in-memory debug log of a TDX guest from a memory dump.\n'
+
+TDX_DEBUG_LOG_SIGNATURE      = struct.unpack ('<Q', b'TDXDBGLG')[0]
+TDX_DEBUG_LOG_MAILBOX_OFFSET = 0x20
+TDX_DEBUG_LOG_FORMAT         = '<QQQQQQ'
+TDX_DEBUG_LOG_SIZE           = struct.calcsize (TDX_DEBUG_LOG_FORMAT)
+PAGE_SIZE                    = 0x1000
+
+def ParseHeader (Dump, Offset):
+    if Offset < 0 or Offset + TDX_DEBUG_LOG_SIZE > len (Dump):
+        return None
+    Signature, RingBase, RingSize, Check, Head, Flushed = struct.unpack_from (TDX_DEBUG_LOG_FORMAT, Dump, Offset)
+    if Signature != TDX_DEBUG_LOG_SIGNATURE or Check != Signature ^ RingBase ^ RingSize:
+        return None
+    if RingSize == 0 or RingSize & (RingSize - 1) != 0:
+        return None
+    return RingBase, RingSize, Head
+
+def FindHeader (Dump, Base):
+    Signature = struct.pack ('<Q', TDX_DEBUG_LOG_SIGNATURE)
+    Offset = Dump.find (Signature)
+    while Offset >= 0:
+        if (Base + Offset) % PAGE_SIZE == TDX_DEBUG_LOG_MAILBOX_OFFSET and ParseHeader (Dump, Offset) is not None:
+            return Offset
+        Offset = Dump.find (Signature, Offset + 1)
+    return None
+
+def ExtractLog (Dump, Base, HeaderOffset):
+    RingBase, RingSize, Head = ParseHeader (Dump, HeaderOffset)
+    RingOffset = RingBase - Base
+    if RingOffset < 0 or RingOffset + RingSize > len (Dump):
+        raise ValueError ('ring buffer at 0x%x is not in the dump' % RingBase)
+    Ring = Dump[RingOffset:RingOffset + RingSize]
+    if Head <= RingSize:
+        return 0, Ring[:Head]
+    Start = Head % RingSize
+    return Head - RingSize, Ring[Start:] + Ring[:Start]
+
+if __name__ == '__main__':
+    def AutoInt (Argument):
+        return int (Argument, 0)
+
+    parser = argparse.ArgumentParser (prog = __prog__,
+                                      description = __description__ + __copyright__,
+                                      conflict_handler = 'resolve')
+    parser.add_argument ('DumpFile', type = argparse.FileType ('rb'),
+                         help = 'Raw dump of guest physical memory.')
+    parser.add_argument ('-b', '--base', type = AutoInt, default = 0,
+                         help = 'Guest physical address of the first byte of the dump. Default is 0.')
+    parser.add_argument ('-a', '--address', type = AutoInt,
+                         help = 'Guest physical address of the log header. Default is to search the dump.')
+    parser.add_argument ('-o', '--output', type = argparse.FileType ('wb'),
+                         help = 'Output file for the log. Default is standard output.')
+    args = parser.parse_args ()
+
+    Dump = args.DumpFile.read ()
+    args.DumpFile.close ()
+
+    if args.address is not None:
+        HeaderOffset = args.address - args.base
+        if ParseHeader (Dump, HeaderOffset) is None:
+            print ('TdxDebugLogDump: error: no valid log header at 0x%x' % args.address, file = sys.stderr)
+            sys.exit (1)
+    else:
+        HeaderOffset = FindHeader (Dump, args.base)
+        if HeaderOffset is None:
+            print ('TdxDebugLogDump: error: no log header found in the dump', file = sys.stderr)
+            sys.exit (1)
+
+    try:
+        Lost, Log = ExtractLog (Dump, args.base, HeaderOffset)
+    except ValueError as Error:
+        print ('TdxDebugLogDump: error: %s' % Error, file = sys.stderr)
+        sys.exit (1)
+
+    if Lost != 0:
+        print ('TdxDebugLogDump: %d bytes of older messages have been overwritten' % Lost, file = sys.stderr)
+    if args.output is not None:
+        args.output.write (Log)
+        args.output.close ()
+    else:
+        Output = getattr (sys.stdout, 'buffer', sys.stdout)
+        Output.write (Log)
@@ -93,7 +93,7 @@ FatDiscardODir (
     //
     ODir->DirCacheTag = OFile->FileCluster;
     InsertHeadList (&Volume->DirCacheList, &ODir->DirCacheLink);
-    if (Volume->DirCacheCount == FAT_MAX_DIR_CACHE_COUNT) {
+    if (Volume->DirCacheCount >= Volume->MaxDirCacheCount) {
       //
       // Replace the least recent used directory
       //
@@ -1,13 +1,96 @@
 /** @file
   Cache implementation for EFI FAT File system driver.
 
-Copyright (c) 2005 - 2013, Intel Corporation. All rights reserved.<BR>
+Copyright (c) 2005 - 2021, Intel Corporation. All rights reserved.<BR>
 SPDX-License-Identifier: BSD-2-Clause-Patent
 
 **/
 
 #include "Fat.h"
 
+/**
+
+  Wait for the pending readahead of the data cache to complete.
+  If the readahead failed, its cache pages are invalidated.
+
+  @param  Volume                - FAT file system volume.
+
+**/
+STATIC
+VOID
+FatWaitReadAhead (
+  IN FAT_VOLUME         *Volume
+  )
+{
+  DISK_CACHE  *DiskCache;
+  UINTN       GroupNo;
+
+  DiskCache = &Volume->DiskCache[CacheData];
+  if (!DiskCache->ReadAheadPending) {
+    return;
+  }
+
+  while (gBS->CheckEvent (DiskCache->ReadAheadToken.Event) == EFI_NOT_READY) {
+    CpuPause ();
+  }
+
+  DiskCache->ReadAheadPending = FALSE;
+  if (EFI_ERROR (DiskCache->ReadAheadToken.TransactionStatus)) {
+    DEBUG ((EFI_D_INFO, "FatDiskIo: readahead failed %r\n", DiskCache->ReadAheadToken.TransactionStatus));
+    for (GroupNo = DiskCache->ReadAheadGroupNo;
+         GroupNo < DiskCache->ReadAheadGroupNo + DiskCache->ReadAheadGroupCount;
+         GroupNo++) {
+      DiskCache->CacheTag[GroupNo].RealSize = 0;
+    }
+
+    DiskCache->ReadAheadPages = 0;
+  }
+}
+
+/**
+
+  Update the sequential read detection of the data cache with a read
+  of the pages from FirstPageNo to LastPageNo.
+
+  A read is sequential if it starts in the page following the previous
+  read, or if it starts in the last page of the previous read and goes on
+  past it. Each sequential read doubles the readahead window, any other
+  read closes it.
+
+  @param  DiskCache             - The data cache.
+  @param  FirstPageNo           - The first page of the read.
+  @param  LastPageNo            - The last page of the read.
+
+**/
+STATIC
+VOID
+FatTrackSequentialRead (
+  IN DISK_CACHE         *DiskCache,
+  IN UINTN              FirstPageNo,
+  IN UINTN              LastPageNo
+  )
+{
+  if (FirstPageNo + 1 == DiskCache->NextPageNo && LastPageNo < DiskCache->NextPageNo) {
+    //
+    // Still in the same page, nothing learnt
+    //
+    return;
+  }
+
+  if (FirstPageNo == DiskCache->NextPageNo || FirstPageNo + 1 == DiskCache->NextPageNo) {
+    if (DiskCache->ReadAheadPages == 0) {
+      DiskCache->ReadAheadPages = FAT_READAHEAD_MIN_PAGES;
+    } else if (DiskCache->ReadAheadPages < FAT_READAHEAD_MAX_PAGES) {
+      DiskCache->ReadAheadPages <<= 1;
+    }
+  } else {
+    DiskCache->ReadAheadPages     = 0;
+    DiskCache->ReadAheadEndPageNo = 0;
+  }
+
+  DiskCache->NextPageNo = LastPageNo + 1;
+}
+
 /**
 
   This function is used by the Data Cache.
@@ -203,6 +286,143 @@ FatGetCachePage (
   return Status;
 }
 
+/**
+
+  Read ahead the data pages following PageNo into the data cache, so that at
+  least half of the readahead window is ahead of the reader.
+
+  The readahead goes through DiskIo2 when the device has it, and completes
+  while the caller consumes the data it has read; FatAccessCache() waits for it
+  before the data cache is accessed again. Otherwise the window is read
+  synchronously, in a single disk access.
+
+  A failed readahead is not an error: the pages are just not cached.
+
+  @param  Volume                - FAT file system volume.
+  @param  PageNo                - The last page read.
+
+**/
+STATIC
+VOID
+FatReadAhead (
+  IN FAT_VOLUME         *Volume,
+  IN UINTN              PageNo
+  )
+{
+  EFI_STATUS  Status;
+  DISK_CACHE  *DiskCache;
+  CACHE_TAG   *CacheTag;
+  UINTN       StartPageNo;
+  UINTN       EndPageNo;
+  UINTN       GroupNo;
+  UINTN       PageCount;
+  UINTN       Index;
+  UINT64      EntryPos;
+  UINT64      MaxPageCount;
+  UINT8       PageAlignment;
+
+  DiskCache     = &Volume->DiskCache[CacheData];
+  PageAlignment = DiskCache->PageAlignment;
+  if (DiskCache->ReadAheadPages == 0 ||
+      DiskCache->ReadAheadEndPageNo > PageNo + DiskCache->ReadAheadPages / 2) {
+    return;
+  }
+
+  StartPageNo = MAX (DiskCache->ReadAheadEndPageNo, PageNo + 1);
+  EndPageNo   = PageNo + 1 + DiskCache->ReadAheadPages;
+  //
+  // Skip the pages that are cached already
+  //
+  while (StartPageNo < EndPageNo) {
+    CacheTag = &DiskCache->CacheTag[StartPageNo & DiskCache->GroupMask];
+    if (CacheTag->RealSize == 0 || CacheTag->PageNo != StartPageNo) {
+      break;
+    }
+
+    StartPageNo++;
+  }
+
+  DiskCache->ReadAheadEndPageNo = StartPageNo;
+  if (StartPageNo >= EndPageNo) {
+    return;
+  }
+
+  //
+  // Read whole pages only, in one disk access: stop at the end of the volume
+  // and at the end of the cache buffer.
+  //
+  EntryPos = DiskCache->BaseAddress + LShiftU64 (StartPageNo, PageAlignment);
+  if (EntryPos >= DiskCache->LimitAddress) {
+    DiskCache->ReadAheadPages = 0;
+    return;
+  }
+
+  MaxPageCount = RShiftU64 (DiskCache->LimitAddress - EntryPos, PageAlignment);
+  if (MaxPageCount < EndPageNo - StartPageNo) {
+    EndPageNo = StartPageNo + (UINTN) MaxPageCount;
+  }
+
+  GroupNo = StartPageNo & DiskCache->GroupMask;
+  if (EndPageNo - StartPageNo > DiskCache->GroupMask + 1 - GroupNo) {
+    EndPageNo = StartPageNo + DiskCache->GroupMask + 1 - GroupNo;
+  }
+
+  if (StartPageNo == EndPageNo) {
+    return;
+  }
+
+  //
+  // Write back the dirty pages that the readahead replaces
+  //
+  PageCount = EndPageNo - StartPageNo;
+  for (Index = 0; Index < PageCount; Index++) {
+    CacheTag = &DiskCache->CacheTag[GroupNo + Index];
+    if (CacheTag->RealSize > 0 && CacheTag->Dirty) {
+      Status = FatExchangeCachePage (Volume, CacheData, WriteDisk, CacheTag, NULL);
+      if (EFI_ERROR (Status)) {
+        DiskCache->ReadAheadPages = 0;
+        return;
+      }
+    }
+
+    CacheTag->RealSize = 0;
+    CacheTag->PageNo   = StartPageNo + Index;
+  }
+
+  if (DiskCache->ReadAheadToken.Event != NULL) {
+    Status = Volume->DiskIo2->ReadDiskEx (
+                                Volume->DiskIo2,
+                                Volume->MediaId,
+                                EntryPos,
+                                &DiskCache->ReadAheadToken,
+                                PageCount << PageAlignment,
+                                DiskCache->CacheBase + (GroupNo << PageAlignment)
+                                );
+    DiskCache->ReadAheadPending = (BOOLEAN) !EFI_ERROR (Status);
+  } else {
+    Status = Volume->DiskIo->ReadDisk (
+                               Volume->DiskIo,
+                               Volume->MediaId,
+                               EntryPos,
+                               PageCount << PageAlignment,
+                               DiskCache->CacheBase + (GroupNo << PageAlignment)
+                               );
+  }
+
+  if (EFI_ERROR (Status)) {
+    DiskCache->ReadAheadPages = 0;
+    return;
+  }
+
+  for (Index = 0; Index < PageCount; Index++) {
+    DiskCache->CacheTag[GroupNo + Index].RealSize = (UINTN)1 << PageAlignment;
+  }
+
+  DiskCache->ReadAheadGroupNo    = GroupNo;
+  DiskCache->ReadAheadGroupCount = PageCount;
+  DiskCache->ReadAheadEndPageNo  = EndPageNo;
+}
+
 /**
 
   Read Length bytes from the position of Offset into Buffer, or
@@ -272,8 +492,11 @@ FatAccessUnalignedCachePage (
      the right cache page.
   2. Access of Data cache (CACHE_DATA):
      The access data will be divided into UnderRun data, Aligned data and OverRun data;
-     The UnderRun data and OverRun data will be accessed by the Data cache,
-     but the Aligned data will be accessed with disk directly.
+     The UnderRun data and OverRun data will be accessed by the Data cache.
+     Aligned data that is read is copied from the Data cache while it is cached,
+     short blocking reads of the rest go through the Data cache, and the other
+     Aligned data will be accessed with disk directly.
+     Sequential reads are read ahead into the Data cache.
 
   @param  Volume                - FAT file system volume.
   @param  CacheDataType         - The type of cache: CACHE_DATA or CACHE_FAT.
@@ -306,9 +529,11 @@ FatAccessCache (
   UINTN       AlignedSize;
   UINTN       Length;
   UINTN       PageNo;
+  UINTN       LastPageNo;
   UINTN       AlignedPageCount;
-  UINTN       OverRunPageNo;
+  UINTN       GroupNo;
   DISK_CACHE  *DiskCache;
+  CACHE_TAG   *CacheTag;
   UINT64      EntryPos;
   UINT8       PageAlignment;
 
@@ -321,6 +546,18 @@ FatAccessCache (
   PageSize      = (UINTN)1 << PageAlignment;
   PageNo        = (UINTN) RShiftU64 (EntryPos, PageAlignment);
   UnderRun      = ((UINTN) EntryPos) & (PageSize - 1);
+  LastPageNo    = PageNo;
+
+  if (CacheDataType == CacheData) {
+    //
+    // The data cache pages of a pending readahead cannot be accessed before it completes
+    //
+    FatWaitReadAhead (Volume);
+    if (IoMode == ReadDisk && BufferSize > 0) {
+      LastPageNo = (UINTN) RShiftU64 (EntryPos + BufferSize - 1, PageAlignment);
+      FatTrackSequentialRead (DiskCache, PageNo, LastPageNo);
+    }
+  }
 
   if (UnderRun > 0) {
     Length = PageSize - UnderRun;
@@ -339,10 +576,51 @@ FatAccessCache (
   }
 
   AlignedPageCount  = BufferSize >> PageAlignment;
-  OverRunPageNo     = PageNo + AlignedPageCount;
   //
   // The access of the Aligned data
   //
+  if (AlignedPageCount > 0 && IoMode == ReadDisk) {
+    //
+    // Accessing fat table cannot have alignment data
+    //
+    ASSERT (CacheDataType == CacheData);
+
+    //
+    // Copy the leading pages that are cached already, typically read ahead
+    //
+    while (AlignedPageCount > 0) {
+      GroupNo  = PageNo & DiskCache->GroupMask;
+      CacheTag = &DiskCache->CacheTag[GroupNo];
+      if (CacheTag->RealSize != PageSize || CacheTag->PageNo != PageNo) {
+        break;
+      }
+
+      CopyMem (Buffer, DiskCache->CacheBase + (GroupNo << PageAlignment), PageSize);
+      Buffer     += PageSize;
+      BufferSize -= PageSize;
+      PageNo++;
+      AlignedPageCount--;
+    }
+
+    //
+    // Short blocking reads go through the cache, so that the pages following
+    // them can be read ahead. Long reads bypass it.
+    //
+    if (AlignedPageCount < FAT_DATACACHE_BYPASS_PAGES && Task == NULL) {
+      while (AlignedPageCount > 0) {
+        Status = FatAccessUnalignedCachePage (Volume, CacheDataType, IoMode, PageNo, 0, PageSize, Buffer);
+        if (EFI_ERROR (Status)) {
+          return Status;
+        }
+
+        Buffer     += PageSize;
+        BufferSize -= PageSize;
+        PageNo++;
+        AlignedPageCount--;
+      }
+    }
+  }
+
   if (AlignedPageCount > 0) {
     //
     // Accessing fat table cannot have alignment data
@@ -359,9 +637,10 @@ FatAccessCache (
     // If these access data over laps the relative cache range, these cache pages need
     // to be updated.
     //
-    FatFlushDataCacheRange (Volume, IoMode, PageNo, OverRunPageNo, Buffer);
+    FatFlushDataCacheRange (Volume, IoMode, PageNo, PageNo + AlignedPageCount, Buffer);
     Buffer      += AlignedSize;
     BufferSize  -= AlignedSize;
+    PageNo      += AlignedPageCount;
   }
   //
   // The access of the OverRun data
@@ -371,7 +650,11 @@ FatAccessCache (
     //
     // Last read is not a complete page
     //
-    Status = FatAccessUnalignedCachePage (Volume, CacheDataType, IoMode, OverRunPageNo, 0, OverRun, Buffer);
+    Status = FatAccessUnalignedCachePage (Volume, CacheDataType, IoMode, PageNo, 0, OverRun, Buffer);
+  }
+
+  if (!EFI_ERROR (Status) && CacheDataType == CacheData && IoMode == ReadDisk) {
+    FatReadAhead (Volume, LastPageNo);
   }
 
   return Status;
@@ -401,6 +684,7 @@ FatVolumeFlushCache (
   DISK_CACHE      *DiskCache;
   CACHE_TAG       *CacheTag;
 
+  FatWaitReadAhead (Volume);
   for (CacheDataType = (CACHE_DATA_TYPE) 0; CacheDataType < CacheMaxType; CacheDataType++) {
     DiskCache = &Volume->DiskCache[CacheDataType];
     if (DiskCache->Dirty) {
@@ -431,10 +715,115 @@ FatVolumeFlushCache (
   return Status;
 }
 
+/**
+
+  Return the size of the free memory.
+
+  @return The total size of the conventional memory, 0 if the memory map cannot be read.
+
+**/
+STATIC
+UINT64
+FatGetFreeMemorySize (
+  VOID
+  )
+{
+  EFI_STATUS            Status;
+  EFI_MEMORY_DESCRIPTOR *MemoryMap;
+  EFI_MEMORY_DESCRIPTOR *Entry;
+  UINTN                 MemoryMapSize;
+  UINTN                 MapKey;
+  UINTN                 DescriptorSize;
+  UINT32                DescriptorVersion;
+  UINT64                FreeMemorySize;
+
+  MemoryMap     = NULL;
+  MemoryMapSize = 0;
+  Status        = gBS->GetMemoryMap (&MemoryMapSize, MemoryMap, &MapKey, &DescriptorSize, &DescriptorVersion);
+  while (Status == EFI_BUFFER_TOO_SMALL) {
+    //
+    // Allocating the memory map may split a descriptor
+    //
+    MemoryMapSize += 2 * DescriptorSize;
+    MemoryMap      = AllocatePool (MemoryMapSize);
+    if (MemoryMap == NULL) {
+      return 0;
+    }
+
+    Status = gBS->GetMemoryMap (&MemoryMapSize, MemoryMap, &MapKey, &DescriptorSize, &DescriptorVersion);
+    if (EFI_ERROR (Status)) {
+      FreePool (MemoryMap);
+      MemoryMap = NULL;
+    }
+  }
+
+  FreeMemorySize = 0;
+  if (MemoryMap != NULL) {
+    for (Entry = MemoryMap;
+         (UINT8 *) Entry < (UINT8 *) MemoryMap + MemoryMapSize;
+         Entry = NEXT_MEMORY_DESCRIPTOR (Entry, DescriptorSize)) {
+      if (Entry->Type == EfiConventionalMemory) {
+        FreeMemorySize += LShiftU64 (Entry->NumberOfPages, EFI_PAGE_SHIFT);
+      }
+    }
+
+    FreePool (MemoryMap);
+  }
+
+  return FreeMemorySize;
+}
+
+/**
+
+  Return the number of cache pages holding CacheSize bytes, rounded up to a
+  power of 2, within MinCount and MaxCount.
+
+  @param  CacheSize             - The size to cache.
+  @param  PageAlignment         - The alignment of the cache pages.
+  @param  MinCount              - The minimum number of pages, a power of 2.
+  @param  MaxCount              - The maximum number of pages, a power of 2.
+
+  @return The number of cache pages.
+
+**/
+STATIC
+UINTN
+FatGetCacheGroupCount (
+  IN UINT64             CacheSize,
+  IN UINT8              PageAlignment,
+  IN UINTN              MinCount,
+  IN UINTN              MaxCount
+  )
+{
+  UINT64  Count;
+  UINT64  GroupCount;
+
+  Count = RShiftU64 (CacheSize + LShiftU64 (1, PageAlignment) - 1, PageAlignment);
+  if (Count <= MinCount) {
+    return MinCount;
+  }
+
+  if (Count >= MaxCount) {
+    return MaxCount;
+  }
+
+  GroupCount = GetPowerOfTwo64 (Count);
+  if (GroupCount < Count) {
+    GroupCount = LShiftU64 (GroupCount, 1);
+  }
+
+  return (UINTN) GroupCount;
+}
+
 /**
 
   Initialize the disk cache according to Volume's FatType.
 
+  FAT12 volumes get the minimum cache. On other volumes, the FAT cache is sized
+  to hold the whole FAT and the data cache to a fraction of the volume, both
+  within a fraction of the free memory; the data cache is shrunk if it cannot be
+  allocated. The directory cache grows with the data cache.
+
   @param  Volume                - FAT file system volume.
 
   @retval EFI_SUCCESS           - The disk cache is successfully initialized.
@@ -446,11 +835,15 @@ FatInitializeDiskCache (
   IN FAT_VOLUME         *Volume
   )
 {
+  EFI_STATUS  Status;
   DISK_CACHE  *DiskCache;
   UINTN       FatCacheGroupCount;
+  UINTN       DataCacheGroupCount;
   UINTN       DataCacheSize;
   UINTN       FatCacheSize;
+  UINT64      MaxCacheSize;
   UINT8       *CacheBuffer;
+  CACHE_TAG   *CacheTag;
 
   DiskCache = Volume->DiskCache;
   //
@@ -458,32 +851,117 @@ FatInitializeDiskCache (
   //
   if (Volume->FatType == Fat12) {
     FatCacheGroupCount                  = FAT_FATCACHE_GROUP_MIN_COUNT;
+    DataCacheGroupCount                 = FAT_DATACACHE_GROUP_MIN_COUNT;
     DiskCache[CacheFat].PageAlignment  = FAT_FATCACHE_PAGE_MIN_ALIGNMENT;
     DiskCache[CacheData].PageAlignment = FAT_DATACACHE_PAGE_MIN_ALIGNMENT;
   } else {
-    FatCacheGroupCount                  = FAT_FATCACHE_GROUP_MAX_COUNT;
     DiskCache[CacheFat].PageAlignment  = FAT_FATCACHE_PAGE_MAX_ALIGNMENT;
     DiskCache[CacheData].PageAlignment = FAT_DATACACHE_PAGE_MAX_ALIGNMENT;
+    MaxCacheSize                        = RShiftU64 (FatGetFreeMemorySize (), FAT_CACHE_FREE_MEMORY_SHIFT);
+    FatCacheGroupCount                  = FatGetCacheGroupCount (
+                                            MIN (Volume->FatSize, MaxCacheSize),
+                                            FAT_FATCACHE_PAGE_MAX_ALIGNMENT,
+                                            FAT_FATCACHE_GROUP_COUNT,
+                                            FAT_FATCACHE_GROUP_MAX_COUNT
+                                            );
+    DataCacheGroupCount                 = FatGetCacheGroupCount (
+                                            MIN (RShiftU64 (Volume->VolumeSize, FAT_DATACACHE_VOLUME_SHIFT), MaxCacheSize),
+                                            FAT_DATACACHE_PAGE_MAX_ALIGNMENT,
+                                            FAT_DATACACHE_GROUP_MIN_COUNT,
+                                            FAT_DATACACHE_GROUP_MAX_COUNT
+                                            );
+  }
+
+  FatCacheSize = FatCacheGroupCount << DiskCache[CacheFat].PageAlignment;
+  //
+  // Allocate the cache buffer, page aligned for the block device
+  //
+  do {
+    DataCacheSize            = DataCacheGroupCount << DiskCache[CacheData].PageAlignment;
+    Volume->CacheBufferPages = EFI_SIZE_TO_PAGES (FatCacheSize + DataCacheSize);
+    CacheBuffer              = AllocatePages (Volume->CacheBufferPages);
+    if (CacheBuffer != NULL) {
+      break;
+    }
+
+    DataCacheGroupCount >>= 1;
+  } while (DataCacheGroupCount >= FAT_DATACACHE_GROUP_MIN_COUNT);
+
+  if (CacheBuffer == NULL) {
+    return EFI_OUT_OF_RESOURCES;
+  }
+
+  Volume->CacheBuffer = CacheBuffer;
+  CacheTag            = AllocateZeroPool ((FatCacheGroupCount + DataCacheGroupCount) * sizeof (CACHE_TAG));
+  if (CacheTag == NULL) {
+    return EFI_OUT_OF_RESOURCES;
   }
 
-  DiskCache[CacheData].GroupMask     = FAT_DATACACHE_GROUP_COUNT - 1;
+  DiskCache[CacheData].GroupMask     = DataCacheGroupCount - 1;
   DiskCache[CacheData].BaseAddress   = Volume->RootPos;
   DiskCache[CacheData].LimitAddress  = Volume->VolumeSize;
+  DiskCache[CacheData].CacheBase     = CacheBuffer + FatCacheSize;
+  DiskCache[CacheData].CacheTag      = CacheTag + FatCacheGroupCount;
   DiskCache[CacheFat].GroupMask      = FatCacheGroupCount - 1;
   DiskCache[CacheFat].BaseAddress    = Volume->FatPos;
   DiskCache[CacheFat].LimitAddress   = Volume->FatPos + Volume->FatSize;
-  FatCacheSize                        = FatCacheGroupCount << DiskCache[CacheFat].PageAlignment;
-  DataCacheSize                       = FAT_DATACACHE_GROUP_COUNT << DiskCache[CacheData].PageAlignment;
+  DiskCache[CacheFat].CacheBase      = CacheBuffer;
+  DiskCache[CacheFat].CacheTag       = CacheTag;
+
   //
-  // Allocate the Fat Cache buffer
+  // Read ahead through DiskIo2 when the device has it. Its completion is polled.
   //
-  CacheBuffer = AllocateZeroPool (FatCacheSize + DataCacheSize);
-  if (CacheBuffer == NULL) {
-    return EFI_OUT_OF_RESOURCES;
+  if (Volume->DiskIo2 != NULL) {
+    Status = gBS->CreateEvent (0, 0, NULL, NULL, &DiskCache[CacheData].ReadAheadToken.Event);
+    if (EFI_ERROR (Status)) {
+      DiskCache[CacheData].ReadAheadToken.Event = NULL;
+    }
   }
 
-  Volume->CacheBuffer             = CacheBuffer;
-  DiskCache[CacheFat].CacheBase  = CacheBuffer;
-  DiskCache[CacheData].CacheBase = CacheBuffer + FatCacheSize;
+  Volume->MaxDirCacheCount = MIN (
+                               MAX (DataCacheGroupCount / 8, FAT_MIN_DIR_CACHE_COUNT),
+                               FAT_MAX_DIR_CACHE_COUNT
+                               );
+
+  DEBUG ((
+    EFI_D_INFO,
+    "FatInitializeDiskCache: FAT cache %dKB, data cache %dKB, %d directories\n",
+    FatCacheSize >> 10,
+    DataCacheSize >> 10,
+    Volume->MaxDirCacheCount
+    ));
   return EFI_SUCCESS;
 }
+
+/**
+
+  Free the disk cache of Volume, after the pending readahead completes.
+
+  @param  Volume                - FAT file system volume.
+
+**/
+VOID
+FatFreeDiskCache (
+  IN FAT_VOLUME         *Volume
+  )
+{
+  DISK_CACHE  *DiskCache;
+
+  DiskCache = &Volume->DiskCache[CacheData];
+  if (DiskCache->ReadAheadToken.Event != NULL) {
+    FatWaitReadAhead (Volume);
+    gBS->CloseEvent (DiskCache->ReadAheadToken.Event);
+    DiskCache->ReadAheadToken.Event = NULL;
+  }
+
+  if (Volume->DiskCache[CacheFat].CacheTag != NULL) {
+    FreePool (Volume->DiskCache[CacheFat].CacheTag);
+    Volume->DiskCache[CacheFat].CacheTag  = NULL;
+    Volume->DiskCache[CacheData].CacheTag = NULL;
+  }
+
+  if (Volume->CacheBuffer != NULL) {
+    FreePages (Volume->CacheBuffer, Volume->CacheBufferPages);
+    Volume->CacheBuffer = NULL;
+  }
+}
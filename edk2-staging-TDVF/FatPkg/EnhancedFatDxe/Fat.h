@@ -80,9 +80,34 @@ SPDX-License-Identifier: BSD-2-Clause-Patent
 #define FAT_FATCACHE_PAGE_MAX_ALIGNMENT   15
 #define FAT_DATACACHE_PAGE_MIN_ALIGNMENT  13
 #define FAT_DATACACHE_PAGE_MAX_ALIGNMENT  16
-#define FAT_DATACACHE_GROUP_COUNT         64
+
+//
+// Number of cache pages (groups), all powers of 2. FAT12 volumes use the
+// minimum counts. On other volumes the FAT cache is sized to hold the whole
+// FAT, and the data cache to 1/64 of the volume, within the limits below and
+// within 1/32 of the free memory.
+//
+#define FAT_DATACACHE_GROUP_MIN_COUNT     64
+#define FAT_DATACACHE_GROUP_MAX_COUNT     1024
+#define FAT_DATACACHE_VOLUME_SHIFT        6
 #define FAT_FATCACHE_GROUP_MIN_COUNT      1
-#define FAT_FATCACHE_GROUP_MAX_COUNT      16
+#define FAT_FATCACHE_GROUP_COUNT          16
+#define FAT_FATCACHE_GROUP_MAX_COUNT      128
+#define FAT_CACHE_FREE_MEMORY_SHIFT       5
+
+//
+// Sequential reads of the data cache are read ahead by a window of pages
+// that doubles up to the maximum. The maximum must not exceed a quarter of
+// FAT_DATACACHE_GROUP_MIN_COUNT.
+//
+#define FAT_READAHEAD_MIN_PAGES           2
+#define FAT_READAHEAD_MAX_PAGES           16
+
+//
+// Reads of at least this many aligned data pages bypass the data cache and
+// go straight into the caller's buffer
+//
+#define FAT_DATACACHE_BYPASS_PAGES        4
 
 //
 // Used in 8.3 generation algorithm
@@ -104,7 +129,8 @@ SPDX-License-Identifier: BSD-2-Clause-Patent
 #define LC_ISO_639_2_ENTRY_SIZE 3
 #define MAX_LANG_CODE_SIZE      100
 
-#define FAT_MAX_DIR_CACHE_COUNT 8
+#define FAT_MIN_DIR_CACHE_COUNT 8
+#define FAT_MAX_DIR_CACHE_COUNT 64
 #define FAT_MAX_DIRENTRY_COUNT  0xFFFF
 typedef CHAR8                   LC_ISO_639_2;
 
@@ -150,13 +176,23 @@ typedef struct {
 } CACHE_TAG;
 
 typedef struct {
-  UINT64    BaseAddress;
-  UINT64    LimitAddress;
-  UINT8     *CacheBase;
-  BOOLEAN   Dirty;
-  UINT8     PageAlignment;
-  UINTN     GroupMask;
-  CACHE_TAG CacheTag[FAT_DATACACHE_GROUP_COUNT];
+  UINT64              BaseAddress;
+  UINT64              LimitAddress;
+  UINT8               *CacheBase;
+  BOOLEAN             Dirty;
+  UINT8               PageAlignment;
+  UINTN               GroupMask;
+  CACHE_TAG           *CacheTag;
+  //
+  // Sequential read detection and readahead, only used by the data cache
+  //
+  UINTN               NextPageNo;             // The page following the last page read
+  UINTN               ReadAheadPages;         // The readahead window, 0 if reads are not sequential
+  UINTN               ReadAheadEndPageNo;     // The page following the last page read ahead
+  BOOLEAN             ReadAheadPending;       // A readahead through DiskIo2 is in flight
+  UINTN               ReadAheadGroupNo;       // The first group of the readahead
+  UINTN               ReadAheadGroupCount;    // The number of groups of the readahead
+  EFI_DISK_IO2_TOKEN  ReadAheadToken;
 } DISK_CACHE;
 
 //
@@ -369,11 +405,13 @@ struct _FAT_VOLUME {
   //
   LIST_ENTRY                      DirCacheList;
   UINTN                           DirCacheCount;
+  UINTN                           MaxDirCacheCount;
 
   //
   // Disk Cache for this volume
   //
   VOID                            *CacheBuffer;
+  UINTN                           CacheBufferPages;
   DISK_CACHE                      DiskCache[CacheMaxType];
 };
 
@@ -711,6 +749,18 @@ FatInitializeDiskCache (
   IN FAT_VOLUME              *Volume
   );
 
+/**
+
+  Free the disk cache of Volume, after the pending readahead completes.
+
+  @param  Volume                - FAT file system volume.
+
+**/
+VOID
+FatFreeDiskCache (
+  IN FAT_VOLUME              *Volume
+  );
+
 /**
 
   Read BufferSize bytes from the position of Offset into Buffer,
@@ -724,8 +774,11 @@ FatInitializeDiskCache (
      the right cache page.
   2. Access of Data cache (CACHE_DATA):
      The access data will be divided into UnderRun data, Aligned data and OverRun data;
-     The UnderRun data and OverRun data will be accessed by the Data cache,
-     but the Aligned data will be accessed with disk directly.
+     The UnderRun data and OverRun data will be accessed by the Data cache.
+     Aligned data that is read is copied from the Data cache while it is cached,
+     short blocking reads of the rest go through the Data cache, and the other
+     Aligned data will be accessed with disk directly.
+     Sequential reads are read ahead into the Data cache.
 
   @param  Volume                - FAT file system volume.
   @param  CacheDataType         - The type of cache: CACHE_DATA or CACHE_FAT.
@@ -0,0 +1,243 @@
+/** @file
+  Measure the throughput of the BaseMemoryLib instance the application is
+  linked with, for CopyMem(), SetMem(), ZeroMem() and CompareMem() over a
+  range of buffer sizes.
+
+  Copyright (c) 2021, Intel Corporation. All rights reserved.<BR>
+
+  SPDX-License-Identifier: BSD-2-Clause-Patent
+
+**/
+
+#include <Uefi.h>
+#include <Library/BaseLib.h>
+#include <Library/BaseMemoryLib.h>
+#include <Library/MemoryAllocationLib.h>
+#include <Library/TimerLib.h>
+#include <Library/UefiLib.h>
+
+//
+// Every measurement moves about this many bytes, however small the buffer.
+//
+#define BENCHMARK_BYTES_PER_RUN  SIZE_256MB
+
+//
+// Largest buffer measured. The size is halved until the buffers can be
+// allocated.
+//
+#define BENCHMARK_MAX_SIZE       SIZE_64MB
+
+typedef enum {
+  BenchmarkCopyAligned,
+  BenchmarkCopyUnaligned,
+  BenchmarkCopyOverlap,
+  BenchmarkSet,
+  BenchmarkZero,
+  BenchmarkCompare,
+  BenchmarkMax
+} BENCHMARK_OPERATION;
+
+STATIC CONST CHAR16  *mOperationNames[BenchmarkMax] = {
+  L"CopyMem aligned",
+  L"CopyMem unaligned",
+  L"CopyMem overlapping",
+  L"SetMem",
+  L"ZeroMem",
+  L"CompareMem"
+};
+
+STATIC CONST UINTN  mSizes[] = {
+  64, 256, SIZE_1KB, SIZE_4KB, SIZE_16KB, SIZE_64KB, SIZE_256KB, SIZE_1MB,
+  SIZE_4MB, SIZE_16MB, SIZE_64MB
+};
+
+/**
+  Return the number of nanoseconds elapsed between two performance counter
+  values.
+
+  @param[in] Start  The performance counter at the start of the measurement.
+  @param[in] End    The performance counter at the end of the measurement.
+
+  @return The elapsed time in nanoseconds.
+
+**/
+STATIC
+UINT64
+ElapsedNanoSeconds (
+  IN UINT64  Start,
+  IN UINT64  End
+  )
+{
+  UINT64  CounterStart;
+  UINT64  CounterEnd;
+  UINT64  Ticks;
+
+  GetPerformanceCounterProperties (&CounterStart, &CounterEnd);
+  if (CounterEnd >= CounterStart) {
+    Ticks = (End >= Start) ? End - Start : (CounterEnd - Start) + (End - CounterStart);
+  } else {
+    Ticks = (Start >= End) ? Start - End : (Start - CounterEnd) + (CounterStart - End);
+  }
+  return GetTimeInNanoSecond (Ticks);
+}
+
+/**
+  Run one operation repeatedly on buffers of one size.
+
+  @param[in] Operation    The operation to measure.
+  @param[in] Destination  The destination buffer, at least Size + 64 bytes.
+  @param[in] Source       The source buffer, at least Size + 64 bytes.
+  @param[in] Size         The number of bytes per operation.
+  @param[in] Iterations   The number of operations.
+
+  @return The elapsed time in nanoseconds.
+
+**/
+STATIC
+UINT64
+RunBenchmark (
+  IN BENCHMARK_OPERATION  Operation,
+  IN UINT8                *Destination,
+  IN UINT8                *Source,
+  IN UINTN                Size,
+  IN UINTN                Iterations
+  )
+{
+  UINT64  Start;
+  UINTN   Index;
+  INTN    Result;
+
+  Result = 0;
+  Start  = GetPerformanceCounter ();
+  for (Index = 0; Index < Iterations; Index++) {
+    switch (Operation) {
+      case BenchmarkCopyAligned:
+        CopyMem (Destination, Source, Size);
+        break;
+      case BenchmarkCopyUnaligned:
+        CopyMem (Destination + 1, Source + 3, Size);
+        break;
+      case BenchmarkCopyOverlap:
+        CopyMem (Source + 64, Source, Size);
+        break;
+      case BenchmarkSet:
+        SetMem (Destination, Size, (UINT8)Index);
+        break;
+      case BenchmarkZero:
+        ZeroMem (Destination, Size);
+        break;
+      case BenchmarkCompare:
+        Result |= CompareMem (Destination, Source, Size);
+        break;
+      default:
+        break;
+    }
+  }
+  if (Result != 0) {
+    Print (L"CompareMem found a difference in equal buffers\n");
+  }
+  return ElapsedNanoSeconds (Start, GetPerformanceCounter ());
+}
+
+/**
+  The entry point of the application.
+
+  @param[in] ImageHandle  The firmware allocated handle for the EFI image.
+  @param[in] SystemTable  A pointer to the EFI System Table.
+
+  @retval EFI_SUCCESS           The measurements have been printed.
+  @retval EFI_UNSUPPORTED       No performance counter is available.
+  @retval EFI_OUT_OF_RESOURCES  The buffers could not be allocated.
+
+**/
+EFI_STATUS
+EFIAPI
+UefiMain (
+  IN EFI_HANDLE        ImageHandle,
+  IN EFI_SYSTEM_TABLE  *SystemTable
+  )
+{
+  UINTN                MaxSize;
+  UINT8                *Destination;
+  UINT8                *Source;
+  UINTN                SizeIndex;
+  UINTN                Size;
+  UINTN                Iterations;
+  BENCHMARK_OPERATION  Operation;
+  UINT64               NanoSeconds;
+  UINT64               MegaBytesPerSecond;
+
+  if (GetPerformanceCounterProperties (NULL, NULL) == 0) {
+    Print (L"No performance counter\n");
+    return EFI_UNSUPPORTED;
+  }
+
+  Destination = NULL;
+  Source      = NULL;
+  for (MaxSize = BENCHMARK_MAX_SIZE; MaxSize >= SIZE_1MB; MaxSize /= 2) {
+    Destination = AllocatePages (EFI_SIZE_TO_PAGES (MaxSize + EFI_PAGE_SIZE));
+    Source      = AllocatePages (EFI_SIZE_TO_PAGES (MaxSize + EFI_PAGE_SIZE));
+    if (Destination != NULL && Source != NULL) {
+      break;
+    }
+    if (Destination != NULL) {
+      FreePages (Destination, EFI_SIZE_TO_PAGES (MaxSize + EFI_PAGE_SIZE));
+      Destination = NULL;
+    }
+    if (Source != NULL) {
+      FreePages (Source, EFI_SIZE_TO_PAGES (MaxSize + EFI_PAGE_SIZE));
+      Source = NULL;
+    }
+  }
+  if (Destination == NULL) {
+    Print (L"Out of memory\n");
+    return EFI_OUT_OF_RESOURCES;
+  }
+
+  //
+  // Touch both buffers once, so that the first measurement does not pay for
+  // faulting them in, and make them equal for CompareMem().
+  //
+  SetMem (Source, MaxSize + EFI_PAGE_SIZE, 0x5A);
+  SetMem (Destination, MaxSize + EFI_PAGE_SIZE, 0x5A);
+
+  Print (L"%-20s %10s %12s %10s\n", L"Operation", L"Size", L"Iterations", L"MB/s");
+  for (Operation = 0; Operation < BenchmarkMax; Operation++) {
+    for (SizeIndex = 0; SizeIndex < ARRAY_SIZE (mSizes); SizeIndex++) {
+      Size = mSizes[SizeIndex];
+      if (Size > MaxSize) {
+        break;
+      }
+      Iterations = MAX (BENCHMARK_BYTES_PER_RUN / Size, 1);
+      NanoSeconds = RunBenchmark (Operation, Destination, Source, Size, Iterations);
+      if (Operation == BenchmarkCopyOverlap) {
+        //
+        // Restore the source for CompareMem().
+        //
+        SetMem (Source, MaxSize + EFI_PAGE_SIZE, 0x5A);
+      }
+      MegaBytesPerSecond = 0;
+      if (NanoSeconds != 0) {
+        MegaBytesPerSecond = DivU64x64Remainder (
+                               MultU64x64 (Size, Iterations) * 1000,
+                               NanoSeconds,
+                               NULL
+                               );
+      }
+      Print (
+        L"%-20s %10lu %12lu %10lu\n",
+        mOperationNames[Operation],
+        (UINT64)Size,
+        (UINT64)Iterations,
+        MegaBytesPerSecond
+        );
+    }
+    if (Operation == BenchmarkZero) {
+      SetMem (Destination, MaxSize + EFI_PAGE_SIZE, 0x5A);
+    }
+  }
+
+  FreePages (Destination, EFI_SIZE_TO_PAGES (MaxSize + EFI_PAGE_SIZE));
+  FreePages (Source, EFI_SIZE_TO_PAGES (MaxSize + EFI_PAGE_SIZE));
+  return EFI_SUCCESS;
+}
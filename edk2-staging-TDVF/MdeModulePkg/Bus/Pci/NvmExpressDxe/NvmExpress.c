@@ -21,6 +21,13 @@ EFI_DRIVER_BINDING_PROTOCOL gNvmExpressDriverBinding = {
   NULL
 };
 
+//
+// NVM Express Driver Binding Prepare Protocol Instance
+//
+EDKII_DRIVER_BINDING_PREPARE_PROTOCOL gNvmExpressDriverBindingPrepare = {
+  NvmExpressDriverBindingPrepare
+};
+
 //
 // NVM Express EFI Driver Supported EFI Version Protocol Instance
 //
@@ -853,6 +860,101 @@ Done:
   return Status;
 }
 
+/**
+  Begin to disable an NVM Express controller, before it is started.
+
+  Start() disables the controller before it configures it, and waits up to
+  CAP.TO * 500ms for the controller to be disabled. Requesting it here lets
+  the controllers that ConnectController() starts one after the other do it
+  at the same time.
+
+  @param[in]  This                 A pointer to the EDKII_DRIVER_BINDING_PREPARE_PROTOCOL instance.
+  @param[in]  Controller           The handle of a controller that the driver supports.
+
+  @retval EFI_SUCCESS              The controller is disabling, or is disabled.
+  @retval Others                   The controller could not be accessed.
+
+**/
+EFI_STATUS
+EFIAPI
+NvmExpressDriverBindingPrepare (
+  IN EDKII_DRIVER_BINDING_PREPARE_PROTOCOL  *This,
+  IN EFI_HANDLE                             Controller
+  )
+{
+  EFI_STATUS                Status;
+  EFI_PCI_IO_PROTOCOL       *PciIo;
+  UINT64                    OriginalAttributes;
+  UINT32                    Data;
+  NVME_CC                   Cc;
+
+  Status = gBS->OpenProtocol (
+                  Controller,
+                  &gEfiPciIoProtocolGuid,
+                  (VOID **) &PciIo,
+                  gNvmExpressDriverBinding.DriverBindingHandle,
+                  Controller,
+                  EFI_OPEN_PROTOCOL_GET_PROTOCOL
+                  );
+  if (EFI_ERROR (Status)) {
+    return Status;
+  }
+
+  Status = PciIo->Attributes (
+                    PciIo,
+                    EfiPciIoAttributeOperationGet,
+                    0,
+                    &OriginalAttributes
+                    );
+  if (EFI_ERROR (Status)) {
+    return Status;
+  }
+
+  Status = PciIo->Attributes (
+                    PciIo,
+                    EfiPciIoAttributeOperationEnable,
+                    EFI_PCI_IO_ATTRIBUTE_MEMORY,
+                    NULL
+                    );
+  if (EFI_ERROR (Status)) {
+    return Status;
+  }
+
+  Status = PciIo->Mem.Read (
+                        PciIo,
+                        EfiPciIoWidthUint32,
+                        NVME_BAR,
+                        NVME_CC_OFFSET,
+                        1,
+                        &Data
+                        );
+  if (!EFI_ERROR (Status)) {
+    WriteUnaligned32 ((UINT32 *) &Cc, Data);
+    if (Cc.En != 0) {
+      Cc.En = 0;
+      Data  = ReadUnaligned32 ((UINT32 *) &Cc);
+      Status = PciIo->Mem.Write (
+                            PciIo,
+                            EfiPciIoWidthUint32,
+                            NVME_BAR,
+                            NVME_CC_OFFSET,
+                            1,
+                            &Data
+                            );
+    }
+  }
+
+  //
+  // The controller keeps disabling without memory decoding.
+  //
+  PciIo->Attributes (
+           PciIo,
+           EfiPciIoAttributeOperationSet,
+           OriginalAttributes,
+           NULL
+           );
+  return Status;
+}
 
 /**
   Starts a device controller or a bus controller.
@@ -1323,6 +1425,8 @@ NvmExpressUnload (
                   &gNvmExpressDriverBinding,
                   &gEfiDriverSupportedEfiVersionProtocolGuid,
                   &gNvmExpressDriverSupportedEfiVersion,
+                  &gEdkiiDriverBindingPrepareProtocolGuid,
+                  &gNvmExpressDriverBindingPrepare,
                   NULL
                   );
 
@@ -1408,13 +1512,16 @@ NvmExpressDriverEntry (
 
   //
   // Install EFI Driver Supported EFI Version Protocol required for
-  // EFI drivers that are on PCI and other plug in cards.
+  // EFI drivers that are on PCI and other plug in cards, and let
+  // ConnectController() disable all the controllers before it starts them.
   //
   gNvmExpressDriverSupportedEfiVersion.FirmwareVersion = 0x00020028;
   Status = gBS->InstallMultipleProtocolInterfaces (
                   &ImageHandle,
                   &gEfiDriverSupportedEfiVersionProtocolGuid,
                   &gNvmExpressDriverSupportedEfiVersion,
+                  &gEdkiiDriverBindingPrepareProtocolGuid,
+                  &gNvmExpressDriverBindingPrepare,
                   NULL
                   );
   ASSERT_EFI_ERROR (Status);
@@ -29,6 +29,7 @@
 #include <Protocol/DriverSupportedEfiVersion.h>
 #include <Protocol/StorageSecurityCommand.h>
 #include <Protocol/ResetNotification.h>
+#include <Protocol/DriverBindingPrepare.h>
 
 #include <Library/BaseLib.h>
 #include <Library/BaseMemoryLib.h>
@@ -52,6 +53,7 @@ extern EFI_DRIVER_BINDING_PROTOCOL                gNvmExpressDriverBinding;
 extern EFI_COMPONENT_NAME_PROTOCOL                gNvmExpressComponentName;
 extern EFI_COMPONENT_NAME2_PROTOCOL               gNvmExpressComponentName2;
 extern EFI_DRIVER_SUPPORTED_EFI_VERSION_PROTOCOL  gNvmExpressDriverSupportedEfiVersion;
+extern EDKII_DRIVER_BINDING_PREPARE_PROTOCOL      gNvmExpressDriverBindingPrepare;
 
 #define PCI_CLASS_MASS_STORAGE_NVM                0x08  // mass storage sub-class non-volatile memory.
 #define PCI_IF_NVMHCI                             0x02  // mass storage programming interface NVMHCI.
@@ -483,6 +485,23 @@ NvmExpressDriverBindingSupported (
   IN EFI_DEVICE_PATH_PROTOCOL     *RemainingDevicePath
   );
 
+/**
+  Begin to disable an NVM Express controller, before it is started.
+
+  @param[in]  This                 A pointer to the EDKII_DRIVER_BINDING_PREPARE_PROTOCOL instance.
+  @param[in]  Controller           The handle of a controller that the driver supports.
+
+  @retval EFI_SUCCESS              The controller is disabling, or is disabled.
+  @retval Others                   The controller could not be accessed.
+
+**/
+EFI_STATUS
+EFIAPI
+NvmExpressDriverBindingPrepare (
+  IN EDKII_DRIVER_BINDING_PREPARE_PROTOCOL  *This,
+  IN EFI_HANDLE                             Controller
+  );
+
 /**
   Starts a device controller or a bus controller.
 
@@ -3,7 +3,7 @@
   Layers on top of Firmware Block protocol to produce a file abstraction
   of FV based files.
 
-Copyright (c) 2006 - 2019, Intel Corporation. All rights reserved.<BR>
+Copyright (c) 2006 - 2021, Intel Corporation. All rights reserved.<BR>
 SPDX-License-Identifier: BSD-2-Clause-Patent
 
 **/
@@ -42,7 +42,10 @@ FV_DEVICE mFvDevice = {
   0,
   0,
   FALSE,
-  FALSE
+  FALSE,
+  FALSE,
+  NULL,
+  0
 };
 
 
@@ -289,6 +292,11 @@ FreeFvDeviceResource (
     CoreFreePool (FvDevice->CachedFv);
   }
 
+  if (FvDevice->FileIndex != NULL) {
+    CoreFreePool (FvDevice->FileIndex);
+    FvDevice->FileIndex = NULL;
+  }
+
   //
   // Free Volume Header
   //
@@ -299,6 +307,132 @@ FreeFvDeviceResource (
 
 
 
+/**
+  Return the bucket of a file name in the file name index of an FV.
+
+  @param  FvDevice              The FV device, with a file name index.
+  @param  NameGuid              The file name.
+
+  @return The bucket number.
+
+**/
+STATIC
+UINTN
+FvFileIndexBucket (
+  IN FV_DEVICE       *FvDevice,
+  IN CONST EFI_GUID  *NameGuid
+  )
+{
+  //
+  // File names are random enough for their first 32 bits to be the hash.
+  //
+  return ReadUnaligned32 ((CONST UINT32 *) NameGuid) & FvDevice->FileIndexMask;
+}
+
+/**
+  Build the file name index of an FV from its file list, so that files are
+  found by name without scanning the list. Pad files are not indexed, and a
+  name used more than once finds the first file with it, like a scan does.
+
+  The FV works without the index if it cannot be allocated.
+
+  @param  FvDevice              The FV device, with its file list.
+
+**/
+STATIC
+VOID
+FvBuildFileIndex (
+  IN OUT FV_DEVICE  *FvDevice
+  )
+{
+  LIST_ENTRY           *Link;
+  FFS_FILE_LIST_ENTRY  *FfsFileEntry;
+  FFS_FILE_LIST_ENTRY  **Tail;
+  UINTN                FileCount;
+  UINTN                IndexSize;
+
+  FileCount = 0;
+  for (Link = FvDevice->FfsFileListHeader.ForwardLink;
+       Link != &FvDevice->FfsFileListHeader;
+       Link = Link->ForwardLink) {
+    FileCount++;
+  }
+
+  IndexSize = FV_FILE_INDEX_MIN_SIZE;
+  while (IndexSize < FileCount) {
+    IndexSize <<= 1;
+  }
+
+  FvDevice->FileIndex = AllocateZeroPool (IndexSize * sizeof (FFS_FILE_LIST_ENTRY *));
+  if (FvDevice->FileIndex == NULL) {
+    return;
+  }
+
+  FvDevice->FileIndexMask = IndexSize - 1;
+  for (Link = FvDevice->FfsFileListHeader.ForwardLink;
+       Link != &FvDevice->FfsFileListHeader;
+       Link = Link->ForwardLink) {
+    FfsFileEntry = (FFS_FILE_LIST_ENTRY *) Link;
+    if (FfsFileEntry->FfsHeader->Type == EFI_FV_FILETYPE_FFS_PAD) {
+      continue;
+    }
+
+    //
+    // Append, to keep the FV order within the bucket
+    //
+    Tail = &FvDevice->FileIndex[FvFileIndexBucket (FvDevice, &FfsFileEntry->FfsHeader->Name)];
+    while (*Tail != NULL) {
+      Tail = &(*Tail)->NextInIndex;
+    }
+
+    *Tail = FfsFileEntry;
+  }
+}
+
+/**
+  Find a file of an FV by name.
+
+  @param  FvDevice              The FV device.
+  @param  NameGuid              The file name.
+
+  @return The first file with this name, or NULL if none is found.
+
+**/
+FFS_FILE_LIST_ENTRY *
+FvFindFile (
+  IN FV_DEVICE       *FvDevice,
+  IN CONST EFI_GUID  *NameGuid
+  )
+{
+  LIST_ENTRY           *Link;
+  FFS_FILE_LIST_ENTRY  *FfsFileEntry;
+
+  if (FvDevice->FileIndex != NULL) {
+    for (FfsFileEntry = FvDevice->FileIndex[FvFileIndexBucket (FvDevice, NameGuid)];
+         FfsFileEntry != NULL;
+         FfsFileEntry = FfsFileEntry->NextInIndex) {
+      if (CompareGuid (&FfsFileEntry->FfsHeader->Name, NameGuid)) {
+        return FfsFileEntry;
+      }
+    }
+
+    return NULL;
+  }
+
+  for (Link = FvDevice->FfsFileListHeader.ForwardLink;
+       Link != &FvDevice->FfsFileListHeader;
+       Link = Link->ForwardLink) {
+    FfsFileEntry = (FFS_FILE_LIST_ENTRY *) Link;
+    if (FfsFileEntry->FfsHeader->Type != EFI_FV_FILETYPE_FFS_PAD &&
+        CompareGuid (&FfsFileEntry->FfsHeader->Name, NameGuid)) {
+      return FfsFileEntry;
+    }
+  }
+
+  return NULL;
+}
+
+
 /**
   Check if an FV is consistent and allocate cache for it.
 
@@ -333,6 +467,7 @@ FvCheck (
   BOOLEAN                               FileCached;
   UINTN                                 WholeFileSize;
   EFI_FFS_FILE_HEADER                   *CacheFfsHeader;
+  EFI_GCD_MEMORY_SPACE_DESCRIPTOR       Descriptor;
 
   FileCached = FALSE;
   CacheFfsHeader = NULL;
@@ -358,6 +493,14 @@ FvCheck (
     // Don't cache memory mapped FV really.
     //
     FvDevice->CachedFv = (UINT8 *) (UINTN) PhysicalAddress;
+
+    //
+    // A memory mapped FV in system memory, e.g. one decompressed from another
+    // FV, is as fast to read as a cache: don't cache its files either.
+    //
+    Status = CoreGetMemorySpaceDescriptor (PhysicalAddress, &Descriptor);
+    FvDevice->IsInSystemMemory = (BOOLEAN) (!EFI_ERROR (Status) &&
+                                            Descriptor.GcdMemoryType == EfiGcdMemoryTypeSystemMemory);
   } else {
     FvDevice->IsMemoryMapped = FALSE;
     FvDevice->CachedFv = AllocatePool (Size);
@@ -481,7 +624,7 @@ FvCheck (
 
     CacheFfsHeader = FfsHeader;
     if ((CacheFfsHeader->Attributes & FFS_ATTRIB_CHECKSUM) == FFS_ATTRIB_CHECKSUM) {
-      if (FvDevice->IsMemoryMapped) {
+      if (FvDevice->IsMemoryMapped && !FvDevice->IsInSystemMemory) {
         //
         // Memory mapped FV has not been cached.
         // Here is to cache FFS file to memory buffer for following checksum calculating.
@@ -559,6 +702,8 @@ Done:
       FileCached = FALSE;
     }
     FreeFvDeviceResource (FvDevice);
+  } else {
+    FvBuildFileIndex (FvDevice);
   }
 
   return Status;
@@ -2,7 +2,7 @@
   Firmware File System protocol. Layers on top of Firmware
   Block protocol to produce a file abstraction of FV based files.
 
-Copyright (c) 2006 - 2014, Intel Corporation. All rights reserved.<BR>
+Copyright (c) 2006 - 2021, Intel Corporation. All rights reserved.<BR>
 SPDX-License-Identifier: BSD-2-Clause-Patent
 
 **/
@@ -16,12 +16,20 @@ SPDX-License-Identifier: BSD-2-Clause-Patent
 //
 // Used to track all non-deleted files
 //
-typedef struct {
+typedef struct _FFS_FILE_LIST_ENTRY FFS_FILE_LIST_ENTRY;
+struct _FFS_FILE_LIST_ENTRY {
   LIST_ENTRY                      Link;
   EFI_FFS_FILE_HEADER             *FfsHeader;
   UINTN                           StreamHandle;
   BOOLEAN                         FileCached;
-} FFS_FILE_LIST_ENTRY;
+  FFS_FILE_LIST_ENTRY             *NextInIndex;
+};
+
+//
+// The file name index of an FV has at least this many buckets, and at least
+// as many as files.
+//
+#define FV_FILE_INDEX_MIN_SIZE  16
 
 typedef struct {
   UINTN                                   Signature;
@@ -41,10 +49,32 @@ typedef struct {
   UINT8                                   ErasePolarity;
   BOOLEAN                                 IsFfs3Fv;
   BOOLEAN                                 IsMemoryMapped;
+  BOOLEAN                                 IsInSystemMemory;
+
+  //
+  // Hash table of the files by name, in FV order within a bucket
+  //
+  FFS_FILE_LIST_ENTRY                     **FileIndex;
+  UINTN                                   FileIndexMask;
 } FV_DEVICE;
 
 #define FV_DEVICE_FROM_THIS(a) CR(a, FV_DEVICE, Fv, FV2_DEVICE_SIGNATURE)
 
+/**
+  Find a file of an FV by name.
+
+  @param  FvDevice              The FV device.
+  @param  NameGuid              The file name.
+
+  @return The first file with this name, or NULL if none is found.
+
+**/
+FFS_FILE_LIST_ENTRY *
+FvFindFile (
+  IN FV_DEVICE       *FvDevice,
+  IN CONST EFI_GUID  *NameGuid
+  );
+
 /**
   Retrieves attributes, insures positive polarity of attribute bits, returns
   resulting attributes in output parameter.
@@ -290,9 +290,8 @@ FvReadFile (
 {
   EFI_STATUS                        Status;
   FV_DEVICE                         *FvDevice;
-  EFI_GUID                          SearchNameGuid;
-  EFI_FV_FILETYPE                   LocalFoundType;
-  EFI_FV_FILE_ATTRIBUTES            LocalAttributes;
+  EFI_FV_ATTRIBUTES                 FvAttributes;
+  FFS_FILE_LIST_ENTRY               *FfsFileEntry;
   UINTN                             FileSize;
   UINT8                             *SrcPtr;
   EFI_FFS_FILE_HEADER               *FfsHeader;
@@ -307,30 +306,33 @@ FvReadFile (
 
 
   //
-  // Keep looking until we find the matching NameGuid.
-  // The Key is really a FfsFileEntry
+  // Look the file up by name.
+  // The LastKey is really a FfsFileEntry
   //
   FvDevice->LastKey = 0;
-  do {
-    LocalFoundType = 0;
-    Status = FvGetNextFile (
-              This,
-              &FvDevice->LastKey,
-              &LocalFoundType,
-              &SearchNameGuid,
-              &LocalAttributes,
-              &FileSize
-              );
-    if (EFI_ERROR (Status)) {
-      return EFI_NOT_FOUND;
-    }
-  } while (!CompareGuid (&SearchNameGuid, NameGuid));
+  Status = FvGetVolumeAttributes (This, &FvAttributes);
+  if (EFI_ERROR (Status) || (FvAttributes & EFI_FV2_READ_STATUS) == 0) {
+    return EFI_NOT_FOUND;
+  }
+
+  FfsFileEntry = FvFindFile (FvDevice, NameGuid);
+  if (FfsFileEntry == NULL) {
+    return EFI_NOT_FOUND;
+  }
+
+  FvDevice->LastKey = FfsFileEntry;
 
   //
   // Get a pointer to the header
   //
   FfsHeader = FvDevice->LastKey->FfsHeader;
-  if (FvDevice->IsMemoryMapped) {
+  if (IS_FFS_FILE2 (FfsHeader)) {
+    FileSize = FFS_FILE2_SIZE (FfsHeader) - sizeof (EFI_FFS_FILE_HEADER2);
+  } else {
+    FileSize = FFS_FILE_SIZE (FfsHeader) - sizeof (EFI_FFS_FILE_HEADER);
+  }
+
+  if (FvDevice->IsMemoryMapped && !FvDevice->IsInSystemMemory) {
     //
     // Memory mapped FV has not been cached, so here is to cache by file.
     //
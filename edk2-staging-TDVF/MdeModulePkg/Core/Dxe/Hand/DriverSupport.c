@@ -13,6 +13,81 @@ SPDX-License-Identifier: BSD-2-Clause-Patent
 //
 // Driver Support Functions
 //
+/**
+  Let the drivers that produce EDKII_DRIVER_BINDING_PREPARE_PROTOCOL begin to
+  initialize the controllers they support, before any of the controllers is
+  started, so that the device delays of independent controllers overlap.
+
+  This is done for the children of a controller connected recursively, which
+  includes the controllers that the Boot Manager connects all at once. There
+  is nothing to overlap for a single controller.
+
+  @param  ControllerHandles     The handles of the controllers.
+  @param  ControllerCount       The number of handles in ControllerHandles.
+
+**/
+STATIC
+VOID
+CorePrepareControllers (
+  IN EFI_HANDLE                 *ControllerHandles,
+  IN UINTN                      ControllerCount
+  )
+{
+  EFI_STATUS                              Status;
+  EFI_HANDLE                              *PrepareHandleBuffer;
+  UINTN                                   PrepareHandleCount;
+  UINTN                                   PrepareIndex;
+  UINTN                                   Index;
+  EFI_DRIVER_BINDING_PROTOCOL             *DriverBinding;
+  EDKII_DRIVER_BINDING_PREPARE_PROTOCOL   *DriverBindingPrepare;
+
+  if (ControllerCount < 2) {
+    return;
+  }
+
+  Status = CoreLocateHandleBuffer (
+             ByProtocol,
+             &gEdkiiDriverBindingPrepareProtocolGuid,
+             NULL,
+             &PrepareHandleCount,
+             &PrepareHandleBuffer
+             );
+  if (EFI_ERROR (Status)) {
+    return;
+  }
+
+  for (PrepareIndex = 0; PrepareIndex < PrepareHandleCount; PrepareIndex++) {
+    Status = CoreHandleProtocol (
+               PrepareHandleBuffer[PrepareIndex],
+               &gEdkiiDriverBindingPrepareProtocolGuid,
+               (VOID **) &DriverBindingPrepare
+               );
+    if (EFI_ERROR (Status)) {
+      continue;
+    }
+    Status = CoreHandleProtocol (
+               PrepareHandleBuffer[PrepareIndex],
+               &gEfiDriverBindingProtocolGuid,
+               (VOID **) &DriverBinding
+               );
+    if (EFI_ERROR (Status)) {
+      continue;
+    }
+
+    for (Index = 0; Index < ControllerCount; Index++) {
+      if (CoreValidateHandle (ControllerHandles[Index]) != EFI_SUCCESS) {
+        continue;
+      }
+      Status = DriverBinding->Supported (DriverBinding, ControllerHandles[Index], NULL);
+      if (!EFI_ERROR (Status)) {
+        DriverBindingPrepare->Prepare (DriverBindingPrepare, ControllerHandles[Index]);
+      }
+    }
+  }
+
+  CoreFreePool (PrepareHandleBuffer);
+}
+
 /**
   Connects one or more drivers to a controller.
 
@@ -213,6 +288,7 @@ CoreConnectController (
     //
     // Recursively connect each child handle
     //
+    CorePrepareControllers (ChildHandleBuffer, ChildHandleCount);
     for (Index = 0; Index < ChildHandleCount; Index++) {
       CoreConnectController (
         ChildHandleBuffer[Index],
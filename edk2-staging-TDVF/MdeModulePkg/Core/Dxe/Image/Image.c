@@ -1344,8 +1344,12 @@ CoreLoadImageCommon (
 
   //
   // Load the image.  If EntryPoint is Null, it will not be set.
+  // The copy and relocation of each image is recorded under its own handle,
+  // apart from the authentication and file reads that LoadImage also covers.
   //
+  PERF_START (Image->Handle, "PeCoffLoad", NULL, 0);
   Status = CoreLoadPeImage (BootPolicy, &FHand, Image, DstBuffer, EntryPoint, Attribute);
+  PERF_END (Image->Handle, "PeCoffLoad", NULL, 0);
   if (EFI_ERROR (Status)) {
     if ((Status == EFI_BUFFER_TOO_SMALL) || (Status == EFI_OUT_OF_RESOURCES)) {
       if (NumberOfPages != NULL) {
@@ -138,6 +138,7 @@ typedef struct {
   VARIABLE_STORE_HEADER   *RuntimeHobCache;
   VARIABLE_STORE_HEADER   *RuntimeNvCache;
   VARIABLE_STORE_HEADER   *RuntimeVolatileCache;
+  UINT32                  *CacheGeneration;
 } SMM_VARIABLE_COMMUNICATE_RUNTIME_VARIABLE_CACHE_CONTEXT;
 
 typedef struct {
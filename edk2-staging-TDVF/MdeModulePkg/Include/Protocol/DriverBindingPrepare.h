@@ -0,0 +1,55 @@
+/** @file
+  EDKII Driver Binding Prepare Protocol.
+
+  A driver installs the protocol on the handle of its EFI_DRIVER_BINDING_PROTOCOL
+  when part of its Start() function is waiting for a device, e.g. for a reset
+  to complete. Before ConnectController() starts the drivers on several
+  controllers one by one, it calls Prepare() on each of them, so that these
+  devices make progress at the same time rather than one after the other.
+
+  Copyright (c) 2021, Intel Corporation. All rights reserved.<BR>
+  SPDX-License-Identifier: BSD-2-Clause-Patent
+
+**/
+
+#ifndef __EDKII_DRIVER_BINDING_PREPARE_PROTOCOL_H__
+#define __EDKII_DRIVER_BINDING_PREPARE_PROTOCOL_H__
+
+#define EDKII_DRIVER_BINDING_PREPARE_PROTOCOL_GUID \
+  { 0xfb6ea3d9, 0x5313, 0x41fd, { 0xb6, 0xcb, 0xf3, 0xf3, 0xe2, 0xbe, 0x19, 0x99 } }
+
+typedef struct _EDKII_DRIVER_BINDING_PREPARE_PROTOCOL EDKII_DRIVER_BINDING_PREPARE_PROTOCOL;
+
+/**
+  Begin the device operations that Start() would wait for on a controller.
+
+  The function is only called for a controller on which the Supported()
+  function of the driver has returned EFI_SUCCESS. It must return without
+  waiting for the device, must not open any protocol BY_DRIVER, and must not
+  install any protocol. The controller may later be started by the driver, by
+  another driver, or not at all, so the device must be left in a state that
+  any driver can start it from. Start() must not depend on Prepare() having
+  been called.
+
+  @param[in]  This               This pointer for EDKII_DRIVER_BINDING_PREPARE_PROTOCOL.
+  @param[in]  ControllerHandle   The handle of the controller.
+
+  @retval EFI_SUCCESS            The device operations have been started, or
+                                 there is nothing to prepare.
+  @retval Others                 The controller could not be prepared. It is
+                                 still started normally.
+**/
+typedef
+EFI_STATUS
+(EFIAPI *EDKII_DRIVER_BINDING_PREPARE) (
+  IN EDKII_DRIVER_BINDING_PREPARE_PROTOCOL    *This,
+  IN EFI_HANDLE                               ControllerHandle
+  );
+
+struct _EDKII_DRIVER_BINDING_PREPARE_PROTOCOL {
+  EDKII_DRIVER_BINDING_PREPARE              Prepare;
+};
+
+extern EFI_GUID gEdkiiDriverBindingPrepareProtocolGuid;
+
+#endif
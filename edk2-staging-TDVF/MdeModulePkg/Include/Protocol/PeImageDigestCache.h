@@ -0,0 +1,69 @@
+/** @file
+  EDKII PE Image Digest Cache Protocol.
+
+  The Authenticode digest of an image is needed both to verify it against the
+  image security databases and to measure it. The image verification produces
+  the protocol: it computes the algorithms that the image measurement asks for
+  in the same pass over the image, and lets the image measurement read the
+  result. Only the image verification writes the cached digests.
+
+  Copyright (c) 2021, Intel Corporation. All rights reserved.<BR>
+  SPDX-License-Identifier: BSD-2-Clause-Patent
+
+**/
+
+#ifndef __EDKII_PE_IMAGE_DIGEST_CACHE_PROTOCOL_H__
+#define __EDKII_PE_IMAGE_DIGEST_CACHE_PROTOCOL_H__
+
+#include <IndustryStandard/Tpm20.h>
+
+#define EDKII_PE_IMAGE_DIGEST_CACHE_PROTOCOL_GUID \
+  { 0x510b7c17, 0xf25f, 0x407d, { 0xa5, 0xa7, 0x77, 0xe4, 0xd0, 0xee, 0xae, 0xd4 } }
+
+typedef struct _EDKII_PE_IMAGE_DIGEST_CACHE_PROTOCOL EDKII_PE_IMAGE_DIGEST_CACHE_PROTOCOL;
+
+//
+// Hash algorithms of the HashMask field.
+//
+#define EDKII_PE_IMAGE_DIGEST_SHA1      BIT0
+#define EDKII_PE_IMAGE_DIGEST_SHA256    BIT1
+#define EDKII_PE_IMAGE_DIGEST_SHA384    BIT2
+#define EDKII_PE_IMAGE_DIGEST_SHA512    BIT3
+
+/**
+  Get the cached Authenticode digests of an image.
+
+  The digests are returned only if the image verification computed them over
+  the same buffer, and the size and the contents of the buffer have not
+  changed since.
+
+  @param[in]  This          This pointer for EDKII_PE_IMAGE_DIGEST_CACHE_PROTOCOL.
+  @param[in]  ImageBuffer   The image, as read from its file.
+  @param[in]  ImageSize     The size of the image in bytes.
+  @param[out] DigestList    Return the cached digests.
+
+  @retval EFI_SUCCESS             The digests of the image are returned.
+  @retval EFI_NOT_FOUND           No digest of the image is cached.
+  @retval EFI_INVALID_PARAMETER   ImageBuffer or DigestList is NULL.
+**/
+typedef
+EFI_STATUS
+(EFIAPI *EDKII_PE_IMAGE_DIGEST_CACHE_GET_DIGESTS) (
+  IN  EDKII_PE_IMAGE_DIGEST_CACHE_PROTOCOL    *This,
+  IN  CONST VOID                              *ImageBuffer,
+  IN  UINTN                                   ImageSize,
+  OUT TPML_DIGEST_VALUES                      *DigestList
+  );
+
+struct _EDKII_PE_IMAGE_DIGEST_CACHE_PROTOCOL {
+  //
+  // The algorithms whose digests the users of the protocol need. The image
+  // verification computes them along with its own, and caches them.
+  //
+  UINT32                                    HashMask;
+  EDKII_PE_IMAGE_DIGEST_CACHE_GET_DIGESTS   GetDigests;
+};
+
+extern EFI_GUID gEdkiiPeImageDigestCacheProtocolGuid;
+
+#endif
@@ -12,6 +12,7 @@
 #include <Library/BaseLib.h>
 #include <Library/BaseMemoryLib.h>
 #include <Library/DebugLib.h>
+#include <Library/PcdLib.h>
 #include <Library/FrameBufferBltLib.h>
 
 struct FRAME_BUFFER_CONFIGURE {
@@ -24,6 +25,12 @@ struct FRAME_BUFFER_CONFIGURE {
   EFI_PIXEL_BITMASK               PixelMasks;
   INT8                            PixelShl[4]; // R-G-B-Rsvd
   INT8                            PixelShr[4]; // R-G-B-Rsvd
+  //
+  // Copy of the frame buffer, NULL if PcdFrameBufferBltShadow is FALSE.
+  // RowValid[Y] is TRUE once line Y of the shadow matches the frame buffer.
+  //
+  UINT8                           *Shadow;
+  BOOLEAN                         *RowValid;
   UINT8                           LineBuffer[0];
 };
 
@@ -35,6 +42,115 @@ CONST EFI_PIXEL_BITMASK mBgrPixelMasks = {
   0x00ff0000, 0x0000ff00, 0x000000ff, 0xff000000
 };
 
+/**
+  Read pixels of one line of the video, from the shadow buffer if the line is
+  valid in it.
+
+  @param[in]  Configure     Pointer to a configuration which was successfully
+                            created by FrameBufferBltConfigure ().
+  @param[in]  X             X location within video.
+  @param[in]  Y             Y location within video.
+  @param[out] Destination   Buffer for the pixels, in the video format.
+  @param[in]  Width         Width (in pixels).
+**/
+STATIC
+VOID
+FrameBufferBltLibReadLine (
+  IN  FRAME_BUFFER_CONFIGURE  *Configure,
+  IN  UINTN                   X,
+  IN  UINTN                   Y,
+  OUT UINT8                   *Destination,
+  IN  UINTN                   Width
+  )
+{
+  UINTN                       Offset;
+
+  Offset = Configure->BytesPerPixel * ((Y * Configure->PixelsPerScanLine) + X);
+  if ((Configure->Shadow != NULL) && Configure->RowValid[Y]) {
+    CopyMem (Destination, Configure->Shadow + Offset, Width * Configure->BytesPerPixel);
+  } else {
+    CopyMem (Destination, Configure->FrameBuffer + Offset, Width * Configure->BytesPerPixel);
+  }
+}
+
+/**
+  Write pixels to one line of the video.
+
+  With a shadow buffer, only the 8-byte chunks that differ from a valid line
+  of the shadow are written to the frame buffer, so that an update that leaves
+  most of the pixels unchanged (e.g. scrolling text) accesses the frame buffer
+  as little as possible.
+
+  @param[in]  Configure     Pointer to a configuration which was successfully
+                            created by FrameBufferBltConfigure ().
+  @param[in]  X             X location within video.
+  @param[in]  Y             Y location within video.
+  @param[in]  Source        The pixels, in the video format.
+  @param[in]  Width         Width (in pixels).
+**/
+STATIC
+VOID
+FrameBufferBltLibWriteLine (
+  IN FRAME_BUFFER_CONFIGURE   *Configure,
+  IN UINTN                    X,
+  IN UINTN                    Y,
+  IN CONST UINT8              *Source,
+  IN UINTN                    Width
+  )
+{
+  UINTN                       Offset;
+  UINTN                       WidthInBytes;
+  UINT8                       *Destination;
+  UINT8                       *Shadow;
+  UINTN                       Start;
+  UINTN                       End;
+
+  Offset       = Configure->BytesPerPixel * ((Y * Configure->PixelsPerScanLine) + X);
+  WidthInBytes = Width * Configure->BytesPerPixel;
+  Destination  = Configure->FrameBuffer + Offset;
+
+  if (Configure->Shadow == NULL) {
+    CopyMem (Destination, Source, WidthInBytes);
+    return;
+  }
+
+  Shadow = Configure->Shadow + Offset;
+  if (!Configure->RowValid[Y]) {
+    CopyMem (Destination, Source, WidthInBytes);
+    CopyMem (Shadow, Source, WidthInBytes);
+    if ((X == 0) && (Width == Configure->Width)) {
+      Configure->RowValid[Y] = TRUE;
+    }
+    return;
+  }
+
+  //
+  // Write the runs of differing chunks.
+  //
+  Start = 0;
+  while (Start < WidthInBytes) {
+    while ((Start + sizeof (UINT64) <= WidthInBytes) &&
+           (ReadUnaligned64 ((UINT64 *) (Shadow + Start)) == ReadUnaligned64 ((CONST UINT64 *) (Source + Start)))) {
+      Start += sizeof (UINT64);
+    }
+    if ((Start + sizeof (UINT64) > WidthInBytes) &&
+        (CompareMem (Shadow + Start, Source + Start, WidthInBytes - Start) == 0)) {
+      break;
+    }
+
+    End = Start + sizeof (UINT64);
+    while ((End + sizeof (UINT64) <= WidthInBytes) &&
+           (ReadUnaligned64 ((UINT64 *) (Shadow + End)) != ReadUnaligned64 ((CONST UINT64 *) (Source + End)))) {
+      End += sizeof (UINT64);
+    }
+    End = MIN (End, WidthInBytes);
+
+    CopyMem (Destination + Start, Source + Start, End - Start);
+    CopyMem (Shadow + Start, Source + Start, End - Start);
+    Start = End;
+  }
+}
+
 /**
   Initialize the bit mask in frame buffer configure.
 
@@ -111,6 +227,9 @@ FrameBufferBltConfigure (
   UINT32                                       BytesPerPixel;
   INT8                                         PixelShl[4];
   INT8                                         PixelShr[4];
+  UINTN                                        LineBufferSize;
+  UINTN                                        RowValidSize;
+  UINTN                                        ShadowSize;
 
   if (ConfigureSize == NULL) {
     return RETURN_INVALID_PARAMETER;
@@ -144,10 +263,25 @@ FrameBufferBltConfigure (
 
   FrameBufferBltLibConfigurePixelFormat (BitMask, &BytesPerPixel, PixelShl, PixelShr);
 
+  //
+  // The pixel conversion accesses a UINT32 at the last pixel of the line
+  // buffer, whatever the size of the pixels.
+  //
+  LineBufferSize = ALIGN_VALUE (
+                     FrameBufferInfo->HorizontalResolution * BytesPerPixel + sizeof (UINT32),
+                     sizeof (UINT64)
+                     );
+  RowValidSize   = 0;
+  ShadowSize     = 0;
+  if (PcdGetBool (PcdFrameBufferBltShadow)) {
+    RowValidSize   = ALIGN_VALUE (FrameBufferInfo->VerticalResolution * sizeof (BOOLEAN), sizeof (UINT64));
+    ShadowSize     = (UINTN) FrameBufferInfo->PixelsPerScanLine * FrameBufferInfo->VerticalResolution * BytesPerPixel;
+  }
+
   if (*ConfigureSize < sizeof (FRAME_BUFFER_CONFIGURE)
-                     + FrameBufferInfo->HorizontalResolution * BytesPerPixel) {
+                     + LineBufferSize + RowValidSize + ShadowSize) {
     *ConfigureSize = sizeof (FRAME_BUFFER_CONFIGURE)
-                   + FrameBufferInfo->HorizontalResolution * BytesPerPixel;
+                   + LineBufferSize + RowValidSize + ShadowSize;
     return RETURN_BUFFER_TOO_SMALL;
   }
 
@@ -165,6 +299,17 @@ FrameBufferBltConfigure (
   Configure->Height            = FrameBufferInfo->VerticalResolution;
   Configure->PixelsPerScanLine = FrameBufferInfo->PixelsPerScanLine;
 
+  Configure->Shadow   = NULL;
+  Configure->RowValid = NULL;
+  if (ShadowSize != 0) {
+    //
+    // The contents of the frame buffer are unknown until they are written.
+    //
+    Configure->RowValid = (BOOLEAN *) (Configure->LineBuffer + LineBufferSize);
+    Configure->Shadow   = Configure->LineBuffer + LineBufferSize + RowValidSize;
+    ZeroMem (Configure->RowValid, RowValidSize);
+  }
+
   return RETURN_SUCCESS;
 }
 
@@ -266,7 +411,8 @@ FrameBufferBltLibVideoFill (
     }
   }
 
-  if (UseWideFill && (DestinationX == 0) && (Width == Configure->PixelsPerScanLine)) {
+  if ((Configure->Shadow == NULL) &&
+      UseWideFill && (DestinationX == 0) && (Width == Configure->PixelsPerScanLine)) {
     DEBUG ((EFI_D_VERBOSE, "VideoFill (wide, one-shot)\n"));
     Offset = DestinationY * Configure->PixelsPerScanLine;
     Offset = Configure->BytesPerPixel * Offset;
@@ -278,7 +424,7 @@ FrameBufferBltLibVideoFill (
       SizeInBytes &= 3;
     }
     if (SizeInBytes > 0) {
-      SetMem (Destination, SizeInBytes, (UINT8) (UINTN) WideFill);
+      CopyMem (Destination, &WideFill, SizeInBytes);
     }
   } else {
     LineBufferReady = FALSE;
@@ -287,7 +433,8 @@ FrameBufferBltLibVideoFill (
       Offset = Configure->BytesPerPixel * Offset;
       Destination = Configure->FrameBuffer + Offset;
 
-      if (UseWideFill && (((UINTN) Destination & 7) == 0)) {
+      if ((Configure->Shadow == NULL) &&
+          UseWideFill && (((UINTN) Destination & 7) == 0)) {
         DEBUG ((EFI_D_VERBOSE, "VideoFill (wide)\n"));
         SizeInBytes = WidthInBytes;
         if (SizeInBytes >= 8) {
@@ -312,7 +459,7 @@ FrameBufferBltLibVideoFill (
           }
           LineBufferReady = TRUE;
         }
-        CopyMem (Destination, Configure->LineBuffer, WidthInBytes);
+        FrameBufferBltLibWriteLine (Configure, DestinationX, IndexY, Configure->LineBuffer, Width);
       }
     }
   }
@@ -354,12 +501,9 @@ FrameBufferBltLibVideoToBltBuffer (
   UINTN                                  DstY;
   UINTN                                  SrcY;
   EFI_GRAPHICS_OUTPUT_BLT_PIXEL          *Blt;
-  UINT8                                  *Source;
   UINT8                                  *Destination;
   UINTN                                  IndexX;
   UINT32                                 Uint32;
-  UINTN                                  Offset;
-  UINTN                                  WidthInBytes;
 
   //
   // Video to BltBuffer: Source is Video, destination is BltBuffer
@@ -385,8 +529,6 @@ FrameBufferBltLibVideoToBltBuffer (
     Delta = Width * sizeof (EFI_GRAPHICS_OUTPUT_BLT_PIXEL);
   }
 
-  WidthInBytes = Width * Configure->BytesPerPixel;
-
   //
   // Video to BltBuffer: Source is Video, destination is BltBuffer
   //
@@ -394,17 +536,13 @@ FrameBufferBltLibVideoToBltBuffer (
        DstY < (Height + DestinationY);
        SrcY++, DstY++) {
 
-    Offset = (SrcY * Configure->PixelsPerScanLine) + SourceX;
-    Offset = Configure->BytesPerPixel * Offset;
-    Source = Configure->FrameBuffer + Offset;
-
     if (Configure->PixelFormat == PixelBlueGreenRedReserved8BitPerColor) {
       Destination = (UINT8 *) BltBuffer + (DstY * Delta) + (DestinationX * sizeof (EFI_GRAPHICS_OUTPUT_BLT_PIXEL));
     } else {
       Destination = Configure->LineBuffer;
     }
 
-    CopyMem (Destination, Source, WidthInBytes);
+    FrameBufferBltLibReadLine (Configure, SourceX, SrcY, Destination, Width);
 
     if (Configure->PixelFormat != PixelBlueGreenRedReserved8BitPerColor) {
       for (IndexX = 0; IndexX < Width; IndexX++) {
@@ -463,11 +601,8 @@ FrameBufferBltLibBufferToVideo (
   UINTN                                    SrcY;
   EFI_GRAPHICS_OUTPUT_BLT_PIXEL            *Blt;
   UINT8                                    *Source;
-  UINT8                                    *Destination;
   UINTN                                    IndexX;
   UINT32                                   Uint32;
-  UINTN                                    Offset;
-  UINTN                                    WidthInBytes;
 
   //
   // BltBuffer to Video: Source is BltBuffer, destination is Video
@@ -493,16 +628,10 @@ FrameBufferBltLibBufferToVideo (
     Delta = Width * sizeof (EFI_GRAPHICS_OUTPUT_BLT_PIXEL);
   }
 
-  WidthInBytes = Width * Configure->BytesPerPixel;
-
   for (SrcY = SourceY, DstY = DestinationY;
        SrcY < (Height + SourceY);
        SrcY++, DstY++) {
 
-    Offset = (DstY * Configure->PixelsPerScanLine) + DestinationX;
-    Offset = Configure->BytesPerPixel * Offset;
-    Destination = Configure->FrameBuffer + Offset;
-
     if (Configure->PixelFormat == PixelBlueGreenRedReserved8BitPerColor) {
       Source = (UINT8 *) BltBuffer + (SrcY * Delta) + SourceX * sizeof (EFI_GRAPHICS_OUTPUT_BLT_PIXEL);
     } else {
@@ -527,7 +656,7 @@ FrameBufferBltLibBufferToVideo (
       Source = Configure->LineBuffer;
     }
 
-    CopyMem (Destination, Source, WidthInBytes);
+    FrameBufferBltLibWriteLine (Configure, DestinationX, DstY, Source, Width);
   }
 
   return RETURN_SUCCESS;
@@ -564,6 +693,8 @@ FrameBufferBltLibVideoToVideo (
   UINTN                                     Offset;
   UINTN                                     WidthInBytes;
   INTN                                      LineStride;
+  UINTN                                     Index;
+  UINTN                                     Line;
 
   //
   // Video to Video: Source is Video, destination is Video
@@ -588,6 +719,20 @@ FrameBufferBltLibVideoToVideo (
     return RETURN_INVALID_PARAMETER;
   }
 
+  if (Configure->Shadow != NULL) {
+    //
+    // Read the lines from the shadow buffer, and write only what changes.
+    // Copy from last line if the lines move down, to avoid reading lines
+    // already written.
+    //
+    for (Index = 0; Index < Height; Index++) {
+      Line = (DestinationY > SourceY) ? Height - 1 - Index : Index;
+      FrameBufferBltLibReadLine (Configure, SourceX, SourceY + Line, Configure->LineBuffer, Width);
+      FrameBufferBltLibWriteLine (Configure, DestinationX, DestinationY + Line, Configure->LineBuffer, Width);
+    }
+    return RETURN_SUCCESS;
+  }
+
   WidthInBytes = Width * Configure->BytesPerPixel;
 
   Offset = (SourceY * Configure->PixelsPerScanLine) + SourceX;
@@ -603,8 +748,8 @@ FrameBufferBltLibVideoToVideo (
     //
     // Copy from last line to avoid source is corrupted by copying
     //
-    Source += Height * LineStride;
-    Destination += Height * LineStride;
+    Source += (Height - 1) * LineStride;
+    Destination += (Height - 1) * LineStride;
     LineStride = -LineStride;
   }
 
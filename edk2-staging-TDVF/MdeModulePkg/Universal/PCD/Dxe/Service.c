@@ -31,6 +31,19 @@ LIST_ENTRY    *mCallbackFnTable;
 EFI_GUID     **TmpTokenSpaceBuffer;
 UINTN          TmpTokenSpaceBufferCount;
 
+//
+// Open addressing hash table of the DynamicEx PCDs, indexed by a hash of their
+// token space GUID and token number, with mExTokenHashMask + 1 entries.
+//
+DYNAMICEX_HASH_ENTRY  *mExTokenHashTable = NULL;
+UINTN                 mExTokenHashMask   = 0;
+
+//
+// Addresses of the values of the PCD_TYPE_DATA and PCD_TYPE_VPD PCDs already
+// got, indexed by token number - 1. These values never move.
+//
+VOID                  **mPcdDataPointerTable = NULL;
+
 UINTN                 mPeiPcdDbSize    = 0;
 PEI_PCD_DATABASE      *mPeiPcdDbBinary = NULL;
 UINTN                 mDxePcdDbSize    = 0;
@@ -382,6 +395,17 @@ GetWorker (
   STRING_HEAD         StringTableIdx;
   BOOLEAN             IsPeiDb;
 
+  //
+  // The value of a PCD that is neither HII nor string type stays where it was
+  // found the first time.
+  //
+  if ((mPcdDataPointerTable != NULL) && (TokenNumber > 0) &&
+      (TokenNumber <= mPcdTotalTokenCount) &&
+      (mPcdDataPointerTable[TokenNumber - 1] != NULL)) {
+    ASSERT ((GetSize == DxePcdGetSize (TokenNumber)) || (GetSize == 0));
+    return mPcdDataPointerTable[TokenNumber - 1];
+  }
+
   //
   // Aquire lock to prevent reentrance from TPL_CALLBACK level
   //
@@ -431,7 +455,9 @@ GetWorker (
       VpdHead = (VPD_HEAD *) ((UINT8 *) PcdDb + Offset);
       ASSERT (mVpdBaseAddress != 0);
       RetPtr = (VOID *) (mVpdBaseAddress + VpdHead->Offset);
-
+      if (mPcdDataPointerTable != NULL) {
+        mPcdDataPointerTable[TokenNumber] = RetPtr;
+      }
       break;
 
     case PCD_TYPE_HII|PCD_TYPE_STRING:
@@ -491,6 +517,9 @@ GetWorker (
 
     case PCD_TYPE_DATA:
       RetPtr = (VOID *) ((UINT8 *) PcdDb + Offset);
+      if (mPcdDataPointerTable != NULL) {
+        mPcdDataPointerTable[TokenNumber] = RetPtr;
+      }
       break;
 
     default:
@@ -831,6 +860,120 @@ UpdatePcdDatabase (
   return EFI_NOT_FOUND;
 }
 
+/**
+  Hash the token space GUID and the token number of a DynamicEx PCD.
+
+  @param Guid            Token space guid for dynamic-ex PCD entry.
+  @param ExTokenNumber   Dynamic-ex PCD token number.
+
+  @return The hash.
+**/
+STATIC
+UINTN
+ExTokenHash (
+  IN CONST EFI_GUID             *Guid,
+  IN UINT32                     ExTokenNumber
+  )
+{
+  UINT32              Hash;
+
+  Hash  = ReadUnaligned32 ((CONST UINT32 *) Guid) ^
+          ReadUnaligned32 ((CONST UINT32 *) Guid + 1) ^
+          ReadUnaligned32 ((CONST UINT32 *) Guid + 2) ^
+          ReadUnaligned32 ((CONST UINT32 *) Guid + 3);
+  //
+  // The token numbers of a token space are mostly consecutive, multiply them
+  // by the golden ratio to spread them over the table.
+  //
+  Hash ^= ExTokenNumber * 0x9E3779B9;
+  Hash ^= Hash >> 16;
+  return Hash;
+}
+
+/**
+  Add the DynamicEx PCDs of a PCD database to the hash table.
+
+  A PCD already in the table is not added again, so that the entries of the
+  PEI database take precedence, as in the mapping tables.
+
+  @param ExMap       The DynamicEx mapping table of the database.
+  @param ExCount     The number of entries in ExMap.
+  @param GuidTable   The GUID table of the database.
+**/
+STATIC
+VOID
+AddExTokensToHashTable (
+  IN DYNAMICEX_MAPPING          *ExMap,
+  IN UINTN                      ExCount,
+  IN EFI_GUID                   *GuidTable
+  )
+{
+  UINTN               Index;
+  UINTN               Slot;
+  EFI_GUID            *Guid;
+
+  for (Index = 0; Index < ExCount; Index++) {
+    Guid = GuidTable + ExMap[Index].ExGuidIndex;
+    for (Slot = ExTokenHash (Guid, ExMap[Index].ExTokenNumber) & mExTokenHashMask;
+         mExTokenHashTable[Slot].Guid != NULL;
+         Slot = (Slot + 1) & mExTokenHashMask) {
+      if ((mExTokenHashTable[Slot].ExTokenNumber == ExMap[Index].ExTokenNumber) &&
+          CompareGuid (mExTokenHashTable[Slot].Guid, Guid)) {
+        break;
+      }
+    }
+    if (mExTokenHashTable[Slot].Guid == NULL) {
+      mExTokenHashTable[Slot].Guid          = Guid;
+      mExTokenHashTable[Slot].ExTokenNumber = ExMap[Index].ExTokenNumber;
+      mExTokenHashTable[Slot].TokenNumber   = ExMap[Index].TokenNumber;
+    }
+  }
+}
+
+/**
+  Build the hash table of the DynamicEx PCDs of the PEI and DXE databases.
+
+  GetExPcdTokenNumber() scans the mapping tables if the table cannot be
+  allocated.
+**/
+STATIC
+VOID
+BuildExTokenHashTable (
+  VOID
+  )
+{
+  UINTN               ExCount;
+  UINTN               TableSize;
+
+  ExCount = mPcdDatabase.PeiDb->ExTokenCount + mPcdDatabase.DxeDb->ExTokenCount;
+  if (ExCount == 0) {
+    return;
+  }
+
+  //
+  // Keep the table at most half full.
+  //
+  TableSize = GetPowerOfTwo32 ((UINT32) ExCount) * 4;
+  mExTokenHashTable = AllocateZeroPool (TableSize * sizeof (DYNAMICEX_HASH_ENTRY));
+  if (mExTokenHashTable == NULL) {
+    return;
+  }
+  mExTokenHashMask = TableSize - 1;
+
+  if (!mPeiDatabaseEmpty) {
+    AddExTokensToHashTable (
+      (DYNAMICEX_MAPPING *)((UINT8 *)mPcdDatabase.PeiDb + mPcdDatabase.PeiDb->ExMapTableOffset),
+      mPcdDatabase.PeiDb->ExTokenCount,
+      (EFI_GUID *)((UINT8 *)mPcdDatabase.PeiDb + mPcdDatabase.PeiDb->GuidTableOffset)
+      );
+  }
+  AddExTokensToHashTable (
+    (DYNAMICEX_MAPPING *)((UINT8 *)mPcdDatabase.DxeDb + mPcdDatabase.DxeDb->ExMapTableOffset),
+    mPcdDatabase.DxeDb->ExTokenCount,
+    (EFI_GUID *)((UINT8 *)mPcdDatabase.DxeDb + mPcdDatabase.DxeDb->GuidTableOffset)
+    );
+}
+
 /**
   Initialize the PCD database in DXE phase.
 
@@ -934,6 +1077,13 @@ BuildPcdDxeDataBase (
   for (Index = 0; Index + 1 < mPcdTotalTokenCount + 1; Index++) {
     InitializeListHead (&mCallbackFnTable[Index]);
   }
+
+  //
+  // Speed up the lookups of the token numbers and of the values. Both are
+  // optional.
+  //
+  BuildExTokenHashTable ();
+  mPcdDataPointerTable = AllocateZeroPool (mPcdTotalTokenCount * sizeof (VOID *));
 }
 
 /**
@@ -1571,6 +1721,21 @@ GetExPcdTokenNumber (
   EFI_GUID            *GuidTable;
   EFI_GUID            *MatchGuid;
   UINTN               MatchGuidIdx;
+  UINTN               Slot;
+
+  if (mExTokenHashTable != NULL) {
+    for (Slot = ExTokenHash (Guid, ExTokenNumber) & mExTokenHashMask;
+         mExTokenHashTable[Slot].Guid != NULL;
+         Slot = (Slot + 1) & mExTokenHashMask) {
+      if ((mExTokenHashTable[Slot].ExTokenNumber == ExTokenNumber) &&
+          CompareGuid (mExTokenHashTable[Slot].Guid, Guid)) {
+        return mExTokenHashTable[Slot].TokenNumber;
+      }
+    }
+
+    ASSERT (FALSE);
+    return 0;
+  }
 
   if (!mPeiDatabaseEmpty) {
     ExMap       = (DYNAMICEX_MAPPING *)((UINT8 *)mPcdDatabase.PeiDb + mPcdDatabase.PeiDb->ExMapTableOffset);
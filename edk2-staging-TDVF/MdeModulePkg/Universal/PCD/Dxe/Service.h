@@ -808,6 +808,15 @@ typedef struct {
 
 #define CR_FNENTRY_FROM_LISTNODE(Record, Type, Field) BASE_CR(Record, Type, Field)
 
+//
+// Entry of the hash table of the DynamicEx PCDs. Guid is NULL in free entries.
+//
+typedef struct {
+  CONST EFI_GUID          *Guid;
+  UINT32                  ExTokenNumber;
+  UINT32                  TokenNumber;
+} DYNAMICEX_HASH_ENTRY;
+
 //
 // Internal Functions
 //
@@ -1189,6 +1198,10 @@ extern  BOOLEAN        mPeiDatabaseEmpty;
 extern  EFI_GUID     **TmpTokenSpaceBuffer;
 extern  UINTN          TmpTokenSpaceBufferCount;
 
+extern  DYNAMICEX_HASH_ENTRY  *mExTokenHashTable;
+extern  UINTN                 mExTokenHashMask;
+extern  VOID                  **mPcdDataPointerTable;
+
 extern EFI_LOCK mPcdDatabaseLock;
 
 #endif
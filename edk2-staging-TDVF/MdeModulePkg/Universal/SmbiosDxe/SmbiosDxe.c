@@ -19,6 +19,23 @@ SMBIOS_INSTANCE mPrivateData;
 UINTN mPreAllocatedPages      = 0;
 UINTN mPre64BitAllocatedPages = 0;
 
+//
+// Lengths of the 32-bit and 64-bit tables, End-Of-Table structure included,
+// kept up to date as records are added, updated and removed, so that the
+// limits of the tables are checked without building them.
+//
+UINTN mSmbios32BitTableLength = sizeof (EFI_SMBIOS_TABLE_END_STRUCTURE);
+UINTN mSmbios64BitTableLength = sizeof (EFI_SMBIOS_TABLE_END_STRUCTURE);
+
+//
+// TRUE while the construction of the tables is deferred, until EndOfDxe, see
+// PcdSmbiosDeferTableConstruction. The stale flags record which tables must
+// be built then.
+//
+BOOLEAN mSmbiosTableDeferred   = FALSE;
+BOOLEAN mSmbios32BitTableStale = FALSE;
+BOOLEAN mSmbios64BitTableStale = FALSE;
+
 //
 // Chassis for SMBIOS entry point structure that is to be installed into EFI system config table.
 //
@@ -240,7 +257,7 @@ GetSmbiosStructureSize (
 
   Determin whether an SmbiosHandle has already in use.
 
-  @param Head        Pointer to the beginning of SMBIOS structure.
+  @param Private     The SMBIOS instance.
   @param Handle      A unique handle will be assigned to the SMBIOS record.
 
   @retval TRUE       Smbios handle already in use.
@@ -250,21 +267,11 @@ GetSmbiosStructureSize (
 BOOLEAN
 EFIAPI
 CheckSmbiosHandleExistance (
-  IN  LIST_ENTRY           *Head,
+  IN  SMBIOS_INSTANCE      *Private,
   IN  EFI_SMBIOS_HANDLE    Handle
   )
 {
-  LIST_ENTRY              *Link;
-  SMBIOS_HANDLE_ENTRY     *HandleEntry;
-
-  for (Link = Head->ForwardLink; Link != Head; Link = Link->ForwardLink) {
-    HandleEntry = SMBIOS_HANDLE_ENTRY_FROM_LINK(Link);
-    if (HandleEntry->SmbiosHandle == Handle) {
-      return TRUE;
-    }
-  }
-
-  return FALSE;
+  return (BOOLEAN) ((Private->AllocatedHandleBitmap[Handle / 8] & (1 << (Handle % 8))) != 0);
 }
 
 /**
@@ -307,18 +314,23 @@ GetAvailableSmbiosHandle (
   IN OUT   EFI_SMBIOS_HANDLE     *Handle
   )
 {
-  LIST_ENTRY              *Head;
   SMBIOS_INSTANCE         *Private;
   EFI_SMBIOS_HANDLE       MaxSmbiosHandle;
-  EFI_SMBIOS_HANDLE       AvailableHandle;
+  UINTN                   AvailableHandle;
 
   GetMaxSmbiosHandle(This, &MaxSmbiosHandle);
 
   Private = SMBIOS_INSTANCE_FROM_THIS (This);
-  Head = &Private->AllocatedHandleListHead;
   for (AvailableHandle = 0; AvailableHandle < MaxSmbiosHandle; AvailableHandle++) {
-    if (!CheckSmbiosHandleExistance(Head, AvailableHandle)) {
-      *Handle = AvailableHandle;
+    if (Private->AllocatedHandleBitmap[AvailableHandle / 8] == MAX_UINT8) {
+      //
+      // Skip the 8 handles of the byte at once.
+      //
+      AvailableHandle |= 7;
+      continue;
+    }
+    if (!CheckSmbiosHandleExistance(Private, (EFI_SMBIOS_HANDLE) AvailableHandle)) {
+      *Handle = (EFI_SMBIOS_HANDLE) AvailableHandle;
       return EFI_SUCCESS;
     }
   }
@@ -361,11 +373,9 @@ SmbiosAdd (
   UINTN                       StructureSize;
   UINTN                       NumberOfStrings;
   EFI_STATUS                  Status;
-  LIST_ENTRY                  *Head;
   SMBIOS_INSTANCE             *Private;
   EFI_SMBIOS_ENTRY            *SmbiosEntry;
   EFI_SMBIOS_HANDLE           MaxSmbiosHandle;
-  SMBIOS_HANDLE_ENTRY         *HandleEntry;
   EFI_SMBIOS_RECORD_HEADER    *InternalRecord;
   BOOLEAN                     Smbios32BitTable;
   BOOLEAN                     Smbios64BitTable;
@@ -378,8 +388,7 @@ SmbiosAdd (
   //
   // Check whether SmbiosHandle is already in use
   //
-  Head = &Private->AllocatedHandleListHead;
-  if (*SmbiosHandle != SMBIOS_HANDLE_PI_RESERVED && CheckSmbiosHandleExistance(Head, *SmbiosHandle)) {
+  if (*SmbiosHandle != SMBIOS_HANDLE_PI_RESERVED && CheckSmbiosHandleExistance(Private, *SmbiosHandle)) {
     return EFI_ALREADY_STARTED;
   }
 
@@ -418,8 +427,7 @@ SmbiosAdd (
     // in the Structure Table Length field of the SMBIOS Structure Table Entry Point,
     // which is a WORD field limited to 65,535 bytes. So the max size of 32-bit table should not exceed 65,535 bytes.
     //
-    if ((EntryPointStructure != NULL) &&
-        (EntryPointStructure->TableLength + StructureSize > SMBIOS_TABLE_MAX_LENGTH)) {
+    if (mSmbios32BitTableLength + StructureSize > SMBIOS_TABLE_MAX_LENGTH) {
       DEBUG ((EFI_D_INFO, "SmbiosAdd: Total length exceeds max 32-bit table length with type = %d size = 0x%x\n", Record->Type, StructureSize));
     } else {
       Smbios32BitTable = TRUE;
@@ -435,8 +443,7 @@ SmbiosAdd (
     // For SMBIOS 64-bit table, Structure table maximum size in SMBIOS 3.0 (64-bit) Entry Point
     // is a DWORD field limited to 0xFFFFFFFF bytes. So the max size of 64-bit table should not exceed 0xFFFFFFFF bytes.
     //
-    if ((Smbios30EntryPointStructure != NULL) &&
-        (Smbios30EntryPointStructure->TableMaximumSize + StructureSize > SMBIOS_3_0_TABLE_MAX_LENGTH)) {
+    if (mSmbios64BitTableLength + StructureSize > SMBIOS_3_0_TABLE_MAX_LENGTH) {
       DEBUG ((EFI_D_INFO, "SmbiosAdd: Total length exceeds max 64-bit table length with type = %d size = 0x%x\n", Record->Type, StructureSize));
     } else {
       DEBUG ((EFI_D_INFO, "SmbiosAdd: Smbios type %d with size 0x%x is added to 64-bit table\n", Record->Type, StructureSize));
@@ -470,18 +477,11 @@ SmbiosAdd (
     EfiReleaseLock (&Private->DataLock);
     return EFI_OUT_OF_RESOURCES;
   }
-  HandleEntry = AllocateZeroPool (sizeof(SMBIOS_HANDLE_ENTRY));
-  if (HandleEntry == NULL) {
-    EfiReleaseLock (&Private->DataLock);
-    return EFI_OUT_OF_RESOURCES;
-  }
 
   //
-  // Build Handle Entry and insert into linked list
+  // Mark the handle as allocated
   //
-  HandleEntry->Signature     = SMBIOS_HANDLE_ENTRY_SIGNATURE;
-  HandleEntry->SmbiosHandle  = *SmbiosHandle;
-  InsertTailList(&Private->AllocatedHandleListHead, &HandleEntry->Link);
+  Private->AllocatedHandleBitmap[*SmbiosHandle / 8] |= (UINT8) (1 << (*SmbiosHandle % 8));
 
   InternalRecord  = (EFI_SMBIOS_RECORD_HEADER *) (SmbiosEntry + 1);
   Raw     = (VOID *) (InternalRecord + 1);
@@ -507,6 +507,13 @@ SmbiosAdd (
   CopyMem (Raw, Record, StructureSize);
   ((EFI_SMBIOS_TABLE_HEADER*)Raw)->Handle = *SmbiosHandle;
 
+  if (Smbios32BitTable) {
+    mSmbios32BitTableLength += StructureSize;
+  }
+  if (Smbios64BitTable) {
+    mSmbios64BitTableLength += StructureSize;
+  }
+
   //
   // Some UEFI drivers (such as network) need some information in SMBIOS table.
   // Here we create SMBIOS table and publish it in
@@ -561,6 +568,10 @@ SmbiosUpdateString (
   EFI_SMBIOS_HANDLE         MaxSmbiosHandle;
   EFI_SMBIOS_TABLE_HEADER   *Record;
   EFI_SMBIOS_RECORD_HEADER  *InternalRecord;
+  UINTN                     StructureSize;
+  UINTN                     NewStructureSize;
+  BOOLEAN                   Smbios32BitTable;
+  BOOLEAN                   Smbios64BitTable;
 
   //
   // Check args validity
@@ -671,15 +682,21 @@ SmbiosUpdateString (
         return EFI_SUCCESS;
       }
 
-      SmbiosEntry->Smbios32BitTable = FALSE;
-      SmbiosEntry->Smbios64BitTable = FALSE;
+      //
+      // Size of the record, and of the record with the new string.
+      //
+      StructureSize    = SmbiosEntry->RecordHeader->RecordSize - sizeof (EFI_SMBIOS_RECORD_HEADER);
+      NewStructureSize = StructureSize + InputStrLen - TargetStrLen;
+
+      Smbios32BitTable = FALSE;
+      Smbios64BitTable = FALSE;
       if ((This->MajorVersion < 0x3) ||
           ((This->MajorVersion >= 0x3) && ((PcdGet32 (PcdSmbiosEntryPointProvideMethod) & BIT0) == BIT0))) {
         //
         // 32-bit table is produced, check the valid length.
         //
-        if ((EntryPointStructure != NULL) &&
-            (EntryPointStructure->TableLength + InputStrLen - TargetStrLen > SMBIOS_TABLE_MAX_LENGTH)) {
+        if (mSmbios32BitTableLength - (SmbiosEntry->Smbios32BitTable ? StructureSize : 0) +
+            NewStructureSize > SMBIOS_TABLE_MAX_LENGTH) {
           //
           // The length of the entire structure table (including all strings) must be reported
           // in the Structure Table Length field of the SMBIOS Structure Table Entry Point,
@@ -688,7 +705,7 @@ SmbiosUpdateString (
           DEBUG ((EFI_D_INFO, "SmbiosUpdateString: Total length exceeds max 32-bit table length\n"));
         } else {
           DEBUG ((EFI_D_INFO, "SmbiosUpdateString: New smbios record add to 32-bit table\n"));
-          SmbiosEntry->Smbios32BitTable = TRUE;
+          Smbios32BitTable = TRUE;
         }
       }
 
@@ -696,16 +713,16 @@ SmbiosUpdateString (
         //
         // 64-bit table is produced, check the valid length.
         //
-        if ((Smbios30EntryPointStructure != NULL) &&
-            (Smbios30EntryPointStructure->TableMaximumSize + InputStrLen - TargetStrLen > SMBIOS_3_0_TABLE_MAX_LENGTH)) {
+        if (mSmbios64BitTableLength - (SmbiosEntry->Smbios64BitTable ? StructureSize : 0) +
+            NewStructureSize > SMBIOS_3_0_TABLE_MAX_LENGTH) {
           DEBUG ((EFI_D_INFO, "SmbiosUpdateString: Total length exceeds max 64-bit table length\n"));
         } else {
           DEBUG ((EFI_D_INFO, "SmbiosUpdateString: New smbios record add to 64-bit table\n"));
-          SmbiosEntry->Smbios64BitTable = TRUE;
+          Smbios64BitTable = TRUE;
         }
       }
 
-      if ((!SmbiosEntry->Smbios32BitTable) && (!SmbiosEntry->Smbios64BitTable)) {
+      if ((!Smbios32BitTable) && (!Smbios64BitTable)) {
         EfiReleaseLock (&Private->DataLock);
         return EFI_UNSUPPORTED;
       }
@@ -749,10 +766,29 @@ SmbiosUpdateString (
       ResizedSmbiosEntry->Signature    = EFI_SMBIOS_ENTRY_SIGNATURE;
       ResizedSmbiosEntry->RecordHeader = InternalRecord;
       ResizedSmbiosEntry->RecordSize   = NewEntrySize;
-      ResizedSmbiosEntry->Smbios32BitTable = SmbiosEntry->Smbios32BitTable;
-      ResizedSmbiosEntry->Smbios64BitTable = SmbiosEntry->Smbios64BitTable;
+      ResizedSmbiosEntry->Smbios32BitTable = Smbios32BitTable;
+      ResizedSmbiosEntry->Smbios64BitTable = Smbios64BitTable;
       InsertTailList (Link->ForwardLink, &ResizedSmbiosEntry->Link);
 
+      if (SmbiosEntry->Smbios32BitTable) {
+        mSmbios32BitTableLength -= StructureSize;
+      }
+      if (SmbiosEntry->Smbios64BitTable) {
+        mSmbios64BitTableLength -= StructureSize;
+      }
+      if (Smbios32BitTable) {
+        mSmbios32BitTableLength += NewStructureSize;
+      }
+      if (Smbios64BitTable) {
+        mSmbios64BitTableLength += NewStructureSize;
+      }
+
+      //
+      // Rebuild the tables the record was in, as well as the ones it is in now.
+      //
+      Smbios32BitTable = (BOOLEAN) (Smbios32BitTable || SmbiosEntry->Smbios32BitTable);
+      Smbios64BitTable = (BOOLEAN) (Smbios64BitTable || SmbiosEntry->Smbios64BitTable);
+
       //
       // Remove old record
       //
@@ -764,7 +800,7 @@ SmbiosUpdateString (
       // configuration table, so other UEFI drivers can get SMBIOS table from
       // configuration table without depending on PI SMBIOS protocol.
       //
-      SmbiosTableConstruction (ResizedSmbiosEntry->Smbios32BitTable, ResizedSmbiosEntry->Smbios64BitTable);
+      SmbiosTableConstruction (Smbios32BitTable, Smbios64BitTable);
       EfiReleaseLock (&Private->DataLock);
       return EFI_SUCCESS;
     }
@@ -797,7 +833,6 @@ SmbiosRemove (
   EFI_SMBIOS_HANDLE          MaxSmbiosHandle;
   SMBIOS_INSTANCE            *Private;
   EFI_SMBIOS_ENTRY           *SmbiosEntry;
-  SMBIOS_HANDLE_ENTRY        *HandleEntry;
   EFI_SMBIOS_TABLE_HEADER    *Record;
 
   //
@@ -828,17 +863,9 @@ SmbiosRemove (
       //
       RemoveEntryList(Link);
       //
-      // Remove this handle from AllocatedHandleList
+      // Free the handle
       //
-      Head = &Private->AllocatedHandleListHead;
-      for (Link = Head->ForwardLink; Link != Head; Link = Link->ForwardLink) {
-        HandleEntry = SMBIOS_HANDLE_ENTRY_FROM_LINK(Link);
-        if (HandleEntry->SmbiosHandle == SmbiosHandle) {
-          RemoveEntryList(Link);
-          FreePool(HandleEntry);
-          break;
-        }
-      }
+      Private->AllocatedHandleBitmap[SmbiosHandle / 8] &= (UINT8) ~(1 << (SmbiosHandle % 8));
       //
       // Some UEFI drivers (such as network) need some information in SMBIOS table.
       // Here we create SMBIOS table and publish it in
@@ -847,9 +874,11 @@ SmbiosRemove (
       //
       if (SmbiosEntry->Smbios32BitTable) {
         DEBUG ((EFI_D_INFO, "SmbiosRemove: remove from 32-bit table\n"));
+        mSmbios32BitTableLength -= SmbiosEntry->RecordHeader->RecordSize - sizeof (EFI_SMBIOS_RECORD_HEADER);
       }
       if (SmbiosEntry->Smbios64BitTable) {
         DEBUG ((EFI_D_INFO, "SmbiosRemove: remove from 64-bit table\n"));
+        mSmbios64BitTableLength -= SmbiosEntry->RecordHeader->RecordSize - sizeof (EFI_SMBIOS_RECORD_HEADER);
       }
       //
       // Update the whole SMBIOS table again based on which table the removed SMBIOS record is in.
@@ -1378,6 +1407,9 @@ SmbiosCreate64BitTable (
 /**
   Create Smbios Table and installs the Smbios Table to the System Table.
 
+  While the construction of the tables is deferred, the tables are only
+  recorded as stale, to be built by SmbiosPublishDeferredTables().
+
   @param  Smbios32BitTable    The flag to update 32-bit table.
   @param  Smbios64BitTable    The flag to update 64-bit table.
 
@@ -1393,6 +1425,12 @@ SmbiosTableConstruction (
   UINT8       *Eps64Bit;
   EFI_STATUS  Status;
 
+  if (mSmbiosTableDeferred) {
+    mSmbios32BitTableStale = (BOOLEAN) (mSmbios32BitTableStale || Smbios32BitTable);
+    mSmbios64BitTableStale = (BOOLEAN) (mSmbios64BitTableStale || Smbios64BitTable);
+    return;
+  }
+
   if (Smbios32BitTable) {
     Status = SmbiosCreateTable ((VOID **) &Eps);
     if (!EFI_ERROR (Status)) {
@@ -1408,6 +1446,41 @@ SmbiosTableConstruction (
   }
 }
 
+/**
+  Build and install the SMBIOS tables whose construction has been deferred,
+  and stop deferring it.
+
+  The function is called at EndOfDxe, and at ReadyToBoot in case EndOfDxe is
+  not signaled.
+
+  @param  Event     Event whose notification function is being invoked.
+  @param  Context   Pointer to the notification function's context, not used.
+
+**/
+VOID
+EFIAPI
+SmbiosPublishDeferredTables (
+  IN EFI_EVENT  Event,
+  IN VOID       *Context
+  )
+{
+  gBS->CloseEvent (Event);
+
+  if (!mSmbiosTableDeferred) {
+    return;
+  }
+
+  EfiAcquireLock (&mPrivateData.DataLock);
+  mSmbiosTableDeferred = FALSE;
+  DEBUG ((DEBUG_INFO, "%a: 32-bit table %a, 64-bit table %a\n", __FUNCTION__,
+    mSmbios32BitTableStale ? "built" : "unchanged",
+    mSmbios64BitTableStale ? "built" : "unchanged"));
+  SmbiosTableConstruction (mSmbios32BitTableStale, mSmbios64BitTableStale);
+  mSmbios32BitTableStale = FALSE;
+  mSmbios64BitTableStale = FALSE;
+  EfiReleaseLock (&mPrivateData.DataLock);
+}
+
 /**
 
   Driver to produce Smbios protocol and pre-allocate 1 page for the final SMBIOS table.
@@ -1427,6 +1500,7 @@ SmbiosDriverEntryPoint (
   )
 {
   EFI_STATUS            Status;
+  EFI_EVENT             Event;
 
   if(TdxIsEnabled()) {
     return EFI_UNSUPPORTED;
@@ -1441,9 +1515,35 @@ SmbiosDriverEntryPoint (
   mPrivateData.Smbios.MinorVersion      = (UINT8) (PcdGet16 (PcdSmbiosVersion) & 0x00ff);
 
   InitializeListHead (&mPrivateData.DataListHead);
-  InitializeListHead (&mPrivateData.AllocatedHandleListHead);
   EfiInitializeLock (&mPrivateData.DataLock, TPL_NOTIFY);
 
+  //
+  // Let the records accumulate until EndOfDxe, and build the tables once then.
+  //
+  mSmbiosTableDeferred = PcdGetBool (PcdSmbiosDeferTableConstruction);
+  if (mSmbiosTableDeferred) {
+    Status = gBS->CreateEventEx (
+                    EVT_NOTIFY_SIGNAL,
+                    TPL_CALLBACK,
+                    SmbiosPublishDeferredTables,
+                    NULL,
+                    &gEfiEndOfDxeEventGroupGuid,
+                    &Event
+                    );
+    if (!EFI_ERROR (Status)) {
+      Status = EfiCreateEventReadyToBootEx (
+                 TPL_CALLBACK,
+                 SmbiosPublishDeferredTables,
+                 NULL,
+                 &Event
+                 );
+    }
+    if (EFI_ERROR (Status)) {
+      DEBUG ((DEBUG_WARN, "%a: not deferring the SMBIOS tables: %r\n", __FUNCTION__, Status));
+      mSmbiosTableDeferred = FALSE;
+    }
+  }
+
   //
   // Make a new handle and install the protocol
   //
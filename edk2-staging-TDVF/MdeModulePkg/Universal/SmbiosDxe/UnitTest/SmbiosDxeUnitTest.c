@@ -0,0 +1,1035 @@
+/** @file
+  Host based unit test of the deferred construction of the SMBIOS tables by
+  SmbiosDxe.
+
+  The records are added, updated and removed with the SMBIOS protocol of the
+  driver, once with the tables built at every change, and once with the tables
+  built at EndOfDxe. The tables published must be identical.
+
+  A benchmark of both modes is built when UNIT_TEST_BENCHMARK is defined, e.g.
+  with -DUNIT_TEST_BENCHMARK in the CC_FLAGS of the host test DSC. It is not
+  part of the default run, as its timings depend on the host.
+
+  Copyright (c) 2021, Intel Corporation. All rights reserved.<BR>
+  SPDX-License-Identifier: BSD-2-Clause-Patent
+
+**/
+
+#include <stdio.h>
+#include <string.h>
+#include <stdarg.h>
+#include <stddef.h>
+#include <setjmp.h>
+#ifdef UNIT_TEST_BENCHMARK
+#include <time.h>
+#endif
+#include <cmocka.h>
+
+#include <Uefi.h>
+#include <Library/BaseLib.h>
+#include <Library/BaseMemoryLib.h>
+#include <Library/DebugLib.h>
+#include <Library/MemoryAllocationLib.h>
+#include <Library/TdxProbeLib.h>
+#include <Library/UnitTestLib.h>
+
+#include "../SmbiosDxe.h"
+
+#define UNIT_TEST_NAME     "SmbiosDxe Deferred Table Unit Test"
+#define UNIT_TEST_VERSION  "0.1"
+
+//
+// Number of records of the tests, more than fit in the 32-bit table.
+//
+#define TEST_RECORD_COUNT        4096
+
+//
+// Largest record built by BuildTestRecord().
+//
+#define TEST_RECORD_MAX_SIZE     64
+
+//
+// Size of the formatted area of the records, header included.
+//
+#define TEST_RECORD_LENGTH       (sizeof (EFI_SMBIOS_TABLE_HEADER) + 12)
+
+#define MOCK_EVENT_MAX           4
+
+//
+// Memory below 4GB for the allocations with AllocateMaxAddress.
+//
+#define MOCK_LOW_MEMORY_SIZE     SIZE_2MB
+
+///================================================================================================
+///================================================================================================
+///
+/// TEST DATA
+///
+///================================================================================================
+///================================================================================================
+
+//
+// Driver state, from SmbiosDxe.c.
+//
+extern SMBIOS_INSTANCE               mPrivateData;
+extern UINTN                         mPreAllocatedPages;
+extern UINTN                         mPre64BitAllocatedPages;
+extern UINTN                         mSmbios32BitTableLength;
+extern UINTN                         mSmbios64BitTableLength;
+extern BOOLEAN                       mSmbiosTableDeferred;
+extern BOOLEAN                       mSmbios32BitTableStale;
+extern BOOLEAN                       mSmbios64BitTableStale;
+extern SMBIOS_TABLE_ENTRY_POINT      *EntryPointStructure;
+extern SMBIOS_TABLE_3_0_ENTRY_POINT  *Smbios30EntryPointStructure;
+
+EFI_STATUS
+EFIAPI
+SmbiosDriverEntryPoint (
+  IN EFI_HANDLE           ImageHandle,
+  IN EFI_SYSTEM_TABLE     *SystemTable
+  );
+
+typedef struct {
+  EFI_EVENT_NOTIFY  NotifyFunction;
+  VOID              *NotifyContext;
+  BOOLEAN           Closed;
+} MOCK_EVENT;
+
+//
+// Copy of the published tables, to compare them.
+//
+typedef struct {
+  UINT8   *Table;
+  UINTN   Length;
+  UINTN   Count;
+  UINTN   MaxStructureSize;
+} TEST_SMBIOS_TABLE;
+
+typedef struct {
+  TEST_SMBIOS_TABLE  Table32;
+  TEST_SMBIOS_TABLE  Table64;
+} TEST_SMBIOS_TABLES;
+
+STATIC EFI_BOOT_SERVICES  mMockBootServices;
+EFI_BOOT_SERVICES         *gBS = &mMockBootServices;
+
+STATIC MOCK_EVENT         mMockEvents[MOCK_EVENT_MAX];
+STATIC UINTN              mMockEventCount;
+
+STATIC VOID               *mMockSmbiosTable;
+STATIC VOID               *mMockSmbios3Table;
+STATIC UINTN              mMockInstallCount;
+
+STATIC UINT8              mMockLowMemory[MOCK_LOW_MEMORY_SIZE + EFI_PAGE_SIZE];
+STATIC UINTN              mMockLowMemoryUsed;
+
+STATIC TEST_SMBIOS_TABLES mExpectedTables;
+
+//
+// Contexts of the tests comparing the tables: whether to update and remove
+// records after adding them.
+//
+STATIC BOOLEAN            mWithChanges    = TRUE;
+STATIC BOOLEAN            mWithoutChanges = FALSE;
+
+///================================================================================================
+///================================================================================================
+///
+/// MOCKS
+///
+///================================================================================================
+///================================================================================================
+
+/**
+  Mock of the TDX probe: the tests are not run in a TD.
+
+  @retval FALSE  Not a TD guest.
+**/
+BOOLEAN
+EFIAPI
+TdxIsEnabled (
+  VOID
+  )
+{
+  return FALSE;
+}
+
+/**
+  Mock of gBS->AllocatePages().
+
+  The pages below an address are taken from a static buffer, which the
+  executable loads below 4GB. FreePages() of MemoryAllocationLib ignores them.
+  The other pages are allocated with MemoryAllocationLib.
+**/
+STATIC
+EFI_STATUS
+EFIAPI
+MockAllocatePages (
+  IN     EFI_ALLOCATE_TYPE     Type,
+  IN     EFI_MEMORY_TYPE       MemoryType,
+  IN     UINTN                 Pages,
+  IN OUT EFI_PHYSICAL_ADDRESS  *Memory
+  )
+{
+  UINTN  Base;
+  VOID   *Buffer;
+
+  if (Type == AllocateMaxAddress) {
+    //
+    // Leave a page free before the pages, so that FreePages() does not find
+    // the signature of its own allocations there.
+    //
+    Base = ALIGN_VALUE ((UINTN) mMockLowMemory, EFI_PAGE_SIZE) + mMockLowMemoryUsed + EFI_PAGE_SIZE;
+    if ((mMockLowMemoryUsed + EFI_PAGES_TO_SIZE (Pages + 1) > MOCK_LOW_MEMORY_SIZE) ||
+        (Base + EFI_PAGES_TO_SIZE (Pages) - 1 > *Memory)) {
+      return EFI_OUT_OF_RESOURCES;
+    }
+    mMockLowMemoryUsed += EFI_PAGES_TO_SIZE (Pages + 1);
+    ZeroMem ((VOID *) (Base - EFI_PAGE_SIZE), EFI_PAGE_SIZE);
+    *Memory = Base;
+    return EFI_SUCCESS;
+  }
+
+  Buffer = AllocatePages (Pages);
+  if (Buffer == NULL) {
+    return EFI_OUT_OF_RESOURCES;
+  }
+  *Memory = (UINTN) Buffer;
+  return EFI_SUCCESS;
+}
+
+/**
+  Mock of gBS->CreateEventEx(), recording the notification function.
+**/
+STATIC
+EFI_STATUS
+EFIAPI
+MockCreateEventEx (
+  IN       UINT32            Type,
+  IN       EFI_TPL           NotifyTpl,
+  IN       EFI_EVENT_NOTIFY  NotifyFunction OPTIONAL,
+  IN CONST VOID              *NotifyContext OPTIONAL,
+  IN CONST EFI_GUID          *EventGroup    OPTIONAL,
+  OUT      EFI_EVENT         *Event
+  )
+{
+  if (mMockEventCount == MOCK_EVENT_MAX) {
+    return EFI_OUT_OF_RESOURCES;
+  }
+  mMockEvents[mMockEventCount].NotifyFunction = NotifyFunction;
+  mMockEvents[mMockEventCount].NotifyContext  = (VOID *) NotifyContext;
+  mMockEvents[mMockEventCount].Closed         = FALSE;
+  *Event = &mMockEvents[mMockEventCount];
+  mMockEventCount++;
+  return EFI_SUCCESS;
+}
+
+/**
+  Mock of gBS->CloseEvent().
+**/
+STATIC
+EFI_STATUS
+EFIAPI
+MockCloseEvent (
+  IN EFI_EVENT  Event
+  )
+{
+  ((MOCK_EVENT *) Event)->Closed = TRUE;
+  return EFI_SUCCESS;
+}
+
+/**
+  Mock of gBS->InstallConfigurationTable(), recording the SMBIOS tables.
+**/
+STATIC
+EFI_STATUS
+EFIAPI
+MockInstallConfigurationTable (
+  IN EFI_GUID  *Guid,
+  IN VOID      *Table
+  )
+{
+  if (CompareGuid (Guid, &gEfiSmbiosTableGuid)) {
+    mMockSmbiosTable = Table;
+  } else if (CompareGuid (Guid, &gEfiSmbios3TableGuid)) {
+    mMockSmbios3Table = Table;
+  } else {
+    return EFI_UNSUPPORTED;
+  }
+  mMockInstallCount++;
+  return EFI_SUCCESS;
+}
+
+/**
+  Mock of gBS->InstallProtocolInterface().
+**/
+STATIC
+EFI_STATUS
+EFIAPI
+MockInstallProtocolInterface (
+  IN OUT EFI_HANDLE          *Handle,
+  IN     EFI_GUID            *Protocol,
+  IN     EFI_INTERFACE_TYPE  InterfaceType,
+  IN     VOID                *Interface
+  )
+{
+  *Handle = (EFI_HANDLE) Interface;
+  return EFI_SUCCESS;
+}
+
+/**
+  Mock of EfiCreateEventReadyToBootEx() of UefiLib.
+**/
+EFI_STATUS
+EFIAPI
+EfiCreateEventReadyToBootEx (
+  IN  EFI_TPL           NotifyTpl,
+  IN  EFI_EVENT_NOTIFY  NotifyFunction,  OPTIONAL
+  IN  VOID              *NotifyContext,  OPTIONAL
+  OUT EFI_EVENT         *ReadyToBootEvent
+  )
+{
+  return MockCreateEventEx (
+           EVT_NOTIFY_SIGNAL,
+           NotifyTpl,
+           NotifyFunction,
+           NotifyContext,
+           &gEfiEventReadyToBootGuid,
+           ReadyToBootEvent
+           );
+}
+
+/**
+  Mock of EfiInitializeLock() of UefiLib.
+**/
+EFI_LOCK *
+EFIAPI
+EfiInitializeLock (
+  IN OUT EFI_LOCK  *Lock,
+  IN EFI_TPL        Priority
+  )
+{
+  Lock->Tpl      = Priority;
+  Lock->OwnerTpl = TPL_APPLICATION;
+  Lock->Lock     = EfiLockReleased;
+  return Lock;
+}
+
+/**
+  Mock of EfiAcquireLockOrFail() of UefiLib.
+**/
+EFI_STATUS
+EFIAPI
+EfiAcquireLockOrFail (
+  IN EFI_LOCK  *Lock
+  )
+{
+  if (Lock->Lock != EfiLockReleased) {
+    return EFI_ACCESS_DENIED;
+  }
+  Lock->Lock = EfiLockAcquired;
+  return EFI_SUCCESS;
+}
+
+/**
+  Mock of EfiAcquireLock() of UefiLib.
+**/
+VOID
+EFIAPI
+EfiAcquireLock (
+  IN EFI_LOCK  *Lock
+  )
+{
+  ASSERT (Lock->Lock == EfiLockReleased);
+  Lock->Lock = EfiLockAcquired;
+}
+
+/**
+  Mock of EfiReleaseLock() of UefiLib.
+**/
+VOID
+EFIAPI
+EfiReleaseLock (
+  IN EFI_LOCK  *Lock
+  )
+{
+  ASSERT (Lock->Lock == EfiLockAcquired);
+  Lock->Lock = EfiLockReleased;
+}
+
+///================================================================================================
+///================================================================================================
+///
+/// HELPER FUNCTIONS
+///
+///================================================================================================
+///================================================================================================
+
+/**
+  Free the records of the driver and start it again, as if it was loaded.
+
+  @param[in]  Deferred   TRUE to leave the table construction deferred, FALSE
+                         to signal EndOfDxe.
+**/
+STATIC
+EFI_STATUS
+ResetSmbiosDriver (
+  IN BOOLEAN  Deferred
+  )
+{
+  EFI_STATUS  Status;
+  LIST_ENTRY  *Link;
+
+  if (mPrivateData.Signature == SMBIOS_INSTANCE_SIGNATURE) {
+    while (!IsListEmpty (&mPrivateData.DataListHead)) {
+      Link = GetFirstNode (&mPrivateData.DataListHead);
+      RemoveEntryList (Link);
+      FreePool (SMBIOS_ENTRY_FROM_LINK (Link));
+    }
+  }
+  if (mPre64BitAllocatedPages != 0) {
+    FreePages ((VOID *) (UINTN) Smbios30EntryPointStructure->TableAddress, mPre64BitAllocatedPages);
+  }
+
+  ZeroMem (&mPrivateData, sizeof (mPrivateData));
+  mPreAllocatedPages          = 0;
+  mPre64BitAllocatedPages     = 0;
+  mSmbios32BitTableLength     = sizeof (EFI_SMBIOS_TABLE_END_STRUCTURE);
+  mSmbios64BitTableLength     = sizeof (EFI_SMBIOS_TABLE_END_STRUCTURE);
+  mSmbios32BitTableStale      = FALSE;
+  mSmbios64BitTableStale      = FALSE;
+  EntryPointStructure         = NULL;
+  Smbios30EntryPointStructure = NULL;
+
+  ZeroMem (&mMockBootServices, sizeof (mMockBootServices));
+  mMockBootServices.AllocatePages             = MockAllocatePages;
+  mMockBootServices.CreateEventEx             = MockCreateEventEx;
+  mMockBootServices.CloseEvent                = MockCloseEvent;
+  mMockBootServices.InstallConfigurationTable = MockInstallConfigurationTable;
+  mMockBootServices.InstallProtocolInterface  = MockInstallProtocolInterface;
+  mMockEventCount    = 0;
+  mMockSmbiosTable   = NULL;
+  mMockSmbios3Table  = NULL;
+  mMockInstallCount  = 0;
+  mMockLowMemoryUsed = 0;
+
+  Status = SmbiosDriverEntryPoint (NULL, NULL);
+  if (EFI_ERROR (Status) || !mSmbiosTableDeferred || (mMockEventCount != 2)) {
+    return EFI_UNSUPPORTED;
+  }
+
+  if (!Deferred) {
+    mMockEvents[0].NotifyFunction (&mMockEvents[0], mMockEvents[0].NotifyContext);
+  }
+  return EFI_SUCCESS;
+}
+
+/**
+  Signal the EndOfDxe event of the driver.
+**/
+STATIC
+VOID
+SignalEndOfDxe (
+  VOID
+  )
+{
+  if (!mMockEvents[0].Closed) {
+    mMockEvents[0].NotifyFunction (&mMockEvents[0], mMockEvents[0].NotifyContext);
+  }
+}
+
+/**
+  Signal the ReadyToBoot event of the driver.
+**/
+STATIC
+VOID
+SignalReadyToBoot (
+  VOID
+  )
+{
+  if (!mMockEvents[1].Closed) {
+    mMockEvents[1].NotifyFunction (&mMockEvents[1], mMockEvents[1].NotifyContext);
+  }
+}
+
+/**
+  Write a number in hexadecimal.
+
+  @param[out] String   Return the 4 digits.
+  @param[in]  Value    The number.
+**/
+STATIC
+VOID
+WriteHex16 (
+  OUT CHAR8   *String,
+  IN  UINT16  Value
+  )
+{
+  UINTN  Index;
+
+  for (Index = 0; Index < 4; Index++) {
+    String[Index] = "0123456789ABCDEF"[(Value >> (12 - Index * 4)) & 0xF];
+  }
+}
+
+/**
+  Build an OEM record with two strings of varying lengths.
+
+  @param[in]  Index    The number of the record.
+  @param[in]  Handle   The handle of the record.
+  @param[out] Buffer   Return the record, of TEST_RECORD_MAX_SIZE bytes.
+**/
+STATIC
+VOID
+BuildTestRecord (
+  IN  UINTN              Index,
+  IN  EFI_SMBIOS_HANDLE  Handle,
+  OUT UINT8              *Buffer
+  )
+{
+  EFI_SMBIOS_TABLE_HEADER  *Header;
+  CHAR8                    *String;
+  UINTN                    Data;
+
+  ZeroMem (Buffer, TEST_RECORD_MAX_SIZE);
+  Header         = (EFI_SMBIOS_TABLE_HEADER *) Buffer;
+  Header->Type   = (UINT8) (0x80 + Index % 4);
+  Header->Length = (UINT8) TEST_RECORD_LENGTH;
+  Header->Handle = Handle;
+  for (Data = sizeof (EFI_SMBIOS_TABLE_HEADER); Data < TEST_RECORD_LENGTH; Data++) {
+    Buffer[Data] = (UINT8) (Index + Data);
+  }
+
+  String = (CHAR8 *) Buffer + TEST_RECORD_LENGTH;
+  CopyMem (String, "Record", 6);
+  WriteHex16 (String + 6, (UINT16) Index);
+  String += 11;
+  CopyMem (String, "Slot", 4);
+  SetMem (String + 4, Index % 8, 'x');
+}
+
+/**
+  Add records with the SMBIOS protocol of the driver.
+
+  @param[in]  First   The number of the first record.
+  @param[in]  Count   The number of records.
+  @param[in]  Auto    TRUE to let the driver assign the handles, FALSE to use
+                      First + 0x100 and the following handles.
+
+  @retval EFI_SUCCESS  The records have been added.
+**/
+STATIC
+EFI_STATUS
+AddTestRecords (
+  IN UINTN    First,
+  IN UINTN    Count,
+  IN BOOLEAN  Auto
+  )
+{
+  EFI_STATUS         Status;
+  UINTN              Index;
+  EFI_SMBIOS_HANDLE  Handle;
+  UINT8              Buffer[TEST_RECORD_MAX_SIZE];
+
+  for (Index = First; Index < First + Count; Index++) {
+    Handle = Auto ? SMBIOS_HANDLE_PI_RESERVED : (EFI_SMBIOS_HANDLE) (Index + 0x100);
+    BuildTestRecord (Index, Handle, Buffer);
+    Status = mPrivateData.Smbios.Add (&mPrivateData.Smbios, NULL, &Handle, (EFI_SMBIOS_TABLE_HEADER *) Buffer);
+    if (EFI_ERROR (Status)) {
+      return Status;
+    }
+  }
+  return EFI_SUCCESS;
+}
+
+/**
+  Update and remove some of the records added by AddTestRecords (0, Count, FALSE).
+
+  @param[in]  Count   The number of records.
+
+  @retval EFI_SUCCESS  The records have been changed.
+**/
+STATIC
+EFI_STATUS
+ChangeTestRecords (
+  IN UINTN  Count
+  )
+{
+  EFI_STATUS         Status;
+  UINTN              Index;
+  UINTN              StringNumber;
+  CHAR8              *String;
+  EFI_SMBIOS_HANDLE  Handle;
+
+  for (Index = 0; Index < Count; Index += 3) {
+    //
+    // A string of the same length, a longer one and a shorter one.
+    //
+    StringNumber = 1 + Index % 2;
+    switch (Index % 9) {
+    case 0:
+      String = "RecordFFFF";
+      break;
+    case 3:
+      String = "A longer string than the other ones";
+      break;
+    default:
+      String = "S";
+      break;
+    }
+    Handle = (EFI_SMBIOS_HANDLE) (Index + 0x100);
+    Status = mPrivateData.Smbios.UpdateString (&mPrivateData.Smbios, &Handle, &StringNumber, String);
+    if (EFI_ERROR (Status)) {
+      return Status;
+    }
+  }
+
+  for (Index = 1; Index < Count; Index += 7) {
+    Status = mPrivateData.Smbios.Remove (&mPrivateData.Smbios, (EFI_SMBIOS_HANDLE) (Index + 0x100));
+    if (EFI_ERROR (Status)) {
+      return Status;
+    }
+  }
+  return EFI_SUCCESS;
+}
+
+/**
+  Walk a table and count its structures.
+
+  @param[in]  Table    The table.
+  @param[in]  Length   The length of the table in bytes.
+
+  @return The number of structures, end of table included, or 0 if the table
+          is not terminated by the end of table structure at its end.
+**/
+STATIC
+UINTN
+CountTableStructures (
+  IN UINT8  *Table,
+  IN UINTN  Length
+  )
+{
+  UINTN                    Offset;
+  UINTN                    Count;
+  EFI_SMBIOS_TABLE_HEADER  *Header;
+
+  Offset = 0;
+  Count  = 0;
+  while (Offset + sizeof (EFI_SMBIOS_TABLE_HEADER) <= Length) {
+    Header = (EFI_SMBIOS_TABLE_HEADER *) (Table + Offset);
+    Count++;
+    Offset += Header->Length;
+    while ((Offset + 1 < Length) && ((Table[Offset] != 0) || (Table[Offset + 1] != 0))) {
+      Offset++;
+    }
+    Offset += 2;
+    if (Header->Type == SMBIOS_TYPE_END_OF_TABLE) {
+      return (Offset == Length) ? Count : 0;
+    }
+  }
+  return 0;
+}
+
+/**
+  Copy the tables the driver has published.
+
+  @param[out] Tables   Return the copies, to be freed with FreeTables().
+
+  @retval EFI_SUCCESS  The tables are valid and have been copied.
+**/
+STATIC
+EFI_STATUS
+CopyPublishedTables (
+  OUT TEST_SMBIOS_TABLES  *Tables
+  )
+{
+  SMBIOS_TABLE_ENTRY_POINT      *Eps;
+  SMBIOS_TABLE_3_0_ENTRY_POINT  *Eps64Bit;
+
+  ZeroMem (Tables, sizeof (*Tables));
+  Eps      = mMockSmbiosTable;
+  Eps64Bit = mMockSmbios3Table;
+  if ((Eps == NULL) || (Eps64Bit == NULL) ||
+      (CalculateSum8 ((UINT8 *) Eps, Eps->EntryPointLength) != 0) ||
+      (CalculateSum8 ((UINT8 *) Eps64Bit, Eps64Bit->EntryPointLength) != 0)) {
+    return EFI_NOT_FOUND;
+  }
+
+  Tables->Table32.Length           = Eps->TableLength;
+  Tables->Table32.Count            = Eps->NumberOfSmbiosStructures;
+  Tables->Table32.MaxStructureSize = Eps->MaxStructureSize;
+  Tables->Table32.Table            = AllocateCopyPool (Eps->TableLength, (VOID *) (UINTN) Eps->TableAddress);
+  Tables->Table64.Length           = Eps64Bit->TableMaximumSize;
+  Tables->Table64.Table            = AllocateCopyPool (Eps64Bit->TableMaximumSize, (VOID *) (UINTN) Eps64Bit->TableAddress);
+  if ((Tables->Table32.Table == NULL) || (Tables->Table64.Table == NULL)) {
+    return EFI_OUT_OF_RESOURCES;
+  }
+  Tables->Table64.Count = CountTableStructures (Tables->Table64.Table, Tables->Table64.Length);
+
+  if ((CountTableStructures (Tables->Table32.Table, Tables->Table32.Length) != Tables->Table32.Count) ||
+      (Tables->Table64.Count == 0)) {
+    return EFI_VOLUME_CORRUPTED;
+  }
+  return EFI_SUCCESS;
+}
+
+/**
+  Free the copies of the tables.
+
+  @param[in]  Tables   The copies made by CopyPublishedTables().
+**/
+STATIC
+VOID
+FreeTables (
+  IN TEST_SMBIOS_TABLES  *Tables
+  )
+{
+  if (Tables->Table32.Table != NULL) {
+    FreePool (Tables->Table32.Table);
+  }
+  if (Tables->Table64.Table != NULL) {
+    FreePool (Tables->Table64.Table);
+  }
+  ZeroMem (Tables, sizeof (*Tables));
+}
+
+/**
+  Compare two copies of the tables.
+
+  @retval TRUE   The tables are identical.
+**/
+STATIC
+BOOLEAN
+SameTables (
+  IN TEST_SMBIOS_TABLES  *Tables1,
+  IN TEST_SMBIOS_TABLES  *Tables2
+  )
+{
+  return (BOOLEAN) ((Tables1->Table32.Length == Tables2->Table32.Length) &&
+                    (Tables1->Table32.Count == Tables2->Table32.Count) &&
+                    (Tables1->Table32.MaxStructureSize == Tables2->Table32.MaxStructureSize) &&
+                    (CompareMem (Tables1->Table32.Table, Tables2->Table32.Table, Tables1->Table32.Length) == 0) &&
+                    (Tables1->Table64.Length == Tables2->Table64.Length) &&
+                    (CompareMem (Tables1->Table64.Table, Tables2->Table64.Table, Tables1->Table64.Length) == 0));
+}
+
+/**
+  Build the expected tables with the construction at every change.
+**/
+STATIC
+UNIT_TEST_STATUS
+EFIAPI
+BuildExpectedTables (
+  IN UNIT_TEST_CONTEXT  Context
+  )
+{
+  EFI_STATUS  Status;
+
+  FreeTables (&mExpectedTables);
+  Status = ResetSmbiosDriver (FALSE);
+  if (!EFI_ERROR (Status)) {
+    Status = AddTestRecords (0, TEST_RECORD_COUNT, FALSE);
+  }
+  if (!EFI_ERROR (Status) && *(BOOLEAN *) Context) {
+    Status = ChangeTestRecords (TEST_RECORD_COUNT);
+  }
+  if (!EFI_ERROR (Status)) {
+    Status = CopyPublishedTables (&mExpectedTables);
+  }
+  return EFI_ERROR (Status) ? UNIT_TEST_ERROR_PREREQUISITE_NOT_MET : UNIT_TEST_PASSED;
+}
+
+/**
+  Free the expected tables.
+**/
+STATIC
+VOID
+EFIAPI
+FreeExpectedTables (
+  IN UNIT_TEST_CONTEXT  Context
+  )
+{
+  FreeTables (&mExpectedTables);
+}
+
+///================================================================================================
+///================================================================================================
+///
+/// TEST CASES
+///
+///================================================================================================
+///================================================================================================
+
+/**
+  The tables built at EndOfDxe are the ones built at every record added, and
+  nothing is published before.
+**/
+UNIT_TEST_STATUS
+EFIAPI
+DeferredTablesMatch (
+  IN UNIT_TEST_CONTEXT  Context
+  )
+{
+  EFI_STATUS          Status;
+  TEST_SMBIOS_TABLES  Tables;
+
+  UT_ASSERT_NOT_EFI_ERROR (ResetSmbiosDriver (TRUE));
+  UT_ASSERT_NOT_EFI_ERROR (AddTestRecords (0, TEST_RECORD_COUNT, FALSE));
+  if (*(BOOLEAN *) Context) {
+    UT_ASSERT_NOT_EFI_ERROR (ChangeTestRecords (TEST_RECORD_COUNT));
+  }
+  UT_ASSERT_EQUAL (mMockInstallCount, 0);
+  UT_ASSERT_TRUE (EntryPointStructure == NULL);
+
+  SignalEndOfDxe ();
+  UT_ASSERT_EQUAL (mMockInstallCount, 2);
+  SignalReadyToBoot ();
+  UT_ASSERT_EQUAL (mMockInstallCount, 2);
+
+  Status = CopyPublishedTables (&Tables);
+  UT_ASSERT_NOT_EFI_ERROR (Status);
+  UT_LOG_INFO (
+    "32-bit table: %d structures, 64-bit table: %d structures\n",
+    (INT32) Tables.Table32.Count,
+    (INT32) Tables.Table64.Count
+    );
+  UT_ASSERT_TRUE (Tables.Table32.Count < Tables.Table64.Count);
+  UT_ASSERT_TRUE (SameTables (&Tables, &mExpectedTables));
+  FreeTables (&Tables);
+  return UNIT_TEST_PASSED;
+}
+
+/**
+  The records added after EndOfDxe are published immediately.
+**/
+UNIT_TEST_STATUS
+EFIAPI
+AddAfterEndOfDxe (
+  IN UNIT_TEST_CONTEXT  Context
+  )
+{
+  TEST_SMBIOS_TABLES  Tables;
+  UINTN               Count64;
+
+  UT_ASSERT_NOT_EFI_ERROR (ResetSmbiosDriver (TRUE));
+  UT_ASSERT_NOT_EFI_ERROR (AddTestRecords (0, 16, FALSE));
+  SignalEndOfDxe ();
+  UT_ASSERT_NOT_EFI_ERROR (CopyPublishedTables (&Tables));
+  Count64 = Tables.Table64.Count;
+  FreeTables (&Tables);
+
+  UT_ASSERT_NOT_EFI_ERROR (AddTestRecords (16, 1, FALSE));
+  UT_ASSERT_EQUAL (mMockInstallCount, 4);
+  UT_ASSERT_NOT_EFI_ERROR (CopyPublishedTables (&Tables));
+  UT_ASSERT_EQUAL (Tables.Table32.Count, Count64 + 1);
+  UT_ASSERT_EQUAL (Tables.Table64.Count, Count64 + 1);
+  FreeTables (&Tables);
+
+  UT_ASSERT_NOT_EFI_ERROR (mPrivateData.Smbios.Remove (&mPrivateData.Smbios, 0x100));
+  UT_ASSERT_EQUAL (mMockInstallCount, 6);
+  UT_ASSERT_NOT_EFI_ERROR (CopyPublishedTables (&Tables));
+  UT_ASSERT_EQUAL (Tables.Table64.Count, Count64);
+  FreeTables (&Tables);
+  return UNIT_TEST_PASSED;
+}
+
+/**
+  The handles are assigned from the lowest free one, and a handle in use is
+  rejected.
+**/
+UNIT_TEST_STATUS
+EFIAPI
+HandleAllocation (
+  IN UNIT_TEST_CONTEXT  Context
+  )
+{
+  EFI_SMBIOS_HANDLE        Handle;
+  EFI_SMBIOS_TABLE_HEADER  *Record;
+  EFI_SMBIOS_TYPE          Type;
+  UINT8                    Buffer[TEST_RECORD_MAX_SIZE];
+  UINTN                    Index;
+
+  UT_ASSERT_NOT_EFI_ERROR (ResetSmbiosDriver (TRUE));
+  UT_ASSERT_NOT_EFI_ERROR (AddTestRecords (0, 300, TRUE));
+
+  Handle = SMBIOS_HANDLE_PI_RESERVED;
+  Type   = 0x81;
+  for (Index = 1; Index < 300; Index += 4) {
+    UT_ASSERT_NOT_EFI_ERROR (mPrivateData.Smbios.GetNext (&mPrivateData.Smbios, &Handle, &Type, &Record, NULL));
+    UT_ASSERT_EQUAL (Handle, Index);
+  }
+
+  Handle = 5;
+  BuildTestRecord (0, Handle, Buffer);
+  UT_ASSERT_STATUS_EQUAL (
+    mPrivateData.Smbios.Add (&mPrivateData.Smbios, NULL, &Handle, (EFI_SMBIOS_TABLE_HEADER *) Buffer),
+    EFI_ALREADY_STARTED
+    );
+
+  UT_ASSERT_NOT_EFI_ERROR (mPrivateData.Smbios.Remove (&mPrivateData.Smbios, 5));
+  UT_ASSERT_STATUS_EQUAL (mPrivateData.Smbios.Remove (&mPrivateData.Smbios, 5), EFI_INVALID_PARAMETER);
+  Handle = SMBIOS_HANDLE_PI_RESERVED;
+  UT_ASSERT_NOT_EFI_ERROR (mPrivateData.Smbios.Add (&mPrivateData.Smbios, NULL, &Handle, (EFI_SMBIOS_TABLE_HEADER *) Buffer));
+  UT_ASSERT_EQUAL (Handle, 5);
+  Handle = SMBIOS_HANDLE_PI_RESERVED;
+  UT_ASSERT_NOT_EFI_ERROR (mPrivateData.Smbios.Add (&mPrivateData.Smbios, NULL, &Handle, (EFI_SMBIOS_TABLE_HEADER *) Buffer));
+  UT_ASSERT_EQUAL (Handle, 300);
+  return UNIT_TEST_PASSED;
+}
+
+#ifdef UNIT_TEST_BENCHMARK
+/**
+  Compare the time to add records with the tables built at every record, and
+  with the tables built once at EndOfDxe.
+**/
+UNIT_TEST_STATUS
+EFIAPI
+DeferredTablesBenchmark (
+  IN UNIT_TEST_CONTEXT  Context
+  )
+{
+  STATIC CONST UINTN  Counts[] = { 256, 1024, 4096 };
+  UINTN               Index;
+  clock_t             Start;
+  clock_t             Immediate;
+  clock_t             Deferred;
+
+  for (Index = 0; Index < ARRAY_SIZE (Counts); Index++) {
+    UT_ASSERT_NOT_EFI_ERROR (ResetSmbiosDriver (FALSE));
+    Start = clock ();
+    UT_ASSERT_NOT_EFI_ERROR (AddTestRecords (0, Counts[Index], FALSE));
+    Immediate = clock () - Start;
+
+    UT_ASSERT_NOT_EFI_ERROR (ResetSmbiosDriver (TRUE));
+    Start = clock ();
+    UT_ASSERT_NOT_EFI_ERROR (AddTestRecords (0, Counts[Index], FALSE));
+    SignalEndOfDxe ();
+    Deferred = clock () - Start;
+
+    UT_LOG_INFO (
+      "%d records: %d us building at every record, %d us building at EndOfDxe\n",
+      (INT32) Counts[Index],
+      (INT32) ((UINT64) Immediate * 1000000 / CLOCKS_PER_SEC),
+      (INT32) ((UINT64) Deferred * 1000000 / CLOCKS_PER_SEC)
+      );
+    UT_ASSERT_TRUE (Deferred <= Immediate);
+  }
+  return UNIT_TEST_PASSED;
+}
+#endif
+
+///================================================================================================
+///================================================================================================
+///
+/// TEST ENGINE
+///
+///================================================================================================
+///================================================================================================
+
+/**
+  SmbiosDxe Unit Test main
+**/
+VOID
+UnitTestMain (
+  VOID
+  )
+{
+  EFI_STATUS                  Status;
+  UNIT_TEST_FRAMEWORK_HANDLE  Framework;
+  UNIT_TEST_SUITE_HANDLE      DeferredTests;
+
+  Framework = NULL;
+
+  DEBUG ((DEBUG_INFO, "%a v%a\n", UNIT_TEST_NAME, UNIT_TEST_VERSION));
+
+  Status = InitUnitTestFramework (&Framework, UNIT_TEST_NAME, gEfiCallerBaseName, UNIT_TEST_VERSION);
+  if (EFI_ERROR (Status)) {
+    DEBUG ((DEBUG_ERROR, "Failed in InitUnitTestFramework. Status = %r\n", Status));
+    goto EXIT;
+  }
+
+  Status = CreateUnitTestSuite (&DeferredTests, Framework, "Deferred SMBIOS Tables", "SmbiosDxe.Deferred", NULL, NULL);
+  if (EFI_ERROR (Status)) {
+    DEBUG ((DEBUG_ERROR, "Failed in CreateUnitTestSuite for the deferred table tests\n"));
+    Status = EFI_OUT_OF_RESOURCES;
+    goto EXIT;
+  }
+  AddTestCase (
+    DeferredTests,
+    "The tables built at EndOfDxe are the ones built at every record",
+    "TablesMatch",
+    DeferredTablesMatch,
+    BuildExpectedTables,
+    FreeExpectedTables,
+    (UNIT_TEST_CONTEXT) &mWithoutChanges
+    );
+  AddTestCase (
+    DeferredTests,
+    "The tables built at EndOfDxe reflect the strings updated and the records removed",
+    "TablesMatchAfterChanges",
+    DeferredTablesMatch,
+    BuildExpectedTables,
+    FreeExpectedTables,
+    (UNIT_TEST_CONTEXT) &mWithChanges
+    );
+  AddTestCase (
+    DeferredTests,
+    "The records changed after EndOfDxe are published immediately",
+    "AddAfterEndOfDxe",
+    AddAfterEndOfDxe,
+    NULL,
+    NULL,
+    NULL
+    );
+  AddTestCase (
+    DeferredTests,
+    "The lowest free handle is assigned and the handles in use are rejected",
+    "HandleAllocation",
+    HandleAllocation,
+    NULL,
+    NULL,
+    NULL
+    );
+#ifdef UNIT_TEST_BENCHMARK
+  AddTestCase (
+    DeferredTests,
+    "Time to add records with and without deferring the tables",
+    "Benchmark",
+    DeferredTablesBenchmark,
+    NULL,
+    NULL,
+    NULL
+    );
+#endif
+
+  Status = RunAllTestSuites (Framework);
+
+EXIT:
+  if (Framework != NULL) {
+    FreeUnitTestFramework (Framework);
+  }
+}
+
+///
+/// Avoid ECC error for function name that starts with lower case letter
+///
+#define Main main
+
+/**
+  Standard POSIX C entry point for host based unit test execution.
+
+  @param[in] Argc  Number of arguments
+  @param[in] Argv  Array of pointers to arguments
+
+  @retval 0      Success
+  @retval other  Error
+**/
+INT32
+Main (
+  IN INT32  Argc,
+  IN CHAR8  *Argv[]
+  )
+{
+  UnitTestMain ();
+  return 0;
+}
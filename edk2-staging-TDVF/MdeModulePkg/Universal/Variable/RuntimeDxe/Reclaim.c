@@ -8,6 +8,40 @@ SPDX-License-Identifier: BSD-2-Clause-Patent
 **/
 
 #include "Variable.h"
+#include "VariableParsing.h"
+#include "VariableRuntimeCache.h"
+
+//
+// The maximum number of FTW writes done by one incremental reclaim step.
+//
+#define INCREMENTAL_RECLAIM_WRITES_PER_STEP  3
+
+//
+// Phases of the incremental reclaim of the non-volatile variable store.
+//
+typedef enum {
+  IncrementalReclaimIdle,
+  IncrementalReclaimCompact,
+  IncrementalReclaimErase,
+  IncrementalReclaimDisabled
+} INCREMENTAL_RECLAIM_PHASE;
+
+//
+// State of the incremental reclaim. All offsets are relative to the start of
+// the non-volatile variable store header.
+//
+typedef struct {
+  INCREMENTAL_RECLAIM_PHASE  Phase;
+  UINTN                      WindowSize;
+  UINT8                      *Buffer;
+  UINTN                      CompactOffset;
+  UINTN                      FillerEnd;
+  UINTN                      CleanStart;
+  UINTN                      CleanEnd;
+  UINTN                      CheckedLastOffset;
+} VARIABLE_INCREMENTAL_RECLAIM;
+
+VARIABLE_INCREMENTAL_RECLAIM  mIncrementalReclaim;
 
 /**
   Gets LBA of block and offset by given address.
@@ -153,3 +187,550 @@ FtwVariableSpace (
 
   return Status;
 }
+
+/**
+  Writes a buffer to a range of the variable storage space, using the Fault
+  Tolerant Write protocol.
+
+  Unlike FtwVariableSpace(), only Length bytes at Address are rewritten, so
+  the cost of the write is bounded by the size of the range, not by the size
+  of the variable store.
+
+  @param  Address        Base address of the range to write.
+  @param  Buffer         Point to the data to write.
+  @param  Length         Length in bytes of the range.
+
+  @retval EFI_SUCCESS    The function completed successfully.
+  @retval EFI_NOT_FOUND  Fail to locate Fault Tolerant Write protocol.
+  @retval EFI_ABORTED    The function could not complete successfully.
+
+**/
+EFI_STATUS
+FtwVariableRegion (
+  IN EFI_PHYSICAL_ADDRESS   Address,
+  IN VOID                   *Buffer,
+  IN UINTN                  Length
+  )
+{
+  EFI_STATUS                         Status;
+  EFI_HANDLE                         FvbHandle;
+  EFI_LBA                            Lba;
+  UINTN                              Offset;
+  EFI_FAULT_TOLERANT_WRITE_PROTOCOL  *FtwProtocol;
+
+  Status = GetFtwProtocol ((VOID **) &FtwProtocol);
+  if (EFI_ERROR (Status)) {
+    return EFI_NOT_FOUND;
+  }
+  Status = GetFvbInfoByAddress (Address, &FvbHandle, NULL);
+  if (EFI_ERROR (Status)) {
+    return Status;
+  }
+  Status = GetLbaAndOffsetByAddress (Address, &Lba, &Offset);
+  if (EFI_ERROR (Status)) {
+    return EFI_ABORTED;
+  }
+
+  return FtwProtocol->Write (
+                        FtwProtocol,
+                        Lba,
+                        Offset,
+                        Length,
+                        NULL,
+                        FvbHandle,
+                        Buffer
+                        );
+}
+
+/**
+  Check whether a variable is kept by reclaim.
+
+  @param[in] Variable   Pointer to the variable header.
+
+  @retval TRUE          The variable is valid, or in deleted transition.
+  @retval FALSE         The variable is garbage.
+
+**/
+STATIC
+BOOLEAN
+IsLiveVariable (
+  IN VARIABLE_HEADER  *Variable
+  )
+{
+  return (BOOLEAN) ((Variable->State == VAR_ADDED) ||
+                    (Variable->State == (VAR_ADDED & VAR_IN_DELETED_TRANSITION)));
+}
+
+/**
+  Recalculate the space used by the non-volatile variables, and the offset of
+  the last non-volatile variable, from the non-volatile variable cache.
+
+**/
+STATIC
+VOID
+RecalculateNonVolatileVariableSpace (
+  VOID
+  )
+{
+  VARIABLE_HEADER  *Variable;
+  VARIABLE_HEADER  *NextVariable;
+  UINTN            VariableSize;
+  BOOLEAN          AuthFormat;
+
+  AuthFormat = mVariableModuleGlobal->VariableGlobal.AuthFormat;
+
+  mVariableModuleGlobal->HwErrVariableTotalSize = 0;
+  mVariableModuleGlobal->CommonVariableTotalSize = 0;
+  mVariableModuleGlobal->CommonUserVariableTotalSize = 0;
+  Variable = GetStartPointer (mNvVariableCache);
+  while (IsValidVariableHeader (Variable, GetEndPointer (mNvVariableCache))) {
+    NextVariable = GetNextVariablePtr (Variable, AuthFormat);
+    VariableSize = (UINTN) NextVariable - (UINTN) Variable;
+    if ((Variable->Attributes & EFI_VARIABLE_HARDWARE_ERROR_RECORD) ==
+        EFI_VARIABLE_HARDWARE_ERROR_RECORD) {
+      mVariableModuleGlobal->HwErrVariableTotalSize += VariableSize;
+    } else {
+      mVariableModuleGlobal->CommonVariableTotalSize += VariableSize;
+      if (IsUserVariable (Variable)) {
+        mVariableModuleGlobal->CommonUserVariableTotalSize += VariableSize;
+      }
+    }
+
+    Variable = NextVariable;
+  }
+  mVariableModuleGlobal->NonVolatileLastVariableOffset =
+    (UINTN) Variable - (UINTN) mNvVariableCache;
+}
+
+/**
+  Write a range of the non-volatile variable store from the reclaim buffer,
+  and mirror it into the non-volatile variable cache.
+
+  @param[in] Offset      Offset of the range in the variable store.
+  @param[in] Length      Length in bytes of the range.
+  @param[in] Moved       TRUE if variables have moved, so the space usage,
+                         the lookup indexes and the runtime cache must be
+                         rebuilt.
+
+  @retval EFI_SUCCESS    The range has been written.
+  @return                Error codes from FtwVariableRegion(). The cache has
+                         been reloaded from the variable store.
+
+**/
+STATIC
+EFI_STATUS
+IncrementalReclaimWrite (
+  IN UINTN    Offset,
+  IN UINTN    Length,
+  IN BOOLEAN  Moved
+  )
+{
+  EFI_STATUS            Status;
+  EFI_PHYSICAL_ADDRESS  VariableBase;
+
+  VariableBase = mVariableModuleGlobal->VariableGlobal.NonVolatileVariableBase;
+  Status = FtwVariableRegion (VariableBase + Offset, mIncrementalReclaim.Buffer, Length);
+  if (EFI_ERROR (Status)) {
+    //
+    // The range may have been partially written, re-read it.
+    //
+    CopyMem (
+      (UINT8 *) mNvVariableCache + Offset,
+      (UINT8 *) (UINTN) VariableBase + Offset,
+      Length
+      );
+    Moved = TRUE;
+  } else {
+    CopyMem (
+      (UINT8 *) mNvVariableCache + Offset,
+      mIncrementalReclaim.Buffer,
+      Length
+      );
+  }
+
+  if (Moved) {
+    RecalculateNonVolatileVariableSpace ();
+    VariableIndexInvalidate (
+      GetStartPointer ((VARIABLE_STORE_HEADER *) (UINTN) VariableBase)
+      );
+    VariableIndexInvalidate (GetStartPointer (mNvVariableCache));
+    //
+    // An update at offset 0 makes the runtime cache users drop their indexes.
+    //
+    Length += Offset;
+    Offset  = 0;
+  }
+  SynchronizeRuntimeVariableCache (
+    &mVariableModuleGlobal->VariableGlobal.VariableRuntimeCacheContext.VariableRuntimeNvCache,
+    Offset,
+    Length
+    );
+
+  return Status;
+}
+
+/**
+  Check whether the non-volatile variable store is worth compacting, and find
+  the first variable that is not live.
+
+  @param[out] GarbageOffset   The offset of the first variable that is not
+                              live.
+
+  @retval TRUE                The store should be compacted.
+  @retval FALSE               The store has enough free space, or too little
+                              garbage to reclaim incrementally.
+
+**/
+STATIC
+BOOLEAN
+IncrementalReclaimNeeded (
+  OUT UINTN  *GarbageOffset
+  )
+{
+  VARIABLE_HEADER  *Variable;
+  VARIABLE_HEADER  *NextVariable;
+  UINTN            LastOffset;
+  UINTN            FreeSize;
+  UINTN            GarbageSize;
+  BOOLEAN          AuthFormat;
+
+  LastOffset = mVariableModuleGlobal->NonVolatileLastVariableOffset;
+  if (LastOffset == mIncrementalReclaim.CheckedLastOffset) {
+    return FALSE;
+  }
+  mIncrementalReclaim.CheckedLastOffset = LastOffset;
+
+  FreeSize = mNvVariableCache->Size - LastOffset;
+  if ((FreeSize >= mNvVariableCache->Size / 4) &&
+      (FreeSize >= 2 * GetMaxVariableSize ())) {
+    return FALSE;
+  }
+
+  AuthFormat     = mVariableModuleGlobal->VariableGlobal.AuthFormat;
+  GarbageSize    = 0;
+  *GarbageOffset = 0;
+  Variable = GetStartPointer (mNvVariableCache);
+  while (IsValidVariableHeader (Variable, GetEndPointer (mNvVariableCache))) {
+    NextVariable = GetNextVariablePtr (Variable, AuthFormat);
+    if (!IsLiveVariable (Variable)) {
+      if (GarbageSize == 0) {
+        *GarbageOffset = (UINTN) Variable - (UINTN) mNvVariableCache;
+      }
+      GarbageSize += (UINTN) NextVariable - (UINTN) Variable;
+    }
+    Variable = NextVariable;
+  }
+
+  return (BOOLEAN) (GarbageSize >= mIncrementalReclaim.WindowSize);
+}
+
+/**
+  Compact one window of the non-volatile variable store.
+
+  Live variables following the compacted prefix are copied down over the
+  garbage, in their original order. A deleted "filler" variable is written
+  after them, covering the remaining space up to the first variable that has
+  not been copied, so that the old copies disappear with the same atomic
+  write that creates the new ones.
+
+  @retval EFI_SUCCESS    One window has been compacted.
+  @retval EFI_ABORTED    No progress can be made.
+  @return                Error codes from FtwVariableRegion().
+
+**/
+STATIC
+EFI_STATUS
+IncrementalReclaimCompactWindow (
+  VOID
+  )
+{
+  EFI_STATUS       Status;
+  UINT8            *Store;
+  UINTN            StartOffset;
+  UINTN            LastOffset;
+  UINTN            WindowStart;
+  UINTN            WindowEnd;
+  UINTN            BlockSize;
+  UINTN            HeaderSize;
+  UINTN            FillerSize;
+  UINTN            Offset;
+  UINTN            VariableSize;
+  UINTN            Moved;
+  VARIABLE_HEADER  *Variable;
+  VARIABLE_HEADER  *NextVariable;
+  VARIABLE_HEADER  *Filler;
+  BOOLEAN          AuthFormat;
+
+  AuthFormat  = mVariableModuleGlobal->VariableGlobal.AuthFormat;
+  Store       = (UINT8 *) mNvVariableCache;
+  StartOffset = (UINTN) GetStartPointer (mNvVariableCache) - (UINTN) Store;
+  LastOffset  = mVariableModuleGlobal->NonVolatileLastVariableOffset;
+  HeaderSize  = GetVariableHeaderSize (AuthFormat);
+  FillerSize  = HEADER_ALIGN (HeaderSize + sizeof (CHAR16));
+
+  //
+  // The window starts at the block holding the first variable that is not
+  // live, so the FTW write touches as few blocks as possible.
+  //
+  BlockSize   = mNvFvHeaderCache->BlockMap[0].Length;
+  WindowStart = mNvFvHeaderCache->HeaderLength + mIncrementalReclaim.CompactOffset;
+  WindowStart = WindowStart - WindowStart % BlockSize;
+  WindowStart = MAX (WindowStart, mNvFvHeaderCache->HeaderLength + StartOffset) -
+                mNvFvHeaderCache->HeaderLength;
+  WindowEnd   = MIN (WindowStart + mIncrementalReclaim.WindowSize,
+                  mNvVariableCache->Size);
+
+  CopyMem (mIncrementalReclaim.Buffer, Store + WindowStart, WindowEnd - WindowStart);
+
+  //
+  // Copy live variables down while they, and a filler after them, fit.
+  //
+  Offset   = mIncrementalReclaim.CompactOffset;
+  Moved    = 0;
+  Variable = (VARIABLE_HEADER *) (Store + Offset);
+  while (IsValidVariableHeader (Variable, GetEndPointer (mNvVariableCache))) {
+    NextVariable = GetNextVariablePtr (Variable, AuthFormat);
+    VariableSize = (UINTN) NextVariable - (UINTN) Variable;
+    if (IsLiveVariable (Variable)) {
+      if (Offset + VariableSize + FillerSize > WindowEnd) {
+        break;
+      }
+      CopyMem (mIncrementalReclaim.Buffer + Offset - WindowStart, Variable, VariableSize);
+      Offset += VariableSize;
+      Moved++;
+    }
+    Variable = NextVariable;
+  }
+  //
+  // The next variable to move, or the end of the variables.
+  //
+  StartOffset = (UINTN) Variable - (UINTN) Store;
+
+  if ((Moved == 0) && (StartOffset < LastOffset)) {
+    return EFI_ABORTED;
+  }
+  if ((StartOffset - Offset) < FillerSize) {
+    //
+    // The space before the first live variable is always at least the size
+    // of the first variable that is not live, unless the store is corrupted.
+    //
+    return EFI_ABORTED;
+  }
+
+  if ((StartOffset == LastOffset) &&
+      ((LastOffset <= WindowEnd) ||
+       ((mIncrementalReclaim.CleanStart <= WindowEnd) &&
+        (mIncrementalReclaim.CleanEnd >= LastOffset)))) {
+    //
+    // Everything after the window is already erased, finish the compaction.
+    //
+    SetMem (mIncrementalReclaim.Buffer + Offset - WindowStart, WindowEnd - Offset, 0xff);
+    Status = IncrementalReclaimWrite (WindowStart, WindowEnd - WindowStart, TRUE);
+    if (EFI_ERROR (Status)) {
+      return Status;
+    }
+
+    DEBUG ((DEBUG_INFO, "Variable: incremental reclaim done, last offset 0x%x\n",
+      mVariableModuleGlobal->NonVolatileLastVariableOffset));
+    mIncrementalReclaim.Phase             = IncrementalReclaimIdle;
+    mIncrementalReclaim.CheckedLastOffset =
+      mVariableModuleGlobal->NonVolatileLastVariableOffset;
+    return EFI_SUCCESS;
+  }
+
+  //
+  // Hide the old copies behind a deleted filler variable.
+  //
+  Filler = (VARIABLE_HEADER *) (mIncrementalReclaim.Buffer + Offset - WindowStart);
+  SetMem (Filler, MIN (StartOffset, WindowEnd) - Offset, 0xff);
+  ZeroMem (Filler, HeaderSize + sizeof (CHAR16));
+  Filler->StartId = VARIABLE_DATA;
+  Filler->State   = VAR_ADDED & VAR_DELETED;
+  SetNameSizeOfVariable (Filler, sizeof (CHAR16), AuthFormat);
+  SetDataSizeOfVariable (
+    Filler,
+    StartOffset - Offset - HeaderSize - sizeof (CHAR16),
+    AuthFormat
+    );
+
+  Status = IncrementalReclaimWrite (WindowStart, WindowEnd - WindowStart, TRUE);
+  if (EFI_ERROR (Status)) {
+    return Status;
+  }
+
+  mIncrementalReclaim.CompactOffset = Offset;
+  mIncrementalReclaim.FillerEnd     = StartOffset;
+
+  //
+  // Keep track of the erased range following the window. It only shrinks
+  // when a window is written over it, since variables are always added
+  // after the filler.
+  //
+  if (mIncrementalReclaim.CleanStart < WindowEnd) {
+    mIncrementalReclaim.CleanStart = WindowEnd;
+  }
+  if ((mIncrementalReclaim.CleanStart >= mIncrementalReclaim.CleanEnd) ||
+      (mIncrementalReclaim.CleanStart > WindowEnd)) {
+    mIncrementalReclaim.CleanStart = WindowEnd;
+    mIncrementalReclaim.CleanEnd   = WindowEnd;
+  }
+
+  if (StartOffset == LastOffset) {
+    //
+    // All live variables are packed; erase the old copies past the window,
+    // then come back to drop the filler.
+    //
+    mIncrementalReclaim.Phase = IncrementalReclaimErase;
+  }
+
+  return EFI_SUCCESS;
+}
+
+/**
+  Erase one window of the old variable copies behind the filler variable.
+
+  @retval EFI_SUCCESS    One window has been erased.
+  @return                Error codes from FtwVariableRegion().
+
+**/
+STATIC
+EFI_STATUS
+IncrementalReclaimEraseWindow (
+  VOID
+  )
+{
+  EFI_STATUS  Status;
+  UINTN       Length;
+
+  Length = MIN (mIncrementalReclaim.WindowSize,
+             mIncrementalReclaim.FillerEnd - mIncrementalReclaim.CleanEnd);
+  SetMem (mIncrementalReclaim.Buffer, Length, 0xff);
+  Status = IncrementalReclaimWrite (mIncrementalReclaim.CleanEnd, Length, FALSE);
+  if (EFI_ERROR (Status)) {
+    return Status;
+  }
+
+  mIncrementalReclaim.CleanEnd += Length;
+  if (mIncrementalReclaim.CleanEnd >= mIncrementalReclaim.FillerEnd) {
+    mIncrementalReclaim.Phase = IncrementalReclaimCompact;
+  }
+
+  return EFI_SUCCESS;
+}
+
+/**
+  Forget the progress of the incremental reclaim.
+
+  Called after a full reclaim of the non-volatile variable store.
+
+**/
+VOID
+VariableIncrementalReclaimReset (
+  VOID
+  )
+{
+  if (mIncrementalReclaim.Phase != IncrementalReclaimDisabled) {
+    mIncrementalReclaim.Phase = IncrementalReclaimIdle;
+  }
+  mIncrementalReclaim.CleanStart        = 0;
+  mIncrementalReclaim.CleanEnd          = 0;
+  mIncrementalReclaim.CheckedLastOffset = 0;
+}
+
+/**
+  Make bounded progress on reclaiming the non-volatile variable store.
+
+  Each call rewrites at most INCREMENTAL_RECLAIM_WRITES_PER_STEP regions of
+  PcdVariableIncrementalReclaimRegionSize bytes (or one flash block plus one
+  maximum sized variable, if larger) of the store through FTW, so the store
+  is compacted without the cost of rewriting it as a whole. Every step leaves
+  the store consistent, so the compaction may be interrupted at any point.
+  Reclaim() is still used when a variable does not fit.
+
+  The caller must hold the variable services lock.
+
+**/
+VOID
+VariableIncrementalReclaimStep (
+  VOID
+  )
+{
+  EFI_STATUS  Status;
+  VOID        *FtwProtocol;
+  UINTN       BlockSize;
+  UINTN       Index;
+
+  if ((PcdGet32 (PcdVariableIncrementalReclaimRegionSize) == 0) ||
+      mVariableModuleGlobal->VariableGlobal.EmuNvMode ||
+      (mIncrementalReclaim.Phase == IncrementalReclaimDisabled)) {
+    return;
+  }
+  if (EFI_ERROR (GetFtwProtocol (&FtwProtocol))) {
+    return;
+  }
+
+  if (mIncrementalReclaim.Phase == IncrementalReclaimIdle) {
+    if (mIncrementalReclaim.WindowSize == 0) {
+      BlockSize = mNvFvHeaderCache->BlockMap[0].Length;
+      mIncrementalReclaim.WindowSize = MAX (
+        PcdGet32 (PcdVariableIncrementalReclaimRegionSize),
+        BlockSize + GetMaxVariableSize () +
+        HEADER_ALIGN (
+          GetVariableHeaderSize (
+            mVariableModuleGlobal->VariableGlobal.AuthFormat
+            ) + sizeof (CHAR16)
+          )
+        );
+      mIncrementalReclaim.WindowSize = ALIGN_VALUE (
+                                         mIncrementalReclaim.WindowSize,
+                                         BlockSize
+                                         );
+      mIncrementalReclaim.WindowSize = MIN (
+                                         mIncrementalReclaim.WindowSize,
+                                         mNvVariableCache->Size
+                                         );
+    }
+    if (!IncrementalReclaimNeeded (&mIncrementalReclaim.CompactOffset)) {
+      return;
+    }
+    if (mIncrementalReclaim.Buffer == NULL) {
+      if (AtRuntime ()) {
+        return;
+      }
+      mIncrementalReclaim.Buffer = AllocateRuntimePool (mIncrementalReclaim.WindowSize);
+      if (mIncrementalReclaim.Buffer == NULL) {
+        return;
+      }
+    }
+    mIncrementalReclaim.Phase = IncrementalReclaimCompact;
+  }
+
+  //
+  // Moving the variables appended since the last step, erasing their old
+  // copies and dropping the filler takes three writes; allowing them in one
+  // step lets the compaction complete while variables keep being added.
+  //
+  Status = EFI_SUCCESS;
+  for (Index = 0; Index < INCREMENTAL_RECLAIM_WRITES_PER_STEP; Index++) {
+    if (mIncrementalReclaim.Phase == IncrementalReclaimCompact) {
+      Status = IncrementalReclaimCompactWindow ();
+    } else if (mIncrementalReclaim.Phase == IncrementalReclaimErase) {
+      Status = IncrementalReclaimEraseWindow ();
+    } else {
+      break;
+    }
+    if (EFI_ERROR (Status)) {
+      break;
+    }
+  }
+
+  if (EFI_ERROR (Status)) {
+    DEBUG ((DEBUG_ERROR, "Variable: incremental reclaim stopped - %r\n", Status));
+    //
+    // The store is consistent whatever the outcome of the step, but the
+    // compaction may not be; leave the store to the full reclaim.
+    //
+    RecalculateNonVolatileVariableSpace ();
+    mIncrementalReclaim.Phase = IncrementalReclaimDisabled;
+  }
+}
@@ -0,0 +1,876 @@
+/** @file
+  This is a host-based unit test for the incremental reclaim of the
+  non-volatile variable store.
+
+  The non-volatile store lives in a memory buffer that stands for the flash
+  device, behind stubs of the Firmware Volume Block and Fault Tolerant Write
+  protocols. The compaction is interrupted at each of its FTW writes in turn,
+  with the interrupted write either lost or completed, as it may be across a
+  power failure. After every step, the store on flash must hold the same live
+  variables, in the same order, and be erased past the last variable; the
+  cache and the space usage computed by the driver must match the flash.
+
+  Copyright (c) 2021, Intel Corporation. All rights reserved.<BR>
+  SPDX-License-Identifier: BSD-2-Clause-Patent
+
+**/
+
+#include <stdio.h>
+#include <string.h>
+#include <stdarg.h>
+#include <stddef.h>
+#include <setjmp.h>
+#include <cmocka.h>
+
+#include <Uefi.h>
+#include <Library/DebugLib.h>
+#include <Library/BaseLib.h>
+#include <Library/BaseMemoryLib.h>
+#include <Library/MemoryAllocationLib.h>
+#include <Library/UnitTestLib.h>
+
+///=== CODE UNDER TEST ===========================================================================
+
+//
+// Reclaim.c is included rather than linked, so that the test can reach the
+// state of the incremental reclaim and RecalculateNonVolatileVariableSpace().
+//
+#include "../Reclaim.c"
+
+#define UNIT_TEST_NAME        "Variable Incremental Reclaim Unit Test"
+#define UNIT_TEST_VERSION     "1.0"
+
+///=== TEST DATA ==================================================================================
+
+#define TEST_BLOCK_SIZE           SIZE_4KB
+#define TEST_BLOCK_COUNT          32
+#define TEST_MAX_VARIABLE_SIZE    0x400
+#define TEST_MAX_DATA_SIZE        0xC0
+#define TEST_MAX_VARIABLES        1024
+#define TEST_MAX_STEPS            256
+
+//
+// Test GUID 1 {0B4F3A86-7D25-4E91-A1C8-5F60E2D7B934}
+//
+EFI_GUID  mTestGuid1 = {
+  0x0b4f3a86, 0x7d25, 0x4e91, {0xa1, 0xc8, 0x5f, 0x60, 0xe2, 0xd7, 0xb9, 0x34}
+};
+
+//
+// Test GUID 2 {E6D21C47-98F3-4A0B-B25E-C37A1490F8D6}
+//
+EFI_GUID  mTestGuid2 = {
+  0xe6d21c47, 0x98f3, 0x4a0b, {0xb2, 0x5e, 0xc3, 0x7a, 0x14, 0x90, 0xf8, 0xd6}
+};
+
+///
+/// Context of a test case.
+///
+typedef struct {
+  BOOLEAN           AuthFormat;
+  //
+  // The flash device, holding the firmware volume of the variable store.
+  //
+  UINT8             *Flash;
+  //
+  // The live variables the store must hold, in order.
+  //
+  VARIABLE_HEADER   *Expected[TEST_MAX_VARIABLES];
+  UINTN             ExpectedCount;
+  UINTN             NextNumber;
+} INCREMENTAL_RECLAIM_TEST_CONTEXT;
+
+INCREMENTAL_RECLAIM_TEST_CONTEXT  mNormalContext = { FALSE };
+INCREMENTAL_RECLAIM_TEST_CONTEXT  mAuthContext   = { TRUE };
+
+VARIABLE_MODULE_GLOBAL      *mVariableModuleGlobal;
+EFI_FIRMWARE_VOLUME_HEADER  *mNvFvHeaderCache;
+VARIABLE_STORE_HEADER       *mNvVariableCache;
+
+//
+// Fault injection: the FTW write number mFailWrite (counting from 1) fails.
+// It reaches the flash if mFailedWriteApplied is TRUE.
+//
+UINTN    mWriteCount;
+UINTN    mFailWrite;
+BOOLEAN  mFailedWriteApplied;
+UINTN    mEraseWrites;
+
+UINT8                               *mTestFlash;
+EFI_FIRMWARE_VOLUME_BLOCK_PROTOCOL  mTestFvb;
+EFI_FAULT_TOLERANT_WRITE_PROTOCOL   mTestFtw;
+
+///=== HELPER FUNCTIONS ===========================================================================
+
+/**
+  Stub of the variable driver function that reports whether ExitBootServices()
+  has been called.
+
+  @retval FALSE  The tests run at boot time.
+**/
+BOOLEAN
+AtRuntime (
+  VOID
+  )
+{
+  return FALSE;
+}
+
+/**
+  Stub of the variable driver function that returns the maximum size of a
+  variable.
+
+  @return TEST_MAX_VARIABLE_SIZE.
+**/
+UINTN
+GetMaxVariableSize (
+  VOID
+  )
+{
+  return TEST_MAX_VARIABLE_SIZE;
+}
+
+/**
+  Stub of the variable driver function that tells user variables apart. The
+  variables of mTestGuid1 are user variables.
+
+  @param[in] Variable   Pointer to the variable header.
+
+  @retval TRUE          The variable is a user variable.
+  @retval FALSE         The variable is not a user variable.
+**/
+BOOLEAN
+IsUserVariable (
+  IN VARIABLE_HEADER    *Variable
+  )
+{
+  return CompareGuid (
+           GetVendorGuidPtr (Variable, mVariableModuleGlobal->VariableGlobal.AuthFormat),
+           &mTestGuid1
+           );
+}
+
+/**
+  Stub of the runtime cache synchronization; the tests have no runtime cache.
+
+  @param[in] VariableRuntimeCache   Not used.
+  @param[in] Offset                 Not used.
+  @param[in] Length                 Not used.
+
+  @retval EFI_SUCCESS               Always.
+**/
+EFI_STATUS
+SynchronizeRuntimeVariableCache (
+  IN  VARIABLE_RUNTIME_CACHE          *VariableRuntimeCache,
+  IN  UINTN                           Offset,
+  IN  UINTN                           Length
+  )
+{
+  return EFI_SUCCESS;
+}
+
+/**
+  Return the base address of the test flash device.
+
+  @param[in]  This      Not used.
+  @param[out] Address   The base address of the firmware volume.
+
+  @retval EFI_SUCCESS   Always.
+**/
+EFI_STATUS
+EFIAPI
+TestFvbGetPhysicalAddress (
+  IN CONST EFI_FIRMWARE_VOLUME_BLOCK_PROTOCOL  *This,
+  OUT      EFI_PHYSICAL_ADDRESS                *Address
+  )
+{
+  *Address = (EFI_PHYSICAL_ADDRESS) (UINTN) mTestFlash;
+  return EFI_SUCCESS;
+}
+
+/**
+  Stub of the variable driver function that finds the FVB of an address.
+  There is a single FVB, the test flash device.
+
+  @param[in]  Address       Not used.
+  @param[out] FvbHandle     The handle of the FVB.
+  @param[out] FvbProtocol   The FVB protocol.
+
+  @retval EFI_SUCCESS       Always.
+**/
+EFI_STATUS
+GetFvbInfoByAddress (
+  IN  EFI_PHYSICAL_ADDRESS                Address,
+  OUT EFI_HANDLE                          *FvbHandle OPTIONAL,
+  OUT EFI_FIRMWARE_VOLUME_BLOCK_PROTOCOL  **FvbProtocol OPTIONAL
+  )
+{
+  if (FvbHandle != NULL) {
+    *FvbHandle = (EFI_HANDLE) &mTestFvb;
+  }
+  if (FvbProtocol != NULL) {
+    *FvbProtocol = &mTestFvb;
+  }
+  return EFI_SUCCESS;
+}
+
+/**
+  Write to the test flash device, failing the write selected by mFailWrite.
+
+  @param[in] This          Not used.
+  @param[in] Lba           The logical block address of the target block.
+  @param[in] Offset        The offset within the target block.
+  @param[in] Length        The number of bytes to write.
+  @param[in] PrivateData   Not used.
+  @param[in] FvbHandle     Not used.
+  @param[in] Buffer        The data to write.
+
+  @retval EFI_SUCCESS       The data was written.
+  @retval EFI_DEVICE_ERROR  The write was interrupted.
+**/
+EFI_STATUS
+EFIAPI
+TestFtwWrite (
+  IN EFI_FAULT_TOLERANT_WRITE_PROTOCOL     *This,
+  IN EFI_LBA                               Lba,
+  IN UINTN                                 Offset,
+  IN UINTN                                 Length,
+  IN VOID                                  *PrivateData,
+  IN EFI_HANDLE                            FvbHandle,
+  IN VOID                                  *Buffer
+  )
+{
+  mWriteCount++;
+  if (mIncrementalReclaim.Phase == IncrementalReclaimErase) {
+    mEraseWrites++;
+  }
+
+  if ((mWriteCount != mFailWrite) || mFailedWriteApplied) {
+    CopyMem (mTestFlash + (UINTN) Lba * TEST_BLOCK_SIZE + Offset, Buffer, Length);
+  }
+  return (mWriteCount == mFailWrite) ? EFI_DEVICE_ERROR : EFI_SUCCESS;
+}
+
+/**
+  Stub of the variable driver function that locates the FTW protocol.
+
+  @param[out] FtwProtocol   The FTW protocol.
+
+  @retval EFI_SUCCESS       Always.
+**/
+EFI_STATUS
+GetFtwProtocol (
+  OUT VOID  **FtwProtocol
+  )
+{
+  *FtwProtocol = &mTestFtw;
+  return EFI_SUCCESS;
+}
+
+/**
+  Return the size of a variable, without the alignment padding.
+
+  @param[in] Variable     Pointer to the variable header.
+  @param[in] AuthFormat   TRUE if the authenticated variable format is used.
+
+  @return The size of the variable.
+**/
+STATIC
+UINTN
+TestVariableSize (
+  IN VARIABLE_HEADER  *Variable,
+  IN BOOLEAN          AuthFormat
+  )
+{
+  return (UINTN) GetVariableDataPtr (Variable, AuthFormat) +
+         DataSizeOfVariable (Variable, AuthFormat) - (UINTN) Variable;
+}
+
+/**
+  Write a test variable to a buffer. The name, data size and data are derived
+  from the number of the variable.
+
+  @param[in]  Context     The test context.
+  @param[out] Variable    The buffer for the variable.
+  @param[in]  Number      Number of the variable.
+  @param[in]  State       State of the variable.
+
+  @return The size of the variable, with the alignment padding.
+**/
+STATIC
+UINTN
+BuildTestVariable (
+  IN  INCREMENTAL_RECLAIM_TEST_CONTEXT  *Context,
+  OUT VARIABLE_HEADER                   *Variable,
+  IN  UINTN                             Number,
+  IN  UINT8                             State
+  )
+{
+  STATIC CONST CHAR16  HexDigits[] = L"0123456789ABCDEF";
+  CHAR16               Name[12];
+  UINTN                Index;
+  UINTN                DataSize;
+
+  StrCpyS (Name, ARRAY_SIZE (Name), L"TestVarXXXX");
+  for (Index = 0; Index < 4; Index++) {
+    Name[10 - Index] = HexDigits[(Number >> (Index * 4)) & 0xF];
+  }
+  DataSize = (Number * 37) % TEST_MAX_DATA_SIZE + 1;
+
+  ZeroMem (Variable, GetVariableHeaderSize (Context->AuthFormat));
+  Variable->StartId    = VARIABLE_DATA;
+  Variable->State      = State;
+  Variable->Attributes = EFI_VARIABLE_NON_VOLATILE | EFI_VARIABLE_BOOTSERVICE_ACCESS;
+  if ((Number % 7) == 3) {
+    Variable->Attributes |= EFI_VARIABLE_HARDWARE_ERROR_RECORD | EFI_VARIABLE_RUNTIME_ACCESS;
+  }
+  SetNameSizeOfVariable (Variable, sizeof (Name), Context->AuthFormat);
+  SetDataSizeOfVariable (Variable, DataSize, Context->AuthFormat);
+  CopyGuid (
+    GetVendorGuidPtr (Variable, Context->AuthFormat),
+    ((Number % 2) == 0) ? &mTestGuid1 : &mTestGuid2
+    );
+  CopyMem (GetVariableNamePtr (Variable, Context->AuthFormat), Name, sizeof (Name));
+  SetMem (GetVariableDataPtr (Variable, Context->AuthFormat), DataSize, (UINT8) Number);
+
+  return (UINTN) GetNextVariablePtr (Variable, Context->AuthFormat) - (UINTN) Variable;
+}
+
+/**
+  Append a test variable to the store on flash and to the cache, as
+  SetVariable() does, and account for it.
+
+  @param[in, out] Context     The test context.
+  @param[in]      State       State of the variable.
+
+  @retval TRUE    The variable has been appended.
+  @retval FALSE   The store is full.
+**/
+STATIC
+BOOLEAN
+AppendTestVariable (
+  IN OUT INCREMENTAL_RECLAIM_TEST_CONTEXT  *Context,
+  IN     UINT8                             State
+  )
+{
+  UINTN            Offset;
+  UINTN            VariableSize;
+  VARIABLE_HEADER  *Variable;
+
+  Offset = mVariableModuleGlobal->NonVolatileLastVariableOffset;
+  if ((Offset + TEST_MAX_VARIABLE_SIZE > mNvVariableCache->Size) ||
+      (Context->ExpectedCount == TEST_MAX_VARIABLES)) {
+    return FALSE;
+  }
+
+  Variable     = (VARIABLE_HEADER *) ((UINT8 *) mNvVariableCache + Offset);
+  VariableSize = BuildTestVariable (Context, Variable, Context->NextNumber++, State);
+  CopyMem (
+    (UINT8 *) (UINTN) mVariableModuleGlobal->VariableGlobal.NonVolatileVariableBase + Offset,
+    Variable,
+    VariableSize
+    );
+
+  if ((Variable->Attributes & EFI_VARIABLE_HARDWARE_ERROR_RECORD) == EFI_VARIABLE_HARDWARE_ERROR_RECORD) {
+    mVariableModuleGlobal->HwErrVariableTotalSize += VariableSize;
+  } else {
+    mVariableModuleGlobal->CommonVariableTotalSize += VariableSize;
+    if (IsUserVariable (Variable)) {
+      mVariableModuleGlobal->CommonUserVariableTotalSize += VariableSize;
+    }
+  }
+  mVariableModuleGlobal->NonVolatileLastVariableOffset += VariableSize;
+
+  if (IsLiveVariable (Variable)) {
+    Context->Expected[Context->ExpectedCount] = AllocateCopyPool (VariableSize, Variable);
+    Context->ExpectedCount++;
+  }
+  return TRUE;
+}
+
+/**
+  Load the driver state from the store on flash, as the variable driver does
+  at boot. The incremental reclaim starts over.
+
+  @param[in] Context  The test context.
+**/
+STATIC
+VOID
+LoadDriverState (
+  IN INCREMENTAL_RECLAIM_TEST_CONTEXT  *Context
+  )
+{
+  EFI_FIRMWARE_VOLUME_HEADER  *FvHeader;
+
+  FvHeader = (EFI_FIRMWARE_VOLUME_HEADER *) Context->Flash;
+  CopyMem (mNvFvHeaderCache, FvHeader, (UINTN) FvHeader->FvLength);
+
+  if (mIncrementalReclaim.Buffer != NULL) {
+    FreePool (mIncrementalReclaim.Buffer);
+  }
+  ZeroMem (&mIncrementalReclaim, sizeof (mIncrementalReclaim));
+  VariableIndexInvalidate (NULL);
+  RecalculateNonVolatileVariableSpace ();
+}
+
+/**
+  Check the store on flash: it holds the expected live variables in order,
+  and it is erased past the last variable.
+
+  @param[in]  Context     The test context.
+  @param[out] LastOffset  The offset of the end of the last variable.
+  @param[out] Compacted   TRUE if the store holds no garbage.
+
+  @retval TRUE    The store is consistent.
+  @retval FALSE   The store is corrupted.
+**/
+STATIC
+BOOLEAN
+CheckFlashStore (
+  IN  INCREMENTAL_RECLAIM_TEST_CONTEXT  *Context,
+  OUT UINTN                             *LastOffset,
+  OUT BOOLEAN                           *Compacted
+  )
+{
+  VARIABLE_STORE_HEADER  *Store;
+  VARIABLE_HEADER        *Variable;
+  UINT8                  *Byte;
+  UINTN                  LiveCount;
+
+  Store      = (VARIABLE_STORE_HEADER *) (UINTN) mVariableModuleGlobal->VariableGlobal.NonVolatileVariableBase;
+  LiveCount  = 0;
+  *Compacted = TRUE;
+  Variable   = GetStartPointer (Store);
+  while (IsValidVariableHeader (Variable, GetEndPointer (Store))) {
+    if (IsLiveVariable (Variable)) {
+      if ((LiveCount == Context->ExpectedCount) ||
+          (TestVariableSize (Variable, Context->AuthFormat) != TestVariableSize (Context->Expected[LiveCount], Context->AuthFormat)) ||
+          (CompareMem (Variable, Context->Expected[LiveCount], TestVariableSize (Variable, Context->AuthFormat)) != 0)) {
+        return FALSE;
+      }
+      LiveCount++;
+    } else {
+      *Compacted = FALSE;
+    }
+    Variable = GetNextVariablePtr (Variable, Context->AuthFormat);
+  }
+  if (LiveCount != Context->ExpectedCount) {
+    return FALSE;
+  }
+
+  *LastOffset = (UINTN) Variable - (UINTN) Store;
+  for (Byte = (UINT8 *) Variable; Byte < (UINT8 *) GetEndPointer (Store); Byte++) {
+    if (*Byte != 0xFF) {
+      return FALSE;
+    }
+  }
+  return TRUE;
+}
+
+/**
+  Check that the cache matches the flash, and that the space usage tracked by
+  the driver matches the result of RecalculateNonVolatileVariableSpace().
+
+  @param[in]  Context     The test context.
+
+  @retval TRUE    The driver state is consistent.
+  @retval FALSE   The driver state is stale.
+**/
+STATIC
+BOOLEAN
+CheckDriverState (
+  IN INCREMENTAL_RECLAIM_TEST_CONTEXT  *Context
+  )
+{
+  VARIABLE_MODULE_GLOBAL  Tracked;
+
+  if (CompareMem (mNvFvHeaderCache, Context->Flash, (UINTN) mNvFvHeaderCache->FvLength) != 0) {
+    return FALSE;
+  }
+
+  CopyMem (&Tracked, mVariableModuleGlobal, sizeof (Tracked));
+  RecalculateNonVolatileVariableSpace ();
+  return (BOOLEAN) ((Tracked.NonVolatileLastVariableOffset == mVariableModuleGlobal->NonVolatileLastVariableOffset) &&
+                    (Tracked.CommonVariableTotalSize == mVariableModuleGlobal->CommonVariableTotalSize) &&
+                    (Tracked.CommonUserVariableTotalSize == mVariableModuleGlobal->CommonUserVariableTotalSize) &&
+                    (Tracked.HwErrVariableTotalSize == mVariableModuleGlobal->HwErrVariableTotalSize));
+}
+
+/**
+  Run incremental reclaim steps until the compaction completes or stops,
+  appending a variable after every other step, and check the store and the
+  driver state after each step.
+
+  @param[in, out] Context   The test context.
+
+  @retval TRUE    The store and the driver state stayed consistent.
+  @retval FALSE   A check failed.
+**/
+STATIC
+BOOLEAN
+RunIncrementalReclaim (
+  IN OUT INCREMENTAL_RECLAIM_TEST_CONTEXT  *Context
+  )
+{
+  UINTN    Step;
+  UINTN    LastOffset;
+  BOOLEAN  Compacted;
+
+  for (Step = 0; Step < TEST_MAX_STEPS; Step++) {
+    VariableIncrementalReclaimStep ();
+
+    if (!CheckFlashStore (Context, &LastOffset, &Compacted) ||
+        !CheckDriverState (Context) ||
+        (LastOffset != mVariableModuleGlobal->NonVolatileLastVariableOffset)) {
+      return FALSE;
+    }
+
+    if ((mIncrementalReclaim.Phase != IncrementalReclaimCompact) &&
+        (mIncrementalReclaim.Phase != IncrementalReclaimErase)) {
+      return TRUE;
+    }
+    if ((Step % 2) == 1) {
+      AppendTestVariable (Context, VAR_ADDED);
+    }
+  }
+  return FALSE;
+}
+
+/**
+  Build a nearly full variable store on the test flash device, two thirds of
+  it garbage, and load the driver state from it.
+
+  @param[in, out] Context   The test context.
+**/
+STATIC
+VOID
+BuildTestStore (
+  IN OUT INCREMENTAL_RECLAIM_TEST_CONTEXT  *Context
+  )
+{
+  EFI_FIRMWARE_VOLUME_HEADER  *FvHeader;
+  VARIABLE_STORE_HEADER       *Store;
+  UINTN                       Index;
+  UINT8                       State;
+
+  for (Index = 0; Index < Context->ExpectedCount; Index++) {
+    FreePool (Context->Expected[Index]);
+  }
+  Context->ExpectedCount = 0;
+  Context->NextNumber    = 0;
+
+  FvHeader = (EFI_FIRMWARE_VOLUME_HEADER *) Context->Flash;
+  SetMem (Context->Flash, TEST_BLOCK_SIZE * TEST_BLOCK_COUNT, 0xFF);
+  ZeroMem (FvHeader, sizeof (*FvHeader) + sizeof (EFI_FV_BLOCK_MAP_ENTRY));
+  FvHeader->FvLength               = TEST_BLOCK_SIZE * TEST_BLOCK_COUNT;
+  FvHeader->Signature              = EFI_FVH_SIGNATURE;
+  FvHeader->HeaderLength           = (UINT16) (sizeof (*FvHeader) + sizeof (EFI_FV_BLOCK_MAP_ENTRY));
+  FvHeader->Revision               = EFI_FVH_REVISION;
+  FvHeader->BlockMap[0].NumBlocks  = TEST_BLOCK_COUNT;
+  FvHeader->BlockMap[0].Length     = TEST_BLOCK_SIZE;
+
+  Store = (VARIABLE_STORE_HEADER *) (Context->Flash + FvHeader->HeaderLength);
+  ZeroMem (Store, sizeof (*Store));
+  CopyGuid (
+    &Store->Signature,
+    Context->AuthFormat ? &gEfiAuthenticatedVariableGuid : &gEfiVariableGuid
+    );
+  Store->Size   = (UINT32) (FvHeader->FvLength - FvHeader->HeaderLength);
+  Store->Format = VARIABLE_STORE_FORMATTED;
+  Store->State  = VARIABLE_STORE_HEALTHY;
+
+  mVariableModuleGlobal->VariableGlobal.NonVolatileVariableBase = (EFI_PHYSICAL_ADDRESS) (UINTN) Store;
+  mVariableModuleGlobal->VariableGlobal.AuthFormat              = Context->AuthFormat;
+  mNvVariableCache = (VARIABLE_STORE_HEADER *) ((UINT8 *) mNvFvHeaderCache + FvHeader->HeaderLength);
+  LoadDriverState (Context);
+
+  //
+  // Fill the store up to 7/8 of its size, which triggers the compaction.
+  //
+  for (Index = 0; mVariableModuleGlobal->NonVolatileLastVariableOffset < Store->Size / 8 * 7; Index++) {
+    switch (Index % 6) {
+    case 0:
+      State = VAR_ADDED;
+      break;
+    case 1:
+      State = VAR_ADDED & VAR_IN_DELETED_TRANSITION;
+      break;
+    case 2:
+      State = VAR_HEADER_VALID_ONLY;
+      break;
+    default:
+      State = VAR_ADDED & VAR_DELETED;
+      break;
+    }
+    AppendTestVariable (Context, State);
+  }
+  LoadDriverState (Context);
+}
+
+/**
+  Allocate the test flash device and the driver state for a test case.
+
+  @param[in]  Context  Unit test case context
+**/
+STATIC
+UNIT_TEST_STATUS
+EFIAPI
+CreateTestFlash (
+  IN UNIT_TEST_CONTEXT  Context
+  )
+{
+  INCREMENTAL_RECLAIM_TEST_CONTEXT  *TestContext;
+
+  TestContext = (INCREMENTAL_RECLAIM_TEST_CONTEXT *) Context;
+
+  mTestFvb.GetPhysicalAddress = TestFvbGetPhysicalAddress;
+  mTestFtw.Write              = TestFtwWrite;
+
+  TestContext->Flash    = AllocatePool (TEST_BLOCK_SIZE * TEST_BLOCK_COUNT);
+  mNvFvHeaderCache      = AllocatePool (TEST_BLOCK_SIZE * TEST_BLOCK_COUNT);
+  mVariableModuleGlobal = AllocateZeroPool (sizeof (*mVariableModuleGlobal));
+  mTestFlash            = TestContext->Flash;
+  if ((TestContext->Flash == NULL) || (mNvFvHeaderCache == NULL) || (mVariableModuleGlobal == NULL)) {
+    return UNIT_TEST_ERROR_PREREQUISITE_NOT_MET;
+  }
+  TestContext->ExpectedCount = 0;
+  return UNIT_TEST_PASSED;
+}
+
+/**
+  Free the test flash device and the driver state of a test case.
+
+  @param[in]  Context  Unit test case context
+**/
+STATIC
+VOID
+EFIAPI
+DestroyTestFlash (
+  IN UNIT_TEST_CONTEXT  Context
+  )
+{
+  INCREMENTAL_RECLAIM_TEST_CONTEXT  *TestContext;
+  UINTN                             Index;
+
+  TestContext = (INCREMENTAL_RECLAIM_TEST_CONTEXT *) Context;
+
+  VariableIndexInvalidate (NULL);
+  if (mIncrementalReclaim.Buffer != NULL) {
+    FreePool (mIncrementalReclaim.Buffer);
+  }
+  ZeroMem (&mIncrementalReclaim, sizeof (mIncrementalReclaim));
+  for (Index = 0; Index < TestContext->ExpectedCount; Index++) {
+    FreePool (TestContext->Expected[Index]);
+  }
+  TestContext->ExpectedCount = 0;
+
+  if (TestContext->Flash != NULL) {
+    FreePool (TestContext->Flash);
+    TestContext->Flash = NULL;
+    mTestFlash         = NULL;
+  }
+  if (mNvFvHeaderCache != NULL) {
+    FreePool (mNvFvHeaderCache);
+    mNvFvHeaderCache = NULL;
+  }
+  if (mVariableModuleGlobal != NULL) {
+    FreePool (mVariableModuleGlobal);
+    mVariableModuleGlobal = NULL;
+  }
+}
+
+///=== TEST CASES =================================================================================
+
+/**
+  Without interruption, the compaction runs through both phases and leaves
+  the store packed.
+
+  @param[in]  Context  Unit test case context
+**/
+UNIT_TEST_STATUS
+EFIAPI
+ReclaimCompactsStore (
+  IN UNIT_TEST_CONTEXT  Context
+  )
+{
+  INCREMENTAL_RECLAIM_TEST_CONTEXT  *TestContext;
+  UINTN                             LastOffset;
+  BOOLEAN                           Compacted;
+  UINTN                             LastOffsetBefore;
+
+  TestContext = (INCREMENTAL_RECLAIM_TEST_CONTEXT *) Context;
+
+  BuildTestStore (TestContext);
+  LastOffsetBefore = mVariableModuleGlobal->NonVolatileLastVariableOffset;
+  mWriteCount  = 0;
+  mFailWrite   = 0;
+  mEraseWrites = 0;
+
+  UT_ASSERT_TRUE (RunIncrementalReclaim (TestContext));
+  UT_ASSERT_EQUAL (mIncrementalReclaim.Phase, IncrementalReclaimIdle);
+  UT_ASSERT_TRUE (mWriteCount > 2);
+  UT_ASSERT_TRUE (mEraseWrites > 0);
+
+  UT_ASSERT_TRUE (CheckFlashStore (TestContext, &LastOffset, &Compacted));
+  UT_ASSERT_TRUE (Compacted);
+  UT_ASSERT_TRUE (LastOffset < LastOffsetBefore / 2);
+
+  return UNIT_TEST_PASSED;
+}
+
+/**
+  Interrupt the compaction at each of its writes in turn, with the write lost
+  and with the write completed. The store must stay consistent, and once the
+  driver restarts from the store on flash, the compaction must complete.
+
+  @param[in]  Context  Unit test case context
+**/
+UNIT_TEST_STATUS
+EFIAPI
+ReclaimSurvivesInterruptedWrites (
+  IN UNIT_TEST_CONTEXT  Context
+  )
+{
+  INCREMENTAL_RECLAIM_TEST_CONTEXT  *TestContext;
+  UINTN                             FailWrite;
+  UINTN                             Applied;
+  UINTN                             LastOffset;
+  BOOLEAN                           Compacted;
+  BOOLEAN                           Completed;
+
+  TestContext = (INCREMENTAL_RECLAIM_TEST_CONTEXT *) Context;
+
+  Completed = FALSE;
+  for (FailWrite = 1; !Completed; FailWrite++) {
+    for (Applied = 0; Applied < 2 && !Completed; Applied++) {
+      BuildTestStore (TestContext);
+      mWriteCount         = 0;
+      mFailWrite          = FailWrite;
+      mFailedWriteApplied = (BOOLEAN) (Applied != 0);
+
+      UT_ASSERT_TRUE (RunIncrementalReclaim (TestContext));
+      if (mWriteCount < FailWrite) {
+        //
+        // The compaction takes fewer writes, every write has been interrupted.
+        //
+        Completed = TRUE;
+      } else {
+        //
+        // The failed write stops the compaction for this boot.
+        //
+        UT_ASSERT_EQUAL (mIncrementalReclaim.Phase, IncrementalReclaimDisabled);
+
+        //
+        // Restart from the store on flash.
+        //
+        LoadDriverState (TestContext);
+        mFailWrite = 0;
+        UT_ASSERT_TRUE (CheckDriverState (TestContext));
+        UT_ASSERT_TRUE (RunIncrementalReclaim (TestContext));
+      }
+      UT_ASSERT_EQUAL (mIncrementalReclaim.Phase, IncrementalReclaimIdle);
+      UT_ASSERT_TRUE (CheckFlashStore (TestContext, &LastOffset, &Compacted));
+      UT_ASSERT_TRUE (Compacted);
+    }
+  }
+  UT_ASSERT_TRUE (FailWrite > 3);
+
+  return UNIT_TEST_PASSED;
+}
+
+///=== TEST ENGINE ================================================================================
+
+/**
+  Main entry point for this unit test.
+**/
+VOID
+UnitTestMain (
+  VOID
+  )
+{
+  EFI_STATUS                  Status;
+  UNIT_TEST_FRAMEWORK_HANDLE  Framework;
+  UNIT_TEST_SUITE_HANDLE      ReclaimTests;
+
+  Framework = NULL;
+
+  DEBUG ((DEBUG_INFO, "%a v%a\n", UNIT_TEST_NAME, UNIT_TEST_VERSION));
+
+  //
+  // Start setting up the test framework for running the tests.
+  //
+  Status = InitUnitTestFramework (&Framework, UNIT_TEST_NAME, gEfiCallerBaseName, UNIT_TEST_VERSION);
+  if (EFI_ERROR (Status)) {
+    DEBUG ((DEBUG_ERROR, "Failed in InitUnitTestFramework. Status = %r\n", Status));
+    goto EXIT;
+  }
+
+  //
+  // Add all test suites and tests.
+  //
+  Status = CreateUnitTestSuite (
+             &ReclaimTests, Framework,
+             "Variable Incremental Reclaim Tests", "Variable.IncrementalReclaim", NULL, NULL
+             );
+  if (EFI_ERROR (Status)) {
+    DEBUG ((DEBUG_ERROR, "Failed in CreateUnitTestSuite for ReclaimTests\n"));
+    Status = EFI_OUT_OF_RESOURCES;
+    goto EXIT;
+  }
+  AddTestCase (
+    ReclaimTests,
+    "Incremental reclaim should pack the store", "Compact",
+    ReclaimCompactsStore, CreateTestFlash, DestroyTestFlash, &mNormalContext
+    );
+  AddTestCase (
+    ReclaimTests,
+    "Incremental reclaim should pack the store (authenticated format)", "CompactAuth",
+    ReclaimCompactsStore, CreateTestFlash, DestroyTestFlash, &mAuthContext
+    );
+  AddTestCase (
+    ReclaimTests,
+    "Store should stay consistent when any write is interrupted", "Interrupted",
+    ReclaimSurvivesInterruptedWrites, CreateTestFlash, DestroyTestFlash, &mNormalContext
+    );
+  AddTestCase (
+    ReclaimTests,
+    "Store should stay consistent when any write is interrupted (authenticated format)", "InterruptedAuth",
+    ReclaimSurvivesInterruptedWrites, CreateTestFlash, DestroyTestFlash, &mAuthContext
+    );
+
+  //
+  // Execute the tests.
+  //
+  Status = RunAllTestSuites (Framework);
+
+EXIT:
+  if (Framework != NULL) {
+    FreeUnitTestFramework (Framework);
+  }
+
+  return;
+}
+
+///
+/// Avoid ECC error for function name that starts with lower case letter
+///
+#define Main main
+
+/**
+  Standard POSIX C entry point for host based unit test execution.
+
+  @param[in] Argc  Number of arguments
+  @param[in] Argv  Array of pointers to arguments
+
+  @retval 0      Success
+  @retval other  Error
+**/
+INT32
+Main (
+  IN INT32  Argc,
+  IN CHAR8  *Argv[]
+  )
+{
+  UnitTestMain ();
+  return 0;
+}
@@ -0,0 +1,753 @@
+/** @file
+  This is a host-based unit test for the variable store lookup index used by
+  FindVariableEx().
+
+  Every lookup through the index is checked against a linear walk of the
+  variable store, which is the lookup algorithm the index replaces.
+
+  A benchmark of the index against the linear walk is built when
+  UNIT_TEST_BENCHMARK is defined, e.g. with -DUNIT_TEST_BENCHMARK in the
+  CC_FLAGS of the host test DSC. It is not part of the default run, as its
+  timings depend on the host.
+
+  Copyright (c) 2021, Intel Corporation. All rights reserved.<BR>
+  SPDX-License-Identifier: BSD-2-Clause-Patent
+
+**/
+
+#include <stdio.h>
+#include <string.h>
+#include <stdarg.h>
+#include <stddef.h>
+#include <setjmp.h>
+#ifdef UNIT_TEST_BENCHMARK
+#include <time.h>
+#endif
+#include <cmocka.h>
+
+#include <Uefi.h>
+#include <Library/DebugLib.h>
+#include <Library/BaseLib.h>
+#include <Library/BaseMemoryLib.h>
+#include <Library/MemoryAllocationLib.h>
+#include <Library/UnitTestLib.h>
+
+#include "../VariableParsing.h"
+
+#define UNIT_TEST_NAME        "Variable Store Index Unit Test"
+#define UNIT_TEST_VERSION     "1.0"
+
+///=== TEST DATA ==================================================================================
+
+#define TEST_STORE_SIZE           SIZE_4MB
+#define TEST_VARIABLE_COUNT       4096
+#define TEST_DATA_SIZE            16
+#define TEST_BENCHMARK_ROUNDS     4
+
+//
+// Test GUID 1 {5A8C1B4E-38A3-4C4E-9E5B-0B8F7C2D6E31}
+//
+EFI_GUID  mTestGuid1 = {
+  0x5a8c1b4e, 0x38a3, 0x4c4e, {0x9e, 0x5b, 0x0b, 0x8f, 0x7c, 0x2d, 0x6e, 0x31}
+};
+
+//
+// Test GUID 2 {C2F0E7A9-6D1B-4B7A-8E44-91A3D65B0F72}
+//
+EFI_GUID  mTestGuid2 = {
+  0xc2f0e7a9, 0x6d1b, 0x4b7a, {0x8e, 0x44, 0x91, 0xa3, 0xd6, 0x5b, 0x0f, 0x72}
+};
+
+///
+/// Context of a test case.
+///
+typedef struct {
+  BOOLEAN                 AuthFormat;
+  VARIABLE_STORE_HEADER   *Store;
+  VARIABLE_HEADER         *LastVariable;
+} VARIABLE_INDEX_TEST_CONTEXT;
+
+VARIABLE_INDEX_TEST_CONTEXT  mNormalContext = { FALSE, NULL, NULL };
+VARIABLE_INDEX_TEST_CONTEXT  mAuthContext   = { TRUE,  NULL, NULL };
+
+BOOLEAN  mAtRuntime = FALSE;
+
+///=== HELPER FUNCTIONS ===========================================================================
+
+/**
+  Stub of the variable driver function that reports whether ExitBootServices()
+  has been called.
+
+  @retval TRUE If ExitBootServices () has been called.
+**/
+BOOLEAN
+AtRuntime (
+  VOID
+  )
+{
+  return mAtRuntime;
+}
+
+/**
+  Build the name of a test variable, "TestVarXXXX" with XXXX the hex number
+  of the variable.
+
+  @param[in]  Number  Number of the variable.
+  @param[out] Name    Buffer of at least 12 characters for the name.
+**/
+STATIC
+VOID
+TestVariableName (
+  IN  UINTN   Number,
+  OUT CHAR16  *Name
+  )
+{
+  STATIC CONST CHAR16  HexDigits[] = L"0123456789ABCDEF";
+  UINTN                Index;
+
+  StrCpyS (Name, 12, L"TestVarXXXX");
+  for (Index = 0; Index < 4; Index++) {
+    Name[10 - Index] = HexDigits[(Number >> (Index * 4)) & 0xF];
+  }
+}
+
+/**
+  Append a variable to the test variable store.
+
+  @param[in, out] Context     The test context that owns the store.
+  @param[in]      Name        Name of the variable.
+  @param[in]      VendorGuid  Vendor GUID of the variable.
+  @param[in]      Attributes  Attributes of the variable.
+  @param[in]      State       State of the variable.
+
+  @return The header of the appended variable.
+**/
+STATIC
+VARIABLE_HEADER *
+AppendTestVariable (
+  IN OUT VARIABLE_INDEX_TEST_CONTEXT  *Context,
+  IN     CHAR16                       *Name,
+  IN     EFI_GUID                     *VendorGuid,
+  IN     UINT32                       Attributes,
+  IN     UINT8                        State
+  )
+{
+  VARIABLE_HEADER  *Variable;
+
+  if (Context->LastVariable == NULL) {
+    Variable = GetStartPointer (Context->Store);
+  } else {
+    Variable = GetNextVariablePtr (Context->LastVariable, Context->AuthFormat);
+  }
+
+  ZeroMem (Variable, GetVariableHeaderSize (Context->AuthFormat));
+  Variable->StartId    = VARIABLE_DATA;
+  Variable->State      = State;
+  Variable->Attributes = Attributes;
+  SetNameSizeOfVariable (Variable, StrSize (Name), Context->AuthFormat);
+  SetDataSizeOfVariable (Variable, TEST_DATA_SIZE, Context->AuthFormat);
+  CopyGuid (GetVendorGuidPtr (Variable, Context->AuthFormat), VendorGuid);
+  CopyMem (GetVariableNamePtr (Variable, Context->AuthFormat), Name, StrSize (Name));
+  SetMem (GetVariableDataPtr (Variable, Context->AuthFormat), TEST_DATA_SIZE, (UINT8) StrLen (Name));
+
+  Context->LastVariable = Variable;
+  return Variable;
+}
+
+/**
+  The linear variable store walk that the index replaces.
+
+  @param[in]       VariableName        Name of the variable to be found
+  @param[in]       VendorGuid          Vendor GUID to be found.
+  @param[in]       IgnoreRtCheck       Ignore EFI_VARIABLE_RUNTIME_ACCESS attribute
+                                       check at runtime when searching variable.
+  @param[in, out]  PtrTrack            Variable Track Pointer structure that contains Variable Information.
+  @param[in]       AuthFormat          TRUE indicates authenticated variables are used.
+                                       FALSE indicates authenticated variables are not used.
+
+  @retval          EFI_SUCCESS         Variable found successfully
+  @retval          EFI_NOT_FOUND       Variable not found
+**/
+STATIC
+EFI_STATUS
+LinearFindVariable (
+  IN     CHAR16                  *VariableName,
+  IN     EFI_GUID                *VendorGuid,
+  IN     BOOLEAN                 IgnoreRtCheck,
+  IN OUT VARIABLE_POINTER_TRACK  *PtrTrack,
+  IN     BOOLEAN                 AuthFormat
+  )
+{
+  VARIABLE_HEADER  *InDeletedVariable;
+
+  PtrTrack->InDeletedTransitionPtr = NULL;
+  InDeletedVariable                = NULL;
+
+  for ( PtrTrack->CurrPtr = PtrTrack->StartPtr
+      ; IsValidVariableHeader (PtrTrack->CurrPtr, PtrTrack->EndPtr)
+      ; PtrTrack->CurrPtr = GetNextVariablePtr (PtrTrack->CurrPtr, AuthFormat)
+      ) {
+    if (PtrTrack->CurrPtr->State != VAR_ADDED &&
+        PtrTrack->CurrPtr->State != (VAR_IN_DELETED_TRANSITION & VAR_ADDED)) {
+      continue;
+    }
+    if (!IgnoreRtCheck && AtRuntime () && ((PtrTrack->CurrPtr->Attributes & EFI_VARIABLE_RUNTIME_ACCESS) == 0)) {
+      continue;
+    }
+    if (!CompareGuid (VendorGuid, GetVendorGuidPtr (PtrTrack->CurrPtr, AuthFormat)) ||
+        CompareMem (VariableName, GetVariableNamePtr (PtrTrack->CurrPtr, AuthFormat), NameSizeOfVariable (PtrTrack->CurrPtr, AuthFormat)) != 0) {
+      continue;
+    }
+    if (PtrTrack->CurrPtr->State == (VAR_IN_DELETED_TRANSITION & VAR_ADDED)) {
+      InDeletedVariable = PtrTrack->CurrPtr;
+    } else {
+      PtrTrack->InDeletedTransitionPtr = InDeletedVariable;
+      return EFI_SUCCESS;
+    }
+  }
+
+  PtrTrack->CurrPtr = InDeletedVariable;
+  return (PtrTrack->CurrPtr == NULL) ? EFI_NOT_FOUND : EFI_SUCCESS;
+}
+
+/**
+  Look a variable up with FindVariableEx() and with the linear walk, and check
+  that both produce the same result.
+
+  @param[in] Context        The test context that owns the store.
+  @param[in] VariableName   Name of the variable to be found
+  @param[in] VendorGuid     Vendor GUID to be found.
+  @param[in] IgnoreRtCheck  Ignore EFI_VARIABLE_RUNTIME_ACCESS attribute check.
+
+  @retval TRUE   The results match.
+  @retval FALSE  The results differ.
+**/
+STATIC
+BOOLEAN
+LookupMatchesLinearWalk (
+  IN VARIABLE_INDEX_TEST_CONTEXT  *Context,
+  IN CHAR16                       *VariableName,
+  IN EFI_GUID                     *VendorGuid,
+  IN BOOLEAN                      IgnoreRtCheck
+  )
+{
+  VARIABLE_POINTER_TRACK  Expected;
+  VARIABLE_POINTER_TRACK  Actual;
+  EFI_STATUS              ExpectedStatus;
+  EFI_STATUS              ActualStatus;
+
+  ZeroMem (&Expected, sizeof (Expected));
+  Expected.StartPtr = GetStartPointer (Context->Store);
+  Expected.EndPtr   = GetEndPointer (Context->Store);
+  CopyMem (&Actual, &Expected, sizeof (Actual));
+
+  ExpectedStatus = LinearFindVariable (VariableName, VendorGuid, IgnoreRtCheck, &Expected, Context->AuthFormat);
+  ActualStatus   = FindVariableEx (VariableName, VendorGuid, IgnoreRtCheck, &Actual, Context->AuthFormat);
+
+  return (BOOLEAN) (ExpectedStatus == ActualStatus &&
+                    Expected.CurrPtr == Actual.CurrPtr &&
+                    Expected.InDeletedTransitionPtr == Actual.InDeletedTransitionPtr);
+}
+
+/**
+  Check every lookup of the test variables, and of variables that do not
+  exist, against the linear walk, at boot time and at runtime.
+
+  @param[in] Context  The test context that owns the store.
+  @param[in] Count    Number of test variable names to look up.
+
+  @retval TRUE   All results match.
+  @retval FALSE  A result differs.
+**/
+STATIC
+BOOLEAN
+AllLookupsMatchLinearWalk (
+  IN VARIABLE_INDEX_TEST_CONTEXT  *Context,
+  IN UINTN                        Count
+  )
+{
+  CHAR16   Name[12];
+  UINTN    Number;
+  BOOLEAN  SavedAtRuntime;
+  BOOLEAN  Match;
+
+  SavedAtRuntime = mAtRuntime;
+  Match          = TRUE;
+  for (Number = 0; Match && Number < Count + 16; Number++) {
+    TestVariableName (Number, Name);
+    Match = (BOOLEAN) (LookupMatchesLinearWalk (Context, Name, &mTestGuid1, FALSE) &&
+                       LookupMatchesLinearWalk (Context, Name, &mTestGuid2, FALSE) &&
+                       LookupMatchesLinearWalk (Context, Name, &mTestGuid1, TRUE));
+    if (Match && !SavedAtRuntime) {
+      mAtRuntime = TRUE;
+      Match = (BOOLEAN) (LookupMatchesLinearWalk (Context, Name, &mTestGuid1, FALSE) &&
+                         LookupMatchesLinearWalk (Context, Name, &mTestGuid1, TRUE));
+      mAtRuntime = FALSE;
+    }
+  }
+
+  //
+  // Prefixes and extensions of existing names do not match.
+  //
+  ZeroMem (Name, sizeof (Name));
+  StrCpyS (Name, ARRAY_SIZE (Name), L"TestVar");
+  Match = (BOOLEAN) (Match && LookupMatchesLinearWalk (Context, Name, &mTestGuid1, FALSE));
+  Match = (BOOLEAN) (Match && LookupMatchesLinearWalk (Context, L"TestVar00000", &mTestGuid1, FALSE));
+
+  return Match;
+}
+
+/**
+  Fill the test variable store with variables in every State, with duplicate
+  names as left behind by updates, and with and without runtime access.
+
+  @param[in, out] Context  The test context that owns the store.
+  @param[in]      Count    Number of distinct variable names.
+**/
+STATIC
+VOID
+FillTestStore (
+  IN OUT VARIABLE_INDEX_TEST_CONTEXT  *Context,
+  IN     UINTN                        Count
+  )
+{
+  CHAR16  Name[12];
+  UINTN   Number;
+  UINT32  Attributes;
+
+  for (Number = 0; Number < Count; Number++) {
+    TestVariableName (Number, Name);
+    Attributes = EFI_VARIABLE_BOOTSERVICE_ACCESS;
+    if ((Number % 3) == 0) {
+      Attributes |= EFI_VARIABLE_RUNTIME_ACCESS;
+    }
+
+    switch (Number % 8) {
+    case 0:
+      //
+      // Updated twice, the old copies are deleted.
+      //
+      AppendTestVariable (Context, Name, &mTestGuid1, Attributes, VAR_ADDED & VAR_DELETED);
+      AppendTestVariable (Context, Name, &mTestGuid1, Attributes, VAR_ADDED & VAR_DELETED & VAR_IN_DELETED_TRANSITION);
+      AppendTestVariable (Context, Name, &mTestGuid1, Attributes, VAR_ADDED);
+      break;
+    case 1:
+      //
+      // Update interrupted after the new copy was added.
+      //
+      AppendTestVariable (Context, Name, &mTestGuid1, Attributes, VAR_ADDED & VAR_IN_DELETED_TRANSITION);
+      AppendTestVariable (Context, Name, &mTestGuid1, Attributes, VAR_ADDED);
+      break;
+    case 2:
+      //
+      // Update interrupted before the new copy was added.
+      //
+      AppendTestVariable (Context, Name, &mTestGuid1, Attributes, VAR_ADDED & VAR_IN_DELETED_TRANSITION);
+      AppendTestVariable (Context, Name, &mTestGuid1, Attributes, VAR_HEADER_VALID_ONLY);
+      break;
+    case 3:
+      //
+      // Deleted.
+      //
+      AppendTestVariable (Context, Name, &mTestGuid1, Attributes, VAR_ADDED & VAR_DELETED);
+      break;
+    case 4:
+      //
+      // Same name under both GUIDs.
+      //
+      AppendTestVariable (Context, Name, &mTestGuid2, Attributes, VAR_ADDED);
+      AppendTestVariable (Context, Name, &mTestGuid1, Attributes, VAR_ADDED);
+      break;
+    default:
+      AppendTestVariable (Context, Name, &mTestGuid1, Attributes, VAR_ADDED);
+      break;
+    }
+  }
+}
+
+/**
+  Allocate an empty variable store for a test case.
+
+  @param[in]  Context  Unit test case context
+**/
+STATIC
+UNIT_TEST_STATUS
+EFIAPI
+CreateTestStore (
+  IN UNIT_TEST_CONTEXT  Context
+  )
+{
+  VARIABLE_INDEX_TEST_CONTEXT  *TestContext;
+
+  TestContext = (VARIABLE_INDEX_TEST_CONTEXT *) Context;
+  mAtRuntime  = FALSE;
+
+  TestContext->Store = AllocatePool (TEST_STORE_SIZE);
+  if (TestContext->Store == NULL) {
+    return UNIT_TEST_ERROR_PREREQUISITE_NOT_MET;
+  }
+  SetMem (TestContext->Store, TEST_STORE_SIZE, 0xFF);
+  CopyGuid (
+    &TestContext->Store->Signature,
+    TestContext->AuthFormat ? &gEfiAuthenticatedVariableGuid : &gEfiVariableGuid
+    );
+  TestContext->Store->Size      = TEST_STORE_SIZE;
+  TestContext->Store->Format    = VARIABLE_STORE_FORMATTED;
+  TestContext->Store->State     = VARIABLE_STORE_HEALTHY;
+  TestContext->Store->Reserved  = 0;
+  TestContext->Store->Reserved1 = 0;
+  TestContext->LastVariable     = NULL;
+
+  return UNIT_TEST_PASSED;
+}
+
+/**
+  Drop the index and free the variable store of a test case.
+
+  @param[in]  Context  Unit test case context
+**/
+STATIC
+VOID
+EFIAPI
+DestroyTestStore (
+  IN UNIT_TEST_CONTEXT  Context
+  )
+{
+  VARIABLE_INDEX_TEST_CONTEXT  *TestContext;
+
+  TestContext = (VARIABLE_INDEX_TEST_CONTEXT *) Context;
+  mAtRuntime  = FALSE;
+
+  VariableIndexInvalidate (NULL);
+  FreePool (TestContext->Store);
+  TestContext->Store        = NULL;
+  TestContext->LastVariable = NULL;
+}
+
+///=== TEST CASES =================================================================================
+
+/**
+  Test Case that looks up every variable of a large store through the index.
+  The results are expected to match the linear walk.
+
+  @param[in]  Context  Unit test case context
+**/
+UNIT_TEST_STATUS
+EFIAPI
+IndexMatchesLinearWalk (
+  IN UNIT_TEST_CONTEXT  Context
+  )
+{
+  FillTestStore (Context, TEST_VARIABLE_COUNT);
+  UT_ASSERT_TRUE (AllLookupsMatchLinearWalk (Context, TEST_VARIABLE_COUNT));
+
+  return UNIT_TEST_PASSED;
+}
+
+/**
+  Test Case that appends variables and changes the State of variables after
+  the index was built. The results are expected to match the linear walk.
+
+  @param[in]  Context  Unit test case context
+**/
+UNIT_TEST_STATUS
+EFIAPI
+IndexFollowsStoreUpdates (
+  IN UNIT_TEST_CONTEXT  Context
+  )
+{
+  VARIABLE_INDEX_TEST_CONTEXT  *TestContext;
+  VARIABLE_HEADER              *Variable;
+  CHAR16                       Name[12];
+  UINTN                        Number;
+
+  TestContext = (VARIABLE_INDEX_TEST_CONTEXT *) Context;
+
+  FillTestStore (TestContext, 64);
+  UT_ASSERT_TRUE (AllLookupsMatchLinearWalk (TestContext, 64));
+
+  //
+  // Update every variable: mark the current copy in transition, append the
+  // new copy, and delete the old copy.
+  //
+  for (Number = 0; Number < 64; Number++) {
+    TestVariableName (Number, Name);
+    Variable = AppendTestVariable (TestContext, Name, &mTestGuid1, EFI_VARIABLE_BOOTSERVICE_ACCESS, VAR_HEADER_VALID_ONLY);
+    //
+    // A variable being written is not visible yet.
+    //
+    UT_ASSERT_TRUE (LookupMatchesLinearWalk (TestContext, Name, &mTestGuid1, FALSE));
+    Variable->State = VAR_ADDED;
+    UT_ASSERT_TRUE (LookupMatchesLinearWalk (TestContext, Name, &mTestGuid1, FALSE));
+  }
+  UT_ASSERT_TRUE (AllLookupsMatchLinearWalk (TestContext, 64));
+
+  //
+  // Grow the store far beyond the initial index capacity.
+  //
+  TestContext->LastVariable = NULL;
+  SetMem (GetStartPointer (TestContext->Store), TEST_STORE_SIZE - sizeof (VARIABLE_STORE_HEADER), 0xFF);
+  VariableIndexInvalidate (GetStartPointer (TestContext->Store));
+  FillTestStore (TestContext, 16);
+  UT_ASSERT_TRUE (AllLookupsMatchLinearWalk (TestContext, 16));
+  for (Number = 16; Number < TEST_VARIABLE_COUNT; Number++) {
+    TestVariableName (Number, Name);
+    AppendTestVariable (TestContext, Name, &mTestGuid1, EFI_VARIABLE_BOOTSERVICE_ACCESS, VAR_ADDED);
+  }
+  UT_ASSERT_TRUE (AllLookupsMatchLinearWalk (TestContext, TEST_VARIABLE_COUNT));
+
+  return UNIT_TEST_PASSED;
+}
+
+/**
+  Test Case that rewrites the store as reclaim does and invalidates the index.
+  The results are expected to match the linear walk.
+
+  @param[in]  Context  Unit test case context
+**/
+UNIT_TEST_STATUS
+EFIAPI
+IndexRebuiltAfterInvalidate (
+  IN UNIT_TEST_CONTEXT  Context
+  )
+{
+  VARIABLE_INDEX_TEST_CONTEXT  *TestContext;
+
+  TestContext = (VARIABLE_INDEX_TEST_CONTEXT *) Context;
+
+  FillTestStore (TestContext, 512);
+  UT_ASSERT_TRUE (AllLookupsMatchLinearWalk (TestContext, 512));
+
+  //
+  // Rewrite the store with different variables at the same offsets.
+  //
+  TestContext->LastVariable = NULL;
+  SetMem (GetStartPointer (TestContext->Store), TEST_STORE_SIZE - sizeof (VARIABLE_STORE_HEADER), 0xFF);
+  AppendTestVariable (TestContext, L"Padding", &mTestGuid2, EFI_VARIABLE_BOOTSERVICE_ACCESS, VAR_ADDED);
+  FillTestStore (TestContext, 300);
+  VariableIndexInvalidate (GetStartPointer (TestContext->Store));
+  UT_ASSERT_TRUE (AllLookupsMatchLinearWalk (TestContext, 512));
+
+  //
+  // The same at runtime, where the index table is reused.
+  //
+  mAtRuntime = TRUE;
+  TestContext->LastVariable = NULL;
+  SetMem (GetStartPointer (TestContext->Store), TEST_STORE_SIZE - sizeof (VARIABLE_STORE_HEADER), 0xFF);
+  FillTestStore (TestContext, 200);
+  VariableIndexInvalidate (GetStartPointer (TestContext->Store));
+  UT_ASSERT_TRUE (AllLookupsMatchLinearWalk (TestContext, 300));
+
+  return UNIT_TEST_PASSED;
+}
+
+/**
+  Test Case that fills the store at runtime beyond what the index table can
+  hold. The index cannot grow at runtime, and the results are expected to
+  match the linear walk.
+
+  @param[in]  Context  Unit test case context
+**/
+UNIT_TEST_STATUS
+EFIAPI
+IndexFallsBackAtRuntime (
+  IN UNIT_TEST_CONTEXT  Context
+  )
+{
+  VARIABLE_INDEX_TEST_CONTEXT  *TestContext;
+  CHAR16                       Name[12];
+  UINTN                        Number;
+
+  TestContext = (VARIABLE_INDEX_TEST_CONTEXT *) Context;
+
+  FillTestStore (TestContext, 8);
+  UT_ASSERT_TRUE (AllLookupsMatchLinearWalk (TestContext, 8));
+
+  mAtRuntime = TRUE;
+  for (Number = 8; Number < 1024; Number++) {
+    TestVariableName (Number, Name);
+    AppendTestVariable (TestContext, Name, &mTestGuid1, EFI_VARIABLE_BOOTSERVICE_ACCESS | EFI_VARIABLE_RUNTIME_ACCESS, VAR_ADDED);
+    UT_ASSERT_TRUE (LookupMatchesLinearWalk (TestContext, Name, &mTestGuid1, FALSE));
+  }
+  UT_ASSERT_TRUE (AllLookupsMatchLinearWalk (TestContext, 1024));
+
+  return UNIT_TEST_PASSED;
+}
+
+#ifdef UNIT_TEST_BENCHMARK
+/**
+  Benchmark that compares the time of looking every variable of a large store
+  up through the index and with the linear walk. The timings are logged, the
+  results are expected to match.
+
+  @param[in]  Context  Unit test case context
+**/
+UNIT_TEST_STATUS
+EFIAPI
+IndexLookupBenchmark (
+  IN UNIT_TEST_CONTEXT  Context
+  )
+{
+  VARIABLE_INDEX_TEST_CONTEXT  *TestContext;
+  VARIABLE_POINTER_TRACK       PtrTrack;
+  CHAR16                       Name[12];
+  UINTN                        Round;
+  UINTN                        Number;
+  UINTN                        Found;
+  UINTN                        LinearFound;
+  clock_t                      Start;
+  clock_t                      LinearTicks;
+  clock_t                      IndexTicks;
+
+  TestContext = (VARIABLE_INDEX_TEST_CONTEXT *) Context;
+
+  FillTestStore (TestContext, TEST_VARIABLE_COUNT);
+  ZeroMem (&PtrTrack, sizeof (PtrTrack));
+  PtrTrack.StartPtr = GetStartPointer (TestContext->Store);
+  PtrTrack.EndPtr   = GetEndPointer (TestContext->Store);
+
+  LinearFound = 0;
+  Start       = clock ();
+  for (Round = 0; Round < TEST_BENCHMARK_ROUNDS; Round++) {
+    for (Number = 0; Number < TEST_VARIABLE_COUNT; Number++) {
+      TestVariableName (Number, Name);
+      if (!EFI_ERROR (LinearFindVariable (Name, &mTestGuid1, FALSE, &PtrTrack, TestContext->AuthFormat))) {
+        LinearFound++;
+      }
+    }
+  }
+  LinearTicks = clock () - Start;
+
+  Found = 0;
+  Start = clock ();
+  for (Round = 0; Round < TEST_BENCHMARK_ROUNDS; Round++) {
+    for (Number = 0; Number < TEST_VARIABLE_COUNT; Number++) {
+      TestVariableName (Number, Name);
+      if (!EFI_ERROR (FindVariableEx (Name, &mTestGuid1, FALSE, &PtrTrack, TestContext->AuthFormat))) {
+        Found++;
+      }
+    }
+  }
+  IndexTicks = clock () - Start;
+
+  UT_LOG_INFO (
+    "%d lookups in %d variables: linear walk %d us, index %d us\n",
+    (INT32) (TEST_BENCHMARK_ROUNDS * TEST_VARIABLE_COUNT),
+    (INT32) TEST_VARIABLE_COUNT,
+    (INT32) ((UINT64) LinearTicks * 1000000 / CLOCKS_PER_SEC),
+    (INT32) ((UINT64) IndexTicks * 1000000 / CLOCKS_PER_SEC)
+    );
+  UT_ASSERT_EQUAL (Found, LinearFound);
+
+  return UNIT_TEST_PASSED;
+}
+#endif
+
+///=== TEST ENGINE ================================================================================
+
+/**
+  Main entry point for this unit test.
+**/
+VOID
+UnitTestMain (
+  VOID
+  )
+{
+  EFI_STATUS                  Status;
+  UNIT_TEST_FRAMEWORK_HANDLE  Framework;
+  UNIT_TEST_SUITE_HANDLE      IndexTests;
+
+  Framework = NULL;
+
+  DEBUG ((DEBUG_INFO, "%a v%a\n", UNIT_TEST_NAME, UNIT_TEST_VERSION));
+
+  //
+  // Start setting up the test framework for running the tests.
+  //
+  Status = InitUnitTestFramework (&Framework, UNIT_TEST_NAME, gEfiCallerBaseName, UNIT_TEST_VERSION);
+  if (EFI_ERROR (Status)) {
+    DEBUG ((DEBUG_ERROR, "Failed in InitUnitTestFramework. Status = %r\n", Status));
+    goto EXIT;
+  }
+
+  //
+  // Add all test suites and tests.
+  //
+  Status = CreateUnitTestSuite (
+             &IndexTests, Framework,
+             "Variable Store Index Tests", "Variable.Index", NULL, NULL
+             );
+  if (EFI_ERROR (Status)) {
+    DEBUG ((DEBUG_ERROR, "Failed in CreateUnitTestSuite for IndexTests\n"));
+    Status = EFI_OUT_OF_RESOURCES;
+    goto EXIT;
+  }
+  AddTestCase (
+    IndexTests,
+    "Index lookups should match the linear walk", "MatchLinear",
+    IndexMatchesLinearWalk, CreateTestStore, DestroyTestStore, &mNormalContext
+    );
+  AddTestCase (
+    IndexTests,
+    "Index lookups should match the linear walk (authenticated format)", "MatchLinearAuth",
+    IndexMatchesLinearWalk, CreateTestStore, DestroyTestStore, &mAuthContext
+    );
+  AddTestCase (
+    IndexTests,
+    "Index should follow appended variables and State changes", "Updates",
+    IndexFollowsStoreUpdates, CreateTestStore, DestroyTestStore, &mNormalContext
+    );
+  AddTestCase (
+    IndexTests,
+    "Index should be rebuilt after invalidation", "Invalidate",
+    IndexRebuiltAfterInvalidate, CreateTestStore, DestroyTestStore, &mAuthContext
+    );
+  AddTestCase (
+    IndexTests,
+    "Index should fall back to the linear walk when full at runtime", "RuntimeOverflow",
+    IndexFallsBackAtRuntime, CreateTestStore, DestroyTestStore, &mNormalContext
+    );
+#ifdef UNIT_TEST_BENCHMARK
+  AddTestCase (
+    IndexTests,
+    "Benchmark index lookups against the linear walk", "Benchmark",
+    IndexLookupBenchmark, CreateTestStore, DestroyTestStore, &mAuthContext
+    );
+#endif
+
+  //
+  // Execute the tests.
+  //
+  Status = RunAllTestSuites (Framework);
+
+EXIT:
+  if (Framework != NULL) {
+    FreeUnitTestFramework (Framework);
+  }
+
+  return;
+}
+
+///
+/// Avoid ECC error for function name that starts with lower case letter
+///
+#define Main main
+
+/**
+  Standard POSIX C entry point for host based unit test execution.
+
+  @param[in] Argc  Number of arguments
+  @param[in] Argv  Array of pointers to arguments
+
+  @retval 0      Success
+  @retval other  Error
+**/
+INT32
+Main (
+  IN INT32  Argc,
+  IN CHAR8  *Argv[]
+  )
+{
+  UnitTestMain ();
+  return 0;
+}
@@ -775,6 +775,15 @@ Reclaim (
   }
 
 Done:
+  //
+  // The variables have moved, drop the lookup index of the reclaimed store.
+  //
+  VariableIndexInvalidate (GetStartPointer (VariableStoreHeader));
+  if (!IsVolatile) {
+    VariableIndexInvalidate (GetStartPointer (mNvVariableCache));
+    VariableIncrementalReclaimReset ();
+  }
+
   DoneStatus = EFI_SUCCESS;
   if (IsVolatile || mVariableModuleGlobal->VariableGlobal.EmuNvMode) {
     DoneStatus = SynchronizeRuntimeVariableCache (
@@ -2551,6 +2560,7 @@ VariableServiceSetVariable (
   VARIABLE_HEADER                     *NextVariable;
   EFI_PHYSICAL_ADDRESS                Point;
   UINTN                               PayloadSize;
+  UINTN                               LastVariableOffset;
   BOOLEAN                             AuthFormat;
 
   AuthFormat = mVariableModuleGlobal->VariableGlobal.AuthFormat;
@@ -2746,6 +2756,7 @@ VariableServiceSetVariable (
     }
     mVariableModuleGlobal->NonVolatileLastVariableOffset = (UINTN) NextVariable - (UINTN) Point;
   }
+  LastVariableOffset = mVariableModuleGlobal->NonVolatileLastVariableOffset;
 
   //
   // Check whether the input variable is already existed.
@@ -2788,6 +2799,13 @@ VariableServiceSetVariable (
     Status = UpdateVariable (VariableName, VendorGuid, Data, DataSize, Attributes, 0, 0, &Variable, NULL);
   }
 
+  if (mVariableModuleGlobal->NonVolatileLastVariableOffset != LastVariableOffset) {
+    //
+    // The non-volatile store has grown, make some progress on reclaiming it.
+    //
+    VariableIncrementalReclaimStep ();
+  }
+
 Done:
   InterlockedDecrement (&mVariableModuleGlobal->VariableGlobal.ReentrantState);
   ReleaseLockOnlyAtBootTime (&mVariableModuleGlobal->VariableGlobal.VariableServicesLock);
@@ -3268,6 +3286,11 @@ FlushHobVariableToFlash (
       if (mVariableModuleGlobal->VariableGlobal.VariableRuntimeCacheContext.HobFlushComplete != NULL) {
         *(mVariableModuleGlobal->VariableGlobal.VariableRuntimeCacheContext.HobFlushComplete) = TRUE;
       }
+      //
+      // The HOB variable store is no longer searched, drop its lookup index
+      // before the buffer goes away.
+      //
+      VariableIndexInvalidate (GetStartPointer (VariableStoreHeader));
       if (!AtRuntime ()) {
         FreePool ((VOID *) VariableStoreHeader);
       }
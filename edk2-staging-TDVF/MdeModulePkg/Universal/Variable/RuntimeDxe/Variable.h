@@ -77,6 +77,7 @@ typedef struct {
   VARIABLE_RUNTIME_CACHE  VariableRuntimeHobCache;
   VARIABLE_RUNTIME_CACHE  VariableRuntimeNvCache;
   VARIABLE_RUNTIME_CACHE  VariableRuntimeVolatileCache;
+  UINT32                  *CacheGeneration;
 } VARIABLE_RUNTIME_CACHE_CONTEXT;
 
 typedef struct {
@@ -160,6 +161,62 @@ FtwVariableSpace (
   IN VARIABLE_STORE_HEADER  *VariableBuffer
   );
 
+/**
+  Is user variable?
+
+  @param[in] Variable   Pointer to variable header.
+
+  @retval TRUE          User variable.
+  @retval FALSE         System variable.
+
+**/
+BOOLEAN
+IsUserVariable (
+  IN VARIABLE_HEADER    *Variable
+  );
+
+/**
+  Writes a buffer to a range of the variable storage space, using the Fault
+  Tolerant Write protocol.
+
+  @param  Address        Base address of the range to write.
+  @param  Buffer         Point to the data to write.
+  @param  Length         Length in bytes of the range.
+
+  @retval EFI_SUCCESS    The function completed successfully.
+  @retval EFI_NOT_FOUND  Fail to locate Fault Tolerant Write protocol.
+  @retval EFI_ABORTED    The function could not complete successfully.
+
+**/
+EFI_STATUS
+FtwVariableRegion (
+  IN EFI_PHYSICAL_ADDRESS   Address,
+  IN VOID                   *Buffer,
+  IN UINTN                  Length
+  );
+
+/**
+  Make bounded progress on reclaiming the non-volatile variable store.
+
+  The caller must hold the variable services lock.
+
+**/
+VOID
+VariableIncrementalReclaimStep (
+  VOID
+  );
+
+/**
+  Forget the progress of the incremental reclaim.
+
+  Called after a full reclaim of the non-volatile variable store.
+
+**/
+VOID
+VariableIncrementalReclaimReset (
+  VOID
+  );
+
 /**
   Finds variable in storage blocks of volatile and non-volatile storage areas.
 
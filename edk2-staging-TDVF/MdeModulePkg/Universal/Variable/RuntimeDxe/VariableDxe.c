@@ -11,6 +11,7 @@ SPDX-License-Identifier: BSD-2-Clause-Patent
 **/
 
 #include "Variable.h"
+#include "VariableParsing.h"
 
 #include <Protocol/VariablePolicy.h>
 #include <Library/VariablePolicyLib.h>
@@ -24,6 +25,7 @@ ProtocolIsVariablePolicyEnabled (
 EFI_HANDLE                          mHandle                    = NULL;
 EFI_EVENT                           mVirtualAddressChangeEvent = NULL;
 VOID                                *mFtwRegistration          = NULL;
+EFI_EVENT                           mIncrementalReclaimEvent   = NULL;
 VOID                                ***mVarCheckAddressPointer = NULL;
 UINTN                               mVarCheckAddressPointerCount = 0;
 EDKII_VARIABLE_LOCK_PROTOCOL        mVariableLock              = { VariableLockRequestToLock };
@@ -141,6 +143,7 @@ ReleaseLockOnlyAtBootTime (
   @retval EFI_SUCCESS           The FTW protocol instance was found and returned in FtwProtocol.
   @retval EFI_NOT_FOUND         The FTW protocol instance was not found.
   @retval EFI_INVALID_PARAMETER SarProtocol is NULL.
+  @retval EFI_UNSUPPORTED       Boot services are no longer available.
 
 **/
 EFI_STATUS
@@ -150,6 +153,10 @@ GetFtwProtocol (
 {
   EFI_STATUS                              Status;
 
+  if (AtRuntime ()) {
+    return EFI_UNSUPPORTED;
+  }
+
   //
   // Locate Fault Tolerent Write protocol
   //
@@ -265,6 +272,7 @@ VariableClassAddressChangeEvent (
   EfiConvertPointer (0x0, (VOID **) &mVariableModuleGlobal);
   EfiConvertPointer (0x0, (VOID **) &mNvVariableCache);
   EfiConvertPointer (0x0, (VOID **) &mNvFvHeaderCache);
+  VariableIndexConvertPointers (EfiConvertPointer);
 
   if (mAuthContextOut.AddressPointer != NULL) {
     for (Index = 0; Index < mAuthContextOut.AddressPointerCount; Index++) {
@@ -315,6 +323,10 @@ OnReadyToBoot (
     //
     InitializeVariableQuota ();
   }
+  if (mIncrementalReclaimEvent != NULL) {
+    gBS->CloseEvent (mIncrementalReclaimEvent);
+    mIncrementalReclaimEvent = NULL;
+  }
   ReclaimForOS ();
   if (FeaturePcdGet (PcdVariableCollectStatistics)) {
     if (mVariableModuleGlobal->VariableGlobal.AuthFormat) {
@@ -362,6 +374,26 @@ OnEndOfDxe (
   gBS->CloseEvent (Event);
 }
 
+/**
+  Timer notification function reclaiming the non-volatile variable store in
+  the background, while the firmware is booting.
+
+  @param  Event        Event whose notification function is being invoked.
+  @param  Context      Pointer to the notification function's context.
+
+**/
+VOID
+EFIAPI
+OnIncrementalReclaimTimer (
+  IN EFI_EVENT                            Event,
+  IN VOID                                 *Context
+  )
+{
+  AcquireLockOnlyAtBootTime (&mVariableModuleGlobal->VariableGlobal.VariableServicesLock);
+  VariableIncrementalReclaimStep ();
+  ReleaseLockOnlyAtBootTime (&mVariableModuleGlobal->VariableGlobal.VariableServicesLock);
+}
+
 /**
   Initializes variable write service for DXE.
 
@@ -384,6 +416,25 @@ VariableWriteServiceInitializeDxe (
   //
   RecordSecureBootPolicyVarData();
 
+  if (!EFI_ERROR (Status) &&
+      !mVariableModuleGlobal->VariableGlobal.EmuNvMode &&
+      (PcdGet32 (PcdVariableIncrementalReclaimRegionSize) != 0)) {
+    //
+    // Reclaim the non-volatile variable store a window at a time until
+    // ReadyToBoot.
+    //
+    Status = gBS->CreateEvent (
+                    EVT_TIMER | EVT_NOTIFY_SIGNAL,
+                    TPL_CALLBACK,
+                    OnIncrementalReclaimTimer,
+                    NULL,
+                    &mIncrementalReclaimEvent
+                    );
+    if (!EFI_ERROR (Status)) {
+      gBS->SetTimer (mIncrementalReclaimEvent, TimerPeriodic, EFI_TIMER_PERIOD_MILLISECONDS (100));
+    }
+  }
+
   //
   // Install the Variable Write Architectural protocol.
   //
@@ -437,6 +437,396 @@ VariableCompareTimeStampInternal (
   return (BOOLEAN) (FirstTime->Second <= SecondTime->Second);
 }
 
+//
+// Lookup index of a variable store.
+//
+// FindVariableEx() is called for every GetVariable() and SetVariable(), and
+// for each of the HOB, volatile and non-volatile stores. Walking a store with
+// several hundred variables, most of them deleted, dominates the cost of the
+// variable services. The index maps a hash of the GUID and name of every
+// variable header in a store to the offset of the header, in an open
+// addressing table with linear probing.
+//
+// Entries are never removed: variables whose State changes keep their entry,
+// and FindVariableEx() applies the same State and attribute checks to the
+// candidates that the linear walk applies to every header. Entries with the
+// same hash are laid out in store order along the probe sequence, so the
+// result is identical to the result of the linear walk.
+//
+// The index only follows variables being appended to the store. Anything else
+// that rewrites the store, such as reclaim, must call
+// VariableIndexInvalidate().
+//
+#define VARIABLE_INDEX_STORE_COUNT    4
+#define VARIABLE_INDEX_MIN_CAPACITY   128
+#define VARIABLE_INDEX_FREE           MAX_UINT32
+
+typedef struct {
+  UINT32                  Hash;
+  UINT32                  Offset;
+} VARIABLE_INDEX_ENTRY;
+
+typedef struct {
+  VARIABLE_HEADER         *StartPtr;
+  VARIABLE_INDEX_ENTRY    *Entries;
+  UINT32                  Capacity;
+  UINT32                  Count;
+  UINTN                   IndexedSize;
+  BOOLEAN                 Overflow;
+} VARIABLE_STORE_INDEX;
+
+VARIABLE_STORE_INDEX  mVariableStoreIndex[VARIABLE_INDEX_STORE_COUNT];
+
+/**
+  Compute the lookup index hash (32-bit FNV-1a) of a variable.
+
+  @param[in] VendorGuid   Vendor GUID of the variable.
+  @param[in] Name         Name of the variable, may be unaligned.
+  @param[in] NameSize     Size of Name in bytes, including the terminator.
+
+  @return The hash of the variable.
+**/
+STATIC
+UINT32
+VariableIndexHash (
+  IN  CONST EFI_GUID        *VendorGuid,
+  IN  CONST VOID            *Name,
+  IN  UINTN                 NameSize
+  )
+{
+  CONST UINT8               *Bytes;
+  UINTN                     Index;
+  UINT32                    Hash;
+
+  Hash  = 0x811C9DC5;
+  Bytes = (CONST UINT8 *) VendorGuid;
+  for (Index = 0; Index < sizeof (EFI_GUID); Index++) {
+    Hash = (Hash ^ Bytes[Index]) * 0x01000193;
+  }
+  Bytes = (CONST UINT8 *) Name;
+  for (Index = 0; Index < NameSize; Index++) {
+    Hash = (Hash ^ Bytes[Index]) * 0x01000193;
+  }
+  return Hash;
+}
+
+/**
+  Replace the table of a variable store index with an empty table.
+
+  @param[in, out] StoreIndex  The variable store index.
+  @param[in]      Capacity    Number of entries of the new table, a power of
+                              two.
+
+  @retval TRUE    The table was replaced. The index is empty.
+  @retval FALSE   Out of memory. The index is unchanged.
+**/
+STATIC
+BOOLEAN
+VariableIndexResize (
+  IN OUT VARIABLE_STORE_INDEX  *StoreIndex,
+  IN     UINT32                Capacity
+  )
+{
+  VARIABLE_INDEX_ENTRY      *Entries;
+
+  Entries = AllocateRuntimePool (Capacity * sizeof (VARIABLE_INDEX_ENTRY));
+  if (Entries == NULL) {
+    return FALSE;
+  }
+  SetMem (Entries, Capacity * sizeof (VARIABLE_INDEX_ENTRY), 0xFF);
+
+  if (StoreIndex->Entries != NULL) {
+    FreePool (StoreIndex->Entries);
+  }
+  StoreIndex->Entries     = Entries;
+  StoreIndex->Capacity    = Capacity;
+  StoreIndex->Count       = 0;
+  StoreIndex->IndexedSize = 0;
+  return TRUE;
+}
+
+/**
+  Add the variables appended to a store since the last call to its index.
+
+  At boot time the table is grown to keep the load factor below 1/2. At
+  runtime no memory can be allocated, so the index is abandoned once the load
+  factor reaches 7/8 and the store is walked linearly until it is invalidated.
+
+  @param[in, out] StoreIndex  The variable store index.
+  @param[in]      EndPtr      End of the variable store.
+  @param[in]      AuthFormat  TRUE indicates authenticated variables are used.
+                              FALSE indicates authenticated variables are not used.
+
+  @retval TRUE    The index covers every variable of the store.
+  @retval FALSE   The index cannot be used.
+**/
+STATIC
+BOOLEAN
+VariableIndexUpdate (
+  IN OUT VARIABLE_STORE_INDEX  *StoreIndex,
+  IN     VARIABLE_HEADER       *EndPtr,
+  IN     BOOLEAN               AuthFormat
+  )
+{
+  VARIABLE_HEADER           *Variable;
+  VARIABLE_HEADER           *NextVariable;
+  UINT32                    Hash;
+  UINT32                    Slot;
+
+  if (StoreIndex->Overflow) {
+    return FALSE;
+  }
+
+  Variable = (VARIABLE_HEADER *) ((UINTN) StoreIndex->StartPtr + StoreIndex->IndexedSize);
+  while (IsValidVariableHeader (Variable, EndPtr)) {
+    NextVariable = GetNextVariablePtr (Variable, AuthFormat);
+    if (Variable->State == VAR_HEADER_VALID_ONLY) {
+      if (!IsValidVariableHeader (NextVariable, EndPtr)) {
+        //
+        // The variable is still being written and its name may be incomplete,
+        // index it on a later call.
+        //
+        break;
+      }
+      //
+      // A variable whose write was interrupted never matches.
+      //
+    } else {
+      if ((StoreIndex->Count + 1) * 2 > StoreIndex->Capacity) {
+        if (AtRuntime ()) {
+          if ((StoreIndex->Count + 1) * 8 > StoreIndex->Capacity * 7) {
+            StoreIndex->Overflow = TRUE;
+            return FALSE;
+          }
+        } else {
+          if (!VariableIndexResize (StoreIndex, StoreIndex->Capacity * 2)) {
+            return FALSE;
+          }
+          Variable = StoreIndex->StartPtr;
+          continue;
+        }
+      }
+
+      Hash = VariableIndexHash (
+               GetVendorGuidPtr (Variable, AuthFormat),
+               GetVariableNamePtr (Variable, AuthFormat),
+               NameSizeOfVariable (Variable, AuthFormat)
+               );
+      for (Slot = Hash & (StoreIndex->Capacity - 1);
+           StoreIndex->Entries[Slot].Offset != VARIABLE_INDEX_FREE;
+           Slot = (Slot + 1) & (StoreIndex->Capacity - 1)) {
+      }
+      StoreIndex->Entries[Slot].Hash   = Hash;
+      StoreIndex->Entries[Slot].Offset = (UINT32) ((UINTN) Variable - (UINTN) StoreIndex->StartPtr);
+      StoreIndex->Count++;
+    }
+
+    Variable = NextVariable;
+    StoreIndex->IndexedSize = (UINTN) Variable - (UINTN) StoreIndex->StartPtr;
+  }
+
+  return TRUE;
+}
+
+/**
+  Get the up to date lookup index of a variable store, creating it on first
+  use at boot time.
+
+  @param[in] PtrTrack     Variable pointer track structure that describes the
+                          variable store.
+  @param[in] AuthFormat   TRUE indicates authenticated variables are used.
+                          FALSE indicates authenticated variables are not used.
+
+  @retval NULL            The store has no usable index and must be walked.
+  @return                 The index of the variable store.
+**/
+STATIC
+VARIABLE_STORE_INDEX *
+VariableIndexGet (
+  IN  VARIABLE_POINTER_TRACK  *PtrTrack,
+  IN  BOOLEAN                 AuthFormat
+  )
+{
+  VARIABLE_STORE_INDEX      *StoreIndex;
+  UINTN                     Index;
+
+  if ((UINTN) PtrTrack->EndPtr - (UINTN) PtrTrack->StartPtr >= VARIABLE_INDEX_FREE) {
+    return NULL;
+  }
+
+  StoreIndex = NULL;
+  for (Index = 0; Index < VARIABLE_INDEX_STORE_COUNT; Index++) {
+    if (mVariableStoreIndex[Index].StartPtr == PtrTrack->StartPtr) {
+      StoreIndex = &mVariableStoreIndex[Index];
+      break;
+    }
+  }
+
+  if (StoreIndex == NULL) {
+    if (AtRuntime ()) {
+      return NULL;
+    }
+    for (Index = 0; Index < VARIABLE_INDEX_STORE_COUNT; Index++) {
+      if (mVariableStoreIndex[Index].StartPtr == NULL) {
+        StoreIndex = &mVariableStoreIndex[Index];
+        break;
+      }
+    }
+    if (StoreIndex == NULL ||
+        !VariableIndexResize (StoreIndex, VARIABLE_INDEX_MIN_CAPACITY)) {
+      return NULL;
+    }
+    StoreIndex->StartPtr = PtrTrack->StartPtr;
+  }
+
+  if (!VariableIndexUpdate (StoreIndex, PtrTrack->EndPtr, AuthFormat)) {
+    return NULL;
+  }
+  return StoreIndex;
+}
+
+/**
+  Drop the lookup index of a variable store.
+
+  The index is rebuilt from the variable store content on the next lookup.
+  This must be called whenever a variable store is rewritten other than by
+  appending variables and updating the State of existing variables, e.g.
+  after reclaim, and before a variable store buffer is freed.
+
+  @param[in] StartPtr   Pointer to the first variable header of the store,
+                        as returned by GetStartPointer(). NULL drops the
+                        index of every variable store.
+
+**/
+VOID
+VariableIndexInvalidate (
+  IN  VARIABLE_HEADER       *StartPtr
+  )
+{
+  VARIABLE_STORE_INDEX      *StoreIndex;
+  UINTN                     Index;
+
+  for (Index = 0; Index < VARIABLE_INDEX_STORE_COUNT; Index++) {
+    StoreIndex = &mVariableStoreIndex[Index];
+    if (StoreIndex->StartPtr == NULL ||
+        (StartPtr != NULL && StoreIndex->StartPtr != StartPtr)) {
+      continue;
+    }
+
+    if (AtRuntime ()) {
+      //
+      // Keep the table, it cannot be allocated again.
+      //
+      SetMem (StoreIndex->Entries, StoreIndex->Capacity * sizeof (VARIABLE_INDEX_ENTRY), 0xFF);
+      StoreIndex->Count       = 0;
+      StoreIndex->IndexedSize = 0;
+      StoreIndex->Overflow    = FALSE;
+    } else {
+      FreePool (StoreIndex->Entries);
+      ZeroMem (StoreIndex, sizeof (*StoreIndex));
+    }
+  }
+}
+
+/**
+  Convert the pointers held by the variable store lookup index to virtual
+  addresses.
+
+  This must be called from the EVT_SIGNAL_VIRTUAL_ADDRESS_CHANGE handler of
+  the runtime DXE drivers that use FindVariableEx().
+
+  @param[in] ConvertPointer   The pointer conversion routine, normally
+                              EfiConvertPointer().
+
+**/
+VOID
+VariableIndexConvertPointers (
+  IN  VARIABLE_INDEX_CONVERT_POINTER  ConvertPointer
+  )
+{
+  UINTN                     Index;
+
+  for (Index = 0; Index < VARIABLE_INDEX_STORE_COUNT; Index++) {
+    if (mVariableStoreIndex[Index].StartPtr != NULL) {
+      ConvertPointer (0x0, (VOID **) &mVariableStoreIndex[Index].StartPtr);
+      ConvertPointer (0x0, (VOID **) &mVariableStoreIndex[Index].Entries);
+    }
+  }
+}
+
+/**
+  Find the variable in a variable store through the lookup index of the store.
+
+  The result is identical to the result of the linear walk in FindVariableEx().
+
+  @param[in]       StoreIndex          The index of the variable store.
+  @param[in]       VariableName        Name of the variable to be found, not
+                                       empty.
+  @param[in]       VendorGuid          Vendor GUID to be found.
+  @param[in]       IgnoreRtCheck       Ignore EFI_VARIABLE_RUNTIME_ACCESS attribute
+                                       check at runtime when searching variable.
+  @param[in, out]  PtrTrack            Variable Track Pointer structure that contains Variable Information.
+  @param[in]       AuthFormat          TRUE indicates authenticated variables are used.
+                                       FALSE indicates authenticated variables are not used.
+
+  @retval          EFI_SUCCESS         Variable found successfully
+  @retval          EFI_NOT_FOUND       Variable not found
+**/
+STATIC
+EFI_STATUS
+FindVariableInIndex (
+  IN     VARIABLE_STORE_INDEX    *StoreIndex,
+  IN     CHAR16                  *VariableName,
+  IN     EFI_GUID                *VendorGuid,
+  IN     BOOLEAN                 IgnoreRtCheck,
+  IN OUT VARIABLE_POINTER_TRACK  *PtrTrack,
+  IN     BOOLEAN                 AuthFormat
+  )
+{
+  VARIABLE_HEADER                *InDeletedVariable;
+  VARIABLE_HEADER                *Variable;
+  UINTN                          NameSize;
+  UINT32                         Hash;
+  UINT32                         Slot;
+
+  InDeletedVariable = NULL;
+  NameSize          = StrSize (VariableName);
+  Hash              = VariableIndexHash (VendorGuid, VariableName, NameSize);
+
+  for (Slot = Hash & (StoreIndex->Capacity - 1);
+       StoreIndex->Entries[Slot].Offset != VARIABLE_INDEX_FREE;
+       Slot = (Slot + 1) & (StoreIndex->Capacity - 1)) {
+    if (StoreIndex->Entries[Slot].Hash != Hash) {
+      continue;
+    }
+
+    Variable = (VARIABLE_HEADER *) ((UINTN) PtrTrack->StartPtr + StoreIndex->Entries[Slot].Offset);
+    if (Variable->State != VAR_ADDED &&
+        Variable->State != (VAR_IN_DELETED_TRANSITION & VAR_ADDED)) {
+      continue;
+    }
+    if (!IgnoreRtCheck && AtRuntime () && ((Variable->Attributes & EFI_VARIABLE_RUNTIME_ACCESS) == 0)) {
+      continue;
+    }
+    if (NameSizeOfVariable (Variable, AuthFormat) != NameSize ||
+        !CompareGuid (VendorGuid, GetVendorGuidPtr (Variable, AuthFormat)) ||
+        CompareMem (VariableName, GetVariableNamePtr (Variable, AuthFormat), NameSize) != 0) {
+      continue;
+    }
+
+    if (Variable->State == (VAR_IN_DELETED_TRANSITION & VAR_ADDED)) {
+      InDeletedVariable = Variable;
+    } else {
+      PtrTrack->CurrPtr                = Variable;
+      PtrTrack->InDeletedTransitionPtr = InDeletedVariable;
+      return EFI_SUCCESS;
+    }
+  }
+
+  PtrTrack->CurrPtr = InDeletedVariable;
+  return (PtrTrack->CurrPtr  == NULL) ? EFI_NOT_FOUND : EFI_SUCCESS;
+}
+
 /**
   Find the variable in the specified variable store.
 
@@ -462,9 +852,17 @@ FindVariableEx (
 {
   VARIABLE_HEADER                *InDeletedVariable;
   VOID                           *Point;
+  VARIABLE_STORE_INDEX           *StoreIndex;
 
   PtrTrack->InDeletedTransitionPtr = NULL;
 
+  if (VariableName[0] != 0) {
+    StoreIndex = VariableIndexGet (PtrTrack, AuthFormat);
+    if (StoreIndex != NULL) {
+      return FindVariableInIndex (StoreIndex, VariableName, VendorGuid, IgnoreRtCheck, PtrTrack, AuthFormat);
+    }
+  }
+
   //
   // Find the variable by walk through HOB, volatile and non-volatile variable store.
   //
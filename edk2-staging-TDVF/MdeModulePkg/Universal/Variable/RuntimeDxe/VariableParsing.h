@@ -344,4 +344,58 @@ UpdateVariableInfo (
   IN OUT VARIABLE_INFO_ENTRY  **VariableInfo
   );
 
+/**
+  Pointer conversion routine used by VariableIndexConvertPointers(). It has
+  the same prototype as EfiConvertPointer() in UefiRuntimeLib.
+
+  @param[in]      DebugDisposition  Supplies type information for the pointer
+                                    being converted.
+  @param[in, out] Address           A pointer to a pointer that is to be fixed
+                                    to be the value needed for the new virtual
+                                    address mappings being applied.
+
+  @retval EFI_SUCCESS               The pointer was converted.
+  @return Others                    The pointer could not be converted.
+**/
+typedef
+EFI_STATUS
+(EFIAPI *VARIABLE_INDEX_CONVERT_POINTER) (
+  IN     UINTN                    DebugDisposition,
+  IN OUT VOID                     **Address
+  );
+
+/**
+  Drop the lookup index of a variable store.
+
+  The index is rebuilt from the variable store content on the next lookup.
+  This must be called whenever a variable store is rewritten other than by
+  appending variables and updating the State of existing variables, e.g.
+  after reclaim, and before a variable store buffer is freed.
+
+  @param[in] StartPtr   Pointer to the first variable header of the store,
+                        as returned by GetStartPointer(). NULL drops the
+                        index of every variable store.
+
+**/
+VOID
+VariableIndexInvalidate (
+  IN  VARIABLE_HEADER       *StartPtr
+  );
+
+/**
+  Convert the pointers held by the variable store lookup index to virtual
+  addresses.
+
+  This must be called from the EVT_SIGNAL_VIRTUAL_ADDRESS_CHANGE handler of
+  the runtime DXE drivers that use FindVariableEx().
+
+  @param[in] ConvertPointer   The pointer conversion routine, normally
+                              EfiConvertPointer().
+
+**/
+VOID
+VariableIndexConvertPointers (
+  IN  VARIABLE_INDEX_CONVERT_POINTER  ConvertPointer
+  );
+
 #endif
@@ -36,11 +36,25 @@ FlushPendingRuntimeVariableCacheUpdates (
 
   if (VariableRuntimeCacheContext->VariableRuntimeNvCache.Store == NULL ||
       VariableRuntimeCacheContext->VariableRuntimeVolatileCache.Store == NULL ||
-      VariableRuntimeCacheContext->PendingUpdate == NULL) {
+      VariableRuntimeCacheContext->PendingUpdate == NULL ||
+      VariableRuntimeCacheContext->CacheGeneration == NULL) {
     return EFI_UNSUPPORTED;
   }
 
   if (*(VariableRuntimeCacheContext->PendingUpdate)) {
+    //
+    // An update that starts at the store header rewrites the whole store (initial
+    // copy or reclaim). Tell the runtime DXE driver to drop its lookup indexes.
+    //
+    if ((VariableRuntimeCacheContext->VariableRuntimeHobCache.PendingUpdateOffset == 0 &&
+         VariableRuntimeCacheContext->VariableRuntimeHobCache.PendingUpdateLength > 0) ||
+        (VariableRuntimeCacheContext->VariableRuntimeNvCache.PendingUpdateOffset == 0 &&
+         VariableRuntimeCacheContext->VariableRuntimeNvCache.PendingUpdateLength > 0) ||
+        (VariableRuntimeCacheContext->VariableRuntimeVolatileCache.PendingUpdateOffset == 0 &&
+         VariableRuntimeCacheContext->VariableRuntimeVolatileCache.PendingUpdateLength > 0)) {
+      (*(VariableRuntimeCacheContext->CacheGeneration))++;
+    }
+
     if (VariableRuntimeCacheContext->VariableRuntimeHobCache.Store != NULL &&
         mVariableModuleGlobal->VariableGlobal.HobVariableBase > 0) {
       CopyMem (
@@ -824,7 +824,8 @@ SmmVariableHandler (
           RuntimeVariableCacheContext->RuntimeNvCache == NULL ||
           RuntimeVariableCacheContext->PendingUpdate == NULL ||
           RuntimeVariableCacheContext->ReadLock == NULL ||
-          RuntimeVariableCacheContext->HobFlushComplete == NULL) {
+          RuntimeVariableCacheContext->HobFlushComplete == NULL ||
+          RuntimeVariableCacheContext->CacheGeneration == NULL) {
         DEBUG ((DEBUG_ERROR, "InitRuntimeVariableCacheContext: Required runtime cache buffer is NULL!\n"));
         Status = EFI_ACCESS_DENIED;
         goto EXIT;
@@ -888,6 +889,13 @@ SmmVariableHandler (
         Status = EFI_ACCESS_DENIED;
         goto EXIT;
       }
+      if (!VariableSmmIsBufferOutsideSmmValid (
+            (UINTN) RuntimeVariableCacheContext->CacheGeneration,
+            sizeof (*(RuntimeVariableCacheContext->CacheGeneration)))) {
+        DEBUG ((DEBUG_ERROR, "InitRuntimeVariableCacheContext: Runtime cache generation buffer in SMRAM or overflow!\n"));
+        Status = EFI_ACCESS_DENIED;
+        goto EXIT;
+      }
 
       VariableCacheContext = &mVariableModuleGlobal->VariableGlobal.VariableRuntimeCacheContext;
       VariableCacheContext->VariableRuntimeHobCache.Store      = RuntimeVariableCacheContext->RuntimeHobCache;
@@ -896,6 +904,7 @@ SmmVariableHandler (
       VariableCacheContext->PendingUpdate                      = RuntimeVariableCacheContext->PendingUpdate;
       VariableCacheContext->ReadLock                           = RuntimeVariableCacheContext->ReadLock;
       VariableCacheContext->HobFlushComplete                   = RuntimeVariableCacheContext->HobFlushComplete;
+      VariableCacheContext->CacheGeneration                    = RuntimeVariableCacheContext->CacheGeneration;
 
       // Set up the intial pending request since the RT cache needs to be in sync with SMM cache
       VariableCacheContext->VariableRuntimeHobCache.PendingUpdateOffset = 0;
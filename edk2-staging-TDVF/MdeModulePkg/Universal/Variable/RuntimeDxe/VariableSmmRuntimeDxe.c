@@ -61,6 +61,8 @@ BOOLEAN                          mVariableRuntimeCachePendingUpdate;
 BOOLEAN                          mVariableRuntimeCacheReadLock;
 BOOLEAN                          mVariableAuthFormat;
 BOOLEAN                          mHobFlushComplete;
+UINT32                           mVariableRuntimeCacheGeneration;
+UINT32                           mVariableIndexGeneration;
 EFI_LOCK                         mVariableServicesLock;
 EDKII_VARIABLE_LOCK_PROTOCOL     mVariableLock;
 EDKII_VAR_CHECK_PROTOCOL         mVarCheck;
@@ -542,7 +544,8 @@ SyncRuntimeCache (
   Check whether a SMI must be triggered to retrieve pending cache updates.
 
   If the variable HOB was finished being flushed since the last check for a runtime cache update, this function
-  will prevent the HOB cache from being used for future runtime cache hits.
+  will prevent the HOB cache from being used for future runtime cache hits. If a runtime cache was rewritten
+  since the last check, the variable store lookup indexes are dropped.
 
 **/
 VOID
@@ -555,10 +558,16 @@ CheckForRuntimeCacheSync (
   }
   ASSERT (!mVariableRuntimeCachePendingUpdate);
 
+  if (mVariableIndexGeneration != mVariableRuntimeCacheGeneration) {
+    VariableIndexInvalidate (NULL);
+    mVariableIndexGeneration = mVariableRuntimeCacheGeneration;
+  }
+
   //
   // The HOB variable data may have finished being flushed in the runtime cache sync update
   //
   if (mHobFlushComplete && mVariableRuntimeHobCacheBuffer != NULL) {
+    VariableIndexInvalidate (GetStartPointer (mVariableRuntimeHobCacheBuffer));
     if (!EfiAtRuntime ()) {
       FreePages (mVariableRuntimeHobCacheBuffer, EFI_SIZE_TO_PAGES (mVariableRuntimeHobCacheBufferSize));
     }
@@ -1327,6 +1336,7 @@ VariableAddressChangeEvent (
   EfiConvertPointer (EFI_OPTIONAL_PTR, (VOID **) &mVariableRuntimeHobCacheBuffer);
   EfiConvertPointer (EFI_OPTIONAL_PTR, (VOID **) &mVariableRuntimeNvCacheBuffer);
   EfiConvertPointer (EFI_OPTIONAL_PTR, (VOID **) &mVariableRuntimeVolatileCacheBuffer);
+  VariableIndexConvertPointers (EfiConvertPointer);
 }
 
 /**
@@ -1535,6 +1545,7 @@ SendRuntimeVariableCacheContextToSmm (
   SmmRuntimeVarCacheContext->PendingUpdate = &mVariableRuntimeCachePendingUpdate;
   SmmRuntimeVarCacheContext->ReadLock = &mVariableRuntimeCacheReadLock;
   SmmRuntimeVarCacheContext->HobFlushComplete = &mHobFlushComplete;
+  SmmRuntimeVarCacheContext->CacheGeneration = &mVariableRuntimeCacheGeneration;
 
   //
   // Send data to SMM.
@@ -0,0 +1,286 @@
+/** @file
+  CPU feature dispatch of the BaseMemoryLibOptDxeAvx instance.
+
+  Small buffers are handled by the plain x64 workers. Larger forward copies
+  and fills use "rep movsb" / "rep stosb" when the processor supports Enhanced
+  REP MOVSB/STOSB, and AVX2 otherwise. Copies and fills that exceed the last
+  level cache use AVX2 non-temporal stores.
+
+  Copyright (c) 2021, Intel Corporation. All rights reserved.<BR>
+  SPDX-License-Identifier: BSD-2-Clause-Patent
+
+**/
+
+#include <Register/Intel/Cpuid.h>
+
+#include "MemLibAvx.h"
+
+//
+// Processor features detected by InternalMemLibFeatures(), zero until the
+// first call.
+//
+UINT32  mMemLibFeatures;
+
+/**
+  Return the processor features the memory functions dispatch on.
+
+  The features are detected with CPUID and XGETBV on the first call, and
+  cached in mMemLibFeatures.
+
+  @return A bit mask of MEM_LIB_FEATURE_* values. MEM_LIB_FEATURE_DETECTED is
+          always set.
+
+**/
+UINT32
+InternalMemLibFeatures (
+  VOID
+  )
+{
+  UINT32                                       Features;
+  UINT32                                       MaxLeaf;
+  CPUID_VERSION_INFO_ECX                       VersionInfoEcx;
+  CPUID_STRUCTURED_EXTENDED_FEATURE_FLAGS_EBX  ExtendedFeatureEbx;
+
+  Features = mMemLibFeatures;
+  if ((Features & MEM_LIB_FEATURE_DETECTED) != 0) {
+    return Features;
+  }
+
+  Features = MEM_LIB_FEATURE_DETECTED;
+  AsmCpuid (CPUID_SIGNATURE, &MaxLeaf, NULL, NULL, NULL);
+  if (MaxLeaf >= CPUID_STRUCTURED_EXTENDED_FEATURE_FLAGS) {
+    AsmCpuid (CPUID_VERSION_INFO, NULL, NULL, &VersionInfoEcx.Uint32, NULL);
+    AsmCpuidEx (
+      CPUID_STRUCTURED_EXTENDED_FEATURE_FLAGS,
+      CPUID_STRUCTURED_EXTENDED_FEATURE_FLAGS_SUB_LEAF_INFO,
+      NULL,
+      &ExtendedFeatureEbx.Uint32,
+      NULL,
+      NULL
+      );
+
+    if (ExtendedFeatureEbx.Bits.EnhancedRepMovsbStosb != 0) {
+      Features |= MEM_LIB_FEATURE_ERMS;
+    }
+
+    //
+    // AVX2 is only usable if the OS (here: the firmware) has enabled XSAVE
+    // and the SSE and AVX state components in XCR0.
+    //
+    if (ExtendedFeatureEbx.Bits.AVX2 != 0 &&
+        VersionInfoEcx.Bits.AVX != 0 &&
+        VersionInfoEcx.Bits.OSXSAVE != 0 &&
+        (AsmXGetBv (0) & (BIT1 | BIT2)) == (BIT1 | BIT2)) {
+      Features |= MEM_LIB_FEATURE_AVX2;
+    }
+  }
+
+  mMemLibFeatures = Features;
+  return Features;
+}
+
+/**
+  Copy Length bytes from Source to Destination.
+
+  @param  DestinationBuffer The target of the copy request.
+  @param  SourceBuffer      The place to copy from.
+  @param  Length            The number of bytes to copy.
+
+  @return Destination.
+
+**/
+VOID *
+EFIAPI
+InternalMemCopyMem (
+  OUT     VOID                      *DestinationBuffer,
+  IN      CONST VOID                *SourceBuffer,
+  IN      UINTN                     Length
+  )
+{
+  UINT32   Features;
+  BOOLEAN  Forward;
+  BOOLEAN  NonTemporal;
+  UINT8    *Destination;
+  UINT8    *Source;
+  BOOLEAN  InterruptState;
+
+  if (Length <= MEM_LIB_SMALL_SIZE) {
+    return InternalMemCopyMemSmall (DestinationBuffer, SourceBuffer, Length);
+  }
+
+  //
+  // A forward copy is safe unless the destination starts inside the source.
+  // Non-temporal stores are only used if the buffers do not overlap at all.
+  //
+  Features    = InternalMemLibFeatures ();
+  Forward     = (BOOLEAN)((UINTN)DestinationBuffer - (UINTN)SourceBuffer >= Length);
+  NonTemporal = (BOOLEAN)(Length >= MEM_LIB_NON_TEMPORAL_THRESHOLD &&
+                          Forward &&
+                          (UINTN)SourceBuffer - (UINTN)DestinationBuffer >= Length);
+
+  if ((Features & MEM_LIB_FEATURE_AVX2) == 0) {
+    if ((Features & MEM_LIB_FEATURE_ERMS) != 0 &&
+        Forward &&
+        Length >= MEM_LIB_ERMS_THRESHOLD) {
+      return InternalMemCopyMemErms (DestinationBuffer, SourceBuffer, Length);
+    }
+    return InternalMemCopyMemSse2 (DestinationBuffer, SourceBuffer, Length);
+  }
+
+  if ((Features & MEM_LIB_FEATURE_ERMS) != 0 &&
+      Forward &&
+      !NonTemporal &&
+      Length >= MEM_LIB_ERMS_THRESHOLD) {
+    return InternalMemCopyMemErms (DestinationBuffer, SourceBuffer, Length);
+  }
+
+  //
+  // Copy block by block, in the same direction as the worker would, so that
+  // every block reads source bytes that have not been overwritten yet. The
+  // last block is at least MEM_LIB_SMALL_SIZE bytes long.
+  //
+  Destination = (UINT8 *)DestinationBuffer;
+  Source      = (UINT8 *)SourceBuffer;
+  while (Length >= MEM_LIB_AVX_BLOCK_SIZE + MEM_LIB_SMALL_SIZE) {
+    Length -= MEM_LIB_AVX_BLOCK_SIZE;
+    InterruptState = SaveAndDisableInterrupts ();
+    if (Forward) {
+      InternalMemCopyMemAvx2 (Destination, Source, MEM_LIB_AVX_BLOCK_SIZE, NonTemporal);
+      Destination += MEM_LIB_AVX_BLOCK_SIZE;
+      Source      += MEM_LIB_AVX_BLOCK_SIZE;
+    } else {
+      InternalMemCopyMemAvx2 (Destination + Length, Source + Length, MEM_LIB_AVX_BLOCK_SIZE, FALSE);
+    }
+    SetInterruptState (InterruptState);
+  }
+
+  InterruptState = SaveAndDisableInterrupts ();
+  InternalMemCopyMemAvx2 (Destination, Source, Length, NonTemporal);
+  SetInterruptState (InterruptState);
+  return DestinationBuffer;
+}
+
+/**
+  Set Buffer to Value for Size bytes.
+
+  @param  Buffer   The memory to set.
+  @param  Length   The number of bytes to set.
+  @param  Value    The value of the set operation.
+
+  @return Buffer.
+
+**/
+VOID *
+EFIAPI
+InternalMemSetMem (
+  OUT     VOID                      *Buffer,
+  IN      UINTN                     Length,
+  IN      UINT8                     Value
+  )
+{
+  UINT32   Features;
+  BOOLEAN  NonTemporal;
+  UINT8    *Pointer;
+  BOOLEAN  InterruptState;
+
+  if (Length <= MEM_LIB_SMALL_SIZE) {
+    return InternalMemSetMemRep (Buffer, Length, Value);
+  }
+
+  Features    = InternalMemLibFeatures ();
+  NonTemporal = (BOOLEAN)(Length >= MEM_LIB_NON_TEMPORAL_THRESHOLD);
+
+  if ((Features & MEM_LIB_FEATURE_ERMS) != 0 &&
+      Length >= MEM_LIB_ERMS_THRESHOLD &&
+      !(NonTemporal && (Features & MEM_LIB_FEATURE_AVX2) != 0)) {
+    return InternalMemSetMemErms (Buffer, Length, Value);
+  }
+
+  if ((Features & MEM_LIB_FEATURE_AVX2) == 0) {
+    return InternalMemSetMemRep (Buffer, Length, Value);
+  }
+
+  Pointer = (UINT8 *)Buffer;
+  while (Length >= MEM_LIB_AVX_BLOCK_SIZE + MEM_LIB_SMALL_SIZE) {
+    InterruptState = SaveAndDisableInterrupts ();
+    InternalMemSetMemAvx2 (Pointer, MEM_LIB_AVX_BLOCK_SIZE, Value, NonTemporal);
+    SetInterruptState (InterruptState);
+    Pointer += MEM_LIB_AVX_BLOCK_SIZE;
+    Length  -= MEM_LIB_AVX_BLOCK_SIZE;
+  }
+
+  InterruptState = SaveAndDisableInterrupts ();
+  InternalMemSetMemAvx2 (Pointer, Length, Value, NonTemporal);
+  SetInterruptState (InterruptState);
+  return Buffer;
+}
+
+/**
+  Set Buffer to 0 for Size bytes.
+
+  @param  Buffer   The memory to set.
+  @param  Length   The number of bytes to set.
+
+  @return Buffer.
+
+**/
+VOID *
+EFIAPI
+InternalMemZeroMem (
+  OUT     VOID                      *Buffer,
+  IN      UINTN                     Length
+  )
+{
+  return InternalMemSetMem (Buffer, Length, 0);
+}
+
+/**
+  Compares two memory buffers of a given length.
+
+  @param  DestinationBuffer The first memory buffer.
+  @param  SourceBuffer      The second memory buffer.
+  @param  Length            The length of DestinationBuffer and SourceBuffer memory
+                            regions to compare. Must be non-zero.
+
+  @return 0                 All Length bytes of the two buffers are identical.
+  @retval Non-zero          The first mismatched byte in SourceBuffer subtracted from the first
+                            mismatched byte in DestinationBuffer.
+
+**/
+INTN
+EFIAPI
+InternalMemCompareMem (
+  IN      CONST VOID                *DestinationBuffer,
+  IN      CONST VOID                *SourceBuffer,
+  IN      UINTN                     Length
+  )
+{
+  CONST UINT8  *Destination;
+  CONST UINT8  *Source;
+  INTN         Result;
+  BOOLEAN      InterruptState;
+
+  if (Length <= MEM_LIB_SMALL_SIZE ||
+      (InternalMemLibFeatures () & MEM_LIB_FEATURE_AVX2) == 0) {
+    return InternalMemCompareMemRep (DestinationBuffer, SourceBuffer, Length);
+  }
+
+  Destination = (CONST UINT8 *)DestinationBuffer;
+  Source      = (CONST UINT8 *)SourceBuffer;
+  while (Length >= MEM_LIB_AVX_BLOCK_SIZE + MEM_LIB_SMALL_SIZE) {
+    InterruptState = SaveAndDisableInterrupts ();
+    Result = InternalMemCompareMemAvx2 (Destination, Source, MEM_LIB_AVX_BLOCK_SIZE);
+    SetInterruptState (InterruptState);
+    if (Result != 0) {
+      return Result;
+    }
+    Destination += MEM_LIB_AVX_BLOCK_SIZE;
+    Source      += MEM_LIB_AVX_BLOCK_SIZE;
+    Length      -= MEM_LIB_AVX_BLOCK_SIZE;
+  }
+
+  InterruptState = SaveAndDisableInterrupts ();
+  Result = InternalMemCompareMemAvx2 (Destination, Source, Length);
+  SetInterruptState (InterruptState);
+  return Result;
+}
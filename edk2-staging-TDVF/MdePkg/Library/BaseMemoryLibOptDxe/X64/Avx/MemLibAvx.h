@@ -0,0 +1,253 @@
+/** @file
+  Declaration of the CPU feature dispatch and of the assembly workers of the
+  BaseMemoryLibOptDxeAvx instance.
+
+  Copyright (c) 2021, Intel Corporation. All rights reserved.<BR>
+  SPDX-License-Identifier: BSD-2-Clause-Patent
+
+**/
+
+#ifndef __MEM_LIB_AVX_H__
+#define __MEM_LIB_AVX_H__
+
+#include "MemLibInternals.h"
+
+//
+// Bits of mMemLibFeatures.
+//
+#define MEM_LIB_FEATURE_DETECTED  BIT0
+#define MEM_LIB_FEATURE_ERMS      BIT1
+#define MEM_LIB_FEATURE_AVX2      BIT2
+
+//
+// Buffers of up to this many bytes are handled without any dispatch.
+//
+#define MEM_LIB_SMALL_SIZE              32
+
+//
+// Smallest forward copy or fill handed to "rep movsb" / "rep stosb" when the
+// processor supports Enhanced REP MOVSB/STOSB. Below this size, the startup
+// cost of the string instructions outweighs their throughput.
+//
+#define MEM_LIB_ERMS_THRESHOLD          SIZE_2KB
+
+//
+// Smallest copy or fill done with non-temporal stores. Buffers this large do
+// not fit in the last level cache anyway, so writing them through the cache
+// only evicts useful data.
+//
+#define MEM_LIB_NON_TEMPORAL_THRESHOLD  SIZE_4MB
+
+//
+// The exception handlers save the processor state with FXSAVE, which does not
+// cover the upper halves of the YMM registers. The AVX2 workers therefore run
+// with interrupts disabled, on blocks of this size, to bound the interrupt
+// latency.
+//
+#define MEM_LIB_AVX_BLOCK_SIZE          SIZE_16KB
+
+/**
+  Return the processor features the memory functions dispatch on.
+
+  The features are detected with CPUID and XGETBV on the first call, and
+  cached in mMemLibFeatures.
+
+  @return A bit mask of MEM_LIB_FEATURE_* values. MEM_LIB_FEATURE_DETECTED is
+          always set.
+
+**/
+UINT32
+InternalMemLibFeatures (
+  VOID
+  );
+
+/**
+  Copy up to MEM_LIB_SMALL_SIZE bytes. The buffers may overlap.
+
+  @param  DestinationBuffer The target of the copy request.
+  @param  SourceBuffer      The place to copy from.
+  @param  Length            The number of bytes to copy, at most
+                            MEM_LIB_SMALL_SIZE.
+
+  @return DestinationBuffer.
+
+**/
+VOID *
+EFIAPI
+InternalMemCopyMemSmall (
+  OUT     VOID                      *DestinationBuffer,
+  IN      CONST VOID                *SourceBuffer,
+  IN      UINTN                     Length
+  );
+
+/**
+  Copy Length bytes with SSE2 non-temporal stores. The buffers may overlap.
+
+  @param  DestinationBuffer The target of the copy request.
+  @param  SourceBuffer      The place to copy from.
+  @param  Length            The number of bytes to copy.
+
+  @return DestinationBuffer.
+
+**/
+VOID *
+EFIAPI
+InternalMemCopyMemSse2 (
+  OUT     VOID                      *DestinationBuffer,
+  IN      CONST VOID                *SourceBuffer,
+  IN      UINTN                     Length
+  );
+
+/**
+  Copy Length bytes forward with "rep movsb".
+
+  The buffers must not overlap, unless DestinationBuffer is below
+  SourceBuffer.
+
+  @param  DestinationBuffer The target of the copy request.
+  @param  SourceBuffer      The place to copy from.
+  @param  Length            The number of bytes to copy.
+
+  @return DestinationBuffer.
+
+**/
+VOID *
+EFIAPI
+InternalMemCopyMemErms (
+  OUT     VOID                      *DestinationBuffer,
+  IN      CONST VOID                *SourceBuffer,
+  IN      UINTN                     Length
+  );
+
+/**
+  Copy Length bytes with AVX2. The buffers may overlap.
+
+  The caller must make sure that the processor supports AVX2, and that no
+  other code can use the YMM registers while the function runs.
+
+  @param  DestinationBuffer The target of the copy request.
+  @param  SourceBuffer      The place to copy from.
+  @param  Length            The number of bytes to copy, at least
+                            MEM_LIB_SMALL_SIZE.
+  @param  NonTemporal       TRUE to bypass the cache with non-temporal
+                            stores. The buffers must not overlap.
+
+  @return DestinationBuffer.
+
+**/
+VOID *
+EFIAPI
+InternalMemCopyMemAvx2 (
+  OUT     VOID                      *DestinationBuffer,
+  IN      CONST VOID                *SourceBuffer,
+  IN      UINTN                     Length,
+  IN      BOOLEAN                   NonTemporal
+  );
+
+/**
+  Set Buffer to Value for Length bytes with "rep stosq".
+
+  @param  Buffer    The memory to set.
+  @param  Length    The number of bytes to set.
+  @param  Value     The value of the set operation.
+
+  @return Buffer.
+
+**/
+VOID *
+EFIAPI
+InternalMemSetMemRep (
+  OUT     VOID                      *Buffer,
+  IN      UINTN                     Length,
+  IN      UINT8                     Value
+  );
+
+/**
+  Set Buffer to Value for Length bytes with "rep stosb".
+
+  @param  Buffer    The memory to set.
+  @param  Length    The number of bytes to set.
+  @param  Value     The value of the set operation.
+
+  @return Buffer.
+
+**/
+VOID *
+EFIAPI
+InternalMemSetMemErms (
+  OUT     VOID                      *Buffer,
+  IN      UINTN                     Length,
+  IN      UINT8                     Value
+  );
+
+/**
+  Set Buffer to Value for Length bytes with AVX2.
+
+  The caller must make sure that the processor supports AVX2, and that no
+  other code can use the YMM registers while the function runs.
+
+  @param  Buffer      The memory to set.
+  @param  Length      The number of bytes to set, at least
+                      MEM_LIB_SMALL_SIZE.
+  @param  Value       The value of the set operation.
+  @param  NonTemporal TRUE to bypass the cache with non-temporal stores.
+
+  @return Buffer.
+
+**/
+VOID *
+EFIAPI
+InternalMemSetMemAvx2 (
+  OUT     VOID                      *Buffer,
+  IN      UINTN                     Length,
+  IN      UINT8                     Value,
+  IN      BOOLEAN                   NonTemporal
+  );
+
+/**
+  Compares two memory buffers of a given length with "repe cmpsb".
+
+  @param  DestinationBuffer The first memory buffer.
+  @param  SourceBuffer      The second memory buffer.
+  @param  Length            The length of DestinationBuffer and SourceBuffer
+                            memory regions to compare. Must be non-zero.
+
+  @return 0                 All Length bytes of the two buffers are identical.
+  @retval Non-zero          The first mismatched byte in SourceBuffer subtracted
+                            from the first mismatched byte in DestinationBuffer.
+
+**/
+INTN
+EFIAPI
+InternalMemCompareMemRep (
+  IN      CONST VOID                *DestinationBuffer,
+  IN      CONST VOID                *SourceBuffer,
+  IN      UINTN                     Length
+  );
+
+/**
+  Compares two memory buffers of a given length with AVX2.
+
+  The caller must make sure that the processor supports AVX2, and that no
+  other code can use the YMM registers while the function runs.
+
+  @param  DestinationBuffer The first memory buffer.
+  @param  SourceBuffer      The second memory buffer.
+  @param  Length            The length of DestinationBuffer and SourceBuffer
+                            memory regions to compare, at least
+                            MEM_LIB_SMALL_SIZE.
+
+  @return 0                 All Length bytes of the two buffers are identical.
+  @retval Non-zero          The first mismatched byte in SourceBuffer subtracted
+                            from the first mismatched byte in DestinationBuffer.
+
+**/
+INTN
+EFIAPI
+InternalMemCompareMemAvx2 (
+  IN      CONST VOID                *DestinationBuffer,
+  IN      CONST VOID                *SourceBuffer,
+  IN      UINTN                     Length
+  );
+
+#endif
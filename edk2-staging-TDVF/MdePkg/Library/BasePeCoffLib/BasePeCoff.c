@@ -858,6 +858,70 @@ PeCoffLoaderImageAddress (
   return (CHAR8 *)((UINTN) ImageContext->ImageAddress + Address - TeStrippedOffset);
 }
 
+/**
+  Applies the fixups of one base relocation block, for a block whose 4KB page
+  lies entirely within the loaded image.
+
+  Every offset of the block then addresses the image, so the per entry bounds
+  check of PeCoffLoaderRelocateImage() is not needed. The fixed up values are
+  not recorded, so this must only be used when FixupData is NULL.
+
+  @param  Reloc      The first relocation entry of the block.
+  @param  RelocEnd   The end of the relocation entries of the block.
+  @param  FixupBase  The loaded address of the page the block relocates.
+  @param  Adjust     The delta to add to each fixup.
+
+  @retval RETURN_SUCCESS      The fixups of the block were applied.
+  @retval RETURN_UNSUPPORTED  A fixup type is not supported.
+
+**/
+STATIC
+RETURN_STATUS
+PeCoffLoaderRelocateBlock (
+  IN     UINT16  *Reloc,
+  IN     UINT16  *RelocEnd,
+  IN     CHAR8   *FixupBase,
+  IN     UINT64  Adjust
+  )
+{
+  RETURN_STATUS  Status;
+  CHAR8          *Fixup;
+  CHAR8          *FixupData;
+
+  FixupData = NULL;
+  for (; (UINTN) Reloc < (UINTN) RelocEnd; Reloc++) {
+    Fixup = FixupBase + (*Reloc & 0xFFF);
+    switch ((*Reloc) >> 12) {
+    case EFI_IMAGE_REL_BASED_ABSOLUTE:
+      break;
+
+    case EFI_IMAGE_REL_BASED_DIR64:
+      *(UINT64 *) Fixup += Adjust;
+      break;
+
+    case EFI_IMAGE_REL_BASED_HIGHLOW:
+      *(UINT32 *) Fixup += (UINT32) Adjust;
+      break;
+
+    case EFI_IMAGE_REL_BASED_HIGH:
+      *(UINT16 *) Fixup = (UINT16) (*(UINT16 *) Fixup + ((UINT16) ((UINT32) Adjust >> 16)));
+      break;
+
+    case EFI_IMAGE_REL_BASED_LOW:
+      *(UINT16 *) Fixup = (UINT16) (*(UINT16 *) Fixup + (UINT16) Adjust);
+      break;
+
+    default:
+      Status = PeCoffLoaderRelocateImageEx (Reloc, Fixup, &FixupData, Adjust);
+      if (RETURN_ERROR (Status)) {
+        return Status;
+      }
+    }
+  }
+
+  return RETURN_SUCCESS;
+}
+
 /**
   Applies relocation fixups to a PE/COFF image that was loaded with PeCoffLoaderLoadImage().
 
@@ -1043,6 +1107,22 @@ PeCoffLoaderRelocateImage (
         return RETURN_LOAD_ERROR;
       }
 
+      //
+      // Unless the fixed up values must be recorded for a runtime image, a
+      // block whose whole page lies within the image is applied without
+      // checking each entry; this is the case of nearly every block.
+      //
+      if ((FixupData == NULL) &&
+          ((UINT64) RelocBase->VirtualAddress + SIZE_4KB <= ImageContext->ImageSize + TeStrippedOffset)) {
+        Status = PeCoffLoaderRelocateBlock (Reloc, RelocEnd, FixupBase, Adjust);
+        if (RETURN_ERROR (Status)) {
+          ImageContext->ImageError = IMAGE_ERROR_FAILED_RELOCATION;
+          return Status;
+        }
+        RelocBase = (EFI_IMAGE_BASE_RELOCATION *) RelocEnd;
+        continue;
+      }
+
       //
       // Run this relocation record
       //
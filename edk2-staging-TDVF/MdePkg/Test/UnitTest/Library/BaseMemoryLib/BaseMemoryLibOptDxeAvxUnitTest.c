@@ -0,0 +1,548 @@
+/** @file
+  Unit tests of the CopyMem(), SetMem(), ZeroMem() and CompareMem() dispatch
+  of BaseMemoryLibOptDxeAvx.
+
+  Every test runs once for each combination of the processor features the
+  library dispatches on, as far as the host supports them, over buffer sizes
+  that cross all dispatch thresholds, at all alignments within a cache line,
+  and with overlapping buffers.
+
+  Copyright (c) 2021, Intel Corporation. All rights reserved.<BR>
+  SPDX-License-Identifier: BSD-2-Clause-Patent
+
+**/
+
+#include <Uefi.h>
+#include <Library/BaseLib.h>
+#include <Library/BaseMemoryLib.h>
+#include <Library/DebugLib.h>
+#include <Library/MemoryAllocationLib.h>
+#include <Library/UnitTestLib.h>
+
+#define UNIT_TEST_APP_NAME     "BaseMemoryLibOptDxeAvx Unit Test Application"
+#define UNIT_TEST_APP_VERSION  "1.0"
+
+//
+// Keep in sync with MemLibAvx.h of BaseMemoryLibOptDxeAvx.
+//
+#define MEM_LIB_FEATURE_DETECTED  BIT0
+#define MEM_LIB_FEATURE_ERMS      BIT1
+#define MEM_LIB_FEATURE_AVX2      BIT2
+
+//
+// Processor features of BaseMemoryLibOptDxeAvx. The tests overwrite them to
+// force each dispatch path.
+//
+extern UINT32  mMemLibFeatures;
+
+//
+// Largest buffer tested, and the slack around it for alignment, overlap and
+// guard bytes.
+//
+#define TEST_MAX_LENGTH  (SIZE_4MB + SIZE_16KB + 100)
+#define TEST_SLACK       SIZE_32KB
+#define TEST_ALIGNMENT   64
+
+//
+// Step between the alignments tested. Large buffers are only tested at a few
+// alignments to keep the run time reasonable.
+//
+#define TEST_ALIGN_STEP(Length)  \
+  (((Length) <= 256) ? 1 : ((Length) <= SIZE_64KB + 64) ? 5 : 31)
+
+typedef struct {
+  UINT32  Features;
+} MEM_LIB_TEST_CONTEXT;
+
+//
+// Lengths around the small buffer limit (32), the ERMS threshold (2 KB), the
+// AVX2 block size (16 KB) and the non-temporal threshold (4 MB).
+//
+STATIC CONST UINTN  mLengths[] = {
+  1,                2,                3,               4,               7,
+  8,                15,               16,              17,              31,
+  32,               33,               63,              64,              65,
+  95,               96,               97,              255,             1000,
+  SIZE_2KB - 1,     SIZE_2KB,         SIZE_2KB + 1,    SIZE_16KB - 1,   SIZE_16KB,
+  SIZE_16KB + 31,   SIZE_16KB + 32,   SIZE_16KB + 33,  SIZE_64KB + 17,  SIZE_4MB - 1,
+  SIZE_4MB,         SIZE_4MB + 33,    SIZE_4MB + SIZE_16KB + 100
+};
+
+//
+// Distances between overlapping source and destination buffers.
+//
+STATIC CONST UINTN  mOverlaps[] = {
+  1, 3, 8, 16, 31, 32, 33, 63, 100, SIZE_4KB + 5, SIZE_16KB, SIZE_16KB + 7
+};
+
+STATIC MEM_LIB_TEST_CONTEXT  mBaseline  = { MEM_LIB_FEATURE_DETECTED };
+STATIC MEM_LIB_TEST_CONTEXT  mErms      = { MEM_LIB_FEATURE_DETECTED | MEM_LIB_FEATURE_ERMS };
+STATIC MEM_LIB_TEST_CONTEXT  mAvx2      = { MEM_LIB_FEATURE_DETECTED | MEM_LIB_FEATURE_AVX2 };
+STATIC MEM_LIB_TEST_CONTEXT  mErmsAvx2  = { MEM_LIB_FEATURE_DETECTED | MEM_LIB_FEATURE_ERMS | MEM_LIB_FEATURE_AVX2 };
+
+STATIC UINT32  mHostFeatures;
+STATIC UINT8   *mBuffer1;
+STATIC UINT8   *mBuffer2;
+STATIC UINT8   *mExpected;
+
+/**
+  Fill a range of a buffer with a pattern that depends on the offset into the
+  buffer and on a seed, without using BaseMemoryLib.
+
+  @param[out] Buffer  The buffer to fill.
+  @param[in]  Start   The offset of the first byte to fill.
+  @param[in]  End     The offset past the last byte to fill.
+  @param[in]  Seed    The seed of the pattern.
+**/
+STATIC
+VOID
+FillPattern (
+  OUT UINT8  *Buffer,
+  IN  UINTN  Start,
+  IN  UINTN  End,
+  IN  UINT8  Seed
+  )
+{
+  UINTN  Index;
+
+  for (Index = Start; Index < End; Index++) {
+    Buffer[Index] = (UINT8)((Index * 7) ^ (Index >> 8) ^ Seed);
+  }
+}
+
+/**
+  Compare two buffers byte by byte, without using BaseMemoryLib.
+
+  @param[in] Buffer1  The first buffer.
+  @param[in] Buffer2  The second buffer.
+  @param[in] Length   The number of bytes to compare.
+
+  @retval TRUE   The buffers are equal.
+  @retval FALSE  The buffers differ.
+**/
+STATIC
+BOOLEAN
+BuffersEqual (
+  IN CONST UINT8  *Buffer1,
+  IN CONST UINT8  *Buffer2,
+  IN UINTN        Length
+  )
+{
+  UINTN  Index;
+
+  for (Index = 0; Index < Length; Index++) {
+    if (Buffer1[Index] != Buffer2[Index]) {
+      return FALSE;
+    }
+  }
+  return TRUE;
+}
+
+/**
+  Force the processor features of the library to the ones of the test
+  context, or skip the test if the host lacks any of them.
+
+  @param[in] Context  The MEM_LIB_TEST_CONTEXT of the test.
+
+  @retval UNIT_TEST_PASSED           The features have been set.
+  @retval UNIT_TEST_SKIPPED          The host does not support the features.
+**/
+STATIC
+UNIT_TEST_STATUS
+EFIAPI
+SetFeatures (
+  IN UNIT_TEST_CONTEXT  Context
+  )
+{
+  MEM_LIB_TEST_CONTEXT  *TestContext;
+
+  TestContext = (MEM_LIB_TEST_CONTEXT *)Context;
+  if ((TestContext->Features & ~mHostFeatures) != 0) {
+    UT_LOG_WARNING ("Host lacks processor features 0x%x\n", TestContext->Features & ~mHostFeatures);
+    return UNIT_TEST_SKIPPED;
+  }
+  mMemLibFeatures = TestContext->Features;
+  return UNIT_TEST_PASSED;
+}
+
+/**
+  Restore the processor features detected on the host.
+
+  @param[in] Context  The MEM_LIB_TEST_CONTEXT of the test.
+**/
+STATIC
+VOID
+EFIAPI
+RestoreFeatures (
+  IN UNIT_TEST_CONTEXT  Context
+  )
+{
+  mMemLibFeatures = mHostFeatures;
+}
+
+/**
+  Check one CopyMem() call against a byte by byte reference copy, including
+  the guard bytes around the source and the destination.
+
+  @param[in] Destination  The destination offset into mBuffer1.
+  @param[in] Source       The source offset into mBuffer1.
+  @param[in] Length       The number of bytes to copy.
+
+  @retval TRUE   CopyMem() produced the expected buffer.
+  @retval FALSE  CopyMem() corrupted the buffer.
+**/
+STATIC
+BOOLEAN
+CheckCopy (
+  IN UINTN  Destination,
+  IN UINTN  Source,
+  IN UINTN  Length
+  )
+{
+  UINTN  Index;
+  UINTN  SourceStart;
+  UINTN  SourceEnd;
+  UINTN  DestinationStart;
+  UINTN  DestinationEnd;
+
+  SourceStart      = Source - TEST_ALIGNMENT;
+  SourceEnd        = Source + Length + TEST_ALIGNMENT;
+  DestinationStart = Destination - TEST_ALIGNMENT;
+  DestinationEnd   = Destination + Length + TEST_ALIGNMENT;
+
+  FillPattern (mBuffer1, SourceStart, SourceEnd, (UINT8)Length);
+  FillPattern (mBuffer1, DestinationStart, DestinationEnd, (UINT8)Length);
+  FillPattern (mExpected, SourceStart, SourceEnd, (UINT8)Length);
+  FillPattern (mExpected, DestinationStart, DestinationEnd, (UINT8)Length);
+
+  //
+  // Reference memmove through mBuffer2.
+  //
+  for (Index = 0; Index < Length; Index++) {
+    mBuffer2[Index] = mBuffer1[Source + Index];
+  }
+  for (Index = 0; Index < Length; Index++) {
+    mExpected[Destination + Index] = mBuffer2[Index];
+  }
+
+  if (CopyMem (mBuffer1 + Destination, mBuffer1 + Source, Length) != mBuffer1 + Destination) {
+    return FALSE;
+  }
+  return (BOOLEAN)(BuffersEqual (mBuffer1 + SourceStart, mExpected + SourceStart, SourceEnd - SourceStart) &&
+                   BuffersEqual (mBuffer1 + DestinationStart, mExpected + DestinationStart, DestinationEnd - DestinationStart));
+}
+
+/**
+  Copy buffers that do not overlap, at all relative alignments.
+
+  @param[in] Context  The MEM_LIB_TEST_CONTEXT of the test.
+
+  @retval UNIT_TEST_PASSED             All copies are correct.
+  @retval UNIT_TEST_ERROR_TEST_FAILED  A copy is incorrect.
+**/
+STATIC
+UNIT_TEST_STATUS
+EFIAPI
+CopyMemDisjointTest (
+  IN UNIT_TEST_CONTEXT  Context
+  )
+{
+  UINTN  LengthIndex;
+  UINTN  Length;
+  UINTN  DestinationAlign;
+  UINTN  SourceAlign;
+  UINTN  Step;
+
+  for (LengthIndex = 0; LengthIndex < ARRAY_SIZE (mLengths); LengthIndex++) {
+    Length = mLengths[LengthIndex];
+    Step   = TEST_ALIGN_STEP (Length);
+    for (DestinationAlign = 0; DestinationAlign < TEST_ALIGNMENT; DestinationAlign += Step) {
+      for (SourceAlign = 0; SourceAlign < TEST_ALIGNMENT; SourceAlign += Step) {
+        UT_ASSERT_TRUE (
+          CheckCopy (
+            TEST_SLACK + DestinationAlign,
+            TEST_SLACK + TEST_MAX_LENGTH + TEST_SLACK + SourceAlign,
+            Length
+            )
+          );
+        UT_ASSERT_TRUE (
+          CheckCopy (
+            TEST_SLACK + TEST_MAX_LENGTH + TEST_SLACK + DestinationAlign,
+            TEST_SLACK + SourceAlign,
+            Length
+            )
+          );
+      }
+    }
+  }
+  return UNIT_TEST_PASSED;
+}
+
+/**
+  Copy overlapping buffers, with the destination below and above the source.
+
+  @param[in] Context  The MEM_LIB_TEST_CONTEXT of the test.
+
+  @retval UNIT_TEST_PASSED             All copies are correct.
+  @retval UNIT_TEST_ERROR_TEST_FAILED  A copy is incorrect.
+**/
+STATIC
+UNIT_TEST_STATUS
+EFIAPI
+CopyMemOverlapTest (
+  IN UNIT_TEST_CONTEXT  Context
+  )
+{
+  UINTN  LengthIndex;
+  UINTN  OverlapIndex;
+  UINTN  Length;
+  UINTN  Overlap;
+  UINTN  Align;
+
+  for (LengthIndex = 0; LengthIndex < ARRAY_SIZE (mLengths); LengthIndex++) {
+    Length = mLengths[LengthIndex];
+    //
+    // Overlapping copies never use non-temporal stores, so lengths beyond a
+    // few AVX2 blocks do not reach any other code.
+    //
+    if (Length > SIZE_64KB + 64) {
+      break;
+    }
+    for (OverlapIndex = 0; OverlapIndex < ARRAY_SIZE (mOverlaps); OverlapIndex++) {
+      Overlap = mOverlaps[OverlapIndex];
+      if (Overlap >= Length) {
+        continue;
+      }
+      for (Align = 0; Align < TEST_ALIGNMENT; Align += TEST_ALIGN_STEP (Length)) {
+        UT_ASSERT_TRUE (CheckCopy (TEST_SLACK + Align, TEST_SLACK + Align + Overlap, Length));
+        UT_ASSERT_TRUE (CheckCopy (TEST_SLACK + Align + Overlap, TEST_SLACK + Align, Length));
+      }
+    }
+  }
+  return UNIT_TEST_PASSED;
+}
+
+/**
+  Fill buffers at all alignments with SetMem() and ZeroMem(), and check the
+  guard bytes around them.
+
+  @param[in] Context  The MEM_LIB_TEST_CONTEXT of the test.
+
+  @retval UNIT_TEST_PASSED             All fills are correct.
+  @retval UNIT_TEST_ERROR_TEST_FAILED  A fill is incorrect.
+**/
+STATIC
+UNIT_TEST_STATUS
+EFIAPI
+SetMemTest (
+  IN UNIT_TEST_CONTEXT  Context
+  )
+{
+  UINTN  LengthIndex;
+  UINTN  Length;
+  UINTN  Align;
+  UINTN  Start;
+  UINTN  End;
+  UINTN  Index;
+  UINT8  Value;
+
+  for (LengthIndex = 0; LengthIndex < ARRAY_SIZE (mLengths); LengthIndex++) {
+    Length = mLengths[LengthIndex];
+    for (Align = 0; Align < TEST_ALIGNMENT; Align += TEST_ALIGN_STEP (Length)) {
+      Start = TEST_SLACK + Align - TEST_ALIGNMENT;
+      End   = TEST_SLACK + Align + Length + TEST_ALIGNMENT;
+      Value = (UINT8)(0x80 | Length);
+
+      FillPattern (mBuffer1, Start, End, 0x5A);
+      FillPattern (mExpected, Start, End, 0x5A);
+      for (Index = 0; Index < Length; Index++) {
+        mExpected[TEST_SLACK + Align + Index] = Value;
+      }
+      UT_ASSERT_EQUAL (
+        (UINTN)SetMem (mBuffer1 + TEST_SLACK + Align, Length, Value),
+        (UINTN)(mBuffer1 + TEST_SLACK + Align)
+        );
+      UT_ASSERT_TRUE (BuffersEqual (mBuffer1 + Start, mExpected + Start, End - Start));
+
+      for (Index = 0; Index < Length; Index++) {
+        mExpected[TEST_SLACK + Align + Index] = 0;
+      }
+      UT_ASSERT_EQUAL (
+        (UINTN)ZeroMem (mBuffer1 + TEST_SLACK + Align, Length),
+        (UINTN)(mBuffer1 + TEST_SLACK + Align)
+        );
+      UT_ASSERT_TRUE (BuffersEqual (mBuffer1 + Start, mExpected + Start, End - Start));
+    }
+  }
+  return UNIT_TEST_PASSED;
+}
+
+/**
+  Compare equal buffers, and buffers that differ in a single byte at the
+  start, inside and at the end, in both directions.
+
+  @param[in] Context  The MEM_LIB_TEST_CONTEXT of the test.
+
+  @retval UNIT_TEST_PASSED             All comparisons are correct.
+  @retval UNIT_TEST_ERROR_TEST_FAILED  A comparison is incorrect.
+**/
+STATIC
+UNIT_TEST_STATUS
+EFIAPI
+CompareMemTest (
+  IN UNIT_TEST_CONTEXT  Context
+  )
+{
+  UINTN  LengthIndex;
+  UINTN  Length;
+  UINTN  Align;
+  UINT8  *Buffer1;
+  UINT8  *Buffer2;
+  UINTN  Positions[5];
+  UINTN  PositionIndex;
+  UINTN  Position;
+
+  for (LengthIndex = 0; LengthIndex < ARRAY_SIZE (mLengths); LengthIndex++) {
+    Length = mLengths[LengthIndex];
+    for (Align = 0; Align < TEST_ALIGNMENT; Align += TEST_ALIGN_STEP (Length)) {
+      Buffer1 = mBuffer1 + TEST_SLACK + Align;
+      Buffer2 = mBuffer2 + TEST_SLACK + TEST_ALIGNMENT - 1 - Align;
+      FillPattern (Buffer1, 0, Length, 0x33);
+      FillPattern (Buffer2, 0, Length, 0x33);
+      UT_ASSERT_EQUAL (CompareMem (Buffer1, Buffer2, Length), 0);
+
+      Positions[0] = 0;
+      Positions[1] = Length / 2;
+      Positions[2] = Length - 1;
+      Positions[3] = Length - Length % 32;
+      Positions[4] = MIN (Length - 1, SIZE_16KB);
+      for (PositionIndex = 0; PositionIndex < ARRAY_SIZE (Positions); PositionIndex++) {
+        Position = MIN (Positions[PositionIndex], Length - 1);
+
+        Buffer1[Position] = 0x10;
+        Buffer2[Position] = 0xF0;
+        UT_ASSERT_EQUAL (CompareMem (Buffer1, Buffer2, Length), (INTN)0x10 - 0xF0);
+        UT_ASSERT_EQUAL (CompareMem (Buffer2, Buffer1, Length), (INTN)0xF0 - 0x10);
+
+        //
+        // A second difference behind the first one must not matter.
+        //
+        if (Position + 1 < Length) {
+          Buffer1[Length - 1] = 0xFF;
+          Buffer2[Length - 1] = 0x00;
+          UT_ASSERT_EQUAL (CompareMem (Buffer1, Buffer2, Length), (INTN)0x10 - 0xF0);
+        }
+
+        FillPattern (Buffer1, 0, Length, 0x33);
+        FillPattern (Buffer2, 0, Length, 0x33);
+      }
+    }
+  }
+  return UNIT_TEST_PASSED;
+}
+
+/**
+  Initialize the unit test framework, suite, and unit tests for the
+  BaseMemoryLibOptDxeAvx dispatch and run the unit tests.
+
+  @retval  EFI_SUCCESS           All test cases were dispatched.
+  @retval  EFI_OUT_OF_RESOURCES  There are not enough resources available to
+                                 initialize the unit tests.
+**/
+EFI_STATUS
+EFIAPI
+UnitTestingEntry (
+  VOID
+  )
+{
+  EFI_STATUS                  Status;
+  UNIT_TEST_FRAMEWORK_HANDLE  Fw;
+  UNIT_TEST_SUITE_HANDLE      DispatchTests;
+  UINT8                       Probe[64];
+
+  Fw = NULL;
+
+  DEBUG ((DEBUG_INFO, "%a v%a\n", UNIT_TEST_APP_NAME, UNIT_TEST_APP_VERSION));
+
+  //
+  // Let the library detect the features of the host.
+  //
+  FillPattern (Probe, 0, sizeof (Probe), 0);
+  mMemLibFeatures = 0;
+  CopyMem (Probe, Probe + 1, sizeof (Probe) - 1);
+  mHostFeatures = mMemLibFeatures;
+  DEBUG ((DEBUG_INFO, "Host processor features: 0x%x\n", mHostFeatures));
+
+  mBuffer1  = AllocatePool (2 * (TEST_SLACK + TEST_MAX_LENGTH) + TEST_SLACK);
+  mBuffer2  = AllocatePool (2 * (TEST_SLACK + TEST_MAX_LENGTH) + TEST_SLACK);
+  mExpected = AllocatePool (2 * (TEST_SLACK + TEST_MAX_LENGTH) + TEST_SLACK);
+  if (mBuffer1 == NULL || mBuffer2 == NULL || mExpected == NULL) {
+    Status = EFI_OUT_OF_RESOURCES;
+    goto EXIT;
+  }
+
+  //
+  // Start setting up the test framework for running the tests.
+  //
+  Status = InitUnitTestFramework (&Fw, UNIT_TEST_APP_NAME, gEfiCallerBaseName, UNIT_TEST_APP_VERSION);
+  if (EFI_ERROR (Status)) {
+    DEBUG ((DEBUG_ERROR, "Failed in InitUnitTestFramework. Status = %r\n", Status));
+    goto EXIT;
+  }
+
+  Status = CreateUnitTestSuite (&DispatchTests, Fw, "CPU feature dispatch", "BaseMemoryLibOptDxeAvx.Dispatch", NULL, NULL);
+  if (EFI_ERROR (Status)) {
+    DEBUG ((DEBUG_ERROR, "Failed in CreateUnitTestSuite for DispatchTests\n"));
+    Status = EFI_OUT_OF_RESOURCES;
+    goto EXIT;
+  }
+
+  // --------------Suite--------Description-----------------------Class Name------------Function-------------Pre----------Post-------------Context-----
+  AddTestCase (DispatchTests, "CopyMem disjoint, baseline",      "CopyDisjointBase",    CopyMemDisjointTest, SetFeatures, RestoreFeatures, &mBaseline);
+  AddTestCase (DispatchTests, "CopyMem disjoint, ERMS",          "CopyDisjointErms",    CopyMemDisjointTest, SetFeatures, RestoreFeatures, &mErms);
+  AddTestCase (DispatchTests, "CopyMem disjoint, AVX2",          "CopyDisjointAvx2",    CopyMemDisjointTest, SetFeatures, RestoreFeatures, &mAvx2);
+  AddTestCase (DispatchTests, "CopyMem disjoint, ERMS and AVX2", "CopyDisjointAll",     CopyMemDisjointTest, SetFeatures, RestoreFeatures, &mErmsAvx2);
+  AddTestCase (DispatchTests, "CopyMem overlap, baseline",       "CopyOverlapBase",     CopyMemOverlapTest,  SetFeatures, RestoreFeatures, &mBaseline);
+  AddTestCase (DispatchTests, "CopyMem overlap, ERMS",           "CopyOverlapErms",     CopyMemOverlapTest,  SetFeatures, RestoreFeatures, &mErms);
+  AddTestCase (DispatchTests, "CopyMem overlap, AVX2",           "CopyOverlapAvx2",     CopyMemOverlapTest,  SetFeatures, RestoreFeatures, &mAvx2);
+  AddTestCase (DispatchTests, "CopyMem overlap, ERMS and AVX2",  "CopyOverlapAll",      CopyMemOverlapTest,  SetFeatures, RestoreFeatures, &mErmsAvx2);
+  AddTestCase (DispatchTests, "SetMem, baseline",                "SetBase",             SetMemTest,          SetFeatures, RestoreFeatures, &mBaseline);
+  AddTestCase (DispatchTests, "SetMem, ERMS",                    "SetErms",             SetMemTest,          SetFeatures, RestoreFeatures, &mErms);
+  AddTestCase (DispatchTests, "SetMem, AVX2",                    "SetAvx2",             SetMemTest,          SetFeatures, RestoreFeatures, &mAvx2);
+  AddTestCase (DispatchTests, "SetMem, ERMS and AVX2",           "SetAll",              SetMemTest,          SetFeatures, RestoreFeatures, &mErmsAvx2);
+  AddTestCase (DispatchTests, "CompareMem, baseline",            "CompareBase",         CompareMemTest,      SetFeatures, RestoreFeatures, &mBaseline);
+  AddTestCase (DispatchTests, "CompareMem, AVX2",                "CompareAvx2",         CompareMemTest,      SetFeatures, RestoreFeatures, &mAvx2);
+
+  //
+  // Execute the tests.
+  //
+  Status = RunAllTestSuites (Fw);
+
+EXIT:
+  if (Fw) {
+    FreeUnitTestFramework (Fw);
+  }
+  if (mBuffer1 != NULL) {
+    FreePool (mBuffer1);
+  }
+  if (mBuffer2 != NULL) {
+    FreePool (mBuffer2);
+  }
+  if (mExpected != NULL) {
+    FreePool (mExpected);
+  }
+
+  return Status;
+}
+
+/**
+  Standard POSIX C entry point for host based unit test execution.
+**/
+int
+main (
+  int argc,
+  char *argv[]
+  )
+{
+  return UnitTestingEntry ();
+}
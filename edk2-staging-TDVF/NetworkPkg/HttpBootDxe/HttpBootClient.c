@@ -840,7 +840,9 @@ HttpBootGetBootFileCallback (
     }
   }
   //
-  // Copy data if caller has provided a buffer.
+  // Copy data if caller has provided a buffer. The data may have been received
+  // into the caller's buffer, behind the destination; CopyMem() handles the
+  // overlap.
   //
   if (CallbackData->BufferSize > CallbackData->CopyedSize) {
     CopyMem (
@@ -916,6 +918,7 @@ HttpBootGetBootFile (
   UINTN                      ContentLength;
   HTTP_BOOT_CACHE_CONTENT    *Cache;
   UINT8                      *Block;
+  UINTN                      BlockUsed;
   UINTN                      UrlSize;
   CHAR16                     *Url;
   BOOLEAN                    IdentityMode;
@@ -1195,28 +1198,42 @@ HttpBootGetBootFile (
       // In "chunked" transfer-coding mode, so we need to parse the received
       // data to get the real entity content.
       //
-      Block = NULL;
+      Block     = NULL;
+      BlockUsed = 0;
       while (!HttpIsMessageComplete (Parser)) {
-        //
-        // Allocate a buffer in Block to hold the message-body.
-        // If caller provides a buffer, this Block will be reused in every HttpIoRecvResponse().
-        // Otherwise a buffer, the buffer in Block will be cached and we should allocate a new before
-        // every HttpIoRecvResponse().
-        //
-        if (Block == NULL || Context.BufferSize == 0) {
-          Block = AllocatePool (HTTP_BOOT_BLOCK_SIZE);
-          if (Block == NULL) {
-            Status = EFI_OUT_OF_RESOURCES;
-            goto ERROR_6;
-          }
-          Context.NewBlock = TRUE;
-          Context.Block = Block;
+        if (Context.BufferSize - Context.CopyedSize >= HTTP_BOOT_MIN_RECEIVE_SIZE) {
+          //
+          // Receive straight into the caller's buffer, behind the entity data
+          // parsed so far. HttpBootGetBootFileCallback() moves the entity data
+          // down over the chunk headers, so nothing needs to be copied twice.
+          //
+          ResponseBody.Body       = (CHAR8*) Buffer + Context.CopyedSize;
+          ResponseBody.BodyLength = Context.BufferSize - Context.CopyedSize;
         } else {
-          Context.NewBlock = FALSE;
+          //
+          // Receive into Block. If the caller doesn't provide a buffer, the
+          // entity data in Block is saved in the cache list, so Block is
+          // filled up before a new one is allocated. Otherwise, and if none
+          // of Block is referenced from the cache yet, Block is reused.
+          //
+          if (Block == NULL || HTTP_BOOT_BLOCK_SIZE - BlockUsed < HTTP_BOOT_MIN_RECEIVE_SIZE) {
+            if (Context.Block != NULL) {
+              Block = Context.Block;
+            } else {
+              Block = AllocatePool (HTTP_BOOT_BLOCK_SIZE);
+              if (Block == NULL) {
+                Status = EFI_OUT_OF_RESOURCES;
+                goto ERROR_6;
+              }
+              Context.NewBlock = TRUE;
+              Context.Block    = Block;
+            }
+            BlockUsed = 0;
+          }
+          ResponseBody.Body       = (CHAR8*) Block + BlockUsed;
+          ResponseBody.BodyLength = HTTP_BOOT_BLOCK_SIZE - BlockUsed;
         }
 
-        ResponseBody.Body       = (CHAR8*) Block;
-        ResponseBody.BodyLength = HTTP_BOOT_BLOCK_SIZE;
         Status = HttpIoRecvResponse (
                    &Private->HttpIo,
                    FALSE,
@@ -1228,9 +1245,13 @@ HttpBootGetBootFile (
           }
           goto ERROR_6;
         }
+        if (Cache != NULL) {
+          BlockUsed += ResponseBody.BodyLength;
+        }
 
         //
-        // Parse the new received block of the message-body, the block will be saved in cache.
+        // Parse the new received data of the message-body, the entity data will be
+        // copied to the caller's buffer or saved in cache.
         //
         Status = HttpParseMessageBody (
                    Parser,
@@ -1270,6 +1291,12 @@ HttpBootGetBootFile (
   if (Parser != NULL) {
     HttpFreeMsgParser (Parser);
   }
+  //
+  // Free the receive block unless it is referenced from the cache.
+  //
+  if (Context.Block != NULL) {
+    FreePool (Context.Block);
+  }
 
   return Status;
 
@@ -12,7 +12,8 @@ SPDX-License-Identifier: BSD-2-Clause-Patent
 
 #define HTTP_BOOT_REQUEST_TIMEOUT            5000      // 5 seconds in uints of millisecond.
 #define HTTP_BOOT_RESPONSE_TIMEOUT           5000      // 5 seconds in uints of millisecond.
-#define HTTP_BOOT_BLOCK_SIZE                 1500
+#define HTTP_BOOT_BLOCK_SIZE                 0x10000   // 64 KiB.
+#define HTTP_BOOT_MIN_RECEIVE_SIZE           1500
 
 
 
@@ -593,6 +593,14 @@ TcpQueueData (
   Seg   = TCPSEG_NETBUF (Nbuf);
   Head  = &Tcb->RcvQue;
 
+  //
+  // Remember the most recent out-of-order segment, it is
+  // reported first in the SACK option.
+  //
+  if (TCP_SEQ_GT (Seg->Seq, Tcb->RcvNxt)) {
+    Tcb->RcvSackSeq = Seg->Seq;
+  }
+
   //
   // Fast path to process normal case. That is,
   // no out-of-order segments are received.
@@ -759,6 +767,7 @@ TcpInput (
   TCP_SEQNO   Urg;
   UINT16      Checksum;
   INT32       Usable;
+  UINT32      FullSize;
 
   ASSERT ((Version == IP_VERSION_4) || (Version == IP_VERSION_6));
 
@@ -1566,6 +1575,20 @@ StepSix:
     if (!IsListEmpty (&Tcb->RcvQue)) {
       TCP_SET_FLG (Tcb->CtrlFlag, TCP_CTRL_ACK_NOW);
     }
+
+    //
+    // A short segment usually ends a burst from the peer, don't
+    // leave the ACK for the segments before it to the timer. The
+    // timestamp option takes its space from full-sized segments.
+    //
+    FullSize = Tcb->RcvMss;
+    if (TCP_FLG_ON (Tcb->CtrlFlag, TCP_CTRL_SND_TS)) {
+      FullSize -= TCP_OPTION_TS_ALIGNED_LEN;
+    }
+
+    if ((Tcb->DelayedAck != 0) && (Nbuf->TotalSize < FullSize)) {
+      TCP_SET_FLG (Tcb->CtrlFlag, TCP_CTRL_ACK_NOW);
+    }
   }
 
   //
@@ -163,7 +163,7 @@ Tcp4Configure (
     }
 
     Option = TcpConfigData->ControlOption;
-    if ((NULL != Option) && (Option->EnableSelectiveAck || Option->EnablePathMtuDiscovery)) {
+    if ((NULL != Option) && (Option->EnablePathMtuDiscovery)) {
       return EFI_UNSUPPORTED;
     }
   }
@@ -697,7 +697,7 @@ Tcp6Configure (
     }
 
     Option = Tcp6ConfigData->ControlOption;
-    if ((NULL != Option) && (Option->EnableSelectiveAck || Option->EnablePathMtuDiscovery)) {
+    if ((NULL != Option) && (Option->EnablePathMtuDiscovery)) {
       return EFI_UNSUPPORTED;
     }
   }
@@ -159,6 +159,28 @@ TcpSynBuildOption (
     TcpPutUint32 (Data, TCP_OPTION_WS_FAST | TcpComputeScale (Tcb));
   }
 
+  //
+  // Build SACK-permitted option, only when configured to
+  // use SACK, and either we are doing active open or we
+  // have received SACK-permitted option from peer.
+  //
+  if (!TCP_FLG_ON (Tcb->CtrlFlag, TCP_CTRL_NO_SACK) &&
+      (!TCP_FLG_ON (TCPSEG_NETBUF (Nbuf)->Flag, TCP_FLG_ACK) ||
+        TCP_FLG_ON (Tcb->CtrlFlag, TCP_CTRL_RCVD_SACK))
+      ) {
+
+    Data = NetbufAllocSpace (
+             Nbuf,
+             TCP_OPTION_SACK_PERM_ALIGNED_LEN,
+             NET_BUF_HEAD
+             );
+
+    ASSERT (Data != NULL);
+
+    Len += TCP_OPTION_SACK_PERM_ALIGNED_LEN;
+    TcpPutUint32 (Data, TCP_OPTION_SACK_PERM_FAST);
+  }
+
   //
   // Build the MSS option.
   //
@@ -171,6 +193,176 @@ TcpSynBuildOption (
   return Len;
 }
 
+/**
+  Collect the SACK blocks from the out-of-order segments in the reassemble
+  queue, as described in RFC2018.
+
+  Adjacent segments are merged into one block. The block that contains the
+  most recently received segment is reported first; the others follow in
+  sequence order, as many as fit.
+
+  @param[in]   Tcb     Pointer to the TCP_CB of this TCP instance.
+  @param[in]   Room    The space left for the option, in bytes.
+  @param[out]  Left    The left edges of the blocks, with room for
+                       TCP_OPTION_SACK_MAX_BLOCK + 1 entries.
+  @param[out]  Right   The right edges of the blocks, likewise.
+  @param[out]  First   The index of the first block to report.
+
+  @return              The number of blocks to report, from First on.
+
+**/
+STATIC
+UINTN
+TcpGetSackBlocks (
+  IN  TCP_CB    *Tcb,
+  IN  UINT16    Room,
+  OUT TCP_SEQNO *Left,
+  OUT TCP_SEQNO *Right,
+  OUT UINTN     *First
+  )
+{
+  LIST_ENTRY  *Entry;
+  NET_BUF     *Node;
+  TCP_SEQNO   BlockLeft;
+  TCP_SEQNO   BlockRight;
+  TCP_SEQNO   SegSeq;
+  TCP_SEQNO   SegEnd;
+  BOOLEAN     InBlock;
+  BOOLEAN     RecentFound;
+  BOOLEAN     Done;
+  UINTN       MaxBlock;
+  UINTN       Count;
+
+  *First = 0;
+  if (Room < TCP_OPTION_SACK_HEAD_ALIGNED_LEN + TCP_OPTION_SACK_BLOCK_LEN) {
+    return 0;
+  }
+
+  MaxBlock = MIN (
+               TCP_OPTION_SACK_MAX_BLOCK,
+               (Room - TCP_OPTION_SACK_HEAD_ALIGNED_LEN) / TCP_OPTION_SACK_BLOCK_LEN
+               );
+
+  //
+  // Slot 0 is reserved for the block of the most recent segment.
+  //
+  Count       = 1;
+  RecentFound = FALSE;
+  InBlock     = FALSE;
+  BlockLeft   = 0;
+  BlockRight  = 0;
+  SegSeq      = 0;
+  SegEnd      = 0;
+  Entry       = Tcb->RcvQue.ForwardLink;
+
+  for (;;) {
+    Done = (BOOLEAN) (Entry == &Tcb->RcvQue);
+
+    if (!Done) {
+      Node   = NET_LIST_USER_STRUCT (Entry, NET_BUF, List);
+      SegSeq = TCPSEG_NETBUF (Node)->Seq;
+      SegEnd = TCPSEG_NETBUF (Node)->End;
+      Entry  = Entry->ForwardLink;
+
+      if (TCP_SEQ_LEQ (SegEnd, Tcb->RcvNxt)) {
+        continue;
+      }
+
+      if (TCP_SEQ_LT (SegSeq, Tcb->RcvNxt)) {
+        SegSeq = Tcb->RcvNxt;
+      }
+
+      if (InBlock && TCP_SEQ_LEQ (SegSeq, BlockRight)) {
+        if (TCP_SEQ_GT (SegEnd, BlockRight)) {
+          BlockRight = SegEnd;
+        }
+        continue;
+      }
+    }
+
+    //
+    // The current block is complete, record it.
+    //
+    if (InBlock) {
+      if (!RecentFound &&
+          TCP_SEQ_LEQ (BlockLeft, Tcb->RcvSackSeq) &&
+          TCP_SEQ_LT (Tcb->RcvSackSeq, BlockRight)) {
+
+        Left[0]     = BlockLeft;
+        Right[0]    = BlockRight;
+        RecentFound = TRUE;
+      } else if (Count <= MaxBlock) {
+        Left[Count]  = BlockLeft;
+        Right[Count] = BlockRight;
+        Count++;
+      }
+    }
+
+    if (Done) {
+      break;
+    }
+
+    InBlock    = TRUE;
+    BlockLeft  = SegSeq;
+    BlockRight = SegEnd;
+  }
+
+  //
+  // If no block holds the most recent segment, slot 0 is unused.
+  //
+  if (!RecentFound) {
+    *First = 1;
+    Count--;
+  }
+  return MIN (Count, MaxBlock);
+}
+
+/**
+  Build the SACK option, as described in RFC2018.
+
+  @param[in]  Tcb     Pointer to the TCP_CB of this TCP instance.
+  @param[in]  Nbuf    Pointer to the buffer to store the options.
+  @param[in]  Room    The space left for the option, in bytes.
+
+  @return             The length of the SACK option, 0 if there is
+                      nothing to report.
+
+**/
+UINT16
+TcpBuildSackOption (
+  IN TCP_CB  *Tcb,
+  IN NET_BUF *Nbuf,
+  IN UINT16  Room
+  )
+{
+  TCP_SEQNO   Left[TCP_OPTION_SACK_MAX_BLOCK + 1];
+  TCP_SEQNO   Right[TCP_OPTION_SACK_MAX_BLOCK + 1];
+  UINTN       Count;
+  UINTN       Index;
+  UINT8       *Data;
+  UINT16      Len;
+
+  Count = TcpGetSackBlocks (Tcb, Room, Left, Right, &Index);
+  if (Count == 0) {
+    return 0;
+  }
+
+  Len  = (UINT16) (TCP_OPTION_SACK_HEAD_ALIGNED_LEN + Count * TCP_OPTION_SACK_BLOCK_LEN);
+  Data = NetbufAllocSpace (Nbuf, Len, NET_BUF_HEAD);
+  ASSERT (Data != NULL);
+
+  TcpPutUint32 (Data, TCP_OPTION_SACK_FAST | (Len - 2));
+  Data += TCP_OPTION_SACK_HEAD_ALIGNED_LEN;
+
+  for (; Count > 0; Count--, Index++) {
+    TcpPutUint32 (Data, Left[Index]);
+    TcpPutUint32 (Data + 4, Right[Index]);
+    Data += TCP_OPTION_SACK_BLOCK_LEN;
+  }
+
+  return Len;
+}
+
 /**
   Build the TCP option in synchronized states.
 
@@ -213,9 +405,60 @@ TcpBuildOption (
     TcpPutUint32 (Data + 8, Tcb->TsRecent);
   }
 
+  //
+  // Build the SACK option if the peer permits it and some
+  // segments have been received out of order.
+  //
+  if (TCP_FLG_ON (Tcb->CtrlFlag, TCP_CTRL_RCVD_SACK) &&
+      !TCP_FLG_ON (TCPSEG_NETBUF (Nbuf)->Flag, TCP_FLG_RST) &&
+      !IsListEmpty (&Tcb->RcvQue)
+      ) {
+
+    Len = (UINT16) (Len + TcpBuildSackOption (Tcb, Nbuf, (UINT16) (40 - Len)));
+  }
+
   return Len;
 }
 
+/**
+  Compute the length of the SACK option that TcpBuildOption() adds to the
+  next data segment.
+
+  @param[in]  Tcb     Pointer to the TCP_CB of this TCP instance.
+
+  @return             The length of the SACK option, 0 if none is sent.
+
+**/
+UINT16
+TcpSackOptionLength (
+  IN TCP_CB  *Tcb
+  )
+{
+  TCP_SEQNO   Left[TCP_OPTION_SACK_MAX_BLOCK + 1];
+  TCP_SEQNO   Right[TCP_OPTION_SACK_MAX_BLOCK + 1];
+  UINTN       Count;
+  UINTN       First;
+  UINT16      Room;
+
+  if (!TCP_FLG_ON (Tcb->CtrlFlag, TCP_CTRL_RCVD_SACK) ||
+      IsListEmpty (&Tcb->RcvQue)
+      ) {
+    return 0;
+  }
+
+  Room = 40;
+  if (TCP_FLG_ON (Tcb->CtrlFlag, TCP_CTRL_SND_TS)) {
+    Room -= TCP_OPTION_TS_ALIGNED_LEN;
+  }
+
+  Count = TcpGetSackBlocks (Tcb, Room, Left, Right, &First);
+  if (Count == 0) {
+    return 0;
+  }
+
+  return (UINT16) (TCP_OPTION_SACK_HEAD_ALIGNED_LEN + Count * TCP_OPTION_SACK_BLOCK_LEN);
+}
+
 /**
   Parse the supported options.
 
@@ -313,6 +556,19 @@ TcpParseOption (
       Cur += TCP_OPTION_TS_LEN;
       break;
 
+    case TCP_OPTION_SACK_PERM:
+      Len = Head[Cur + 1];
+
+      if ((Len != TCP_OPTION_SACK_PERM_LEN) || (TotalLen - Cur < TCP_OPTION_SACK_PERM_LEN)) {
+
+        return -1;
+      }
+
+      TCP_SET_FLG (Option->Flag, TCP_OPTION_RCVD_SACK_PERM);
+
+      Cur += TCP_OPTION_SACK_PERM_LEN;
+      break;
+
     case TCP_OPTION_NOP:
       Cur++;
       break;
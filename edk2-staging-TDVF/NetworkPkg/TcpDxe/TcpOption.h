@@ -17,12 +17,19 @@
 #define TCP_OPTION_NOP             1  ///< No-Option.
 #define TCP_OPTION_MSS             2  ///< Maximum Segment Size
 #define TCP_OPTION_WS              3  ///< Window scale
+#define TCP_OPTION_SACK_PERM       4  ///< Selective acknowledgement permitted
+#define TCP_OPTION_SACK            5  ///< Selective acknowledgement
 #define TCP_OPTION_TS              8  ///< Timestamp
 #define TCP_OPTION_MSS_LEN         4  ///< Length of MSS option
 #define TCP_OPTION_WS_LEN          3  ///< Length of window scale option
 #define TCP_OPTION_TS_LEN          10 ///< Length of timestamp option
 #define TCP_OPTION_WS_ALIGNED_LEN  4  ///< Length of window scale option, aligned
 #define TCP_OPTION_TS_ALIGNED_LEN  12 ///< Length of timestamp option, aligned
+#define TCP_OPTION_SACK_PERM_LEN   2  ///< Length of SACK-permitted option
+#define TCP_OPTION_SACK_PERM_ALIGNED_LEN 4 ///< Length of SACK-permitted option, aligned
+#define TCP_OPTION_SACK_HEAD_ALIGNED_LEN 4 ///< Length of SACK option without blocks, aligned
+#define TCP_OPTION_SACK_BLOCK_LEN  8  ///< Length of a block in SACK option
+#define TCP_OPTION_SACK_MAX_BLOCK  4  ///< Maximum number of blocks in SACK option
 
 //
 // recommend format of timestamp window scale
@@ -39,12 +46,22 @@
 
 #define TCP_OPTION_MSS_FAST  ((TCP_OPTION_MSS << 24) | (TCP_OPTION_MSS_LEN << 16))
 
+#define TCP_OPTION_SACK_PERM_FAST ((TCP_OPTION_NOP << 24) | \
+                                   (TCP_OPTION_NOP << 16) | \
+                                   (TCP_OPTION_SACK_PERM << 8) | \
+                                   (TCP_OPTION_SACK_PERM_LEN))
+
+#define TCP_OPTION_SACK_FAST ((TCP_OPTION_NOP << 24) | \
+                              (TCP_OPTION_NOP << 16) | \
+                              (TCP_OPTION_SACK << 8))
+
 //
 // Other misc definitions
 //
 #define TCP_OPTION_RCVD_MSS        0x01
 #define TCP_OPTION_RCVD_WS         0x02
 #define TCP_OPTION_RCVD_TS         0x04
+#define TCP_OPTION_RCVD_SACK_PERM  0x08
 #define TCP_OPTION_MAX_WS          14      ///< Maximum window scale value
 #define TCP_OPTION_MAX_WIN         0xffff  ///< Max window size in TCP header
 
@@ -103,6 +120,20 @@ TcpBuildOption (
   IN NET_BUF *Nbuf
   );
 
+/**
+  Compute the length of the SACK option that TcpBuildOption() adds to the
+  next data segment.
+
+  @param[in]  Tcb     Pointer to the TCP_CB of this TCP instance.
+
+  @return             The length of the SACK option, 0 if none is sent.
+
+**/
+UINT16
+TcpSackOptionLength (
+  IN TCP_CB  *Tcb
+  );
+
 /**
   Parse the supported options.
 
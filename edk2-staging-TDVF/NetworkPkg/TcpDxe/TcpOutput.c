@@ -177,6 +177,7 @@ TcpDataToSend (
   UINT32  Len;
   UINT32  Left;
   UINT32  Limit;
+  UINT32  Mss;
 
   Sk = Tcb->Sk;
   ASSERT (Sk != NULL);
@@ -210,8 +211,13 @@ TcpDataToSend (
 
   Len   = MIN (Win, Left);
 
-  if (Len > Tcb->SndMss) {
-    Len = Tcb->SndMss;
+  //
+  // The SACK option takes room from the payload, as the timestamp
+  // option does, which SndMss already accounts for.
+  //
+  Mss = Tcb->SndMss - TcpSackOptionLength (Tcb);
+  if (Len > Mss) {
+    Len = Mss;
   }
 
   if ((Force != 0)|| (Len == 0 && Left == 0)) {
@@ -230,7 +236,7 @@ TcpDataToSend (
   // c)It can send everything it has, and either it isn't
   // expecting an ACK, or the Nagle algorithm is disabled.
   //
-  if ((Len == Tcb->SndMss) || (2 * Len >= Tcb->SndWndMax)) {
+  if ((Len == Mss) || (2 * Len >= Tcb->SndWndMax)) {
 
     return Len;
   }
@@ -662,7 +668,7 @@ TcpRetransmit (
   //
   // Compute the maximum length of retransmission. It is
   // limited by three factors:
-  // 1. Less than SndMss
+  // 1. Less than SndMss, less the SACK option
   // 2. Must in the current send window
   // 3. Will not change the boundaries of queued segments.
   //
@@ -696,7 +702,7 @@ TcpRetransmit (
     return 0;
   }
 
-  Len = MIN (Len, Tcb->SndMss);
+  Len = MIN (Len, (UINT32) (Tcb->SndMss - TcpSackOptionLength (Tcb)));
 
   Nbuf = TcpGetSegmentSndQue (Tcb, Seq, Len);
   if (Nbuf == NULL) {
@@ -970,7 +976,7 @@ TcpToSendData (
       Tcb->RttMeasure = 0;
     }
 
-  } while (Len == Tcb->SndMss);
+  } while (Len == (UINT32) (Tcb->SndMss - TcpSackOptionLength (Tcb)));
 
   return Sent;
 
@@ -1070,20 +1076,31 @@ TcpToSendAck (
   )
 {
   UINT32 TcpNow;
+  UINT8  MaxDelayedAck;
+
+  TcpNow = TcpRcvWinNow (Tcb);
+
+  //
+  // Stretch the ACKs on a bulk receive with a large window.
+  //
+  MaxDelayedAck = 1;
+  if ((TcpNow >= (UINT32) TCP_STRETCH_ACK_WINDOW * Tcb->RcvMss) &&
+      (TCP_SUB_SEQ (Tcb->RcvNxt, Tcb->Irs) > TCP_STRETCH_ACK_AFTER)) {
+    MaxDelayedAck = TCP_STRETCH_ACK_SEGMENTS - 1;
+  }
 
   //
   // Generally, TCP should send a delayed ACK unless:
-  //   1. ACK at least every other FULL sized segment received.
+  //   1. ACK at least every other FULL sized segment received,
+  //      or every TCP_STRETCH_ACK_SEGMENTS on a bulk receive.
   //   2. Packets received out of order.
   //   3. Receiving window is open.
   //
-  if (TCP_FLG_ON (Tcb->CtrlFlag, TCP_CTRL_ACK_NOW) || (Tcb->DelayedAck >= 1)) {
+  if (TCP_FLG_ON (Tcb->CtrlFlag, TCP_CTRL_ACK_NOW) || (Tcb->DelayedAck >= MaxDelayedAck)) {
     TcpSendAck (Tcb);
     return;
   }
 
-  TcpNow = TcpRcvWinNow (Tcb);
-
   if (TcpNow > TcpRcvWinOld (Tcb)) {
     TcpSendAck (Tcb);
     return;
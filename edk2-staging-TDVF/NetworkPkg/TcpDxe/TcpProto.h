@@ -72,6 +72,8 @@
 #define TCP_CTRL_TIMER_ON        0x1000 ///< At least one of the timer is on.
 #define TCP_CTRL_RTT_ON          0x2000 ///< The RTT measurement is on.
 #define TCP_CTRL_ACK_NOW         0x4000 ///< Send the ACK now, don't delay.
+#define TCP_CTRL_NO_SACK         0x8000 ///< Disable selective acknowledgement.
+#define TCP_CTRL_RCVD_SACK       0x10000 ///< Received a SACK-permitted option in syn.
 
 //
 // Timer related values
@@ -102,6 +104,17 @@
 #define TCP_PAWS_24DAY           (24 * 24 * 60 * 60 * TCP_TICK_HZ)
 #define TCP_CONNECT_TIME         (75 * TCP_TICK_HZ)
 
+//
+// Delayed ACK. An ACK is sent for at least every other full-sized segment.
+// When the receive window is open for at least TCP_STRETCH_ACK_WINDOW
+// segments, and more than TCP_STRETCH_ACK_AFTER bytes have been received,
+// an ACK is sent for every TCP_STRETCH_ACK_SEGMENTS full-sized segments.
+// A short segment, which usually ends a burst, is acknowledged at once.
+//
+#define TCP_STRETCH_ACK_SEGMENTS 4
+#define TCP_STRETCH_ACK_WINDOW   64
+#define TCP_STRETCH_ACK_AFTER    (1024 * 1024)
+
 //
 // The header space to be reserved before TCP data to accommodate:
 // 60byte IP head + 60byte TCP head + link layer head
@@ -268,6 +281,8 @@ struct _TCP_CONTROL_BLOCK {
   UINT32            RcvWnd;     ///< Window advertised by the local peer.
   TCP_SEQNO         RcvWl2;     ///< The RcvNxt (or ACK) of last window update.
                                 ///< It is necessary because of delayed ACK.
+  TCP_SEQNO         RcvSackSeq; ///< Sequence number in the out-of-order
+                                ///< segment received most recently.
 
   TCP_SEQNO         RcvUp;                   ///< Urgent point;
   TCP_SEQNO         Irs;                     ///< Initial Receiving Sequence.
@@ -22,6 +22,7 @@
 #include <Protocol/Tcg2Protocol.h>
 #include <Protocol/Tdx.h>
 #include <Protocol/QemuAcpiTableNotify.h>
+#include <Protocol/QemuAcpiTableUpdate.h>
 
 EFI_TD_PROTOCOL                 *mTdProtocol = NULL;
 EFI_HANDLE                      mQemuAcpiHandle  = NULL;
@@ -809,9 +810,18 @@ UndoCmdWritePointer (
 //
 #define INSTALLED_TABLES_MAX 128
 
+//
+// An ACPI table found by the second pass, to be installed once the pass is
+// complete.
+//
+typedef struct {
+  VOID    *Table;
+  UINTN   Size;
+} STAGED_TABLE;
+
 /**
   Process a QEMU_LOADER_ADD_POINTER command in order to see if its target byte
-  array is an ACPI table, and if so, install it.
+  array is an ACPI table, and if so, stage it for installation.
 
   This function assumes that the entire QEMU linker/loader command file has
   been processed successfully in a prior first pass.
@@ -821,22 +831,19 @@ UndoCmdWritePointer (
   @param[in] Tracker           The ORDERED_COLLECTION tracking the BLOB user
                                structures.
 
-  @param[in] AcpiProtocol      The ACPI table protocol used to install tables.
-
-  @param[in,out] InstalledKey  On input, an array of INSTALLED_TABLES_MAX UINTN
-                               elements, allocated by the caller. On output,
-                               the function will have stored (appended) the
-                               AcpiProtocol-internal key of the ACPI table that
-                               the function has installed, if the AddPointer
+  @param[in,out] Staged        On input, an array of INSTALLED_TABLES_MAX
+                               STAGED_TABLE elements, allocated by the caller.
+                               On output, the function will have stored
+                               (appended) the ACPI table, if the AddPointer
                                command identified an ACPI table that is
                                different from RSDT and XSDT.
 
-  @param[in,out] NumInstalled  On input, the number of entries already used in
-                               InstalledKey; it must be in [0,
-                               INSTALLED_TABLES_MAX] inclusive. On output, the
-                               parameter is incremented if the AddPointer
-                               command identified an ACPI table that is
-                               different from RSDT and XSDT.
+  @param[in,out] NumStaged     On input, the number of entries already used in
+                               Staged; it must be in [0, INSTALLED_TABLES_MAX]
+                               inclusive. On output, the parameter is
+                               incremented if the AddPointer command identified
+                               an ACPI table that is different from RSDT and
+                               XSDT.
 
   @param[in,out] SeenPointers  The ORDERED_COLLECTION tracking the absolute
                                target addresses that have been pointed-to by
@@ -844,29 +851,29 @@ UndoCmdWritePointer (
                                target address is encountered for the first
                                time, and it identifies an ACPI table that is
                                different from RDST and XSDT, the table is
-                               installed. If a target address is seen for the
+                               staged. If a target address is seen for the
                                second or later times, it is skipped without
                                taking any action.
 
-  @retval EFI_INVALID_PARAMETER  NumInstalled was outside the allowed range on
+  @retval EFI_INVALID_PARAMETER  NumStaged was outside the allowed range on
                                  input.
 
   @retval EFI_OUT_OF_RESOURCES   The AddPointer command identified an ACPI
                                  table different from RSDT and XSDT, but there
-                                 was no more room in InstalledKey.
+                                 was no more room in Staged.
 
   @retval EFI_SUCCESS            AddPointer has been processed. Either its
                                  absolute target address has been encountered
                                  before, or an ACPI table different from RSDT
-                                 and XSDT has been installed (reflected by
-                                 InstalledKey and NumInstalled), or RSDT or
-                                 XSDT has been identified but not installed, or
-                                 the fw_cfg blob pointed-into by AddPointer has
-                                 been marked as hosting something else than
-                                 just direct ACPI table contents.
+                                 and XSDT has been staged (reflected by Staged
+                                 and NumStaged), or RSDT or XSDT has been
+                                 identified but not staged, or the fw_cfg blob
+                                 pointed-into by AddPointer has been marked as
+                                 hosting something else than just direct ACPI
+                                 table contents.
 
   @return                        Error codes returned by
-                                 AcpiProtocol->InstallAcpiTable().
+                                 OrderedCollectionInsert().
 **/
 STATIC
 EFI_STATUS
@@ -874,9 +881,8 @@ EFIAPI
 Process2ndPassCmdAddPointer (
   IN     CONST QEMU_LOADER_ADD_POINTER *AddPointer,
   IN     CONST ORDERED_COLLECTION      *Tracker,
-  IN     EFI_ACPI_TABLE_PROTOCOL       *AcpiProtocol,
-  IN OUT UINTN                         InstalledKey[INSTALLED_TABLES_MAX],
-  IN OUT INT32                         *NumInstalled,
+  IN OUT STAGED_TABLE                  Staged[INSTALLED_TABLES_MAX],
+  IN OUT INT32                         *NumStaged,
   IN OUT ORDERED_COLLECTION            *SeenPointers
   )
 {
@@ -893,7 +899,7 @@ Process2ndPassCmdAddPointer (
   CONST EFI_ACPI_DESCRIPTION_HEADER                  *Header;
   EFI_STATUS                                         Status;
 
-  if (*NumInstalled < 0 || *NumInstalled > INSTALLED_TABLES_MAX) {
+  if (*NumStaged < 0 || *NumStaged > INSTALLED_TABLES_MAX) {
     return EFI_INVALID_PARAMETER;
   }
 
@@ -994,27 +1000,97 @@ Process2ndPassCmdAddPointer (
     return EFI_SUCCESS;
   }
 
-  if (*NumInstalled == INSTALLED_TABLES_MAX) {
+  if (*NumStaged == INSTALLED_TABLES_MAX) {
     DEBUG ((DEBUG_ERROR, "%a: can't install more than %d tables\n",
       __FUNCTION__, INSTALLED_TABLES_MAX));
-    Status = EFI_OUT_OF_RESOURCES;
-    goto RollbackSeenPointer;
+    OrderedCollectionDelete (SeenPointers, SeenPointerEntry, NULL);
+    return EFI_OUT_OF_RESOURCES;
   }
 
-  Status = AcpiProtocol->InstallAcpiTable (AcpiProtocol,
-                         (VOID *)(UINTN)PointerValue, TableSize,
-                         &InstalledKey[*NumInstalled]);
+  Staged[*NumStaged].Table = (VOID *)(UINTN)PointerValue;
+  Staged[*NumStaged].Size  = TableSize;
+  ++*NumStaged;
+  return EFI_SUCCESS;
+}
 
-  if (EFI_ERROR (Status)) {
-    DEBUG ((DEBUG_ERROR, "%a: InstallAcpiTable(): %r\n", __FUNCTION__,
-      Status));
-    goto RollbackSeenPointer;
+
+/**
+  Install the ACPI tables staged by the second pass, back to back.
+
+  The tables already have their final contents, as all the commands of the
+  QEMU linker/loader script have been applied to them in memory. If
+  QEMU_ACPI_TABLE_UPDATE_PROTOCOL is present, it may replace any table first.
+
+  @param[in] AcpiProtocol      The ACPI table protocol used to install tables.
+
+  @param[in] Staged            The tables to install.
+
+  @param[in] NumStaged         The number of entries in Staged.
+
+  @param[out] InstalledKey     An array of INSTALLED_TABLES_MAX UINTN elements,
+                               allocated by the caller. On output, the
+                               AcpiProtocol-internal keys of the installed
+                               tables.
+
+  @param[out] NumInstalled     The number of tables installed, even on error.
+
+  @retval EFI_SUCCESS          All the tables have been installed.
+
+  @return                      Error codes returned by
+                               AcpiProtocol->InstallAcpiTable().
+**/
+STATIC
+EFI_STATUS
+InstallStagedTables (
+  IN     EFI_ACPI_TABLE_PROTOCOL       *AcpiProtocol,
+  IN     CONST STAGED_TABLE            *Staged,
+  IN     INT32                         NumStaged,
+  OUT    UINTN                         InstalledKey[INSTALLED_TABLES_MAX],
+  OUT    INT32                         *NumInstalled
+  )
+{
+  QEMU_ACPI_TABLE_UPDATE_PROTOCOL    *TableUpdate;
+  CONST EFI_ACPI_DESCRIPTION_HEADER  *Header;
+  EFI_ACPI_DESCRIPTION_HEADER        *NewTable;
+  VOID                               *Table;
+  UINTN                              TableSize;
+  EFI_STATUS                         Status;
+
+  if (EFI_ERROR (gBS->LocateProtocol (&gQemuAcpiTableUpdateProtocolGuid, NULL,
+                        (VOID **)&TableUpdate))) {
+    TableUpdate = NULL;
+  }
+
+  Status = EFI_SUCCESS;
+  for (*NumInstalled = 0; *NumInstalled < NumStaged; ++*NumInstalled) {
+    Table     = Staged[*NumInstalled].Table;
+    TableSize = Staged[*NumInstalled].Size;
+    NewTable  = NULL;
+
+    Header = Table;
+    if (TableUpdate != NULL &&
+        Header->Signature !=
+                EFI_ACPI_1_0_FIRMWARE_ACPI_CONTROL_STRUCTURE_SIGNATURE &&
+        !EFI_ERROR (TableUpdate->UpdateTable (TableUpdate, Header,
+                                  &NewTable))) {
+      DEBUG ((DEBUG_VERBOSE, "%a: \"%-4.4a\" updated by the platform\n",
+        __FUNCTION__, (CONST CHAR8 *)&Header->Signature));
+      Table     = NewTable;
+      TableSize = NewTable->Length;
+    }
+
+    Status = AcpiProtocol->InstallAcpiTable (AcpiProtocol, Table, TableSize,
+                             &InstalledKey[*NumInstalled]);
+    if (NewTable != NULL) {
+      FreePool (NewTable);
+    }
+    if (EFI_ERROR (Status)) {
+      DEBUG ((DEBUG_ERROR, "%a: InstallAcpiTable(): %r\n", __FUNCTION__,
+        Status));
+      break;
+    }
   }
-  ++*NumInstalled;
-  return EFI_SUCCESS;
 
-RollbackSeenPointer:
-  OrderedCollectionDelete (SeenPointers, SeenPointerEntry, NULL);
   return Status;
 }
 
@@ -1060,6 +1136,8 @@ InstallQemuFwCfgTables (
   ORDERED_COLLECTION       *Tracker;
   UINTN                    *InstalledKey;
   INT32                    Installed;
+  STAGED_TABLE             *Staged;
+  INT32                    NumStaged;
   ORDERED_COLLECTION_ENTRY *TrackerEntry, *TrackerEntry2;
   ORDERED_COLLECTION       *SeenPointers;
   ORDERED_COLLECTION_ENTRY *SeenPointerEntry, *SeenPointerEntry2;
@@ -1176,24 +1254,30 @@ InstallQemuFwCfgTables (
     goto RollbackWritePointersAndFreeTracker;
   }
 
+  Staged = AllocatePool (INSTALLED_TABLES_MAX * sizeof *Staged);
+  if (Staged == NULL) {
+    Status = EFI_OUT_OF_RESOURCES;
+    goto FreeKeys;
+  }
+
   SeenPointers = OrderedCollectionInit (PointerCompare, PointerCompare);
   if (SeenPointers == NULL) {
     Status = EFI_OUT_OF_RESOURCES;
-    goto FreeKeys;
+    goto FreeStaged;
   }
 
   //
-  // second pass: identify and install ACPI tables
+  // second pass: identify the ACPI tables, then install them all at once
   //
   Installed = 0;
+  NumStaged = 0;
   for (LoaderEntry = LoaderStart; LoaderEntry < LoaderEnd; ++LoaderEntry) {
     if (LoaderEntry->Type == QemuLoaderCmdAddPointer) {
       Status = Process2ndPassCmdAddPointer (
                  &LoaderEntry->Command.AddPointer,
                  Tracker,
-                 AcpiProtocol,
-                 InstalledKey,
-                 &Installed,
+                 Staged,
+                 &NumStaged,
                  SeenPointers
                  );
       if (EFI_ERROR (Status)) {
@@ -1202,6 +1286,12 @@ InstallQemuFwCfgTables (
     }
   }
 
+  Status = InstallStagedTables (AcpiProtocol, Staged, NumStaged, InstalledKey,
+             &Installed);
+  if (EFI_ERROR (Status)) {
+    goto UninstallAcpiTables;
+  }
+
   //
   // Translating the condensed QEMU_LOADER_WRITE_POINTER commands to ACPI S3
   // Boot Script opcodes has to be the last operation in this function, because
@@ -1246,6 +1336,9 @@ UninstallAcpiTables:
   }
   OrderedCollectionUninit (SeenPointers);
 
+FreeStaged:
+  FreePool (Staged);
+
 FreeKeys:
   FreePool (InstalledKey);
 
@@ -0,0 +1,66 @@
+/** @file
+  GUID and structure of the in-memory debug log of TDX guests.
+
+  DEBUG messages are appended to a ring buffer in private memory instead of
+  being written to the debug I/O port, which costs one TDVMCALL per character
+  in a TD. The header of the ring lives at a fixed offset in the TD mailbox
+  page, so that every DebugLib instance can find it without any discovery
+  protocol. TdxStartupLib sets the ring up and publishes the address of the
+  header in a GUID HOB; TdxDxe installs it as a configuration table.
+
+  Copyright (c) 2021, Intel Corporation. All rights reserved.<BR>
+
+  SPDX-License-Identifier: BSD-2-Clause-Patent
+
+**/
+
+#ifndef __TDX_DEBUG_LOG_H__
+#define __TDX_DEBUG_LOG_H__
+
+#define TDX_DEBUG_LOG_GUID \
+{0x3b1a8c7e, 0x52d4, 0x4f0b, {0x9e, 0x61, 0x0c, 0x7a, 0x2d, 0x95, 0xb4, 0x13}}
+
+#define TDX_DEBUG_LOG_SIGNATURE  SIGNATURE_64 ('T', 'D', 'X', 'D', 'B', 'G', 'L', 'G')
+
+//
+// Offset of the header in the TD mailbox page (PcdOvmfSecGhcbBackupBase).
+// The TDX work area of the reset vector occupies [0x10, 0x20).
+//
+#define TDX_DEBUG_LOG_MAILBOX_OFFSET  0x20
+
+typedef struct {
+  ///
+  /// TDX_DEBUG_LOG_SIGNATURE.
+  ///
+  UINT64                Signature;
+  ///
+  /// Base address and size in bytes of the ring buffer. The size is a power
+  /// of two.
+  ///
+  EFI_PHYSICAL_ADDRESS  RingBase;
+  UINT64                RingSize;
+  ///
+  /// Signature ^ RingBase ^ RingSize. Guards against stale data in the
+  /// mailbox page being taken for a header.
+  ///
+  UINT64                Check;
+  ///
+  /// The number of bytes ever written to the ring. The byte at log position
+  /// N is stored at RingBase + (N & (RingSize - 1)), so the ring holds log
+  /// positions [MAX (Head, RingSize) - RingSize, Head).
+  ///
+  volatile UINT64       Head;
+  ///
+  /// The number of bytes ever sent to the debug I/O port.
+  ///
+  volatile UINT64       Flushed;
+  ///
+  /// 0 when free, 1 while a processor appends to the ring or flushes it.
+  /// Head and Flushed are only updated by the holder.
+  ///
+  volatile UINT32       Lock;
+} TDX_DEBUG_LOG;
+
+extern EFI_GUID gUefiOvmfPkgTdxDebugLogGuid;
+
+#endif
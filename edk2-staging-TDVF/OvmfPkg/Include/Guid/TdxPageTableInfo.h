@@ -0,0 +1,53 @@
+/** @file
+  GUID HOB that describes the identity-mapping page tables that TdxStartupLib
+  hands off to DXE.
+
+  The page tables only map the address ranges that the resource descriptor
+  HOBs describe, plus the 32-bit address space. TdxDxe maps other addresses
+  on demand, from a pool of page table pages that TdxStartupLib reserves.
+
+  Copyright (c) 2021, Intel Corporation. All rights reserved.<BR>
+
+  SPDX-License-Identifier: BSD-2-Clause-Patent
+
+**/
+
+#ifndef __TDX_PAGE_TABLE_INFO_H__
+#define __TDX_PAGE_TABLE_INFO_H__
+
+#define TDX_PAGE_TABLE_INFO_GUID \
+{0x8ed7c998, 0xeee6, 0x42f1, {0xa3, 0x61, 0x5e, 0xe8, 0x34, 0xdd, 0xc9, 0x1a}}
+
+typedef struct {
+  ///
+  /// Number of pages that the page tables occupied at hand-off, excluding the
+  /// on-demand pool.
+  ///
+  UINT64                PageTablePages;
+  ///
+  /// Time it took to build the page tables, in TSC ticks.
+  ///
+  UINT64                BuildTicks;
+  ///
+  /// The memory encryption mask that is set in non-leaf and leaf entries.
+  ///
+  UINT64                AddressEncMask;
+  ///
+  /// Base and size of the page pool for on-demand mappings. The pages are
+  /// part of the write-protected page table pool.
+  ///
+  EFI_PHYSICAL_ADDRESS  OnDemandPoolBase;
+  UINT32                OnDemandPoolPages;
+  ///
+  /// Addresses at or above 2^PhysicalAddressBits are never mapped.
+  ///
+  UINT8                 PhysicalAddressBits;
+  ///
+  /// TRUE if on-demand mappings use 1GB pages, FALSE for 2MB pages.
+  ///
+  BOOLEAN               Page1GSupport;
+} TDX_PAGE_TABLE_INFO;
+
+extern EFI_GUID gUefiOvmfPkgTdxPageTableInfoGuid;
+
+#endif
@@ -83,6 +83,20 @@ typedef enum {
 
 } FIRMWARE_CONFIG_ITEM;
 
+//
+// An entry of the file directory, QemuFwCfgItemFileDir. The directory starts
+// with the number of entries, as a big endian UINT32. Size and Select are big
+// endian.
+//
+#pragma pack (1)
+typedef struct {
+  UINT32 Size;
+  UINT16 Select;
+  UINT16 Reserved;
+  CHAR8  Name[QEMU_FW_CFG_FNAME_SIZE];
+} FW_CFG_FILE;
+#pragma pack ()
+
 //
 // Communication structure for the DMA access method. All fields are encoded in
 // big endian.
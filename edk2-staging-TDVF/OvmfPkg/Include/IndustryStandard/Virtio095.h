@@ -130,7 +130,7 @@ typedef struct {
 //
 #define VRING_DESC_F_NEXT     BIT0 // more descriptors in this request
 #define VRING_DESC_F_WRITE    BIT1 // buffer to be written *by the host*
-#define VRING_DESC_F_INDIRECT BIT2 // unused
+#define VRING_DESC_F_INDIRECT BIT2 // buffer holds a table of descriptors
 
 #pragma pack(1)
 typedef struct {
@@ -148,6 +148,8 @@ typedef struct {
   VRING_AVAIL         Avail;
   VRING_USED          Used;
   UINT16              QueueSize;
+  VOID                *Event;      // EFI_EVENT; NULL if the ring is polled
+  UINT16              EventQueue;  // queue index Event is registered for
 } VRING;
 
 //
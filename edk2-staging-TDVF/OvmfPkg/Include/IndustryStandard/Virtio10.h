@@ -70,6 +70,12 @@ typedef struct {
 } VIRTIO_PCI_COMMON_CFG;
 #pragma pack ()
 
+//
+// The value of VIRTIO_PCI_COMMON_CFG.MsixConfig and .QueueMsixVector that
+// disables MSI-X notifications
+//
+#define VIRTIO_MSI_NO_VECTOR 0xFFFF
+
 //
 // VirtIo 1.0 device status bits
 //
@@ -124,6 +124,7 @@ typedef struct {
 // Flags for VirtioFsFuseOpInit.
 //
 #define VIRTIO_FS_FUSE_INIT_REQ_F_DO_READDIRPLUS BIT13
+#define VIRTIO_FS_FUSE_INIT_REQ_F_MAX_PAGES      BIT22
 
 /**
   Macro for calculating the size of a directory stream entry.
@@ -79,6 +79,40 @@ VirtioRingMap (
   OUT VOID                   **Mapping
   );
 
+/**
+
+  Attach an event to a virtio ring, and ask the device to signal it when the
+  device places buffers in the used ring of the queue.
+
+  When the device supports it, VirtioPrepare() stops suppressing used buffer
+  notifications for the ring, and VirtioFlush() halts the CPU until the event
+  is signaled, rather than polling the used ring.
+
+  The function is to be called after VirtioRingInit() and before the queue is
+  enabled (that is, before VirtIo->SetQueueAddress()). VirtioRingUninit()
+  detaches and closes the event.
+
+  @param[in]     VirtIo      The virtio device that owns the ring.
+
+  @param[in]     QueueIndex  The index of the queue that Ring is used for.
+
+  @param[in,out] Ring        The virtio ring to attach the event to.
+
+  @retval EFI_SUCCESS  The event has been attached to the ring, or the device
+                       does not support interrupt-driven completion (in which
+                       case Ring->Event stays NULL, and the ring is polled).
+
+  @return              Error codes from gBS->CreateEvent() and
+                       VirtIo->SetQueueEvent().
+**/
+EFI_STATUS
+EFIAPI
+VirtioRingEnableEvent (
+  IN     VIRTIO_DEVICE_PROTOCOL *VirtIo,
+  IN     UINT16                 QueueIndex,
+  IN OUT VRING                  *Ring
+  );
+
 /**
 
   Tear down the internal resources of a configured virtio ring.
@@ -156,8 +190,9 @@ VirtioPrepare (
   @param[in] Flags                  A bitmask of VRING_DESC_F_* flags. The
                                     caller computes this mask dependent on
                                     further buffers to append and transfer
-                                    direction. VRING_DESC_F_INDIRECT is
-                                    unsupported. The VRING_DESC.Next field is
+                                    direction. For VRING_DESC_F_INDIRECT, use
+                                    VirtioAppendIndirectTable(). The
+                                    VRING_DESC.Next field is
                                     always set, but the host only interprets
                                     it dependent on VRING_DESC_F_NEXT.
 
@@ -217,6 +252,162 @@ VirtioFlush (
   );
 
 
+//
+// Guest-allocated table of indirect descriptors (virtio-1.0, 2.4.5.3 Indirect
+// Descriptors). A single descriptor in the virtio ring, flagged with
+// VRING_DESC_F_INDIRECT, refers to the whole table, so a request consumes one
+// ring entry irrespective of the number of buffers it consists of.
+//
+typedef struct {
+  UINTN                NumPages;
+  VOID                 *Base;          // deallocate only this field
+  volatile VRING_DESC  *Desc;          // NumDescs elements
+  UINT16               NumDescs;
+  EFI_PHYSICAL_ADDRESS DeviceAddress;  // of Base, for the ring descriptor
+  VOID                 *Mapping;       // VirtIo->UnmapSharedBuffer() token
+} VRING_INDIRECT;
+
+
+/**
+
+  Allocate and map a table of indirect descriptors.
+
+  The table is allocated with VirtIo->AllocateSharedPages() and mapped as a
+  common buffer, so that both the guest and the hypervisor can access it (for
+  example, the table resides in shared memory in a confidential guest). The
+  table may be reused for any number of requests, but it may only carry one
+  in-flight request at a time.
+
+  @param[in]  VirtIo         The virtio device which will use the table.
+
+  @param[in]  NumDescs       The number of descriptors to allocate. The caller
+                             is responsible for not exceeding the queue size
+                             of the device.
+
+  @param[out] Table          The indirect descriptor table to set up.
+
+  @retval EFI_SUCCESS        Allocation and mapping successful.
+
+  @return                    Status codes propagated from
+                             VirtIo->AllocateSharedPages() and
+                             VirtioMapAllBytesInSharedBuffer().
+
+**/
+EFI_STATUS
+EFIAPI
+VirtioIndirectTableInit (
+  IN  VIRTIO_DEVICE_PROTOCOL *VirtIo,
+  IN  UINT16                 NumDescs,
+  OUT VRING_INDIRECT         *Table
+  );
+
+
+/**
+
+  Unmap and release a table of indirect descriptors that has been set up with
+  VirtioIndirectTableInit().
+
+  The caller is responsible to stop the host from using the table before
+  invoking this function.
+
+  @param[in]     VirtIo  The virtio device which was using the table.
+
+  @param[in,out] Table   The indirect descriptor table to clean up.
+
+**/
+VOID
+EFIAPI
+VirtioIndirectTableUninit (
+  IN     VIRTIO_DEVICE_PROTOCOL *VirtIo,
+  IN OUT VRING_INDIRECT         *Table
+  );
+
+
+/**
+
+  Prepare for appending multiple descriptors to a table of indirect
+  descriptors.
+
+  @param[in,out] Table  The indirect descriptor table we intend to append
+                        descriptors to.
+
+  @param[out] Indices   The DESC_INDICES structure to initialize.
+
+**/
+VOID
+EFIAPI
+VirtioPrepareIndirect (
+  IN OUT VRING_INDIRECT *Table,
+  OUT    DESC_INDICES   *Indices
+  );
+
+
+/**
+
+  Append a contiguous buffer for transmission / reception to a table of
+  indirect descriptors.
+
+  The semantics of the parameters are identical to those of
+  VirtioAppendDesc(), except that the descriptor is placed into Table, and
+  that the caller is responsible for not exceeding Table->NumDescs.
+
+  @param[in,out] Table              The indirect descriptor table to append
+                                    the buffer to, as a descriptor.
+
+  @param[in] BufferDeviceAddress    (Bus master device) start address of the
+                                    transmit / receive buffer.
+
+  @param[in] BufferSize             Number of bytes to transmit or receive.
+
+  @param[in] Flags                  A bitmask of VRING_DESC_F_* flags.
+                                    VRING_DESC_F_INDIRECT is not permitted.
+
+  @param[in,out] Indices            Initialized with VirtioPrepareIndirect().
+                                    Indices->NextDescIdx is incremented by
+                                    one.
+
+**/
+VOID
+EFIAPI
+VirtioAppendIndirectDesc (
+  IN OUT VRING_INDIRECT *Table,
+  IN     UINT64         BufferDeviceAddress,
+  IN     UINT32         BufferSize,
+  IN     UINT16         Flags,
+  IN OUT DESC_INDICES   *Indices
+  );
+
+
+/**
+
+  Append a single descriptor to the virtio ring that refers to the descriptor
+  chain built in a table of indirect descriptors.
+
+  The caller is responsible for initializing *RingIndices with VirtioPrepare()
+  first, and for submitting the request with VirtioFlush() afterwards.
+
+  @param[in,out] Ring          The virtio ring to append the descriptor to.
+
+  @param[in] Table             The indirect descriptor table carrying the
+                               descriptor chain.
+
+  @param[in] TableIndices      TableIndices->NextDescIdx identifies the number
+                               of descriptors appended to Table.
+
+  @param[in,out] RingIndices   On output, RingIndices->NextDescIdx is
+                               incremented by one, modulo 2^16.
+
+**/
+VOID
+EFIAPI
+VirtioAppendIndirectTable (
+  IN OUT VRING          *Ring,
+  IN     VRING_INDIRECT *Table,
+  IN     DESC_INDICES   *TableIndices,
+  IN OUT DESC_INDICES   *RingIndices
+  );
+
+
 /**
 
   Report the feature bits to the VirtIo 1.0 device that the VirtIo 1.0 driver
@@ -0,0 +1,53 @@
+/** @file
+  Let a platform driver replace ACPI tables from QEMU before they are
+  installed.
+
+  AcpiPlatformDxe applies the QEMU linker/loader script to the fw_cfg blobs in
+  memory, then installs all the resulting ACPI tables at once. If the protocol
+  is present, each table is passed to UpdateTable() first, so that the driver
+  does not need to uninstall and reinstall the table after the fact.
+
+  Copyright (c) 2021, Intel Corporation. All rights reserved.<BR>
+  SPDX-License-Identifier: BSD-2-Clause-Patent
+
+**/
+
+#ifndef __QEMU_ACPI_TABLE_UPDATE_H__
+#define __QEMU_ACPI_TABLE_UPDATE_H__
+
+#include <IndustryStandard/Acpi.h>
+
+#define QEMU_ACPI_TABLE_UPDATE_PROTOCOL_GUID \
+  { 0x63542d9d, 0x262a, 0x477b, { 0x8f, 0x41, 0x15, 0x03, 0x65, 0x97, 0x9f, 0xa0 } }
+
+typedef struct _QEMU_ACPI_TABLE_UPDATE_PROTOCOL QEMU_ACPI_TABLE_UPDATE_PROTOCOL;
+
+/**
+  Return the table to install in place of an ACPI table from QEMU.
+
+  @param[in]  This       This pointer for QEMU_ACPI_TABLE_UPDATE_PROTOCOL.
+  @param[in]  Table      The ACPI table from QEMU, with a valid checksum. The
+                         FACS, which has no such header, is not passed.
+  @param[out] NewTable   The table to install instead, allocated from pool
+                         and freed by the caller. The checksum is computed
+                         when the table is installed.
+
+  @retval EFI_SUCCESS           NewTable is returned.
+  @retval EFI_UNSUPPORTED       The table is installed unchanged.
+  @retval EFI_OUT_OF_RESOURCES  The table is installed unchanged.
+**/
+typedef
+EFI_STATUS
+(EFIAPI *QEMU_ACPI_TABLE_UPDATE) (
+  IN  QEMU_ACPI_TABLE_UPDATE_PROTOCOL    *This,
+  IN  CONST EFI_ACPI_DESCRIPTION_HEADER  *Table,
+  OUT EFI_ACPI_DESCRIPTION_HEADER        **NewTable
+  );
+
+struct _QEMU_ACPI_TABLE_UPDATE_PROTOCOL {
+  QEMU_ACPI_TABLE_UPDATE    UpdateTable;
+};
+
+extern EFI_GUID gQemuAcpiTableUpdateProtocolGuid;
+
+#endif
@@ -466,6 +466,50 @@ EFI_STATUS
   IN  VOID                      *Mapping
   );
 
+/**
+  Route the used buffer notifications of a virtqueue to an event.
+
+  Whenever the device places buffers on the Used Ring of the queue, and the
+  driver has not suppressed the notification with VRING_AVAIL_F_NO_INTERRUPT,
+  the transport signals Event from its interrupt handler. This allows the
+  driver to wait for, or to be notified about, request completion instead of
+  polling the Used Ring.
+
+  The function should be called before VIRTIO_SET_QUEUE_ADDRESS enables the
+  queue. The event must be unregistered (by passing NULL for Event) before it
+  is closed.
+
+  This member of VIRTIO_DEVICE_PROTOCOL is optional, and was added after the
+  others: a transport that cannot deliver interrupts may set it to NULL, and
+  callers must check it for NULL before calling it.
+
+  @param[in] This        This instance of VIRTIO_DEVICE_PROTOCOL.
+
+  @param[in] QueueIndex  The index of the queue whose notifications should be
+                         routed.
+
+  @param[in] Event       The event to signal. NULL unregisters the event that
+                         has previously been registered for QueueIndex.
+
+  @retval EFI_SUCCESS           The event has been registered or unregistered.
+
+  @retval EFI_UNSUPPORTED       The transport cannot deliver interrupts for the
+                                device, or the platform has not enabled
+                                interrupt delivery. The driver has to poll the
+                                Used Ring.
+
+  @retval EFI_OUT_OF_RESOURCES  Memory allocation failed.
+
+  @return                       Error codes from the underlying IO device.
+**/
+typedef
+EFI_STATUS
+(EFIAPI *VIRTIO_SET_QUEUE_EVENT)(
+  IN  VIRTIO_DEVICE_PROTOCOL    *This,
+  IN  UINT16                    QueueIndex,
+  IN  EFI_EVENT                 Event       OPTIONAL
+  );
+
 ///
 ///  This protocol provides an abstraction over the VirtIo transport layer
 ///
@@ -513,6 +557,12 @@ struct _VIRTIO_DEVICE_PROTOCOL {
   VIRTIO_FREE_SHARED          FreeSharedPages;
   VIRTIO_MAP_SHARED           MapSharedBuffer;
   VIRTIO_UNMAP_SHARED         UnmapSharedBuffer;
+
+  //
+  // Function to request interrupt-driven completion. Optional: NULL if the
+  // transport cannot deliver interrupts.
+  //
+  VIRTIO_SET_QUEUE_EVENT      SetQueueEvent;
 };
 
 extern EFI_GUID gVirtioDeviceProtocolGuid;
@@ -0,0 +1,67 @@
+/** @file
+  Print the in-memory debug log of a TDX guest, oldest message first.
+
+  Copyright (c) 2021, Intel Corporation. All rights reserved.<BR>
+
+  SPDX-License-Identifier: BSD-2-Clause-Patent
+
+**/
+
+#include <Uefi.h>
+#include <Library/BaseLib.h>
+#include <Library/BaseMemoryLib.h>
+#include <Library/UefiLib.h>
+#include <Guid/TdxDebugLog.h>
+
+#define PRINT_CHUNK_SIZE  256
+
+/**
+  The entry point of the application.
+
+  @param[in] ImageHandle  The firmware allocated handle for the EFI image.
+  @param[in] SystemTable  A pointer to the EFI System Table.
+
+  @retval EFI_SUCCESS     The debug log has been printed.
+  @retval EFI_NOT_FOUND   The firmware has not set up a debug log.
+
+**/
+EFI_STATUS
+EFIAPI
+UefiMain (
+  IN EFI_HANDLE        ImageHandle,
+  IN EFI_SYSTEM_TABLE  *SystemTable
+  )
+{
+  EFI_STATUS     Status;
+  TDX_DEBUG_LOG  *Log;
+  UINT64         Head;
+  UINT64         Position;
+  UINTN          Offset;
+  UINTN          Length;
+  CHAR8          Chunk[PRINT_CHUNK_SIZE + 1];
+
+  Status = EfiGetSystemConfigurationTable (&gUefiOvmfPkgTdxDebugLogGuid, (VOID **) &Log);
+  if (EFI_ERROR (Status) || Log->Signature != TDX_DEBUG_LOG_SIGNATURE) {
+    Print (L"TDX debug log not found\n");
+    return EFI_NOT_FOUND;
+  }
+
+  Head = Log->Head;
+  Position = 0;
+  if (Head > Log->RingSize) {
+    Position = Head - Log->RingSize;
+    Print (L"[%ld bytes of older messages have been overwritten]\n", Position);
+  }
+
+  while (Position < Head) {
+    Offset = (UINTN) (Position & (Log->RingSize - 1));
+    Length = (UINTN) MIN (Head - Position, PRINT_CHUNK_SIZE);
+    Length = MIN (Length, (UINTN) Log->RingSize - Offset);
+    CopyMem (Chunk, (VOID *) (UINTN) (Log->RingBase + Offset), Length);
+    Chunk[Length] = '\0';
+    Print (L"%a", Chunk);
+    Position += Length;
+  }
+
+  return EFI_SUCCESS;
+}
@@ -1416,7 +1416,7 @@ PlatformBdsConnectSequence (
   }
 
   Status = ConnectDevicesFromQemu ();
-  if (RETURN_ERROR (Status)) {
+  if (RETURN_ERROR (Status) && !ConnectBootPathCache ()) {
     //
     // Just use the simple policy to connect all devices
     //
@@ -1541,6 +1541,8 @@ PlatformBootManagerAfterConsole (
   SetBootOrderFromQemu ();
 
   PlatformBmPrintScRegisterHandler ();
+
+  RegisterBootPathCache ();
 }
 
 /**
@@ -1701,6 +1703,26 @@ PlatformBootManagerUnableToBoot (
   EFI_INPUT_KEY                Key;
   EFI_BOOT_MANAGER_LOAD_OPTION BootManagerMenu;
   UINTN                        Index;
+  EFI_BOOT_MANAGER_LOAD_OPTION *BootOptions;
+  UINTN                        BootOptionCount;
+
+  //
+  // If only the devices of the previous boots have been connected, connect
+  // the other ones and try their boot options before giving up.
+  //
+  if (ConnectBootPathCacheDeferred ()) {
+    BootOptions = EfiBootManagerGetLoadOptions (&BootOptionCount,
+                    LoadOptionTypeBoot);
+    for (Index = 0; Index < BootOptionCount; Index++) {
+      if (((BootOptions[Index].Attributes & LOAD_OPTION_ACTIVE) == 0) ||
+          ((BootOptions[Index].Attributes & LOAD_OPTION_CATEGORY) !=
+           LOAD_OPTION_CATEGORY_BOOT)) {
+        continue;
+      }
+      EfiBootManagerBoot (&BootOptions[Index]);
+    }
+    EfiBootManagerFreeLoadOptions (BootOptions, BootOptionCount);
+  }
 
   //
   // BootManagerMenu doesn't contain the correct information when return status
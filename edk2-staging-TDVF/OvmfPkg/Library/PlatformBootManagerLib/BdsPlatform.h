@@ -45,6 +45,7 @@ Abstract:
 #include <Library/QemuFwCfgLib.h>
 #include <Library/QemuFwCfgS3Lib.h>
 #include <Library/QemuBootOrderLib.h>
+#include <Library/PrintLib.h>
 
 #include <Protocol/Decompress.h>
 #include <Protocol/PciIo.h>
@@ -187,4 +188,37 @@ TryRunningQemuKernel (
   VOID
   );
 
+/**
+  Connect the devices of the cached boot device paths, and their children,
+  recursively.
+
+  @retval TRUE   At least one device has been connected. The other devices
+                 are connected only if no boot option can be launched.
+  @retval FALSE  Nothing is cached, or no cached device is present.
+**/
+BOOLEAN
+ConnectBootPathCache (
+  VOID
+  );
+
+/**
+  Connect all the devices if ConnectBootPathCache() has left them
+  disconnected, and create their boot options.
+
+  @retval TRUE   The devices have been connected.
+  @retval FALSE  All the devices were already connected.
+**/
+BOOLEAN
+ConnectBootPathCacheDeferred (
+  VOID
+  );
+
+/**
+  Remember the device paths of the boot options as they are launched.
+**/
+VOID
+RegisterBootPathCache (
+  VOID
+  );
+
 #endif // _PLATFORM_SPECIFIC_BDS_PLATFORM_H_
@@ -0,0 +1,345 @@
+/** @file
+  Connect the devices of the previous boots only, instead of all devices.
+
+  The device paths of the boot options that are launched are remembered in a
+  non-volatile variable, most recent first. When QEMU does not specify a boot
+  order, BDS connects these devices only, and connects all the other devices
+  if none of the boot options can be launched.
+
+  Copyright (c) 2021, Intel Corporation. All rights reserved.<BR>
+  SPDX-License-Identifier: BSD-2-Clause-Patent
+
+**/
+
+#include "BdsPlatform.h"
+#include <Guid/OvmfPlatformConfig.h>
+#include <Protocol/BlockIo.h>
+
+//
+// Name of the variable holding the boot device paths, under
+// gOvmfPlatformConfigGuid. It is a multi-instance device path.
+//
+#define BOOT_PATH_CACHE_VARIABLE_NAME  L"BootPathCache"
+
+//
+// Maximum number of device paths remembered.
+//
+#define BOOT_PATH_CACHE_MAX_COUNT      4
+
+//
+// TRUE if the devices that are not in the cache have not been connected.
+//
+STATIC BOOLEAN  mBootPathCacheConnectDeferred = FALSE;
+
+/**
+  Return the cached boot device paths.
+
+  @return The multi-instance device path, to be freed with FreePool(), or
+          NULL if there is none.
+**/
+STATIC
+EFI_DEVICE_PATH_PROTOCOL *
+GetBootPathCache (
+  VOID
+  )
+{
+  EFI_STATUS                Status;
+  EFI_DEVICE_PATH_PROTOCOL  *Cache;
+  UINTN                     CacheSize;
+
+  Status = GetVariable2 (
+             BOOT_PATH_CACHE_VARIABLE_NAME,
+             &gOvmfPlatformConfigGuid,
+             (VOID **) &Cache,
+             &CacheSize
+             );
+  if (EFI_ERROR (Status)) {
+    return NULL;
+  }
+
+  if (!IsDevicePathValid (Cache, CacheSize)) {
+    DEBUG ((DEBUG_WARN, "%a: ignoring invalid %s\n", __FUNCTION__,
+      BOOT_PATH_CACHE_VARIABLE_NAME));
+    FreePool (Cache);
+    return NULL;
+  }
+
+  return Cache;
+}
+
+/**
+  Connect the devices of the cached boot device paths, and their children,
+  recursively.
+
+  @retval TRUE   At least one device has been connected. The other devices
+                 are connected only if no boot option can be launched.
+  @retval FALSE  Nothing is cached, or no cached device is present.
+**/
+BOOLEAN
+ConnectBootPathCache (
+  VOID
+  )
+{
+  EFI_DEVICE_PATH_PROTOCOL  *Cache;
+  EFI_DEVICE_PATH_PROTOCOL  *Remaining;
+  EFI_DEVICE_PATH_PROTOCOL  *Instance;
+  UINTN                     InstanceSize;
+  EFI_HANDLE                Controller;
+  EFI_STATUS                Status;
+  UINTN                     NumConnected;
+
+  if (!PcdGetBool (PcdBootPathCacheConnect)) {
+    return FALSE;
+  }
+
+  Cache = GetBootPathCache ();
+  if (Cache == NULL) {
+    return FALSE;
+  }
+
+  NumConnected = 0;
+  Remaining    = Cache;
+  while ((Instance = GetNextDevicePathInstance (&Remaining, &InstanceSize)) != NULL) {
+    Status = EfiBootManagerConnectDevicePath (Instance, &Controller);
+    if (!EFI_ERROR (Status)) {
+      //
+      // Connect the partitions and the file systems of the device too.
+      //
+      Status = gBS->ConnectController (Controller, NULL, NULL, TRUE);
+    }
+    DEBUG ((DEBUG_VERBOSE, "%a: connecting cached boot path: %r\n",
+      __FUNCTION__, Status));
+    if (!EFI_ERROR (Status)) {
+      NumConnected++;
+    }
+    FreePool (Instance);
+  }
+  FreePool (Cache);
+
+  DEBUG ((DEBUG_INFO, "%a: %Lu cached boot device(s) connected\n",
+    __FUNCTION__, (UINT64)NumConnected));
+
+  mBootPathCacheConnectDeferred = (BOOLEAN) (NumConnected > 0);
+  return mBootPathCacheConnectDeferred;
+}
+
+/**
+  Connect all the devices if ConnectBootPathCache() has left them
+  disconnected, and create their boot options.
+
+  @retval TRUE   The devices have been connected.
+  @retval FALSE  All the devices were already connected.
+**/
+BOOLEAN
+ConnectBootPathCacheDeferred (
+  VOID
+  )
+{
+  if (!mBootPathCacheConnectDeferred) {
+    return FALSE;
+  }
+
+  mBootPathCacheConnectDeferred = FALSE;
+  DEBUG ((DEBUG_INFO, "%a: EfiBootManagerConnectAll\n", __FUNCTION__));
+  EfiBootManagerConnectAll ();
+  EfiBootManagerRefreshAllBootOption ();
+  return TRUE;
+}
+
+/**
+  Expand a hard drive short-form device path, HD(...)/..., to the full device
+  path of the partition.
+
+  Only the partitions that are already connected are searched: the devices are
+  not connected, unlike EfiBootManagerGetNextLoadOptionDevicePath().
+
+  @param[in] FilePath  The short-form device path, starting with a hard drive
+                       media device path node.
+
+  @return The full device path, to be freed with FreePool(), or NULL if no
+          connected partition matches.
+**/
+STATIC
+EFI_DEVICE_PATH_PROTOCOL *
+ExpandPartitionDevicePath (
+  IN EFI_DEVICE_PATH_PROTOCOL  *FilePath
+  )
+{
+  EFI_STATUS                Status;
+  EFI_HANDLE                *Handles;
+  UINTN                     HandleCount;
+  UINTN                     Index;
+  EFI_DEVICE_PATH_PROTOCOL  *Node;
+  EFI_DEVICE_PATH_PROTOCOL  *FullPath;
+
+  Status = gBS->LocateHandleBuffer (
+                  ByProtocol,
+                  &gEfiBlockIoProtocolGuid,
+                  NULL,
+                  &HandleCount,
+                  &Handles
+                  );
+  if (EFI_ERROR (Status)) {
+    return NULL;
+  }
+
+  FullPath = NULL;
+  for (Index = 0; (Index < HandleCount) && (FullPath == NULL); Index++) {
+    Node = DevicePathFromHandle (Handles[Index]);
+    if (Node == NULL) {
+      continue;
+    }
+    //
+    // The device path of a partition ends with its hard drive node.
+    //
+    while (!IsDevicePathEnd (NextDevicePathNode (Node))) {
+      Node = NextDevicePathNode (Node);
+    }
+    if ((DevicePathNodeLength (Node) == DevicePathNodeLength (FilePath)) &&
+        (CompareMem (Node, FilePath, DevicePathNodeLength (FilePath)) == 0)) {
+      FullPath = AppendDevicePath (
+                   DevicePathFromHandle (Handles[Index]),
+                   NextDevicePathNode (FilePath)
+                   );
+    }
+  }
+
+  FreePool (Handles);
+  return FullPath;
+}
+
+/**
+  Add the device path of the boot option being launched to the cache.
+
+  Hard drive short-form boot options, HD(...)/..., are cached with the full
+  device path of their partition. Boot options that do not start with a
+  device otherwise (e.g. applications in the firmware volumes, or the File()
+  and USB short-forms, which can only be expanded by probing and connecting
+  all the devices) are not cached.
+
+  @param[in] Event    The ReadyToBoot event.
+  @param[in] Context  Not used.
+**/
+STATIC
+VOID
+EFIAPI
+UpdateBootPathCache (
+  IN EFI_EVENT  Event,
+  IN VOID       *Context
+  )
+{
+  EFI_STATUS                    Status;
+  UINT16                        *BootCurrent;
+  CHAR16                        OptionName[sizeof ("Boot####")];
+  EFI_BOOT_MANAGER_LOAD_OPTION  Option;
+  EFI_DEVICE_PATH_PROTOCOL      *OptionPath;
+  UINT8                         PathType;
+  EFI_DEVICE_PATH_PROTOCOL      *OldCache;
+  EFI_DEVICE_PATH_PROTOCOL      *NewCache;
+  EFI_DEVICE_PATH_PROTOCOL      *Remaining;
+  EFI_DEVICE_PATH_PROTOCOL      *Instance;
+  EFI_DEVICE_PATH_PROTOCOL      *Appended;
+  UINTN                         OptionPathSize;
+  UINTN                         InstanceSize;
+  UINTN                         Count;
+
+  Status = GetEfiGlobalVariable2 (EFI_BOOT_CURRENT_VARIABLE_NAME, (VOID **) &BootCurrent, NULL);
+  if (EFI_ERROR (Status)) {
+    return;
+  }
+  UnicodeSPrint (OptionName, sizeof (OptionName), L"Boot%04x", *BootCurrent);
+  FreePool (BootCurrent);
+
+  Status = EfiBootManagerVariableToLoadOption (OptionName, &Option);
+  if (EFI_ERROR (Status)) {
+    return;
+  }
+
+  if ((DevicePathType (Option.FilePath) == MEDIA_DEVICE_PATH) &&
+      (DevicePathSubType (Option.FilePath) == MEDIA_HARDDRIVE_DP)) {
+    OptionPath = ExpandPartitionDevicePath (Option.FilePath);
+  } else {
+    OptionPath = DuplicateDevicePath (Option.FilePath);
+  }
+  if (OptionPath == NULL) {
+    goto FreeOption;
+  }
+
+  PathType = DevicePathType (OptionPath);
+  if ((PathType != ACPI_DEVICE_PATH) && (PathType != HARDWARE_DEVICE_PATH)) {
+    goto FreeOptionPath;
+  }
+
+  //
+  // Put the option first, and keep the other cached paths in their order.
+  //
+  OldCache       = GetBootPathCache ();
+  NewCache       = DuplicateDevicePath (OptionPath);
+  OptionPathSize = GetDevicePathSize (OptionPath);
+  Count          = 1;
+  Remaining      = OldCache;
+  while ((NewCache != NULL) && (Count < BOOT_PATH_CACHE_MAX_COUNT) &&
+         ((Instance = GetNextDevicePathInstance (&Remaining, &InstanceSize)) != NULL)) {
+    if ((InstanceSize != OptionPathSize) ||
+        (CompareMem (Instance, OptionPath, InstanceSize) != 0)) {
+      Appended = AppendDevicePathInstance (NewCache, Instance);
+      FreePool (NewCache);
+      NewCache = Appended;
+      Count++;
+    }
+    FreePool (Instance);
+  }
+
+  if ((NewCache != NULL) &&
+      ((OldCache == NULL) ||
+       (GetDevicePathSize (NewCache) != GetDevicePathSize (OldCache)) ||
+       (CompareMem (NewCache, OldCache, GetDevicePathSize (NewCache)) != 0))) {
+    Status = gRT->SetVariable (
+                    BOOT_PATH_CACHE_VARIABLE_NAME,
+                    &gOvmfPlatformConfigGuid,
+                    EFI_VARIABLE_NON_VOLATILE | EFI_VARIABLE_BOOTSERVICE_ACCESS,
+                    GetDevicePathSize (NewCache),
+                    NewCache
+                    );
+    DEBUG ((EFI_ERROR (Status) ? DEBUG_ERROR : DEBUG_VERBOSE,
+      "%a: SetVariable(%s, %s): %r\n", __FUNCTION__,
+      BOOT_PATH_CACHE_VARIABLE_NAME, OptionName, Status));
+  }
+
+  if (NewCache != NULL) {
+    FreePool (NewCache);
+  }
+  if (OldCache != NULL) {
+    FreePool (OldCache);
+  }
+
+FreeOptionPath:
+  FreePool (OptionPath);
+
+FreeOption:
+  EfiBootManagerFreeLoadOption (&Option);
+}
+
+/**
+  Remember the device paths of the boot options as they are launched.
+**/
+VOID
+RegisterBootPathCache (
+  VOID
+  )
+{
+  EFI_STATUS  Status;
+  EFI_EVENT   Event;
+
+  if (!PcdGetBool (PcdBootPathCacheConnect)) {
+    return;
+  }
+
+  Status = EfiCreateEventReadyToBootEx (
+             TPL_CALLBACK,
+             UpdateBootPathCache,
+             NULL,
+             &Event
+             );
+  ASSERT_EFI_ERROR (Status);
+}
@@ -0,0 +1,49 @@
+/** @file
+  Output of debug messages to the hypervisor debug port.
+
+  Copyright (c) 2006 - 2019, Intel Corporation. All rights reserved.<BR>
+  Copyright (c) 2012, Red Hat, Inc.<BR>
+  SPDX-License-Identifier: BSD-2-Clause-Patent
+
+**/
+
+#include <Base.h>
+#include <Library/IoLib.h>
+#include <Library/PcdLib.h>
+#include "DebugLibDetect.h"
+
+/**
+  Return whether DEBUG messages can be output, either to the debug I/O port or
+  to a memory log.
+
+  @retval TRUE   if the debug I/O port device was detected.
+  @retval FALSE  otherwise
+
+**/
+BOOLEAN
+EFIAPI
+PlatformDebugLibOutputFound (
+  VOID
+  )
+{
+  return PlatformDebugLibIoPortFound ();
+}
+
+/**
+  Output a formatted debug message.
+
+  @param[in] ErrorLevel  The error level of the debug message.
+  @param[in] Buffer      The message.
+  @param[in] Length      The length of the message in bytes.
+
+**/
+VOID
+EFIAPI
+PlatformDebugLibWrite (
+  IN UINTN        ErrorLevel,
+  IN CONST CHAR8  *Buffer,
+  IN UINTN        Length
+  )
+{
+  IoWriteFifo8 (PcdGet16 (PcdDebugIoPort), Length, (VOID *) Buffer);
+}
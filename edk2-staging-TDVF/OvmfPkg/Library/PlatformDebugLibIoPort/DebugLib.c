@@ -11,7 +11,6 @@
 #include <Base.h>
 #include <Library/DebugLib.h>
 #include <Library/BaseLib.h>
-#include <Library/IoLib.h>
 #include <Library/PrintLib.h>
 #include <Library/PcdLib.h>
 #include <Library/BaseMemoryLib.h>
@@ -97,7 +96,7 @@ DebugPrintMarker (
   // Check if the global mask disables this message or the device is inactive
   //
   if ((ErrorLevel & GetDebugPrintErrorLevel ()) == 0 ||
-      !PlatformDebugLibIoPortFound ()) {
+      !PlatformDebugLibOutputFound ()) {
     return;
   }
 
@@ -111,9 +110,9 @@ DebugPrintMarker (
   }
 
   //
-  // Send the print string to the debug I/O port
+  // Send the print string to the debug output
   //
-  IoWriteFifo8 (PcdGet16 (PcdDebugIoPort), Length, Buffer);
+  PlatformDebugLibWrite (ErrorLevel, Buffer, Length);
 }
 
 
@@ -212,10 +211,10 @@ DebugAssert (
              FileName, (UINT64)LineNumber, Description);
 
   //
-  // Send the print string to the debug I/O port, if present
+  // Send the print string to the debug output, if present
   //
-  if (PlatformDebugLibIoPortFound ()) {
-    IoWriteFifo8 (PcdGet16 (PcdDebugIoPort), Length, Buffer);
+  if (PlatformDebugLibOutputFound ()) {
+    PlatformDebugLibWrite (DEBUG_ERROR, Buffer, Length);
   }
 
   //
@@ -42,4 +42,34 @@ PlatformDebugLibIoPortFound (
   VOID
   );
 
+/**
+  Return whether DEBUG messages can be output, either to the debug I/O port or
+  to a memory log.
+
+  @retval TRUE   if the debug messages can be output.
+  @retval FALSE  otherwise
+
+**/
+BOOLEAN
+EFIAPI
+PlatformDebugLibOutputFound (
+  VOID
+  );
+
+/**
+  Output a formatted debug message.
+
+  @param[in] ErrorLevel  The error level of the debug message.
+  @param[in] Buffer      The message.
+  @param[in] Length      The length of the message in bytes.
+
+**/
+VOID
+EFIAPI
+PlatformDebugLibWrite (
+  IN UINTN        ErrorLevel,
+  IN CONST CHAR8  *Buffer,
+  IN UINTN        Length
+  );
+
 #endif
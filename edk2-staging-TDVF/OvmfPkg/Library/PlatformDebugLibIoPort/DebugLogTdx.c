@@ -0,0 +1,225 @@
+/** @file
+  Output of debug messages to the in-memory debug log of TDX guests, with
+  batched copies to the hypervisor debug port.
+
+  In a TD, every byte written to the debug I/O port is a TDVMCALL. Messages
+  are therefore appended to the ring buffer described by TDX_DEBUG_LOG, and
+  only copied to the debug I/O port in batches, before error messages and
+  ASSERTs, and whenever half of the ring is pending, so that the ring does
+  not wrap over messages that the port has not received. The log can be read
+  from the guest through the configuration table, or from a memory dump of
+  the guest.
+
+  Before the log has been set up, and in guests other than TDs, messages are
+  written to the debug I/O port directly.
+
+  Copyright (c) 2021, Intel Corporation. All rights reserved.<BR>
+  SPDX-License-Identifier: BSD-2-Clause-Patent
+
+**/
+
+#include <Base.h>
+#include <Library/BaseLib.h>
+#include <Library/BaseMemoryLib.h>
+#include <Library/DebugLib.h>
+#include <Library/IoLib.h>
+#include <Library/PcdLib.h>
+#include <Library/SynchronizationLib.h>
+#include <Guid/TdxDebugLog.h>
+#include "DebugLibDetect.h"
+
+/**
+  Return the in-memory debug log, if it has been set up.
+
+  This function does not depend on any state of the module, so that it can
+  be used in SEC, and in the DXE core before library constructors run.
+
+  @retval NULL  The debug log is not available.
+  @return       The header of the debug log.
+
+**/
+STATIC
+TDX_DEBUG_LOG *
+GetTdxDebugLog (
+  VOID
+  )
+{
+  TDX_DEBUG_LOG  *Log;
+
+  if (FixedPcdGet32 (PcdTdxDebugLogSize) == 0) {
+    return NULL;
+  }
+
+  Log = (TDX_DEBUG_LOG *) (UINTN) (FixedPcdGet32 (PcdOvmfSecGhcbBackupBase) +
+                                   TDX_DEBUG_LOG_MAILBOX_OFFSET);
+  if (Log->Signature != TDX_DEBUG_LOG_SIGNATURE ||
+      Log->Check != (Log->Signature ^ Log->RingBase ^ Log->RingSize)) {
+    return NULL;
+  }
+  return Log;
+}
+
+/**
+  Take the lock of the debug log.
+
+  Interrupts are disabled while the lock is held, so that an interrupt
+  handler that logs a message on the same processor cannot wait for it.
+
+  @param[in,out] Log  The header of the debug log.
+
+  @return  The interrupt state to pass to ReleaseTdxDebugLog().
+
+**/
+STATIC
+BOOLEAN
+AcquireTdxDebugLog (
+  IN OUT TDX_DEBUG_LOG  *Log
+  )
+{
+  BOOLEAN  InterruptState;
+
+  InterruptState = SaveAndDisableInterrupts ();
+  while (InterlockedCompareExchange32 (&Log->Lock, 0, 1) != 0) {
+    CpuPause ();
+  }
+  return InterruptState;
+}
+
+/**
+  Release the lock of the debug log.
+
+  @param[in,out] Log             The header of the debug log.
+  @param[in]     InterruptState  The return value of AcquireTdxDebugLog().
+
+**/
+STATIC
+VOID
+ReleaseTdxDebugLog (
+  IN OUT TDX_DEBUG_LOG  *Log,
+  IN     BOOLEAN        InterruptState
+  )
+{
+  InterlockedCompareExchange32 (&Log->Lock, 1, 0);
+  SetInterruptState (InterruptState);
+}
+
+/**
+  Copy the part of the debug log that has not been sent to the debug I/O port
+  yet to the port, as one batch.
+
+  Messages that have been overwritten in the ring since the last flush are
+  lost for the debug I/O port. The caller must hold the lock of the log.
+
+  @param[in,out] Log  The header of the debug log.
+
+**/
+STATIC
+VOID
+FlushTdxDebugLog (
+  IN OUT TDX_DEBUG_LOG  *Log
+  )
+{
+  UINT64  Head;
+  UINT64  Start;
+  UINTN   Offset;
+  UINTN   Length;
+
+  Head  = Log->Head;
+  Start = Log->Flushed;
+  if (Start >= Head) {
+    return;
+  }
+  Log->Flushed = Head;
+  if (!PlatformDebugLibIoPortFound ()) {
+    return;
+  }
+
+  if (Head - Start > Log->RingSize) {
+    Start = Head - Log->RingSize;
+  }
+  while (Start < Head) {
+    Offset = (UINTN) (Start & (Log->RingSize - 1));
+    Length = (UINTN) MIN (Head - Start, Log->RingSize - Offset);
+    IoWriteFifo8 (
+      PcdGet16 (PcdDebugIoPort),
+      Length,
+      (VOID *) (UINTN) (Log->RingBase + Offset)
+      );
+    Start += Length;
+  }
+}
+
+/**
+  Return whether DEBUG messages can be output, either to the debug I/O port or
+  to a memory log.
+
+  @retval TRUE   if the debug messages can be output.
+  @retval FALSE  otherwise
+
+**/
+BOOLEAN
+EFIAPI
+PlatformDebugLibOutputFound (
+  VOID
+  )
+{
+  return (BOOLEAN) (GetTdxDebugLog () != NULL || PlatformDebugLibIoPortFound ());
+}
+
+/**
+  Output a formatted debug message.
+
+  The message is appended to the in-memory debug log if it is available, and
+  written to the debug I/O port otherwise. Error messages, and messages that
+  leave half of the debug log pending, flush the debug log to the debug I/O
+  port.
+
+  @param[in] ErrorLevel  The error level of the debug message.
+  @param[in] Buffer      The message.
+  @param[in] Length      The length of the message in bytes.
+
+**/
+VOID
+EFIAPI
+PlatformDebugLibWrite (
+  IN UINTN        ErrorLevel,
+  IN CONST CHAR8  *Buffer,
+  IN UINTN        Length
+  )
+{
+  TDX_DEBUG_LOG  *Log;
+  UINT64         Head;
+  UINTN          Offset;
+  UINTN          Chunk;
+  BOOLEAN        InterruptState;
+
+  Log = GetTdxDebugLog ();
+  if (Log == NULL) {
+    IoWriteFifo8 (PcdGet16 (PcdDebugIoPort), Length, (VOID *) Buffer);
+    return;
+  }
+
+  //
+  // APs may log concurrently. The lock covers the copy as well, so that a
+  // flush never sends a reserved part of the ring that is not written yet.
+  //
+  InterruptState = AcquireTdxDebugLog (Log);
+
+  Head = Log->Head;
+  while (Length > 0) {
+    Offset = (UINTN) (Head & (Log->RingSize - 1));
+    Chunk  = (UINTN) MIN (Length, Log->RingSize - Offset);
+    CopyMem ((VOID *) (UINTN) (Log->RingBase + Offset), Buffer, Chunk);
+    Buffer += Chunk;
+    Head   += Chunk;
+    Length -= Chunk;
+  }
+  Log->Head = Head;
+
+  if (((ErrorLevel & DEBUG_ERROR) != 0) ||
+      (Head - Log->Flushed >= Log->RingSize / 2)) {
+    FlushTdxDebugLog (Log);
+  }
+
+  ReleaseTdxDebugLog (Log, InterruptState);
+}
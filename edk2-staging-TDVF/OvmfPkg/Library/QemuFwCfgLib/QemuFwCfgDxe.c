@@ -29,6 +29,30 @@ STATIC BOOLEAN mQemuFwCfgDmaSupported;
 
 STATIC EDKII_IOMMU_PROTOCOL        *mIoMmuProtocol;
 
+//
+// Maximum size of the DMA bounce buffer of a large transfer. Transfers larger
+// than this are split into chunks of this size.
+//
+#define FW_CFG_DMA_BOUNCE_MAX_SIZE     SIZE_256KB
+
+//
+// Offset of the small data area in the DMA access page.
+//
+#define FW_CFG_DMA_ACCESS_DATA_OFFSET  ALIGN_VALUE (sizeof (FW_CFG_DMA_ACCESS), 8)
+
+//
+// The DMA access page, used when memory encryption is enabled. The page is
+// allocated, zeroed, and mapped (that is, converted to shared memory) on the
+// first DMA transfer, and kept until the module is unloaded. It holds
+// FW_CFG_DMA_ACCESS, followed by a data area for the transfers that fit in
+// the rest of the page, such as integers and fw_cfg file directory entries.
+// Larger transfers use a bounce buffer that is allocated and mapped for the
+// duration of the transfer only.
+//
+STATIC VOID                        *mDmaAccessPage;
+STATIC VOID                        *mDmaAccessMapping;
+STATIC EFI_PHYSICAL_ADDRESS        mDmaAccessDeviceAddress;
+
 /**
   Returns a boolean indicating if the firmware configuration interface
   is available or not.
@@ -108,6 +132,33 @@ QemuFwCfgInitialize (
 }
 
 
+STATIC
+VOID
+FreeFwCfgDmaSharedBuffer (
+  IN  UINTN   NumPages,
+  IN  VOID    *HostAddress,
+  IN  VOID    *Mapping
+  );
+
+/**
+  Release the DMA access page, if it has been allocated.
+
+  @retval RETURN_SUCCESS  The function always succeeds.
+**/
+RETURN_STATUS
+EFIAPI
+QemuFwCfgUninitialize (
+  VOID
+  )
+{
+  if (mDmaAccessPage != NULL) {
+    FreeFwCfgDmaSharedBuffer (1, mDmaAccessPage, mDmaAccessMapping);
+    mDmaAccessPage = NULL;
+  }
+  return RETURN_SUCCESS;
+}
+
+
 /**
   Returns a boolean indicating if the firmware configuration interface is
   available for library-internal purposes.
@@ -141,27 +192,33 @@ InternalQemuFwCfgDmaIsAvailable (
 }
 
 /**
-  Function is used for allocating a bi-directional FW_CFG_DMA_ACCESS used
-  between Host and device to exchange the information. The buffer must be free'd
-  using FreeFwCfgDmaAccessBuffer ().
+  Allocate a bi-directional DMA buffer that is shared between the guest and
+  the host. The buffer must be freed with FreeFwCfgDmaSharedBuffer().
+
+  @param[in]  NumPages       The size of the buffer in pages.
+
+  @param[out] HostAddress    The address of the buffer for the guest.
 
+  @param[out] DeviceAddress  The address of the buffer for the host.
+
+  @param[out] MapInfo        The mapping of the buffer.
 **/
 STATIC
 VOID
-AllocFwCfgDmaAccessBuffer (
-  OUT   VOID     **Access,
-  OUT   VOID     **MapInfo
+AllocFwCfgDmaSharedBuffer (
+  IN  UINTN                 NumPages,
+  OUT VOID                  **HostAddress,
+  OUT EFI_PHYSICAL_ADDRESS  *DeviceAddress,
+  OUT VOID                  **MapInfo
   )
 {
   UINTN                 Size;
-  UINTN                 NumPages;
   EFI_STATUS            Status;
-  VOID                  *HostAddress;
+  VOID                  *Buffer;
   EFI_PHYSICAL_ADDRESS  DmaAddress;
   VOID                  *Mapping;
 
-  Size = sizeof (FW_CFG_DMA_ACCESS);
-  NumPages = EFI_SIZE_TO_PAGES (Size);
+  Size = EFI_PAGES_TO_SIZE (NumPages);
 
   //
   // As per UEFI spec, in order to map a host address with
@@ -173,12 +230,12 @@ AllocFwCfgDmaAccessBuffer (
                              AllocateAnyPages,
                              EfiBootServicesData,
                              NumPages,
-                             &HostAddress,
+                             &Buffer,
                              EDKII_IOMMU_ATTRIBUTE_DUAL_ADDRESS_CYCLE
                              );
   if (EFI_ERROR (Status)) {
     DEBUG ((DEBUG_ERROR,
-      "%a:%a failed to allocate FW_CFG_DMA_ACCESS\n", gEfiCallerBaseName,
+      "%a:%a failed to allocate DMA bounce buffer\n", gEfiCallerBaseName,
       __FUNCTION__));
     ASSERT (FALSE);
     CpuDeadLoop ();
@@ -188,7 +245,7 @@ AllocFwCfgDmaAccessBuffer (
   // Avoid exposing stale data even temporarily: zero the area before mapping
   // it.
   //
-  ZeroMem (HostAddress, Size);
+  ZeroMem (Buffer, Size);
 
   //
   // Map the host buffer with BusMasterCommonBuffer64
@@ -196,51 +253,54 @@ AllocFwCfgDmaAccessBuffer (
   Status = mIoMmuProtocol->Map (
                              mIoMmuProtocol,
                              EdkiiIoMmuOperationBusMasterCommonBuffer64,
-                             HostAddress,
+                             Buffer,
                              &Size,
                              &DmaAddress,
                              &Mapping
                              );
   if (EFI_ERROR (Status)) {
-    mIoMmuProtocol->FreeBuffer (mIoMmuProtocol, NumPages, HostAddress);
+    mIoMmuProtocol->FreeBuffer (mIoMmuProtocol, NumPages, Buffer);
     DEBUG ((DEBUG_ERROR,
-      "%a:%a failed to Map() FW_CFG_DMA_ACCESS\n", gEfiCallerBaseName,
+      "%a:%a failed to Map() DMA bounce buffer\n", gEfiCallerBaseName,
       __FUNCTION__));
     ASSERT (FALSE);
     CpuDeadLoop ();
   }
 
-  if (Size < sizeof (FW_CFG_DMA_ACCESS)) {
+  if (Size < EFI_PAGES_TO_SIZE (NumPages)) {
     mIoMmuProtocol->Unmap (mIoMmuProtocol, Mapping);
-    mIoMmuProtocol->FreeBuffer (mIoMmuProtocol, NumPages, HostAddress);
+    mIoMmuProtocol->FreeBuffer (mIoMmuProtocol, NumPages, Buffer);
     DEBUG ((DEBUG_ERROR,
       "%a:%a failed to Map() - requested 0x%Lx got 0x%Lx\n", gEfiCallerBaseName,
-      __FUNCTION__, (UINT64)sizeof (FW_CFG_DMA_ACCESS), (UINT64)Size));
+      __FUNCTION__, (UINT64)EFI_PAGES_TO_SIZE (NumPages), (UINT64)Size));
     ASSERT (FALSE);
     CpuDeadLoop ();
   }
 
-  *Access = HostAddress;
-  *MapInfo = Mapping;
+  *HostAddress   = Buffer;
+  *DeviceAddress = DmaAddress;
+  *MapInfo       = Mapping;
 }
 
 /**
-  Function is to used for freeing the Access buffer allocated using
-  AllocFwCfgDmaAccessBuffer()
+  Free a DMA buffer allocated with AllocFwCfgDmaSharedBuffer().
+
+  @param[in]  NumPages       The size of the buffer in pages.
 
+  @param[in]  HostAddress    The address of the buffer for the guest.
+
+  @param[in]  Mapping        The mapping of the buffer.
 **/
 STATIC
 VOID
-FreeFwCfgDmaAccessBuffer (
-  IN  VOID    *Access,
+FreeFwCfgDmaSharedBuffer (
+  IN  UINTN   NumPages,
+  IN  VOID    *HostAddress,
   IN  VOID    *Mapping
   )
 {
-  UINTN       NumPages;
   EFI_STATUS  Status;
 
-  NumPages = EFI_SIZE_TO_PAGES (sizeof (FW_CFG_DMA_ACCESS));
-
   Status = mIoMmuProtocol->Unmap (mIoMmuProtocol, Mapping);
   if (EFI_ERROR (Status)) {
     DEBUG ((DEBUG_ERROR,
@@ -250,90 +310,76 @@ FreeFwCfgDmaAccessBuffer (
     CpuDeadLoop ();
   }
 
-  Status = mIoMmuProtocol->FreeBuffer (mIoMmuProtocol, NumPages, Access);
+  Status = mIoMmuProtocol->FreeBuffer (mIoMmuProtocol, NumPages, HostAddress);
   if (EFI_ERROR (Status)) {
     DEBUG ((DEBUG_ERROR,
       "%a:%a failed to Free() 0x%Lx\n", gEfiCallerBaseName, __FUNCTION__,
-      (UINT64)(UINTN)Access));
+      (UINT64)(UINTN)HostAddress));
     ASSERT (FALSE);
     CpuDeadLoop ();
   }
 }
 
 /**
-  Function is used for mapping host address to device address. The buffer must
-  be unmapped with UnmapDmaDataBuffer ().
+  Start a DMA transfer, and wait until it completes.
 
+  @param[in,out] Access         The DMA access structure, already populated.
+
+  @param[in]     AccessAddress  The device address of Access.
 **/
 STATIC
 VOID
-MapFwCfgDmaDataBuffer (
-  IN  BOOLEAN               IsWrite,
-  IN  VOID                  *HostAddress,
-  IN  UINT32                Size,
-  OUT EFI_PHYSICAL_ADDRESS  *DeviceAddress,
-  OUT VOID                  **MapInfo
+FwCfgDmaTransfer (
+  IN OUT volatile FW_CFG_DMA_ACCESS *Access,
+  IN     EFI_PHYSICAL_ADDRESS       AccessAddress
   )
 {
-  EFI_STATUS              Status;
-  UINTN                   NumberOfBytes;
-  VOID                    *Mapping;
-  EFI_PHYSICAL_ADDRESS    PhysicalAddress;
+  UINT32 AccessHigh, AccessLow;
+  UINT32 Status;
 
-  NumberOfBytes = Size;
-  Status = mIoMmuProtocol->Map (
-                             mIoMmuProtocol,
-                             (IsWrite ?
-                              EdkiiIoMmuOperationBusMasterRead64 :
-                              EdkiiIoMmuOperationBusMasterWrite64),
-                             HostAddress,
-                             &NumberOfBytes,
-                             &PhysicalAddress,
-                             &Mapping
-                             );
-  if (EFI_ERROR (Status)) {
-    DEBUG ((DEBUG_ERROR,
-      "%a:%a failed to Map() Address 0x%Lx Size 0x%Lx\n", gEfiCallerBaseName,
-      __FUNCTION__, (UINT64)(UINTN)HostAddress, (UINT64)Size));
-    ASSERT (FALSE);
-    CpuDeadLoop ();
-  }
+  //
+  // Delimit the transfer from (a) modifications to Access, (b) in case of a
+  // write, from writes to the data buffer.
+  //
+  MemoryFence ();
 
-  if (NumberOfBytes < Size) {
-    mIoMmuProtocol->Unmap (mIoMmuProtocol, Mapping);
-    DEBUG ((DEBUG_ERROR,
-      "%a:%a failed to Map() - requested 0x%x got 0x%Lx\n", gEfiCallerBaseName,
-      __FUNCTION__, Size, (UINT64)NumberOfBytes));
-    ASSERT (FALSE);
-    CpuDeadLoop ();
-  }
+  //
+  // Start the transfer.
+  //
+  AccessHigh = (UINT32)RShiftU64 (AccessAddress, 32);
+  AccessLow  = (UINT32)AccessAddress;
+  IoWrite32 (FW_CFG_IO_DMA_ADDRESS,     SwapBytes32 (AccessHigh));
+  IoWrite32 (FW_CFG_IO_DMA_ADDRESS + 4, SwapBytes32 (AccessLow));
 
-  *DeviceAddress = PhysicalAddress;
-  *MapInfo = Mapping;
-}
+  //
+  // Don't look at Access.Control before starting the transfer.
+  //
+  MemoryFence ();
 
-STATIC
-VOID
-UnmapFwCfgDmaDataBuffer (
-  IN  VOID  *Mapping
-  )
-{
-  EFI_STATUS  Status;
+  //
+  // Wait for the transfer to complete.
+  //
+  do {
+    Status = SwapBytes32 (Access->Control);
+    ASSERT ((Status & FW_CFG_DMA_CTL_ERROR) == 0);
+  } while (Status != 0);
 
-  Status = mIoMmuProtocol->Unmap (mIoMmuProtocol, Mapping);
-  if (EFI_ERROR (Status)) {
-    DEBUG ((DEBUG_ERROR,
-      "%a:%a failed to UnMap() Mapping 0x%Lx\n", gEfiCallerBaseName,
-      __FUNCTION__, (UINT64)(UINTN)Mapping));
-    ASSERT (FALSE);
-    CpuDeadLoop ();
-  }
+  //
+  // After a read, the caller will want to use the data buffer.
+  //
+  MemoryFence ();
 }
 
 /**
   Transfer an array of bytes, or skip a number of bytes, using the DMA
   interface.
 
+  When memory encryption is enabled, small transfers go through the data area
+  of the DMA access page, which stays mapped. Larger transfers are streamed
+  through a bounce buffer of at most FW_CFG_DMA_BOUNCE_MAX_SIZE bytes, which
+  is mapped once for the whole transfer, and freed at its end. Each chunk
+  costs one DMA transfer and one copy.
+
   @param[in]     Size     Size in bytes to transfer or skip.
 
   @param[in,out] Buffer   Buffer to read data into or write data from. Ignored,
@@ -354,10 +400,13 @@ InternalQemuFwCfgDmaBytes (
 {
   volatile FW_CFG_DMA_ACCESS LocalAccess;
   volatile FW_CFG_DMA_ACCESS *Access;
-  UINT32                     AccessHigh, AccessLow;
-  UINT32                     Status;
-  VOID                       *AccessMapping, *DataMapping;
-  VOID                       *DataBuffer;
+  UINT8                      *Data;
+  UINT8                      *BounceData;
+  EFI_PHYSICAL_ADDRESS       BounceDataAddress;
+  VOID                       *BounceMapping;
+  UINTN                      BouncePages;
+  UINT32                     BounceSize;
+  UINT32                     ChunkSize;
 
   ASSERT (Control == FW_CFG_DMA_CTL_WRITE || Control == FW_CFG_DMA_CTL_READ ||
     Control == FW_CFG_DMA_CTL_SKIP);
@@ -366,89 +415,74 @@ InternalQemuFwCfgDmaBytes (
     return;
   }
 
-  Access = &LocalAccess;
-  AccessMapping = NULL;
-  DataMapping = NULL;
-  DataBuffer = Buffer;
-
-  //
-  // When memory encryption is enabled, map Buffer to DMA address before issuing the DMA
-  // request
-  //
-  if (MemEncryptSevIsEnabled() || MemEncryptTdxIsEnabled ()) {
-    VOID                  *AccessBuffer;
-    EFI_PHYSICAL_ADDRESS  DataBufferAddress;
-
+  if (!MemEncryptSevIsEnabled () && !MemEncryptTdxIsEnabled ()) {
     //
-    // Allocate DMA Access buffer
+    // The host can access Buffer and LocalAccess directly.
     //
-    AllocFwCfgDmaAccessBuffer (&AccessBuffer, &AccessMapping);
-
-    Access = AccessBuffer;
+    LocalAccess.Control = SwapBytes32 (Control);
+    LocalAccess.Length  = SwapBytes32 (Size);
+    LocalAccess.Address = SwapBytes64 ((UINTN)Buffer);
+    FwCfgDmaTransfer (&LocalAccess, (UINTN)&LocalAccess);
+    return;
+  }
 
-    //
-    // Map actual data buffer
-    //
-    if (Control != FW_CFG_DMA_CTL_SKIP) {
-      MapFwCfgDmaDataBuffer (
-        Control == FW_CFG_DMA_CTL_WRITE,
-        Buffer,
-        Size,
-        &DataBufferAddress,
-        &DataMapping
-        );
-
-      DataBuffer = (VOID *) (UINTN) DataBufferAddress;
-    }
+  if (mDmaAccessPage == NULL) {
+    AllocFwCfgDmaSharedBuffer (
+      1,
+      &mDmaAccessPage,
+      &mDmaAccessDeviceAddress,
+      &mDmaAccessMapping
+      );
   }
+  Access = mDmaAccessPage;
 
-  Access->Control = SwapBytes32 (Control);
-  Access->Length  = SwapBytes32 (Size);
-  Access->Address = SwapBytes64 ((UINTN)DataBuffer);
+  if (Control == FW_CFG_DMA_CTL_SKIP) {
+    Access->Control = SwapBytes32 (Control);
+    Access->Length  = SwapBytes32 (Size);
+    Access->Address = 0;
+    FwCfgDmaTransfer (Access, mDmaAccessDeviceAddress);
+    return;
+  }
 
-  //
-  // Delimit the transfer from (a) modifications to Access, (b) in case of a
-  // write, from writes to Buffer by the caller.
-  //
-  MemoryFence ();
+  if (Size <= EFI_PAGE_SIZE - FW_CFG_DMA_ACCESS_DATA_OFFSET) {
+    BouncePages       = 0;
+    BounceSize        = Size;
+    BounceMapping     = NULL;
+    BounceData        = (UINT8 *)mDmaAccessPage + FW_CFG_DMA_ACCESS_DATA_OFFSET;
+    BounceDataAddress = mDmaAccessDeviceAddress + FW_CFG_DMA_ACCESS_DATA_OFFSET;
+  } else {
+    BouncePages = EFI_SIZE_TO_PAGES (MIN (Size, FW_CFG_DMA_BOUNCE_MAX_SIZE));
+    BounceSize  = (UINT32)EFI_PAGES_TO_SIZE (BouncePages);
+    AllocFwCfgDmaSharedBuffer (
+      BouncePages,
+      (VOID **)&BounceData,
+      &BounceDataAddress,
+      &BounceMapping
+      );
+  }
 
-  //
-  // Start the transfer.
-  //
-  AccessHigh = (UINT32)RShiftU64 ((UINTN)Access, 32);
-  AccessLow  = (UINT32)(UINTN)Access;
-  IoWrite32 (FW_CFG_IO_DMA_ADDRESS,     SwapBytes32 (AccessHigh));
-  IoWrite32 (FW_CFG_IO_DMA_ADDRESS + 4, SwapBytes32 (AccessLow));
+  Data = Buffer;
+  while (Size > 0) {
+    ChunkSize = MIN (Size, BounceSize);
 
-  //
-  // Don't look at Access.Control before starting the transfer.
-  //
-  MemoryFence ();
+    if (Control == FW_CFG_DMA_CTL_WRITE) {
+      CopyMem (BounceData, Data, ChunkSize);
+    }
 
-  //
-  // Wait for the transfer to complete.
-  //
-  do {
-    Status = SwapBytes32 (Access->Control);
-    ASSERT ((Status & FW_CFG_DMA_CTL_ERROR) == 0);
-  } while (Status != 0);
+    Access->Control = SwapBytes32 (Control);
+    Access->Length  = SwapBytes32 (ChunkSize);
+    Access->Address = SwapBytes64 (BounceDataAddress);
+    FwCfgDmaTransfer (Access, mDmaAccessDeviceAddress);
 
-  //
-  // After a read, the caller will want to use Buffer.
-  //
-  MemoryFence ();
+    if (Control == FW_CFG_DMA_CTL_READ) {
+      CopyMem (Data, BounceData, ChunkSize);
+    }
 
-  //
-  // If Access buffer was dynamically allocated then free it.
-  //
-  if (AccessMapping != NULL) {
-    FreeFwCfgDmaAccessBuffer ((VOID *)Access, AccessMapping);
+    Data += ChunkSize;
+    Size -= ChunkSize;
   }
 
-  //
-  // If DataBuffer was mapped then unmap it.
-  //
-  if (DataMapping != NULL) {
-    UnmapFwCfgDmaDataBuffer (DataMapping);
+  if (BouncePages > 0) {
+    FreeFwCfgDmaSharedBuffer (BouncePages, BounceData, BounceMapping);
   }
 }
@@ -19,6 +19,11 @@
 
 #include "QemuFwCfgLibInternal.h"
 
+//
+// The number of file directory entries that QemuFwCfgFindFile() reads at once.
+//
+#define FW_CFG_FILE_DIR_BATCH  8
+
 
 /**
   Selects a firmware configuration item for reading.
@@ -259,8 +264,11 @@ QemuFwCfgFindFile (
   OUT  UINTN                 *Size
   )
 {
-  UINT32 Count;
-  UINT32 Idx;
+  UINT32      Count;
+  UINT32      Idx;
+  UINT32      BatchCount;
+  UINT32      BatchIdx;
+  FW_CFG_FILE Files[FW_CFG_FILE_DIR_BATCH];
 
   if (!InternalQemuFwCfgIsAvailable ()) {
     return RETURN_UNSUPPORTED;
@@ -269,22 +277,20 @@ QemuFwCfgFindFile (
   QemuFwCfgSelectItem (QemuFwCfgItemFileDir);
   Count = SwapBytes32 (QemuFwCfgRead32 ());
 
-  for (Idx = 0; Idx < Count; ++Idx) {
-    UINT32 FileSize;
-    UINT16 FileSelect;
-    UINT16 FileReserved;
-    CHAR8  FName[QEMU_FW_CFG_FNAME_SIZE];
-
-    FileSize     = QemuFwCfgRead32 ();
-    FileSelect   = QemuFwCfgRead16 ();
-    FileReserved = QemuFwCfgRead16 ();
-    (VOID) FileReserved; /* Force a do-nothing reference. */
-    InternalQemuFwCfgReadBytes (sizeof (FName), FName);
-
-    if (AsciiStrCmp (Name, FName) == 0) {
-      *Item = SwapBytes16 (FileSelect);
-      *Size = SwapBytes32 (FileSize);
-      return RETURN_SUCCESS;
+  //
+  // Read several directory entries per transfer, as each transfer is an exit
+  // to the hypervisor.
+  //
+  for (Idx = 0; Idx < Count; Idx += BatchCount) {
+    BatchCount = MIN (Count - Idx, FW_CFG_FILE_DIR_BATCH);
+    InternalQemuFwCfgReadBytes (BatchCount * sizeof (FW_CFG_FILE), Files);
+
+    for (BatchIdx = 0; BatchIdx < BatchCount; ++BatchIdx) {
+      if (AsciiStrCmp (Name, Files[BatchIdx].Name) == 0) {
+        *Item = SwapBytes16 (Files[BatchIdx].Select);
+        *Size = SwapBytes32 (Files[BatchIdx].Size);
+        return RETURN_SUCCESS;
+      }
     }
   }
 
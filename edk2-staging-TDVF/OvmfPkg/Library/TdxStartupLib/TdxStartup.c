@@ -10,6 +10,7 @@
 #include <Library/PrePiLibTdx.h>
 #include <Library/TdxMpLib.h>
 #include <Library/TdxStartupLib.h>
+#include <Guid/TdxDebugLog.h>
 #include "TdxStartupInternal.h"
 
 
@@ -63,6 +64,66 @@ MeasureConfigurationVolume (
   TdxMeasureFvImage ((UINTN)Fv, CfvSize, 1);
 }
 
+/**
+  Set up the in-memory debug log, if it is enabled with PcdTdxDebugLogSize.
+
+  The header of the log is written to the TD mailbox page, where the DebugLib
+  instances of all later modules find it. The address of the header is passed
+  on to DXE in a GUID HOB.
+
+  This function must be called after the HOB list has been transferred, so
+  that the ring buffer is allocated from the final memory map.
+**/
+STATIC
+VOID
+TdxDebugLogInitialize (
+  VOID
+  )
+{
+  TDX_DEBUG_LOG         *Log;
+  VOID                  *Ring;
+  UINT32                RingSize;
+  EFI_PHYSICAL_ADDRESS  LogAddress;
+
+  RingSize = FixedPcdGet32 (PcdTdxDebugLogSize);
+  if (RingSize == 0 || !DebugPrintEnabled ()) {
+    return;
+  }
+  if ((RingSize & (RingSize - 1)) != 0 || RingSize < EFI_PAGE_SIZE) {
+    DEBUG ((DEBUG_ERROR, "%a: invalid log size 0x%x\n", __FUNCTION__, RingSize));
+    return;
+  }
+
+  Ring = AllocatePagesWithMemoryType (
+           EfiReservedMemoryType,
+           EFI_SIZE_TO_PAGES (RingSize)
+           );
+  if (Ring == NULL) {
+    DEBUG ((DEBUG_ERROR, "%a: out of resources\n", __FUNCTION__));
+    return;
+  }
+
+  LogAddress = FixedPcdGet32 (PcdOvmfSecGhcbBackupBase) +
+               TDX_DEBUG_LOG_MAILBOX_OFFSET;
+  Log = (TDX_DEBUG_LOG *) (UINTN) LogAddress;
+  Log->RingBase  = (EFI_PHYSICAL_ADDRESS) (UINTN) Ring;
+  Log->RingSize  = RingSize;
+  Log->Head      = 0;
+  Log->Flushed   = 0;
+  Log->Lock      = 0;
+  Log->Signature = TDX_DEBUG_LOG_SIGNATURE;
+  //
+  // Writing the check value last publishes the log to the DebugLib instances.
+  //
+  MemoryFence ();
+  Log->Check     = Log->Signature ^ Log->RingBase ^ Log->RingSize;
+
+  BuildGuidDataHob (&gUefiOvmfPkgTdxDebugLogGuid, &LogAddress, sizeof LogAddress);
+
+  DEBUG ((DEBUG_INFO, "TdxDebugLog: header 0x%lx, ring %p, size 0x%x\n",
+    LogAddress, Ring, RingSize));
+}
+
 VOID
 EFIAPI
 TdxStartup(
@@ -131,6 +192,11 @@ TdxStartup(
   //
   TransferHobList (VmmHobList);
 
+  //
+  // Set up the in-memory debug log in the final memory map
+  //
+  TdxDebugLogInitialize ();
+
   //
   // Initialize Platform
   //
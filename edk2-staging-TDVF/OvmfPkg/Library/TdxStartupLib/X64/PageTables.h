@@ -167,6 +167,11 @@ typedef union {
 #define PAGE_TABLE_POOL_ALIGN_MASK  \
   (~(EFI_PHYSICAL_ADDRESS)(PAGE_TABLE_POOL_ALIGNMENT - 1))
 
+//
+// Number of page table pages reserved for on-demand mappings in DXE.
+//
+#define TDX_ON_DEMAND_PAGE_TABLE_PAGES  64
+
 typedef struct {
   VOID            *NextPool;
   UINTN           Offset;
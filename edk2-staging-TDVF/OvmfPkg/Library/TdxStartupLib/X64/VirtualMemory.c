@@ -18,6 +18,7 @@ SPDX-License-Identifier: BSD-2-Clause-Patent
 #include <Library/PcdLib.h>
 #include <Guid/MemoryTypeInformation.h>
 #include <Guid/MemoryAllocationHob.h>
+#include <Guid/TdxPageTableInfo.h>
 #include <Register/Intel/Cpuid.h>
 #include "PageTables.h"
 
@@ -26,6 +27,11 @@ SPDX-License-Identifier: BSD-2-Clause-Patent
 //
 PAGE_TABLE_POOL         *mPageTablePool = NULL;
 
+//
+// Number of page table pages handed out by AllocatePageTableMemory().
+//
+UINTN                   mPageTablePagesAllocated = 0;
+
 UINTN   mLevelShift[5] = {
   0,
   PAGING_L1_ADDRESS_SHIFT,
@@ -334,6 +340,7 @@ AllocatePageTableMemory (
 
   mPageTablePool->Offset     += EFI_PAGES_TO_SIZE (Pages);
   mPageTablePool->FreePages  -= Pages;
+  mPageTablePagesAllocated   += Pages;
 
   DEBUG ((
     DEBUG_INFO,
@@ -643,10 +650,155 @@ EnablePageTableProtection (
   AsmWriteCr0 (AsmReadCr0() | CR0_WP);
 }
 
+/**
+  Return the next level table that a page table entry points to, creating the
+  table if the entry is not present.
+
+  @param[in,out] Entry           The non-leaf page table entry.
+  @param[in]     AddressEncMask  The memory encryption mask for the entry.
+
+  @retval NULL   Out of page table memory.
+  @return        The next level table.
+**/
+STATIC
+UINT64 *
+GetOrCreateNextTable (
+  IN OUT UINT64  *Entry,
+  IN     UINT64  AddressEncMask
+  )
+{
+  UINT64  *Table;
+
+  if ((*Entry & IA32_PG_P) != 0) {
+    ASSERT ((*Entry & IA32_PG_PS) == 0);
+    return (UINT64 *)(UINTN)(*Entry & ~AddressEncMask &
+                             PAGING_4K_ADDRESS_MASK_64);
+  }
+
+  Table = AllocatePageTableMemory (1);
+  if (Table == NULL) {
+    return NULL;
+  }
+  ZeroMem (Table, EFI_PAGE_SIZE);
+  *Entry = (UINT64)(UINTN)Table | AddressEncMask | IA32_PG_P | IA32_PG_RW;
+  return Table;
+}
+
+/**
+  Identity-map an address range with large pages.
+
+  Entries that are already present are left alone. Large pages that cover the
+  NULL page (with NULL pointer detection) or the stack are split, as in
+  ToSplitPageTable().
+
+  @param[in] PageMap            The top level table (PML5 or PML4).
+  @param[in] Page5LevelSupport  TRUE if PageMap is a PML5 table.
+  @param[in] Page1GSupport      TRUE to map with 1GB pages, FALSE for 2MB.
+  @param[in] AddressEncMask     The memory encryption mask for the entries.
+  @param[in] Start              Start of the range. Rounded down to the page
+                                size.
+  @param[in] End                End of the range (exclusive). Rounded up to
+                                the page size.
+  @param[in] StackBase          Stack base address.
+  @param[in] StackSize          Stack size.
+
+  @retval TRUE   The range has been mapped.
+  @retval FALSE  Out of page table memory.
+**/
+STATIC
+BOOLEAN
+MapIdentityRange (
+  IN UINT64                *PageMap,
+  IN BOOLEAN               Page5LevelSupport,
+  IN BOOLEAN               Page1GSupport,
+  IN UINT64                AddressEncMask,
+  IN EFI_PHYSICAL_ADDRESS  Start,
+  IN EFI_PHYSICAL_ADDRESS  End,
+  IN EFI_PHYSICAL_ADDRESS  StackBase,
+  IN UINTN                 StackSize
+  )
+{
+  UINT64                PageSize;
+  EFI_PHYSICAL_ADDRESS  Address;
+  UINT64                *Table;
+  UINT64                *Entry;
+
+  PageSize = Page1GSupport ? SIZE_1GB : SIZE_2MB;
+  Start    = Start & ~(PageSize - 1);
+  End      = ALIGN_VALUE (End, PageSize);
+
+  for (Address = Start; Address < End; Address += PageSize) {
+    Table = PageMap;
+    if (Page5LevelSupport) {
+      Table = GetOrCreateNextTable (
+                &Table[RShiftU64 (Address, 48) & PAGING_PAE_INDEX_MASK],
+                AddressEncMask
+                );
+      if (Table == NULL) {
+        return FALSE;
+      }
+    }
+    Table = GetOrCreateNextTable (
+              &Table[RShiftU64 (Address, PAGING_L4_ADDRESS_SHIFT) &
+                     PAGING_PAE_INDEX_MASK],
+              AddressEncMask
+              );
+    if (Table == NULL) {
+      return FALSE;
+    }
+
+    if (Page1GSupport) {
+      Entry = &Table[RShiftU64 (Address, PAGING_L3_ADDRESS_SHIFT) &
+                     PAGING_PAE_INDEX_MASK];
+      if ((*Entry & IA32_PG_P) != 0) {
+        continue;
+      }
+      if (ToSplitPageTable (Address, SIZE_1GB, StackBase, StackSize)) {
+        Split1GPageTo2M (Address, Entry, StackBase, StackSize);
+      } else {
+        *Entry = Address | AddressEncMask | IA32_PG_P | IA32_PG_RW |
+                 IA32_PG_PS;
+      }
+      continue;
+    }
+
+    Table = GetOrCreateNextTable (
+              &Table[RShiftU64 (Address, PAGING_L3_ADDRESS_SHIFT) &
+                     PAGING_PAE_INDEX_MASK],
+              AddressEncMask
+              );
+    if (Table == NULL) {
+      return FALSE;
+    }
+    Entry = &Table[RShiftU64 (Address, PAGING_L2_ADDRESS_SHIFT) &
+                   PAGING_PAE_INDEX_MASK];
+    if ((*Entry & IA32_PG_P) != 0) {
+      continue;
+    }
+    if (ToSplitPageTable (Address, SIZE_2MB, StackBase, StackSize)) {
+      //
+      // Need to split this 2M page that covers NULL or stack range.
+      //
+      Split2MPageTo4K (Address, Entry, StackBase, StackSize);
+    } else {
+      *Entry = Address | AddressEncMask | IA32_PG_P | IA32_PG_RW | IA32_PG_PS;
+    }
+  }
+  return TRUE;
+}
+
 /**
   Allocates and fills in the Page Directory and Page Table Entries to
   establish a 1:1 Virtual to Physical mapping.
 
+  Only the 32-bit address space (RAM below 4GB, flash, and the 32-bit MMIO
+  apertures) and the ranges that resource descriptor HOBs describe (RAM above
+  4GB, 64-bit MMIO apertures) are mapped. Sizing the page tables from the
+  guest physical address width would map up to 4PB, most of which is never
+  accessed. TdxDxe maps the rest on demand, from a pool of pages that is
+  reserved here; the pool and the page table statistics are described by the
+  gUefiOvmfPkgTdxPageTableInfoGuid HOB.
+
   @param[in] StackBase  Stack base address.
   @param[in] StackSize  Stack size.
 
@@ -662,32 +814,22 @@ CreateIdentityMappingPageTables (
   UINT32                                        RegEax;
   UINT32                                        RegEdx;
   UINT8                                         PhysicalAddressBits;
-  EFI_PHYSICAL_ADDRESS                          PageAddress;
-  UINTN                                         IndexOfPml5Entries;
-  UINTN                                         IndexOfPml4Entries;
-  UINTN                                         IndexOfPdpEntries;
-  UINTN                                         IndexOfPageDirectoryEntries;
-  UINT32                                        NumberOfPml5EntriesNeeded;
-  UINT32                                        NumberOfPml4EntriesNeeded;
-  UINT32                                        NumberOfPdpEntriesNeeded;
-  PAGE_MAP_AND_DIRECTORY_POINTER                *PageMapLevel5Entry;
-  PAGE_MAP_AND_DIRECTORY_POINTER                *PageMapLevel4Entry;
-  PAGE_MAP_AND_DIRECTORY_POINTER                *PageMap;
-  PAGE_MAP_AND_DIRECTORY_POINTER                *PageDirectoryPointerEntry;
-  PAGE_TABLE_ENTRY                              *PageDirectoryEntry;
-  UINTN                                         TotalPagesNum;
-  UINTN                                         BigPageAddress;
+  UINT64                                        AddressLimit;
+  UINT64                                        *PageMap;
   VOID                                          *Hob;
+  EFI_PEI_HOB_POINTERS                          ResourceHob;
+  EFI_PHYSICAL_ADDRESS                          RangeEnd;
   BOOLEAN                                       Page5LevelSupport;
   BOOLEAN                                       Page1GSupport;
-  PAGE_TABLE_1G_ENTRY                           *PageDirectory1GEntry;
   UINT64                                        AddressEncMask;
   IA32_CR4                                      Cr4;
+  UINT64                                        StartTicks;
+  UINTN                                         PagesBefore;
+  TDX_PAGE_TABLE_INFO                           Info;
+  VOID                                          *OnDemandPool;
 
-  //
-  // Set PageMapLevel5Entry to suppress incorrect compiler/analyzer warnings
-  //
-  PageMapLevel5Entry = NULL;
+  StartTicks  = AsmReadTsc ();
+  PagesBefore = mPageTablePagesAllocated;
 
   //
   // Make sure AddressEncMask is contained to smallest supported address field
@@ -720,179 +862,67 @@ CreateIdentityMappingPageTables (
   Cr4.UintN = AsmReadCr4 ();
   Page5LevelSupport = (Cr4.Bits.LA57 ? TRUE : FALSE);
 
-  DEBUG ((DEBUG_INFO, "AddressBits=%u 5LevelPaging=%u 1GPage=%u AddressEncMask=0x%llx\n",
-    PhysicalAddressBits, Page5LevelSupport,
-    Page1GSupport, AddressEncMask));
-
-  //
-  // Calculate the table entries needed.
-  //
-  NumberOfPml5EntriesNeeded = 1;
-  if (PhysicalAddressBits > 48) {
-    NumberOfPml5EntriesNeeded = (UINT32) LShiftU64 (1, PhysicalAddressBits - 48);
+  if (!Page5LevelSupport && PhysicalAddressBits > 48) {
     PhysicalAddressBits = 48;
   }
+  AddressLimit = LShiftU64 (1, PhysicalAddressBits);
 
-  NumberOfPml4EntriesNeeded = 1;
-  if (PhysicalAddressBits > 39) {
-    NumberOfPml4EntriesNeeded = (UINT32) LShiftU64 (1, PhysicalAddressBits - 39);
-    PhysicalAddressBits = 39;
-  }
-
-  NumberOfPdpEntriesNeeded = 1;
-  ASSERT (PhysicalAddressBits > 30);
-  NumberOfPdpEntriesNeeded = (UINT32) LShiftU64 (1, PhysicalAddressBits - 30);
+  DEBUG ((DEBUG_INFO, "AddressBits=%u 5LevelPaging=%u 1GPage=%u AddressEncMask=0x%llx\n",
+    PhysicalAddressBits, Page5LevelSupport,
+    Page1GSupport, AddressEncMask));
 
   //
-  // Pre-allocate big pages to avoid later allocations.
+  // By architecture only one top level table (PML5 or PML4) exists.
   //
-  if (!Page1GSupport) {
-    TotalPagesNum = ((NumberOfPdpEntriesNeeded + 1) * NumberOfPml4EntriesNeeded + 1) * NumberOfPml5EntriesNeeded + 1;
-  } else {
-    TotalPagesNum = (NumberOfPml4EntriesNeeded + 1) * NumberOfPml5EntriesNeeded + 1;
+  PageMap = AllocatePageTableMemory (1);
+  if (PageMap == NULL) {
+    ASSERT (FALSE);
+    return 0;
   }
+  ZeroMem (PageMap, EFI_PAGE_SIZE);
 
   //
-  // Substract the one page occupied by PML5 entries if 5-Level Paging is disabled.
+  // Map the 32-bit address space, which holds the flash, the local APIC, the
+  // IO APIC and the 32-bit PCI MMIO aperture, in addition to low RAM.
   //
-  if (!Page5LevelSupport) {
-    TotalPagesNum--;
-  }
-
-  DEBUG ((DEBUG_INFO, "Pml5=%u Pml4=%u Pdp=%u TotalPage=%Lu\n",
-    NumberOfPml5EntriesNeeded, NumberOfPml4EntriesNeeded,
-    NumberOfPdpEntriesNeeded, (UINT64)TotalPagesNum));
-
-  BigPageAddress = (UINTN) AllocatePageTableMemory (TotalPagesNum);
-  if (BigPageAddress == 0) {
+  if (!MapIdentityRange (PageMap, Page5LevelSupport, Page1GSupport,
+         AddressEncMask, 0, SIZE_4GB, StackBase, StackSize)) {
     ASSERT (FALSE);
     return 0;
   }
-  DEBUG((DEBUG_INFO, "BigPageAddress = 0x%llx\n", BigPageAddress));
 
   //
-  // By architecture only one PageMapLevel4 exists - so lets allocate storage for it.
+  // Map every range that a resource descriptor HOB describes, regardless of
+  // the resource type: RAM (accepted or not), MMIO, and reserved ranges.
   //
-  PageMap         = (VOID *) BigPageAddress;
-  if (Page5LevelSupport) {
-    //
-    // By architecture only one PageMapLevel5 exists - so lets allocate storage for it.
-    //
-    PageMapLevel5Entry = PageMap;
-    BigPageAddress    += SIZE_4KB;
-  }
-  PageAddress        = 0;
-
-  for ( IndexOfPml5Entries = 0
-      ; IndexOfPml5Entries < NumberOfPml5EntriesNeeded
-      ; IndexOfPml5Entries++) {
-
-    //
-    // Each PML5 entry points to a page of PML4 entires.
-    // So lets allocate space for them and fill them in in the IndexOfPml4Entries loop.
-    // When 5-Level Paging is disabled, below allocation happens only once.
-    //
-    PageMapLevel4Entry = (VOID *) BigPageAddress;
-    BigPageAddress    += SIZE_4KB;
-
-    if (Page5LevelSupport) {
-      //
-      // Make a PML5 Entry
-      //
-      PageMapLevel5Entry->Uint64 = (UINT64) (UINTN) PageMapLevel4Entry | AddressEncMask;
-      PageMapLevel5Entry->Bits.ReadWrite = 1;
-      PageMapLevel5Entry->Bits.Present   = 1;
-      PageMapLevel5Entry++;
+  for (ResourceHob.Raw = GetFirstHob (EFI_HOB_TYPE_RESOURCE_DESCRIPTOR);
+       ResourceHob.Raw != NULL;
+       ResourceHob.Raw = GetNextHob (EFI_HOB_TYPE_RESOURCE_DESCRIPTOR,
+                           GET_NEXT_HOB (ResourceHob))) {
+    if (ResourceHob.ResourceDescriptor->PhysicalStart >= AddressLimit) {
+      continue;
     }
-
-    for ( IndexOfPml4Entries = 0
-        ; IndexOfPml4Entries < (NumberOfPml5EntriesNeeded == 1 ? NumberOfPml4EntriesNeeded : 512)
-        ; IndexOfPml4Entries++, PageMapLevel4Entry++) {
-      //
-      // Each PML4 entry points to a page of Page Directory Pointer entires.
-      // So lets allocate space for them and fill them in in the IndexOfPdpEntries loop.
-      //
-      PageDirectoryPointerEntry = (VOID *) BigPageAddress;
-      BigPageAddress += SIZE_4KB;
-
-      //
-      // Make a PML4 Entry
-      //
-      PageMapLevel4Entry->Uint64 = (UINT64)(UINTN)PageDirectoryPointerEntry | AddressEncMask;
-      PageMapLevel4Entry->Bits.ReadWrite = 1;
-      PageMapLevel4Entry->Bits.Present = 1;
-
-      if (Page1GSupport) {
-        PageDirectory1GEntry = (VOID *) PageDirectoryPointerEntry;
-
-        for (IndexOfPageDirectoryEntries = 0; IndexOfPageDirectoryEntries < 512; IndexOfPageDirectoryEntries++, PageDirectory1GEntry++, PageAddress += SIZE_1GB) {
-          if (ToSplitPageTable (PageAddress, SIZE_1GB, StackBase, StackSize)) {
-            Split1GPageTo2M (PageAddress, (UINT64 *) PageDirectory1GEntry,
-              StackBase, StackSize);
-          } else {
-            //
-            // Fill in the Page Directory entries
-            //
-            PageDirectory1GEntry->Uint64 = (UINT64)PageAddress | AddressEncMask;
-            PageDirectory1GEntry->Bits.ReadWrite = 1;
-            PageDirectory1GEntry->Bits.Present = 1;
-            PageDirectory1GEntry->Bits.MustBe1 = 1;
-          }
-        }
-      } else {
-        for ( IndexOfPdpEntries = 0
-            ; IndexOfPdpEntries < (NumberOfPml4EntriesNeeded == 1 ? NumberOfPdpEntriesNeeded : 512)
-            ; IndexOfPdpEntries++, PageDirectoryPointerEntry++) {
-          //
-          // Each Directory Pointer entries points to a page of Page Directory entires.
-          // So allocate space for them and fill them in in the IndexOfPageDirectoryEntries loop.
-          //
-          PageDirectoryEntry = (VOID *) BigPageAddress;
-          BigPageAddress += SIZE_4KB;
-
-          //
-          // Fill in a Page Directory Pointer Entries
-          //
-          PageDirectoryPointerEntry->Uint64 = (UINT64)(UINTN)PageDirectoryEntry | AddressEncMask;
-          PageDirectoryPointerEntry->Bits.ReadWrite = 1;
-          PageDirectoryPointerEntry->Bits.Present = 1;
-
-          for (IndexOfPageDirectoryEntries = 0; IndexOfPageDirectoryEntries < 512; IndexOfPageDirectoryEntries++, PageDirectoryEntry++, PageAddress += SIZE_2MB) {
-            if (ToSplitPageTable (PageAddress, SIZE_2MB, StackBase, StackSize)) {
-              //
-              // Need to split this 2M page that covers NULL or stack range.
-              //
-              Split2MPageTo4K (PageAddress, (UINT64 *) PageDirectoryEntry, StackBase, StackSize);
-            } else {
-              //
-              // Fill in the Page Directory entries
-              //
-              PageDirectoryEntry->Uint64 = (UINT64)PageAddress | AddressEncMask;
-              PageDirectoryEntry->Bits.ReadWrite = 1;
-              PageDirectoryEntry->Bits.Present = 1;
-              PageDirectoryEntry->Bits.MustBe1 = 1;
-            }
-          }
-        }
-
-        //
-        // Fill with null entry for unused PDPTE
-        //
-        ZeroMem (PageDirectoryPointerEntry, (512 - IndexOfPdpEntries) * sizeof(PAGE_MAP_AND_DIRECTORY_POINTER));
-      }
+    RangeEnd = ResourceHob.ResourceDescriptor->PhysicalStart +
+               ResourceHob.ResourceDescriptor->ResourceLength;
+    if (!MapIdentityRange (PageMap, Page5LevelSupport, Page1GSupport,
+           AddressEncMask, ResourceHob.ResourceDescriptor->PhysicalStart,
+           MIN (RangeEnd, AddressLimit), StackBase, StackSize)) {
+      ASSERT (FALSE);
+      return 0;
     }
-
-    //
-    // For the PML4 entries we are not using fill in a null entry.
-    //
-    ZeroMem (PageMapLevel4Entry, (512 - IndexOfPml4Entries) * sizeof (PAGE_MAP_AND_DIRECTORY_POINTER));
   }
 
-  if (Page5LevelSupport) {
-    //
-    // For the PML5 entries we are not using fill in a null entry.
-    //
-    ZeroMem (PageMapLevel5Entry, (512 - IndexOfPml5Entries) * sizeof (PAGE_MAP_AND_DIRECTORY_POINTER));
+  ZeroMem (&Info, sizeof Info);
+  Info.PageTablePages = mPageTablePagesAllocated - PagesBefore;
+
+  //
+  // Reserve the pages for mapping other addresses on demand. They become
+  // write-protected together with the rest of the page table pool.
+  //
+  OnDemandPool = AllocatePageTableMemory (TDX_ON_DEMAND_PAGE_TABLE_PAGES);
+  if (OnDemandPool != NULL) {
+    Info.OnDemandPoolBase  = (EFI_PHYSICAL_ADDRESS)(UINTN)OnDemandPool;
+    Info.OnDemandPoolPages = TDX_ON_DEMAND_PAGE_TABLE_PAGES;
   }
 
   //
@@ -912,5 +942,14 @@ CreateIdentityMappingPageTables (
     EnableExecuteDisableBit ();
   }
 
+  Info.BuildTicks          = AsmReadTsc () - StartTicks;
+  Info.AddressEncMask      = AddressEncMask;
+  Info.PhysicalAddressBits = PhysicalAddressBits;
+  Info.Page1GSupport       = Page1GSupport;
+  BuildGuidDataHob (&gUefiOvmfPkgTdxPageTableInfoGuid, &Info, sizeof Info);
+
+  DEBUG ((DEBUG_INFO, "%a: %Lu page table pages, %Lu TSC ticks\n",
+    __FUNCTION__, Info.PageTablePages, Info.BuildTicks));
+
   return (UINTN)PageMap;
 }
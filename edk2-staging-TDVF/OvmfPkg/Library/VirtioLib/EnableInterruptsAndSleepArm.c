@@ -0,0 +1,33 @@
+/** @file
+
+  Enable interrupts and put the CPU to sleep, on ARM and AARCH64.
+
+  Copyright (c) 2021, Intel Corporation. All rights reserved.<BR>
+
+  SPDX-License-Identifier: BSD-2-Clause-Patent
+
+**/
+
+#include <Library/BaseLib.h>
+#include <Library/CpuLib.h>
+
+#include "VirtioLibInternal.h"
+
+/**
+
+  Enable interrupts and put the CPU to sleep until the next interrupt, with no
+  interrupt window in between.
+
+  WFI wakes the CPU up on a pending interrupt even while interrupts are masked,
+  so the interrupts are enabled after it, to service the interrupt.
+
+**/
+VOID
+EFIAPI
+InternalVirtioEnableInterruptsAndSleep (
+  VOID
+  )
+{
+  CpuSleep ();
+  EnableInterrupts ();
+}
@@ -17,6 +17,8 @@
 
 #include <Library/VirtioLib.h>
 
+#include "VirtioLibInternal.h"
+
 
 /**
 
@@ -118,7 +120,9 @@ VirtioRingInit (
   Ring->Used.AvailEvent = (volatile VOID *) RingPagesPtr;
   RingPagesPtr += sizeof *Ring->Used.AvailEvent;
 
-  Ring->QueueSize = QueueSize;
+  Ring->QueueSize  = QueueSize;
+  Ring->Event      = NULL;
+  Ring->EventQueue = 0;
   return EFI_SUCCESS;
 }
 
@@ -131,6 +135,9 @@ VirtioRingInit (
   invoking this function: the VSTAT_DRIVER_OK bit must be clear in
   VhdrDeviceStatus.
 
+  If VirtioRingEnableEvent() has attached an event to the ring, the event is
+  unregistered from the device and closed.
+
   @param[in]  VirtIo  The virtio device which was using the ring.
 
   @param[out] Ring    The virtio ring to clean up.
@@ -143,6 +150,11 @@ VirtioRingUninit (
   IN OUT VRING                  *Ring
   )
 {
+  if (Ring->Event != NULL) {
+    ASSERT (VirtIo->SetQueueEvent != NULL);
+    VirtIo->SetQueueEvent (VirtIo, Ring->EventQueue, NULL);
+    gBS->CloseEvent (Ring->Event);
+  }
   VirtIo->FreeSharedPages (VirtIo, Ring->NumPages, Ring->Base);
   SetMem (Ring, sizeof *Ring, 0x00);
 }
@@ -150,7 +162,8 @@ VirtioRingUninit (
 
 /**
 
-  Turn off interrupt notifications from the host, and prepare for appending
+  Turn off interrupt notifications from the host (unless the ring has an
+  event attached with VirtioRingEnableEvent()), and prepare for appending
   multiple descriptors to the virtio ring.
 
   The calling driver must be in VSTAT_DRIVER_OK state.
@@ -169,9 +182,12 @@ VirtioPrepare (
 {
   //
   // Prepare for virtio-0.9.5, 2.4.2 Receiving Used Buffers From the Device.
-  // We're going to poll the answer, the host should not send an interrupt.
+  // Unless the device signals Ring->Event for us, we're going to poll the
+  // answer, and the host should not send an interrupt.
   //
-  *Ring->Avail.Flags = (UINT16) VRING_AVAIL_F_NO_INTERRUPT;
+  *Ring->Avail.Flags = (Ring->Event == NULL) ?
+                       (UINT16) VRING_AVAIL_F_NO_INTERRUPT :
+                       (UINT16) 0;
 
   //
   // Prepare for virtio-0.9.5, 2.4.1 Supplying Buffers to the Device.
@@ -209,8 +225,9 @@ VirtioPrepare (
   @param[in] Flags                  A bitmask of VRING_DESC_F_* flags. The
                                     caller computes this mask dependent on
                                     further buffers to append and transfer
-                                    direction. VRING_DESC_F_INDIRECT is
-                                    unsupported. The VRING_DESC.Next field is
+                                    direction. For VRING_DESC_F_INDIRECT, use
+                                    VirtioAppendIndirectTable(). The
+                                    VRING_DESC.Next field is
                                     always set, but the host only interprets
                                     it dependent on VRING_DESC_F_NEXT.
 
@@ -320,6 +337,28 @@ VirtioFlush (
   // Wait until the host processes and acknowledges our descriptor chain. The
   // condition we use for polling is greatly simplified and relies on the
   // synchronous, lock-step progress.
+  if ((Ring->Event != NULL) && GetInterruptState ()) {
+    //
+    // The device interrupts the CPU (and signals Ring->Event) when it places
+    // our chain in the used ring. Halt the CPU until then, rather than
+    // spinning on the used index. The used index is checked with interrupts
+    // disabled, and they are enabled atomically with halting, so that an
+    // interrupt arriving after the check still wakes the CPU up.
+    //
+    // (If interrupts are disabled by the caller, e.g. at TPL_HIGH_LEVEL, the
+    // used ring is polled below.)
+    //
+    DisableInterrupts ();
+    MemoryFence();
+    while (*Ring->Used.Idx != NextAvailIdx) {
+      InternalVirtioEnableInterruptsAndSleep ();
+      DisableInterrupts ();
+      MemoryFence();
+    }
+    EnableInterrupts ();
+    goto UsedBufferReady;
+  }
+
   //
   // Keep slowing down until we reach a poll period of slightly above 1 ms.
   //
@@ -334,6 +373,7 @@ VirtioFlush (
     MemoryFence();
   }
 
+UsedBufferReady:
   MemoryFence();
 
   if (UsedLen != NULL) {
@@ -348,6 +388,229 @@ VirtioFlush (
 }
 
 
+/**
+
+  Allocate and map a table of indirect descriptors.
+
+  The table is allocated with VirtIo->AllocateSharedPages() and mapped as a
+  common buffer, so that both the guest and the hypervisor can access it (for
+  example, the table resides in shared memory in a confidential guest). The
+  table may be reused for any number of requests, but it may only carry one
+  in-flight request at a time.
+
+  @param[in]  VirtIo         The virtio device which will use the table.
+
+  @param[in]  NumDescs       The number of descriptors to allocate. The caller
+                             is responsible for not exceeding the queue size
+                             of the device.
+
+  @param[out] Table          The indirect descriptor table to set up.
+
+  @retval EFI_SUCCESS        Allocation and mapping successful.
+
+  @return                    Status codes propagated from
+                             VirtIo->AllocateSharedPages() and
+                             VirtioMapAllBytesInSharedBuffer().
+
+**/
+EFI_STATUS
+EFIAPI
+VirtioIndirectTableInit (
+  IN  VIRTIO_DEVICE_PROTOCOL *VirtIo,
+  IN  UINT16                 NumDescs,
+  OUT VRING_INDIRECT         *Table
+  )
+{
+  EFI_STATUS Status;
+  UINTN      TableSize;
+
+  ASSERT (NumDescs > 0);
+
+  TableSize = sizeof *Table->Desc * NumDescs;
+  Table->NumPages = EFI_SIZE_TO_PAGES (TableSize);
+  Status = VirtIo->AllocateSharedPages (
+                     VirtIo,
+                     Table->NumPages,
+                     &Table->Base
+                     );
+  if (EFI_ERROR (Status)) {
+    return Status;
+  }
+  SetMem (Table->Base, EFI_PAGES_TO_SIZE (Table->NumPages), 0x00);
+
+  Status = VirtioMapAllBytesInSharedBuffer (
+             VirtIo,
+             VirtioOperationBusMasterCommonBuffer,
+             Table->Base,
+             EFI_PAGES_TO_SIZE (Table->NumPages),
+             &Table->DeviceAddress,
+             &Table->Mapping
+             );
+  if (EFI_ERROR (Status)) {
+    VirtIo->FreeSharedPages (VirtIo, Table->NumPages, Table->Base);
+    SetMem (Table, sizeof *Table, 0x00);
+    return Status;
+  }
+
+  Table->Desc     = Table->Base;
+  Table->NumDescs = NumDescs;
+  return EFI_SUCCESS;
+}
+
+
+/**
+
+  Unmap and release a table of indirect descriptors that has been set up with
+  VirtioIndirectTableInit().
+
+  The caller is responsible to stop the host from using the table before
+  invoking this function.
+
+  @param[in]     VirtIo  The virtio device which was using the table.
+
+  @param[in,out] Table   The indirect descriptor table to clean up.
+
+**/
+VOID
+EFIAPI
+VirtioIndirectTableUninit (
+  IN     VIRTIO_DEVICE_PROTOCOL *VirtIo,
+  IN OUT VRING_INDIRECT         *Table
+  )
+{
+  VirtIo->UnmapSharedBuffer (VirtIo, Table->Mapping);
+  VirtIo->FreeSharedPages (VirtIo, Table->NumPages, Table->Base);
+  SetMem (Table, sizeof *Table, 0x00);
+}
+
+
+/**
+
+  Prepare for appending multiple descriptors to a table of indirect
+  descriptors.
+
+  @param[in,out] Table  The indirect descriptor table we intend to append
+                        descriptors to.
+
+  @param[out] Indices   The DESC_INDICES structure to initialize.
+
+**/
+VOID
+EFIAPI
+VirtioPrepareIndirect (
+  IN OUT VRING_INDIRECT *Table,
+  OUT    DESC_INDICES   *Indices
+  )
+{
+  //
+  // virtio-1.0, 2.4.5.3.1: the first descriptor of the chain is located at
+  // the start of the table.
+  //
+  Indices->HeadDescIdx = 0;
+  Indices->NextDescIdx = Indices->HeadDescIdx;
+}
+
+
+/**
+
+  Append a contiguous buffer for transmission / reception to a table of
+  indirect descriptors.
+
+  The semantics of the parameters are identical to those of
+  VirtioAppendDesc(), except that the descriptor is placed into Table, and
+  that the caller is responsible for not exceeding Table->NumDescs.
+
+  @param[in,out] Table              The indirect descriptor table to append
+                                    the buffer to, as a descriptor.
+
+  @param[in] BufferDeviceAddress    (Bus master device) start address of the
+                                    transmit / receive buffer.
+
+  @param[in] BufferSize             Number of bytes to transmit or receive.
+
+  @param[in] Flags                  A bitmask of VRING_DESC_F_* flags.
+                                    VRING_DESC_F_INDIRECT is not permitted.
+
+  @param[in,out] Indices            Initialized with VirtioPrepareIndirect().
+                                    Indices->NextDescIdx is incremented by
+                                    one.
+
+**/
+VOID
+EFIAPI
+VirtioAppendIndirectDesc (
+  IN OUT VRING_INDIRECT *Table,
+  IN     UINT64         BufferDeviceAddress,
+  IN     UINT32         BufferSize,
+  IN     UINT16         Flags,
+  IN OUT DESC_INDICES   *Indices
+  )
+{
+  volatile VRING_DESC *Desc;
+
+  //
+  // virtio-1.0, 2.4.5.3.1: "The driver MUST NOT set the VIRTQ_DESC_F_INDIRECT
+  // flag within an indirect descriptor".
+  //
+  ASSERT ((Flags & VRING_DESC_F_INDIRECT) == 0);
+  ASSERT (Indices->NextDescIdx < Table->NumDescs);
+
+  Desc        = &Table->Desc[Indices->NextDescIdx++];
+  Desc->Addr  = BufferDeviceAddress;
+  Desc->Len   = BufferSize;
+  Desc->Flags = Flags;
+  Desc->Next  = Indices->NextDescIdx;
+}
+
+
+/**
+
+  Append a single descriptor to the virtio ring that refers to the descriptor
+  chain built in a table of indirect descriptors.
+
+  The caller is responsible for initializing *RingIndices with VirtioPrepare()
+  first, and for submitting the request with VirtioFlush() afterwards.
+
+  @param[in,out] Ring          The virtio ring to append the descriptor to.
+
+  @param[in] Table             The indirect descriptor table carrying the
+                               descriptor chain.
+
+  @param[in] TableIndices      TableIndices->NextDescIdx identifies the number
+                               of descriptors appended to Table.
+
+  @param[in,out] RingIndices   On output, RingIndices->NextDescIdx is
+                               incremented by one, modulo 2^16.
+
+**/
+VOID
+EFIAPI
+VirtioAppendIndirectTable (
+  IN OUT VRING          *Ring,
+  IN     VRING_INDIRECT *Table,
+  IN     DESC_INDICES   *TableIndices,
+  IN OUT DESC_INDICES   *RingIndices
+  )
+{
+  ASSERT (TableIndices->NextDescIdx > 0);
+  ASSERT (TableIndices->NextDescIdx <= Table->NumDescs);
+
+  //
+  // virtio-1.0, 2.4.5.3.1: "The driver MUST NOT set both VIRTQ_DESC_F_INDIRECT
+  // and VIRTQ_DESC_F_NEXT in flags". The host derives the number of indirect
+  // descriptors from the length of the table, and the direction of each
+  // buffer from the indirect descriptors themselves.
+  //
+  VirtioAppendDesc (
+    Ring,
+    Table->DeviceAddress,
+    (UINT32) (sizeof *Table->Desc * TableIndices->NextDescIdx),
+    VRING_DESC_F_INDIRECT,
+    RingIndices
+    );
+}
+
+
 /**
 
   Report the feature bits to the VirtIo 1.0 device that the VirtIo 1.0 driver
@@ -550,3 +813,70 @@ VirtioRingMap (
   *RingBaseShift = DeviceAddress - (UINT64)(UINTN)Ring->Base;
   return EFI_SUCCESS;
 }
+
+/**
+
+  Attach an event to a virtio ring, and ask the device to signal it when the
+  device places buffers in the used ring of the queue.
+
+  When the device supports it, VirtioPrepare() stops suppressing used buffer
+  notifications for the ring, and VirtioFlush() halts the CPU until the event
+  is signaled, rather than polling the used ring.
+
+  The function is to be called after VirtioRingInit() and before the queue is
+  enabled (that is, before VirtIo->SetQueueAddress()). VirtioRingUninit()
+  detaches and closes the event.
+
+  @param[in]     VirtIo      The virtio device that owns the ring.
+
+  @param[in]     QueueIndex  The index of the queue that Ring is used for.
+
+  @param[in,out] Ring        The virtio ring to attach the event to.
+
+  @retval EFI_SUCCESS  The event has been attached to the ring, or the device
+                       does not support interrupt-driven completion (in which
+                       case Ring->Event stays NULL, and the ring is polled).
+
+  @return              Error codes from gBS->CreateEvent() and
+                       VirtIo->SetQueueEvent().
+**/
+EFI_STATUS
+EFIAPI
+VirtioRingEnableEvent (
+  IN     VIRTIO_DEVICE_PROTOCOL *VirtIo,
+  IN     UINT16                 QueueIndex,
+  IN OUT VRING                  *Ring
+  )
+{
+  EFI_STATUS Status;
+  EFI_EVENT  Event;
+
+  ASSERT (Ring->Event == NULL);
+
+  //
+  // SetQueueEvent() is optional: transports that cannot deliver interrupts
+  // leave it NULL.
+  //
+  if (VirtIo->SetQueueEvent == NULL) {
+    return EFI_SUCCESS;
+  }
+
+  Status = gBS->CreateEvent (0, TPL_CALLBACK, NULL, NULL, &Event);
+  if (EFI_ERROR (Status)) {
+    return Status;
+  }
+
+  Status = VirtIo->SetQueueEvent (VirtIo, QueueIndex, Event);
+  if (Status == EFI_UNSUPPORTED) {
+    gBS->CloseEvent (Event);
+    return EFI_SUCCESS;
+  }
+  if (EFI_ERROR (Status)) {
+    gBS->CloseEvent (Event);
+    return Status;
+  }
+
+  Ring->Event      = Event;
+  Ring->EventQueue = QueueIndex;
+  return EFI_SUCCESS;
+}
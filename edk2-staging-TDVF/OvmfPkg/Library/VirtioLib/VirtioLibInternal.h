@@ -0,0 +1,29 @@
+/** @file
+
+  Internal functions of VirtioLib.
+
+  Copyright (c) 2021, Intel Corporation. All rights reserved.<BR>
+
+  SPDX-License-Identifier: BSD-2-Clause-Patent
+
+**/
+
+#ifndef _VIRTIO_LIB_INTERNAL_H_
+#define _VIRTIO_LIB_INTERNAL_H_
+
+#include <Base.h>
+
+/**
+
+  Enable interrupts and put the CPU to sleep until the next interrupt, with no
+  interrupt window in between: an interrupt that becomes pending after the
+  caller disabled interrupts wakes the CPU up.
+
+**/
+VOID
+EFIAPI
+InternalVirtioEnableInterruptsAndSleep (
+  VOID
+  );
+
+#endif // _VIRTIO_LIB_INTERNAL_H_
@@ -33,7 +33,8 @@ STATIC CONST VIRTIO_DEVICE_PROTOCOL mMmioDeviceProtocolTemplate = {
     VirtioMmioAllocateSharedPages,         // AllocateSharedPages
     VirtioMmioFreeSharedPages,             // FreeSharedPages
     VirtioMmioMapSharedBuffer,             // MapSharedBuffer
-    VirtioMmioUnmapSharedBuffer            // UnmapSharedBuffer
+    VirtioMmioUnmapSharedBuffer,           // UnmapSharedBuffer
+    VirtioMmioSetQueueEvent                // SetQueueEvent
 };
 
 /**
@@ -168,4 +168,12 @@ VirtioMmioUnmapSharedBuffer (
   IN  VOID                          *Mapping
   );
 
+EFI_STATUS
+EFIAPI
+VirtioMmioSetQueueEvent (
+  IN  VIRTIO_DEVICE_PROTOCOL        *This,
+  IN  UINT16                        QueueIndex,
+  IN  EFI_EVENT                     Event       OPTIONAL
+  );
+
 #endif // _VIRTIO_MMIO_DEVICE_INTERNAL_H_
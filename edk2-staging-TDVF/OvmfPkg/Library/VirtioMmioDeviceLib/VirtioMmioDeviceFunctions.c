@@ -347,3 +347,17 @@ VirtioMmioUnmapSharedBuffer (
 {
   return EFI_SUCCESS;
 }
+
+EFI_STATUS
+EFIAPI
+VirtioMmioSetQueueEvent (
+  IN VIRTIO_DEVICE_PROTOCOL    *This,
+  IN UINT16                    QueueIndex,
+  IN EFI_EVENT                 Event       OPTIONAL
+  )
+{
+  //
+  // Interrupts of virtio-mmio devices are not routed in the firmware.
+  //
+  return EFI_UNSUPPORTED;
+}
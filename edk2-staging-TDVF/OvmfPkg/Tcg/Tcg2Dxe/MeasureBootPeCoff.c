@@ -21,8 +21,100 @@ SPDX-License-Identifier: BSD-2-Clause-Patent
 #include <Library/UefiBootServicesTableLib.h>
 #include <Library/PeCoffLib.h>
 #include <Library/HashLib.h>
+#include <Library/TdxLib.h>
+#include <Protocol/PeImageDigestCache.h>
 
-UINTN  mTcg2DxeImageSize = 0;
+UINTN                                 mTcg2DxeImageSize    = 0;
+EDKII_PE_IMAGE_DIGEST_CACHE_PROTOCOL  *mPeImageDigestCache = NULL;
+
+/**
+  Notification function of EDKII_PE_IMAGE_DIGEST_CACHE_PROTOCOL installation.
+
+  Ask the image verification to compute the SHA384 digests of the images it
+  hashes, so that they are not computed again when the images are measured.
+
+  @param[in]  Event     Event whose notification function is being invoked.
+  @param[in]  Context   Pointer to the notification function's context.
+
+**/
+VOID
+EFIAPI
+PeImageDigestCacheNotify (
+  IN EFI_EVENT  Event,
+  IN VOID       *Context
+  )
+{
+  EFI_STATUS  Status;
+
+  Status = gBS->LocateProtocol (&gEdkiiPeImageDigestCacheProtocolGuid, NULL, (VOID **) &mPeImageDigestCache);
+  if (EFI_ERROR (Status)) {
+    return;
+  }
+
+  mPeImageDigestCache->HashMask |= EDKII_PE_IMAGE_DIGEST_SHA384;
+  gBS->CloseEvent (Event);
+}
+
+/**
+  Extend an RTMR with the SHA384 digest the image verification cached for an
+  image.
+
+  @param[in]  RtmrIndex      Rtmr index
+  @param[in]  ImageAddress   Start address of image buffer.
+  @param[in]  ImageSize      Image size
+  @param[out] DigestList     Digest list of this image.
+
+  @retval EFI_SUCCESS            Successfully measure image.
+  @retval EFI_NOT_FOUND          The SHA384 digest of the image is not cached.
+  @retval other error value
+**/
+STATIC
+EFI_STATUS
+ExtendCachedPeImageDigest (
+  IN  UINT32                    RtmrIndex,
+  IN  EFI_PHYSICAL_ADDRESS      ImageAddress,
+  IN  UINTN                     ImageSize,
+  OUT TPML_DIGEST_VALUES        *DigestList
+  )
+{
+  EFI_STATUS          Status;
+  TPML_DIGEST_VALUES  CachedDigests;
+  UINT32              Index;
+
+  if (mPeImageDigestCache == NULL) {
+    return EFI_NOT_FOUND;
+  }
+
+  Status = mPeImageDigestCache->GetDigests (
+                                  mPeImageDigestCache,
+                                  (VOID *) (UINTN) ImageAddress,
+                                  ImageSize,
+                                  &CachedDigests
+                                  );
+  if (EFI_ERROR (Status)) {
+    return EFI_NOT_FOUND;
+  }
+
+  for (Index = 0; Index < CachedDigests.count; Index++) {
+    if (CachedDigests.digests[Index].hashAlg == TPM_ALG_SHA384) {
+      break;
+    }
+  }
+  if (Index == CachedDigests.count) {
+    return EFI_NOT_FOUND;
+  }
+
+  ZeroMem (DigestList, sizeof (*DigestList));
+  DigestList->count              = 1;
+  DigestList->digests[0].hashAlg = TPM_ALG_SHA384;
+  CopyMem (DigestList->digests[0].digest.sha384, CachedDigests.digests[Index].digest.sha384, SHA384_DIGEST_SIZE);
+
+  return TdExtendRtmr (
+           (UINT32 *) DigestList->digests[0].digest.sha384,
+           SHA384_DIGEST_SIZE,
+           (UINT8) RtmrIndex
+           );
+}
 
 /**
   Reads contents of a PE/COFF image in memory buffer.
@@ -152,6 +244,14 @@ MeasurePeImageAndExtend (
     goto Finish;
   }
 
+  //
+  // The image verification may have hashed the image already.
+  //
+  Status = ExtendCachedPeImageDigest (RtmrIndex, ImageAddress, ImageSize, DigestList);
+  if (Status != EFI_NOT_FOUND) {
+    goto Finish;
+  }
+
   //
   // PE/COFF Image Measurement
   //
@@ -26,6 +26,7 @@
 #include <Protocol/TrEEProtocol.h>
 #include <Protocol/ResetNotification.h>
 #include <Protocol/AcpiTable.h>
+#include <Protocol/PeImageDigestCache.h>
 
 #include <Library/DebugLib.h>
 #include <Library/BaseMemoryLib.h>
@@ -256,6 +257,23 @@ MeasurePeImageAndExtend (
   OUT TPML_DIGEST_VALUES        *DigestList
   );
 
+/**
+  Notification function of EDKII_PE_IMAGE_DIGEST_CACHE_PROTOCOL installation.
+
+  Ask the image verification to compute the SHA384 digests of the images it
+  hashes, so that they are not computed again when the images are measured.
+
+  @param[in]  Event     Event whose notification function is being invoked.
+  @param[in]  Context   Pointer to the notification function's context.
+
+**/
+VOID
+EFIAPI
+PeImageDigestCacheNotify (
+  IN EFI_EVENT  Event,
+  IN VOID       *Context
+  );
+
 #define COLUME_SIZE  (16 * 2)
 /**
 
@@ -2472,6 +2490,11 @@ DriverEntry (
   //
   EfiCreateProtocolNotifyEvent (&gEfiVariableWriteArchProtocolGuid, TPL_CALLBACK, MeasureSecureBootPolicy, NULL, &Registration);
 
+  //
+  // Share the digests of the images with the image verification.
+  //
+  EfiCreateProtocolNotifyEvent (&gEdkiiPeImageDigestCacheProtocolGuid, TPL_CALLBACK, PeImageDigestCacheNotify, NULL, &Registration);
+
   //
   // Install EfiTdProtocol
   //
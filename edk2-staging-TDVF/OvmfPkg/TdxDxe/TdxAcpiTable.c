@@ -17,7 +17,6 @@
 #include <Library/DxeServicesTableLib.h>
 #include <Library/PcdLib.h>
 #include <Library/OrderedCollectionLib.h>
-#include <Library/TdvfPlatformLib.h>
 #include <Library/TdxLib.h>
 #include <IndustryStandard/Acpi.h>
 #include <IndustryStandard/AcpiTdx.h>
@@ -28,6 +27,65 @@
 #include <Protocol/Cpu.h>
 #include <Uefi.h>
 #include <TdxAcpiTable.h>
+#include "TdxMadt.h"
+
+//
+// TRUE once the MADT from QEMU has been replaced before its installation, so
+// that AlterAcpiTable() has nothing left to do.
+//
+STATIC BOOLEAN  mMadtUpdated = FALSE;
+
+/**
+  Build the MADT of the TD from the MADT from QEMU.
+
+  @param[in]  AcpiTableBuffer      The MADT from QEMU.
+  @param[in]  AcpiTableBufferSize  The size of the MADT from QEMU.
+  @param[out] NewMadt              The new MADT, allocated from pool.
+
+  @retval EFI_SUCCESS              The new MADT is returned.
+  @retval EFI_INVALID_PARAMETER    The MADT from QEMU is not valid.
+  @retval EFI_OUT_OF_RESOURCES     The new MADT could not be allocated.
+**/
+STATIC
+EFI_STATUS
+BuildTdxMadt (
+  IN   CONST VOID                    *AcpiTableBuffer,
+  IN   UINTN                         AcpiTableBufferSize,
+  OUT  EFI_ACPI_DESCRIPTION_HEADER   **NewMadt
+  )
+{
+  CONST EFI_ACPI_DESCRIPTION_HEADER  *Madt;
+  UINTN                              NewBufferSize;
+  EFI_STATUS                         Status;
+
+  Madt = AcpiTableBuffer;
+  if ((AcpiTableBufferSize < sizeof (EFI_ACPI_DESCRIPTION_HEADER)) ||
+      (Madt->Length > AcpiTableBufferSize)) {
+    return EFI_INVALID_PARAMETER;
+  }
+
+  NewBufferSize = TdxMadtSize (Madt);
+  if (NewBufferSize == 0) {
+    return EFI_INVALID_PARAMETER;
+  }
+
+  *NewMadt = AllocatePool (NewBufferSize);
+  if (*NewMadt == NULL) {
+    return EFI_OUT_OF_RESOURCES;
+  }
+
+  Status = TdxBuildMadt (
+             Madt,
+             PcdGet64 (PcdTdRelocatedMailboxBase),
+             *NewMadt,
+             &NewBufferSize
+             );
+  if (EFI_ERROR (Status)) {
+    FreePool (*NewMadt);
+    *NewMadt = NULL;
+  }
+  return Status;
+}
 
 STATIC
 EFI_STATUS
@@ -39,121 +97,58 @@ QemuInstallAcpiMadtTable (
   OUT  UINTN                         *TableKey
   )
 {
-  UINTN                                               CpuCount;
-  UINTN                                               NewBufferSize;
-  EFI_ACPI_1_0_MULTIPLE_APIC_DESCRIPTION_TABLE_HEADER *Madt;
-  EFI_ACPI_1_0_PROCESSOR_LOCAL_APIC_STRUCTURE         *LocalApic;
-  EFI_ACPI_1_0_IO_APIC_STRUCTURE                      *IoApic;
-  EFI_ACPI_1_0_INTERRUPT_SOURCE_OVERRIDE_STRUCTURE    *Iso;
-  EFI_ACPI_1_0_LOCAL_APIC_NMI_STRUCTURE               *LocalApicNmi;
-  VOID                                                *Ptr;
-  UINTN                                               Loop;
-  EFI_STATUS                                          Status;
-  ACPI_MADT_MPWK_STRUCT                               *MadtMpWk;
-
-  ASSERT (AcpiTableBufferSize >= sizeof (EFI_ACPI_DESCRIPTION_HEADER));
-
-  CpuCount = TdVCpuNum();
-
-  ASSERT (CpuCount >= 1);
-
-#define NUM_8259_IRQS                   16
-  NewBufferSize = 1                     * sizeof (*Madt) +
-                  CpuCount              * sizeof (*LocalApic) +
-                  1                     * sizeof (*IoApic) +
-                  NUM_8259_IRQS         * sizeof (*Iso) +
-                  1                     * sizeof (*LocalApicNmi);
-
-  NewBufferSize += sizeof(ACPI_MADT_MPWK_STRUCT);
-
-  Madt = AllocatePool (NewBufferSize);
-  if (Madt == NULL) {
-    return EFI_OUT_OF_RESOURCES;
-  }
+  EFI_ACPI_DESCRIPTION_HEADER  *Madt;
+  EFI_STATUS                   Status;
 
-  CopyMem (&(Madt->Header), AcpiTableBuffer, sizeof (EFI_ACPI_DESCRIPTION_HEADER));
-  Madt->Header.Length    = (UINT32) NewBufferSize;
-  Madt->LocalApicAddress = PcdGet32 (PcdCpuLocalApicBaseAddress);
-  Madt->Flags            = EFI_ACPI_1_0_PCAT_COMPAT;
-  Ptr = Madt + 1;
-
-  LocalApic = Ptr;
-  for (Loop = 0; Loop < CpuCount; ++Loop) {
-    LocalApic->Type            = EFI_ACPI_1_0_PROCESSOR_LOCAL_APIC;
-    LocalApic->Length          = sizeof (*LocalApic);
-    LocalApic->AcpiProcessorId = (UINT8) Loop;
-    LocalApic->ApicId          = (UINT8) Loop;
-    LocalApic->Flags           = 1; // enabled
-    ++LocalApic;
-  }
-  Ptr = LocalApic;
-
-  IoApic = Ptr;
-  IoApic->Type             = EFI_ACPI_1_0_IO_APIC;
-  IoApic->Length           = sizeof (*IoApic);
-  IoApic->IoApicId         = (UINT8) CpuCount;
-  IoApic->Reserved         = EFI_ACPI_RESERVED_BYTE;
-  IoApic->IoApicAddress    = 0xFEC00000;
-  IoApic->SystemVectorBase = 0x00000000;
-  Ptr = IoApic + 1;
-
-  //
-  // IRQ0 (8254 Timer) => IRQ2 (PIC) Interrupt Source Override Structure
-  //
-  Iso = Ptr;
-  Iso->Type                        = EFI_ACPI_1_0_INTERRUPT_SOURCE_OVERRIDE;
-  Iso->Length                      = sizeof (*Iso);
-  Iso->Bus                         = 0x00;    // ISA
-  Iso->Source                      = 0x00;    // IRQ0
-  Iso->GlobalSystemInterruptVector = 0x00000002;
-  Iso->Flags                       = 0x0005;  // Edge-triggered, Active High
-  ++Iso;
-
-  for (Loop = 1; Loop < NUM_8259_IRQS; ++Loop) {
-    Iso->Type                        = EFI_ACPI_1_0_INTERRUPT_SOURCE_OVERRIDE;
-    Iso->Length                      = sizeof (*Iso);
-    Iso->Bus                         = 0x00; // ISA
-    Iso->Source                      = (UINT8) Loop;
-    Iso->GlobalSystemInterruptVector = (UINT32) Loop;
-    Iso->Flags                       = 0x0005; // Edge-triggered, Active High
-    ++Iso;
+  Status = BuildTdxMadt (AcpiTableBuffer, AcpiTableBufferSize, &Madt);
+  if (EFI_ERROR (Status)) {
+    return Status;
   }
-  Ptr = Iso;
-
-  LocalApicNmi = Ptr;
-  LocalApicNmi->Type            = EFI_ACPI_1_0_LOCAL_APIC_NMI;
-  LocalApicNmi->Length          = sizeof (*LocalApicNmi);
-  LocalApicNmi->AcpiProcessorId = 0xFF; // applies to all processors
-  //
-  // polarity and trigger mode of the APIC I/O input signals conform to the
-  // specifications of the bus
-  //
-  LocalApicNmi->Flags           = 0x0000;
-  //
-  // Local APIC interrupt input LINTn to which NMI is connected.
-  //
-  LocalApicNmi->LocalApicInti   = 0x01;
-  Ptr = LocalApicNmi + 1;
-
-  MadtMpWk = Ptr;
-  MadtMpWk->Type = ACPI_MADT_MPWK_STRUCT_TYPE;
-  MadtMpWk->Length = sizeof(ACPI_MADT_MPWK_STRUCT);
-  MadtMpWk->MailBoxVersion = 1;
-  MadtMpWk->Reserved2 = 0;
-  MadtMpWk->MailBoxAddress = PcdGet64 (PcdTdRelocatedMailboxBase);
-  Ptr = MadtMpWk + 1;
-
-  //DEBUG ((DEBUG_INFO, "%a:%d:ACPI setting mailbox to 0x%x 0x%x\n", __func__, __LINE__,
-  //  MadtMpWk->MailBoxAddress, PcdGet64 (PcdTdRelocatedMailboxBase)));
-
-  ASSERT ((UINTN) ((UINT8 *)Ptr - (UINT8 *)Madt) == NewBufferSize);
-  Status = AcpiProtocol->InstallAcpiTable (AcpiProtocol, Madt, NewBufferSize, TableKey);
+
+  Status = AcpiProtocol->InstallAcpiTable (AcpiProtocol, Madt, Madt->Length, TableKey);
 
   FreePool (Madt);
 
   return Status;
 }
 
+/**
+  Replace the MADT from QEMU with the MADT of the TD before it is installed.
+
+  @param[in]  This       This pointer for QEMU_ACPI_TABLE_UPDATE_PROTOCOL.
+  @param[in]  Table      The ACPI table from QEMU.
+  @param[out] NewTable   The table to install instead, allocated from pool.
+
+  @retval EFI_SUCCESS           NewTable is returned.
+  @retval EFI_UNSUPPORTED       Table is not the MADT.
+  @retval EFI_OUT_OF_RESOURCES  The new MADT could not be allocated.
+**/
+STATIC
+EFI_STATUS
+EFIAPI
+TdxUpdateAcpiTable (
+  IN  QEMU_ACPI_TABLE_UPDATE_PROTOCOL    *This,
+  IN  CONST EFI_ACPI_DESCRIPTION_HEADER  *Table,
+  OUT EFI_ACPI_DESCRIPTION_HEADER        **NewTable
+  )
+{
+  EFI_STATUS  Status;
+
+  if (Table->Signature != EFI_ACPI_1_0_APIC_SIGNATURE) {
+    return EFI_UNSUPPORTED;
+  }
+
+  Status = BuildTdxMadt (Table, Table->Length, NewTable);
+  if (!EFI_ERROR (Status)) {
+    mMadtUpdated = TRUE;
+  }
+  return Status;
+}
+
+QEMU_ACPI_TABLE_UPDATE_PROTOCOL  mTdxAcpiTableUpdate = {
+  TdxUpdateAcpiTable
+};
+
 /**
   Alter the MADT when ACPI Table from QEMU is available.
 
@@ -176,6 +171,10 @@ AlterAcpiTable (
   UINTN                          OriginalTableKey;
   UINTN                          UpdatedTableKey;
 
+  if (mMadtUpdated) {
+    return;
+  }
+
   Index = 0;
 
   Status = gBS->LocateProtocol (&gEfiAcpiSdtProtocolGuid, NULL, (void **) &AcpiSdtTable);
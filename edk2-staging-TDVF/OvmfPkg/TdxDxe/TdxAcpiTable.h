@@ -14,6 +14,7 @@
 #include <Protocol/AcpiTable.h>
 #include <Protocol/FirmwareVolume2.h>
 #include <Protocol/PciIo.h>
+#include <Protocol/QemuAcpiTableUpdate.h>
 
 #include <Library/BaseLib.h>
 #include <Library/UefiBootServicesTableLib.h>
@@ -22,6 +23,11 @@
 
 #include <IndustryStandard/Acpi.h>
 
+//
+// Replaces the MADT from QEMU before AcpiPlatformDxe installs it.
+//
+extern QEMU_ACPI_TABLE_UPDATE_PROTOCOL  mTdxAcpiTableUpdate;
+
 /**
   Alter the MADT when ACPI Table from QEMU is available.
 
@@ -9,6 +9,8 @@
     - Sets PCDs indicating we are using protected mode resets
     - Sets max logical cpus based on TDINFO
     - Sets PCI PCDs based on resource hobs
+    - Maps addresses on demand that the SEC page tables do not cover
+    - Publishes the in-memory debug log as a configuration table
 
   Copyright (c) 2020, Intel Corporation. All rights reserved.<BR>
 
@@ -27,9 +29,11 @@
 #include <Library/TdvfPlatformLib.h>
 #include <Protocol/Cpu.h>
 #include <Protocol/MemoryAccept.h>
+#include <Guid/TdxDebugLog.h>
 #include <IndustryStandard/Tdx.h>
 #include <Library/TdxLib.h>
 #include <TdxAcpiTable.h>
+#include "TdxPageFault.h"
 
 EFI_HANDLE                      mTdxDxeHandle  = NULL;
 
@@ -160,6 +164,11 @@ TdxDxeEntryPoint (
 
   PlatformInfo = (EFI_HOB_PLATFORM_INFO *) GET_GUID_HOB_DATA (GuidHob);
 
+  //
+  // Map addresses that the page tables from SEC do not cover, on demand.
+  //
+  TdxInstallPageFaultHandler ();
+
   // Install MemoryAccept protocol for TDX
   Status = gBS->InstallProtocolInterface (&mTdxDxeHandle,
                   &gEfiMemoryAcceptProtocolGuid, EFI_NATIVE_INTERFACE,
@@ -168,6 +177,20 @@ TdxDxeEntryPoint (
     DEBUG ((DEBUG_ERROR, "Install EfiMemoryAcceptProtocol failed.\n"));
   }
 
+  //
+  // Publish the in-memory debug log, so that it can be read from the shell.
+  //
+  GuidHob = GetFirstGuidHob (&gUefiOvmfPkgTdxDebugLogGuid);
+  if (GuidHob != NULL) {
+    Status = gBS->InstallConfigurationTable (
+                    &gUefiOvmfPkgTdxDebugLogGuid,
+                    (VOID *) (UINTN) *(EFI_PHYSICAL_ADDRESS *) GET_GUID_HOB_DATA (GuidHob)
+                    );
+    if (EFI_ERROR (Status)) {
+      DEBUG ((DEBUG_ERROR, "Install TdxDebugLog table failed.\n"));
+    }
+  }
+
   //
   // Call TDINFO to get actual number of cpus in domain
   //
@@ -185,6 +208,24 @@ TdxDxeEntryPoint (
     ASSERT_RETURN_ERROR(PcdStatus);
   }
 
+  //
+  // Every device that BDS connects costs MMIO and PCI config exits in a TD.
+  // Connect the devices that the previous boots used, rather than all.
+  //
+  PcdStatus = PcdSetBoolS (PcdBootPathCacheConnect, TRUE);
+  ASSERT_RETURN_ERROR (PcdStatus);
+
+  //
+  // Let AcpiPlatformDxe install the MADT of the TD in place of the MADT from
+  // QEMU, rather than install the latter and replace it afterwards.
+  //
+  Status = gBS->InstallProtocolInterface (&mTdxDxeHandle,
+                  &gQemuAcpiTableUpdateProtocolGuid, EFI_NATIVE_INTERFACE,
+                  &mTdxAcpiTableUpdate);
+  if (EFI_ERROR (Status)) {
+    DEBUG ((DEBUG_ERROR, "Install QemuAcpiTableUpdateProtocol failed.\n"));
+  }
+
   //
   // Register for protocol notifications to call the AlterAcpiTable(),
   // the protocol will be installed in AcpiPlatformDxe when the ACPI
@@ -0,0 +1,181 @@
+/** @file
+  Build the MADT of a TD from the MADT from QEMU.
+
+  The MADT of a TD is the MADT from QEMU with a multiprocessor wakeup
+  structure. As QEMU describes every vCPU with its own processor local APIC or
+  x2APIC structure, the MADT grows with the number of vCPUs. It is therefore
+  copied once into a buffer sized for the result, rather than rebuilt entry by
+  entry.
+
+  Copyright (c) 2021, Intel Corporation. All rights reserved.<BR>
+
+  SPDX-License-Identifier: BSD-2-Clause-Patent
+
+**/
+
+#include <Library/BaseLib.h>
+#include <Library/BaseMemoryLib.h>
+#include <IndustryStandard/AcpiTdx.h>
+
+#include "TdxMadt.h"
+
+//
+// The header shared by all the interrupt controller structures of the MADT.
+//
+typedef struct {
+  UINT8   Type;
+  UINT8   Length;
+} MADT_ENTRY_HEADER;
+
+/**
+  Check the MADT from QEMU, and return the size of its multiprocessor wakeup
+  structures, if any.
+
+  @param[in]   Madt        The MADT from QEMU.
+  @param[out]  WakeupSize  The total size of the multiprocessor wakeup
+                           structures of the MADT.
+
+  @retval TRUE   The MADT is valid.
+  @retval FALSE  The MADT is too small, or one of its structures overflows it.
+**/
+STATIC
+BOOLEAN
+CheckMadt (
+  IN  CONST EFI_ACPI_DESCRIPTION_HEADER  *Madt,
+  OUT UINTN                              *WakeupSize
+  )
+{
+  CONST UINT8              *Entry;
+  CONST UINT8              *End;
+  CONST MADT_ENTRY_HEADER  *Header;
+
+  *WakeupSize = 0;
+  if ((Madt == NULL) ||
+      (Madt->Length < sizeof (EFI_ACPI_1_0_MULTIPLE_APIC_DESCRIPTION_TABLE_HEADER))) {
+    return FALSE;
+  }
+
+  Entry = (CONST UINT8 *)Madt + sizeof (EFI_ACPI_1_0_MULTIPLE_APIC_DESCRIPTION_TABLE_HEADER);
+  End   = (CONST UINT8 *)Madt + Madt->Length;
+  while (Entry < End) {
+    Header = (CONST MADT_ENTRY_HEADER *)Entry;
+    if (((UINTN)(End - Entry) < sizeof (*Header)) ||
+        (Header->Length < sizeof (*Header)) ||
+        (Header->Length > (UINTN)(End - Entry))) {
+      return FALSE;
+    }
+    if (Header->Type == ACPI_MADT_MPWK_STRUCT_TYPE) {
+      *WakeupSize += Header->Length;
+    }
+    Entry += Header->Length;
+  }
+  return TRUE;
+}
+
+/**
+  Return the size of the MADT that TdxBuildMadt() builds from a MADT.
+
+  @param[in]  Madt     The MADT from QEMU.
+
+  @return The size in bytes of the MADT of the TD.
+**/
+UINTN
+TdxMadtSize (
+  IN CONST EFI_ACPI_DESCRIPTION_HEADER  *Madt
+  )
+{
+  UINTN  WakeupSize;
+
+  if (!CheckMadt (Madt, &WakeupSize)) {
+    return 0;
+  }
+  return Madt->Length - WakeupSize + sizeof (ACPI_MADT_MPWK_STRUCT);
+}
+
+/**
+  Build the MADT of the TD from the MADT from QEMU.
+
+  The MADT from QEMU, with its processor local APIC and x2APIC structures, is
+  copied to Buffer in a single pass, leaving out any multiprocessor wakeup
+  structure it already has. The multiprocessor wakeup structure for the
+  mailbox is appended, and the checksum is computed.
+
+  @param[in]      Madt            The MADT from QEMU.
+  @param[in]      MailBoxAddress  The address of the multiprocessor wakeup
+                                  mailbox.
+  @param[out]     Buffer          The buffer for the MADT of the TD. It may be
+                                  NULL if *BufferSize is 0.
+  @param[in,out]  BufferSize      On input, the size of Buffer. On output, the
+                                  size of the MADT of the TD.
+
+  @retval EFI_SUCCESS             The MADT of the TD is in Buffer.
+  @retval EFI_BUFFER_TOO_SMALL    Buffer is too small. *BufferSize is the size
+                                  needed.
+  @retval EFI_INVALID_PARAMETER   Madt is not a valid MADT.
+**/
+EFI_STATUS
+TdxBuildMadt (
+  IN     CONST EFI_ACPI_DESCRIPTION_HEADER  *Madt,
+  IN     UINT64                             MailBoxAddress,
+  OUT    VOID                               *Buffer OPTIONAL,
+  IN OUT UINTN                              *BufferSize
+  )
+{
+  UINTN                        WakeupSize;
+  UINTN                        NewSize;
+  CONST UINT8                  *Entry;
+  CONST UINT8                  *End;
+  CONST UINT8                  *Run;
+  UINT8                        *Ptr;
+  EFI_ACPI_DESCRIPTION_HEADER  *NewMadt;
+  ACPI_MADT_MPWK_STRUCT        *MadtMpWk;
+
+  if ((BufferSize == NULL) || !CheckMadt (Madt, &WakeupSize)) {
+    return EFI_INVALID_PARAMETER;
+  }
+
+  NewSize = Madt->Length - WakeupSize + sizeof (ACPI_MADT_MPWK_STRUCT);
+  if ((*BufferSize < NewSize) || (Buffer == NULL)) {
+    *BufferSize = NewSize;
+    return EFI_BUFFER_TOO_SMALL;
+  }
+  *BufferSize = NewSize;
+
+  Ptr = Buffer;
+  if (WakeupSize == 0) {
+    CopyMem (Ptr, Madt, Madt->Length);
+    Ptr += Madt->Length;
+  } else {
+    //
+    // Copy the runs of structures between the wakeup structures that QEMU
+    // provides, so that only the one appended below is left.
+    //
+    Run   = (CONST UINT8 *)Madt;
+    Entry = Run + sizeof (EFI_ACPI_1_0_MULTIPLE_APIC_DESCRIPTION_TABLE_HEADER);
+    End   = Run + Madt->Length;
+    while (Entry < End) {
+      if (((CONST MADT_ENTRY_HEADER *)Entry)->Type == ACPI_MADT_MPWK_STRUCT_TYPE) {
+        CopyMem (Ptr, Run, Entry - Run);
+        Ptr += Entry - Run;
+        Run  = Entry + ((CONST MADT_ENTRY_HEADER *)Entry)->Length;
+      }
+      Entry += ((CONST MADT_ENTRY_HEADER *)Entry)->Length;
+    }
+    CopyMem (Ptr, Run, End - Run);
+    Ptr += End - Run;
+  }
+
+  MadtMpWk                 = (ACPI_MADT_MPWK_STRUCT *)Ptr;
+  MadtMpWk->Type           = ACPI_MADT_MPWK_STRUCT_TYPE;
+  MadtMpWk->Length         = sizeof (ACPI_MADT_MPWK_STRUCT);
+  MadtMpWk->MailBoxVersion = 1;
+  MadtMpWk->Reserved2      = 0;
+  MadtMpWk->MailBoxAddress = MailBoxAddress;
+
+  NewMadt           = Buffer;
+  NewMadt->Length   = (UINT32)NewSize;
+  NewMadt->Checksum = 0;
+  NewMadt->Checksum = CalculateCheckSum8 (Buffer, NewSize);
+
+  return EFI_SUCCESS;
+}
@@ -0,0 +1,57 @@
+/** @file
+  Build the MADT of a TD from the MADT from QEMU.
+
+  Copyright (c) 2021, Intel Corporation. All rights reserved.<BR>
+
+  SPDX-License-Identifier: BSD-2-Clause-Patent
+
+**/
+
+#ifndef _TDX_MADT_H_
+#define _TDX_MADT_H_
+
+#include <Uefi.h>
+#include <IndustryStandard/Acpi.h>
+
+/**
+  Return the size of the MADT that TdxBuildMadt() builds from a MADT.
+
+  @param[in]  Madt     The MADT from QEMU.
+
+  @return The size in bytes of the MADT of the TD.
+**/
+UINTN
+TdxMadtSize (
+  IN CONST EFI_ACPI_DESCRIPTION_HEADER  *Madt
+  );
+
+/**
+  Build the MADT of the TD from the MADT from QEMU.
+
+  The MADT from QEMU, with its processor local APIC and x2APIC structures, is
+  copied to Buffer in a single pass, leaving out any multiprocessor wakeup
+  structure it already has. The multiprocessor wakeup structure for the
+  mailbox is appended, and the checksum is computed.
+
+  @param[in]      Madt            The MADT from QEMU.
+  @param[in]      MailBoxAddress  The address of the multiprocessor wakeup
+                                  mailbox.
+  @param[out]     Buffer          The buffer for the MADT of the TD. It may be
+                                  NULL if *BufferSize is 0.
+  @param[in,out]  BufferSize      On input, the size of Buffer. On output, the
+                                  size of the MADT of the TD.
+
+  @retval EFI_SUCCESS             The MADT of the TD is in Buffer.
+  @retval EFI_BUFFER_TOO_SMALL    Buffer is too small. *BufferSize is the size
+                                  needed.
+  @retval EFI_INVALID_PARAMETER   Madt is not a valid MADT.
+**/
+EFI_STATUS
+TdxBuildMadt (
+  IN     CONST EFI_ACPI_DESCRIPTION_HEADER  *Madt,
+  IN     UINT64                             MailBoxAddress,
+  OUT    VOID                               *Buffer OPTIONAL,
+  IN OUT UINTN                              *BufferSize
+  );
+
+#endif
@@ -0,0 +1,381 @@
+/** @file
+  On-demand identity mapping of addresses that the page tables built by
+  TdxStartupLib do not cover.
+
+  TdxStartupLib only maps the 32-bit address space and the ranges that the
+  resource descriptor HOBs describe. An access to any other address below the
+  guest physical address width raises a not-present page fault; the handler
+  below maps the surrounding 1GB (or 2MB) page, using page table pages from
+  the pool that TdxStartupLib reserved, and resumes the faulting instruction.
+
+  The handler cannot allocate memory, as it may run at any TPL and on any
+  processor. A timer event at TPL_NOTIFY tops up the pool with pages from
+  the boot services whenever it runs low, so that the pool is only exhausted
+  by a burst of faults that outruns the timer.
+
+  Faults taken before the CPU Architectural Protocol is installed still go to
+  the default exception handler, and are fatal.
+
+  Copyright (c) 2021, Intel Corporation. All rights reserved.<BR>
+
+  SPDX-License-Identifier: BSD-2-Clause-Patent
+
+**/
+
+#include <Library/BaseLib.h>
+#include <Library/BaseMemoryLib.h>
+#include <Library/CpuExceptionHandlerLib.h>
+#include <Library/DebugLib.h>
+#include <Library/HobLib.h>
+#include <Library/PrintLib.h>
+#include <Library/SerialPortLib.h>
+#include <Library/SynchronizationLib.h>
+#include <Library/UefiBootServicesTableLib.h>
+#include <Library/UefiLib.h>
+#include <Guid/TdxPageTableInfo.h>
+#include <Protocol/Cpu.h>
+
+#include "TdxPageFault.h"
+
+#define CR0_WP                      BIT16
+
+#define IA32_PG_P                   BIT0
+#define IA32_PG_RW                  BIT1
+#define IA32_PG_PS                  BIT7
+
+#define IA32_PF_EC_P                BIT0
+
+#define PAGING_PAE_INDEX_MASK       0x1FF
+#define PAGING_4K_ADDRESS_MASK_64   0x000FFFFFFFFFF000ull
+
+//
+// The pool is topped up when fewer pages than this are left, by
+// ON_DEMAND_REFILL_PAGES pages. The timer that checks the pool runs every
+// ON_DEMAND_REFILL_PERIOD, in 100ns units.
+//
+#define ON_DEMAND_LOW_PAGES         16
+#define ON_DEMAND_REFILL_PAGES      64
+#define ON_DEMAND_REFILL_PERIOD     EFI_TIMER_PERIOD_MILLISECONDS (10)
+
+STATIC TDX_PAGE_TABLE_INFO  mPageTableInfo;
+
+//
+// The page fault handler runs on every processor that uses the DXE IDT, and
+// several processors may fault at the same time. mOnDemandLock serializes
+// the updates of the page tables and of the variables below.
+//
+// Page table pages are taken from the current pool, then from the spare
+// pool that the refill timer allocated, if any.
+//
+STATIC SPIN_LOCK             mOnDemandLock;
+STATIC EFI_PHYSICAL_ADDRESS  mOnDemandPoolBase;
+STATIC UINT32                mOnDemandPoolPages;
+STATIC UINT32                mOnDemandPagesUsed;
+STATIC EFI_PHYSICAL_ADDRESS  mOnDemandSpareBase;
+STATIC UINT32                mOnDemandSparePages;
+STATIC UINT32                mOnDemandPagesTotal;
+STATIC UINT32                mOnDemandFaults;
+STATIC VOID                  *mCpuRegistration;
+
+/**
+  Return the next level table that a non-leaf page table entry points to,
+  creating the table from the on-demand pool if the entry is not present.
+
+  The caller must hold mOnDemandLock.
+
+  @param[in,out] Entry  The non-leaf page table entry. It must not map a large
+                        page.
+
+  @retval NULL  The pool is exhausted.
+  @return       The next level table.
+**/
+STATIC
+UINT64 *
+GetOrCreateNextTable (
+  IN OUT UINT64  *Entry
+  )
+{
+  UINT64  *Table;
+
+  if ((*Entry & IA32_PG_P) != 0) {
+    return (UINT64 *)(UINTN)(*Entry & ~mPageTableInfo.AddressEncMask &
+                             PAGING_4K_ADDRESS_MASK_64);
+  }
+
+  if (mOnDemandPagesUsed == mOnDemandPoolPages) {
+    if (mOnDemandSparePages == 0) {
+      return NULL;
+    }
+    mOnDemandPoolBase   = mOnDemandSpareBase;
+    mOnDemandPoolPages  = mOnDemandSparePages;
+    mOnDemandPagesUsed  = 0;
+    mOnDemandSparePages = 0;
+  }
+  Table = (UINT64 *)(UINTN)(mOnDemandPoolBase +
+                            EFI_PAGES_TO_SIZE (mOnDemandPagesUsed));
+  mOnDemandPagesUsed++;
+
+  ZeroMem (Table, EFI_PAGE_SIZE);
+  *Entry = (UINT64)(UINTN)Table | mPageTableInfo.AddressEncMask |
+           IA32_PG_P | IA32_PG_RW;
+  return Table;
+}
+
+/**
+  Identity-map the large page that contains an address.
+
+  @param[in] Address  The address to map.
+
+  @retval EFI_SUCCESS           The address has been mapped, by this call or by
+                                another processor since the fault.
+  @retval EFI_UNSUPPORTED       The address is out of range, or a 4KB entry
+                                that covers it is not present (the fault has
+                                a different cause).
+  @retval EFI_OUT_OF_RESOURCES  The on-demand pool is exhausted.
+**/
+STATIC
+EFI_STATUS
+MapOnDemand (
+  IN UINT64  Address
+  )
+{
+  UINTN       Cr0;
+  IA32_CR4    Cr4;
+  UINT64      *Table;
+  UINT64      *Entry;
+  UINTN       Shift;
+  UINTN       LeafShift;
+  EFI_STATUS  Status;
+
+  if (Address >= LShiftU64 (1, mPageTableInfo.PhysicalAddressBits)) {
+    return EFI_UNSUPPORTED;
+  }
+
+  //
+  // The page table pool is write-protected; clear CR0.WP to update it. CR0 is
+  // per processor, so the other processors keep WP set and cannot write the
+  // page tables meanwhile. This processor runs nothing else until WP is
+  // restored, as the handler runs with interrupts disabled, and the other
+  // processors that fault wait for mOnDemandLock. The entries are only ever
+  // changed from not present to present, and a table is zeroed before it is
+  // linked, so the other processors never see a half-built translation.
+  //
+  AcquireSpinLock (&mOnDemandLock);
+  Cr0 = AsmReadCr0 ();
+  AsmWriteCr0 (Cr0 & ~(UINTN)CR0_WP);
+
+  Cr4.UintN = AsmReadCr4 ();
+  Table = (UINT64 *)(UINTN)(AsmReadCr3 () & ~mPageTableInfo.AddressEncMask &
+                            PAGING_4K_ADDRESS_MASK_64);
+  Shift     = (Cr4.Bits.LA57 != 0) ? 48 : 39;
+  LeafShift = mPageTableInfo.Page1GSupport ? 30 : 21;
+
+  for (; Shift > LeafShift; Shift -= 9) {
+    Entry = &Table[RShiftU64 (Address, Shift) & PAGING_PAE_INDEX_MASK];
+    if ((*Entry & (IA32_PG_P | IA32_PG_PS)) == (IA32_PG_P | IA32_PG_PS)) {
+      //
+      // Another processor has mapped a large page here since the fault.
+      //
+      Status = EFI_SUCCESS;
+      goto RestoreCr0;
+    }
+    Table = GetOrCreateNextTable (Entry);
+    if (Table == NULL) {
+      Status = EFI_OUT_OF_RESOURCES;
+      goto RestoreCr0;
+    }
+  }
+
+  Entry = &Table[RShiftU64 (Address, LeafShift) & PAGING_PAE_INDEX_MASK];
+  if ((*Entry & IA32_PG_P) == 0) {
+    *Entry = (Address & ~(LShiftU64 (1, LeafShift) - 1)) |
+             mPageTableInfo.AddressEncMask |
+             IA32_PG_P | IA32_PG_RW | IA32_PG_PS;
+    mOnDemandFaults++;
+    Status = EFI_SUCCESS;
+  } else if ((*Entry & IA32_PG_PS) != 0) {
+    Status = EFI_SUCCESS;
+  } else {
+    Status = EFI_UNSUPPORTED;
+  }
+
+RestoreCr0:
+  AsmWriteCr0 (Cr0);
+  ReleaseSpinLock (&mOnDemandLock);
+  return Status;
+}
+
+/**
+  Page fault handler. Map the faulting address if the fault was caused by a
+  not-present entry; otherwise dump the CPU context and hang, as the default
+  exception handler does. The faulting access cannot be resumed without a
+  mapping, so the exhaustion of the on-demand pool is fatal as well; it is
+  reported as such, rather than as an unexpected fault. The report goes to
+  the serial port, like the context dump, so that RELEASE builds show it too.
+
+  @param[in] InterruptType  EXCEPT_X64_PAGE_FAULT.
+  @param[in] SystemContext  The processor context at the time of the fault.
+**/
+STATIC
+VOID
+EFIAPI
+TdxPageFaultHandler (
+  IN EFI_EXCEPTION_TYPE  InterruptType,
+  IN EFI_SYSTEM_CONTEXT  SystemContext
+  )
+{
+  UINT64      Address;
+  EFI_STATUS  Status;
+  CHAR8       Buffer[128];
+  UINTN       Length;
+
+  if ((SystemContext.SystemContextX64->ExceptionData & IA32_PF_EC_P) == 0) {
+    Address = AsmReadCr2 ();
+    Status  = MapOnDemand (Address);
+    if (!EFI_ERROR (Status)) {
+      return;
+    }
+    if (Status == EFI_OUT_OF_RESOURCES) {
+      Length = AsciiSPrint (Buffer, sizeof Buffer,
+                 "!!!! TdxDxe: cannot map 0x%Lx: the on-demand page table pool "
+                 "(%u pages, %u faults) is exhausted !!!!\n", Address,
+                 mOnDemandPagesTotal, mOnDemandFaults);
+      SerialPortWrite ((UINT8 *)Buffer, Length);
+      ASSERT (FALSE);
+    }
+  }
+
+  DumpCpuContext (InterruptType, SystemContext);
+  CpuDeadLoop ();
+}
+
+/**
+  Top up the on-demand pool when it runs low.
+
+  The pages come from the boot services, so they are not write-protected like
+  the pool that TdxStartupLib reserved.
+
+  @param[in] Event    The refill timer event.
+  @param[in] Context  Not used.
+**/
+STATIC
+VOID
+EFIAPI
+OnDemandPoolRefill (
+  IN EFI_EVENT  Event,
+  IN VOID       *Context
+  )
+{
+  EFI_STATUS            Status;
+  EFI_PHYSICAL_ADDRESS  Base;
+  BOOLEAN               InterruptState;
+  BOOLEAN               Low;
+
+  //
+  // Unsynchronized reads; a stale value only delays the refill to the next
+  // tick.
+  //
+  Low = (BOOLEAN)(mOnDemandSparePages == 0 &&
+                  mOnDemandPoolPages - mOnDemandPagesUsed < ON_DEMAND_LOW_PAGES);
+  if (!Low) {
+    return;
+  }
+
+  Status = gBS->AllocatePages (AllocateAnyPages, EfiBootServicesData,
+                  ON_DEMAND_REFILL_PAGES, &Base);
+  if (EFI_ERROR (Status)) {
+    DEBUG ((DEBUG_WARN, "%a: %r\n", __FUNCTION__, Status));
+    return;
+  }
+
+  //
+  // Keep interrupts disabled while holding the lock, so that no page fault
+  // handler runs on this processor and waits for it.
+  //
+  InterruptState = SaveAndDisableInterrupts ();
+  AcquireSpinLock (&mOnDemandLock);
+  mOnDemandSpareBase   = Base;
+  mOnDemandSparePages  = ON_DEMAND_REFILL_PAGES;
+  mOnDemandPagesTotal += ON_DEMAND_REFILL_PAGES;
+  ReleaseSpinLock (&mOnDemandLock);
+  SetInterruptState (InterruptState);
+
+  DEBUG ((DEBUG_VERBOSE, "%a: %u pages at 0x%Lx, %u faults so far\n",
+    __FUNCTION__, ON_DEMAND_REFILL_PAGES, Base, mOnDemandFaults));
+}
+
+/**
+  Register the page fault handler with the CPU Architectural Protocol.
+
+  @param[in] Event    The event that is signaled when the protocol is
+                      installed.
+  @param[in] Context  Not used.
+**/
+STATIC
+VOID
+EFIAPI
+OnCpuArchProtocolInstalled (
+  IN EFI_EVENT  Event,
+  IN VOID       *Context
+  )
+{
+  EFI_STATUS             Status;
+  EFI_CPU_ARCH_PROTOCOL  *Cpu;
+  EFI_EVENT              RefillEvent;
+
+  Status = gBS->LocateProtocol (&gEfiCpuArchProtocolGuid, NULL,
+                  (VOID **)&Cpu);
+  if (EFI_ERROR (Status)) {
+    return;
+  }
+  gBS->CloseEvent (Event);
+
+  Status = Cpu->RegisterInterruptHandler (Cpu, EXCEPT_X64_PAGE_FAULT,
+                  TdxPageFaultHandler);
+  DEBUG ((EFI_ERROR (Status) ? DEBUG_WARN : DEBUG_INFO,
+    "%a: on-demand page table mapping: %r\n", __FUNCTION__, Status));
+  if (EFI_ERROR (Status)) {
+    return;
+  }
+
+  Status = gBS->CreateEvent (EVT_TIMER | EVT_NOTIFY_SIGNAL, TPL_NOTIFY,
+                  OnDemandPoolRefill, NULL, &RefillEvent);
+  if (!EFI_ERROR (Status)) {
+    Status = gBS->SetTimer (RefillEvent, TimerPeriodic,
+                    ON_DEMAND_REFILL_PERIOD);
+  }
+  if (EFI_ERROR (Status)) {
+    DEBUG ((DEBUG_WARN, "%a: no pool refill: %r\n", __FUNCTION__, Status));
+  }
+}
+
+VOID
+TdxInstallPageFaultHandler (
+  VOID
+  )
+{
+  EFI_HOB_GUID_TYPE  *GuidHob;
+
+  GuidHob = GetFirstGuidHob (&gUefiOvmfPkgTdxPageTableInfoGuid);
+  if (GuidHob == NULL) {
+    return;
+  }
+  CopyMem (&mPageTableInfo, GET_GUID_HOB_DATA (GuidHob),
+    sizeof mPageTableInfo);
+
+  DEBUG ((DEBUG_INFO,
+    "%a: page tables: %Lu pages, built in %Lu TSC ticks; on-demand pool: "
+    "%u pages\n", __FUNCTION__, mPageTableInfo.PageTablePages,
+    mPageTableInfo.BuildTicks, mPageTableInfo.OnDemandPoolPages));
+
+  if (mPageTableInfo.OnDemandPoolPages == 0) {
+    return;
+  }
+
+  InitializeSpinLock (&mOnDemandLock);
+  mOnDemandPoolBase   = mPageTableInfo.OnDemandPoolBase;
+  mOnDemandPoolPages  = mPageTableInfo.OnDemandPoolPages;
+  mOnDemandPagesTotal = mPageTableInfo.OnDemandPoolPages;
+  EfiCreateProtocolNotifyEvent (&gEfiCpuArchProtocolGuid, TPL_CALLBACK,
+    OnCpuArchProtocolInstalled, NULL, &mCpuRegistration);
+}
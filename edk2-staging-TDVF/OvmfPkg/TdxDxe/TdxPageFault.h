@@ -0,0 +1,25 @@
+/** @file
+  On-demand identity mapping of addresses that the page tables built by
+  TdxStartupLib do not cover.
+
+  Copyright (c) 2021, Intel Corporation. All rights reserved.<BR>
+
+  SPDX-License-Identifier: BSD-2-Clause-Patent
+
+**/
+
+#ifndef _TDX_PAGE_FAULT_H_
+#define _TDX_PAGE_FAULT_H_
+
+/**
+  Install the page fault handler that maps addresses on demand, once the CPU
+  Architectural Protocol is available.
+
+  Does nothing if TdxStartupLib did not report an on-demand page pool.
+**/
+VOID
+TdxInstallPageFaultHandler (
+  VOID
+  );
+
+#endif
@@ -0,0 +1,607 @@
+/** @file
+  This is a host-based unit test for the construction of the MADT of a TD by
+  TdxBuildMadt().
+
+  MADTs are generated the way QEMU does for 1 to 1024 vCPUs, and the MADT of
+  the TD built from each of them is checked structure by structure.
+
+  A benchmark of the MADT construction is built when UNIT_TEST_BENCHMARK is
+  defined, e.g. with -DUNIT_TEST_BENCHMARK in the CC_FLAGS of the host test
+  DSC. It is not part of the default run, as its timings depend on the host.
+
+  Copyright (c) 2021, Intel Corporation. All rights reserved.<BR>
+  SPDX-License-Identifier: BSD-2-Clause-Patent
+
+**/
+
+#include <stdio.h>
+#include <string.h>
+#include <stdarg.h>
+#include <stddef.h>
+#include <setjmp.h>
+#ifdef UNIT_TEST_BENCHMARK
+#include <time.h>
+#endif
+#include <cmocka.h>
+
+#include <Uefi.h>
+#include <IndustryStandard/AcpiTdx.h>
+#include <Library/DebugLib.h>
+#include <Library/BaseLib.h>
+#include <Library/BaseMemoryLib.h>
+#include <Library/MemoryAllocationLib.h>
+#include <Library/UnitTestLib.h>
+
+#include "../TdxMadt.h"
+
+#define UNIT_TEST_NAME        "TD MADT Unit Test"
+#define UNIT_TEST_VERSION     "1.0"
+
+///=== TEST DATA ==================================================================================
+
+#define TEST_MAX_CPU_COUNT        1024
+#define TEST_BENCHMARK_ROUNDS     16
+#define TEST_MAILBOX_ADDRESS      0x7F000000ULL
+#define TEST_OLD_MAILBOX_ADDRESS  0x12345000ULL
+
+//
+// QEMU describes the vCPUs with APIC IDs up to 254 with processor local APIC
+// structures, and the other ones with processor local x2APIC structures.
+//
+#define TEST_MAX_XAPIC_ID         254
+
+///
+/// Header of the interrupt controller structures of the MADT.
+///
+typedef struct {
+  UINT8    Type;
+  UINT8    Length;
+} TEST_MADT_ENTRY_HEADER;
+
+///=== HELPER FUNCTIONS ===========================================================================
+
+/**
+  Generate a MADT the way QEMU does: the processor structures, one I/O APIC,
+  the interrupt source overrides of the legacy IRQs and the local APIC NMI.
+
+  @param[in]  CpuCount       The number of vCPUs.
+  @param[in]  WakeupAtIndex  Insert a multiprocessor wakeup structure before
+                             the processor structure of this vCPU. No
+                             structure is inserted if it is CpuCount or more.
+
+  @return The MADT, to be freed with FreePool(), or NULL if out of memory.
+**/
+STATIC
+EFI_ACPI_DESCRIPTION_HEADER *
+GenerateQemuMadt (
+  IN UINTN  CpuCount,
+  IN UINTN  WakeupAtIndex
+  )
+{
+  EFI_ACPI_DESCRIPTION_HEADER                          *Madt;
+  EFI_ACPI_4_0_MULTIPLE_APIC_DESCRIPTION_TABLE_HEADER  *Header;
+  EFI_ACPI_1_0_PROCESSOR_LOCAL_APIC_STRUCTURE          *LocalApic;
+  EFI_ACPI_4_0_PROCESSOR_LOCAL_X2APIC_STRUCTURE        *LocalX2Apic;
+  EFI_ACPI_1_0_IO_APIC_STRUCTURE                       *IoApic;
+  EFI_ACPI_1_0_INTERRUPT_SOURCE_OVERRIDE_STRUCTURE     *Iso;
+  EFI_ACPI_1_0_LOCAL_APIC_NMI_STRUCTURE                *Nmi;
+  ACPI_MADT_MPWK_STRUCT                                *Wakeup;
+  UINTN                                                MaxSize;
+  UINT8                                                *Ptr;
+  UINTN                                                Index;
+
+  MaxSize = sizeof (*Header) +
+            CpuCount * sizeof (EFI_ACPI_4_0_PROCESSOR_LOCAL_X2APIC_STRUCTURE) +
+            sizeof (*IoApic) + 5 * sizeof (*Iso) + sizeof (*Nmi) + sizeof (*Wakeup);
+  Madt = AllocateZeroPool (MaxSize);
+  if (Madt == NULL) {
+    return NULL;
+  }
+
+  Header = (EFI_ACPI_4_0_MULTIPLE_APIC_DESCRIPTION_TABLE_HEADER *) Madt;
+  Header->Header.Signature = EFI_ACPI_4_0_MULTIPLE_APIC_DESCRIPTION_TABLE_SIGNATURE;
+  Header->Header.Revision  = EFI_ACPI_4_0_MULTIPLE_APIC_DESCRIPTION_TABLE_REVISION;
+  CopyMem (Header->Header.OemId, "BOCHS ", sizeof (Header->Header.OemId));
+  Header->LocalApicAddress = 0xFEE00000;
+  Header->Flags            = EFI_ACPI_4_0_PCAT_COMPAT;
+
+  Ptr = (UINT8 *) (Header + 1);
+  for (Index = 0; Index < CpuCount; Index++) {
+    if (Index == WakeupAtIndex) {
+      Wakeup = (ACPI_MADT_MPWK_STRUCT *) Ptr;
+      Wakeup->Type           = ACPI_MADT_MPWK_STRUCT_TYPE;
+      Wakeup->Length         = sizeof (*Wakeup);
+      Wakeup->MailBoxVersion = 1;
+      Wakeup->MailBoxAddress = TEST_OLD_MAILBOX_ADDRESS;
+      Ptr += sizeof (*Wakeup);
+    }
+
+    if (Index <= TEST_MAX_XAPIC_ID) {
+      LocalApic = (EFI_ACPI_1_0_PROCESSOR_LOCAL_APIC_STRUCTURE *) Ptr;
+      LocalApic->Type            = EFI_ACPI_1_0_PROCESSOR_LOCAL_APIC;
+      LocalApic->Length          = sizeof (*LocalApic);
+      LocalApic->AcpiProcessorId = (UINT8) Index;
+      LocalApic->ApicId          = (UINT8) Index;
+      LocalApic->Flags           = EFI_ACPI_1_0_LOCAL_APIC_ENABLED;
+      Ptr += sizeof (*LocalApic);
+    } else {
+      LocalX2Apic = (EFI_ACPI_4_0_PROCESSOR_LOCAL_X2APIC_STRUCTURE *) Ptr;
+      LocalX2Apic->Type             = EFI_ACPI_4_0_PROCESSOR_LOCAL_X2APIC;
+      LocalX2Apic->Length           = sizeof (*LocalX2Apic);
+      LocalX2Apic->X2ApicId         = (UINT32) Index;
+      LocalX2Apic->Flags            = EFI_ACPI_4_0_LOCAL_APIC_ENABLED;
+      LocalX2Apic->AcpiProcessorUid = (UINT32) Index;
+      Ptr += sizeof (*LocalX2Apic);
+    }
+  }
+
+  IoApic = (EFI_ACPI_1_0_IO_APIC_STRUCTURE *) Ptr;
+  IoApic->Type             = EFI_ACPI_1_0_IO_APIC;
+  IoApic->Length           = sizeof (*IoApic);
+  IoApic->IoApicAddress    = 0xFEC00000;
+  Ptr += sizeof (*IoApic);
+
+  for (Index = 0; Index < 5; Index++) {
+    Iso = (EFI_ACPI_1_0_INTERRUPT_SOURCE_OVERRIDE_STRUCTURE *) Ptr;
+    Iso->Type   = EFI_ACPI_1_0_INTERRUPT_SOURCE_OVERRIDE;
+    Iso->Length = sizeof (*Iso);
+    Iso->Source = (UINT8) ((Index == 0) ? 0 : Index + 4);
+    Iso->GlobalSystemInterruptVector = (Index == 0) ? 2 : (UINT32) Index + 4;
+    Iso->Flags  = (Index == 0) ? 0 : 0xD;
+    Ptr += sizeof (*Iso);
+  }
+
+  Nmi = (EFI_ACPI_1_0_LOCAL_APIC_NMI_STRUCTURE *) Ptr;
+  Nmi->Type                    = EFI_ACPI_1_0_LOCAL_APIC_NMI;
+  Nmi->Length                  = sizeof (*Nmi);
+  Nmi->AcpiProcessorId         = 0xFF;
+  Nmi->LocalApicInti           = 1;
+  Ptr += sizeof (*Nmi);
+
+  Madt->Length   = (UINT32) (Ptr - (UINT8 *) Madt);
+  Madt->Checksum = CalculateCheckSum8 ((UINT8 *) Madt, Madt->Length);
+  return Madt;
+}
+
+/**
+  Check the MADT of a TD built from a MADT generated by GenerateQemuMadt().
+
+  @param[in]  TdMadt    The MADT of the TD.
+  @param[in]  Size      The size returned by TdxBuildMadt().
+  @param[in]  Madt      The MADT it was built from.
+  @param[in]  CpuCount  The number of vCPUs of the MADT.
+
+  @retval UNIT_TEST_PASSED  The MADT of the TD is correct.
+  @retval Others            The MADT of the TD is not correct.
+**/
+STATIC
+UNIT_TEST_STATUS
+CheckTdMadt (
+  IN CONST EFI_ACPI_DESCRIPTION_HEADER  *TdMadt,
+  IN UINTN                              Size,
+  IN CONST EFI_ACPI_DESCRIPTION_HEADER  *Madt,
+  IN UINTN                              CpuCount
+  )
+{
+  CONST UINT8                                          *Ptr;
+  CONST UINT8                                          *End;
+  CONST TEST_MADT_ENTRY_HEADER                         *Entry;
+  CONST EFI_ACPI_1_0_PROCESSOR_LOCAL_APIC_STRUCTURE    *LocalApic;
+  CONST EFI_ACPI_4_0_PROCESSOR_LOCAL_X2APIC_STRUCTURE  *LocalX2Apic;
+  CONST ACPI_MADT_MPWK_STRUCT                          *Wakeup;
+  UINTN                                                ProcessorCount;
+  UINTN                                                IoApicCount;
+  UINTN                                                WakeupCount;
+
+  UT_ASSERT_EQUAL (Size, TdxMadtSize (Madt));
+  UT_ASSERT_EQUAL (TdMadt->Length, Size);
+  UT_ASSERT_EQUAL (TdMadt->Signature, EFI_ACPI_4_0_MULTIPLE_APIC_DESCRIPTION_TABLE_SIGNATURE);
+  UT_ASSERT_EQUAL (CalculateSum8 ((CONST UINT8 *) TdMadt, TdMadt->Length), 0);
+
+  //
+  // The rest of the header, including the local APIC address and the flags,
+  // is kept.
+  //
+  UT_ASSERT_EQUAL (TdMadt->Revision, Madt->Revision);
+  UT_ASSERT_MEM_EQUAL (
+    TdMadt->OemId,
+    Madt->OemId,
+    sizeof (EFI_ACPI_4_0_MULTIPLE_APIC_DESCRIPTION_TABLE_HEADER) -
+      OFFSET_OF (EFI_ACPI_DESCRIPTION_HEADER, OemId)
+    );
+
+  ProcessorCount = 0;
+  IoApicCount    = 0;
+  WakeupCount    = 0;
+  Wakeup         = NULL;
+  Ptr = (CONST UINT8 *) TdMadt + sizeof (EFI_ACPI_4_0_MULTIPLE_APIC_DESCRIPTION_TABLE_HEADER);
+  End = (CONST UINT8 *) TdMadt + TdMadt->Length;
+  while (Ptr < End) {
+    UT_ASSERT_TRUE ((UINTN) (End - Ptr) >= sizeof (*Entry));
+    Entry = (CONST TEST_MADT_ENTRY_HEADER *) Ptr;
+    UT_ASSERT_TRUE (Entry->Length >= sizeof (*Entry));
+    UT_ASSERT_TRUE (Entry->Length <= (UINTN) (End - Ptr));
+
+    //
+    // The multiprocessor wakeup structure comes last.
+    //
+    UT_ASSERT_EQUAL (WakeupCount, 0);
+
+    switch (Entry->Type) {
+      case EFI_ACPI_1_0_PROCESSOR_LOCAL_APIC:
+        LocalApic = (CONST EFI_ACPI_1_0_PROCESSOR_LOCAL_APIC_STRUCTURE *) Ptr;
+        UT_ASSERT_EQUAL (LocalApic->ApicId, ProcessorCount);
+        ProcessorCount++;
+        break;
+      case EFI_ACPI_4_0_PROCESSOR_LOCAL_X2APIC:
+        LocalX2Apic = (CONST EFI_ACPI_4_0_PROCESSOR_LOCAL_X2APIC_STRUCTURE *) Ptr;
+        UT_ASSERT_EQUAL (LocalX2Apic->X2ApicId, ProcessorCount);
+        UT_ASSERT_EQUAL (LocalX2Apic->AcpiProcessorUid, ProcessorCount);
+        ProcessorCount++;
+        break;
+      case EFI_ACPI_1_0_IO_APIC:
+        IoApicCount++;
+        break;
+      case ACPI_MADT_MPWK_STRUCT_TYPE:
+        UT_ASSERT_EQUAL (Entry->Length, sizeof (ACPI_MADT_MPWK_STRUCT));
+        Wakeup = (CONST ACPI_MADT_MPWK_STRUCT *) Ptr;
+        WakeupCount++;
+        break;
+      default:
+        break;
+    }
+    Ptr += Entry->Length;
+  }
+
+  UT_ASSERT_EQUAL (ProcessorCount, CpuCount);
+  UT_ASSERT_EQUAL (IoApicCount, 1);
+  UT_ASSERT_EQUAL (WakeupCount, 1);
+  UT_ASSERT_NOT_NULL (Wakeup);
+  UT_ASSERT_EQUAL (Wakeup->MailBoxVersion, 1);
+  UT_ASSERT_EQUAL (Wakeup->MailBoxAddress, TEST_MAILBOX_ADDRESS);
+
+  return UNIT_TEST_PASSED;
+}
+
+/**
+  Build and check the MADT of a TD from a generated MADT.
+
+  @param[in]  CpuCount       The number of vCPUs.
+  @param[in]  WakeupAtIndex  See GenerateQemuMadt().
+
+  @retval UNIT_TEST_PASSED  The MADT of the TD is correct.
+  @retval Others            The MADT of the TD is not correct.
+**/
+STATIC
+UNIT_TEST_STATUS
+BuildAndCheckTdMadt (
+  IN UINTN  CpuCount,
+  IN UINTN  WakeupAtIndex
+  )
+{
+  EFI_ACPI_DESCRIPTION_HEADER  *Madt;
+  VOID                         *Buffer;
+  UINTN                        BufferSize;
+  EFI_STATUS                   Status;
+  UNIT_TEST_STATUS             TestStatus;
+
+  Madt = GenerateQemuMadt (CpuCount, WakeupAtIndex);
+  if (Madt == NULL) {
+    return UNIT_TEST_ERROR_PREREQUISITE_NOT_MET;
+  }
+
+  BufferSize = TdxMadtSize (Madt);
+  Buffer     = AllocatePool (BufferSize);
+  if (Buffer == NULL) {
+    FreePool (Madt);
+    return UNIT_TEST_ERROR_PREREQUISITE_NOT_MET;
+  }
+
+  Status = TdxBuildMadt (Madt, TEST_MAILBOX_ADDRESS, Buffer, &BufferSize);
+  if (EFI_ERROR (Status)) {
+    UT_LOG_ERROR ("%d vCPUs: TdxBuildMadt() returned %r\n", (INT32) CpuCount, Status);
+    TestStatus = UNIT_TEST_ERROR_TEST_FAILED;
+  } else {
+    TestStatus = CheckTdMadt (Buffer, BufferSize, Madt, CpuCount);
+  }
+
+  FreePool (Buffer);
+  FreePool (Madt);
+  return TestStatus;
+}
+
+///=== TEST CASES =================================================================================
+
+/**
+  Test Case that builds the MADT of a TD for every vCPU count from 1 to
+  TEST_MAX_CPU_COUNT.
+
+  @param[in]  Context  Unit test case context
+**/
+UNIT_TEST_STATUS
+EFIAPI
+MadtLayoutForAllCpuCounts (
+  IN UNIT_TEST_CONTEXT  Context
+  )
+{
+  UINTN             CpuCount;
+  UNIT_TEST_STATUS  TestStatus;
+
+  for (CpuCount = 1; CpuCount <= TEST_MAX_CPU_COUNT; CpuCount++) {
+    TestStatus = BuildAndCheckTdMadt (CpuCount, MAX_UINTN);
+    if (TestStatus != UNIT_TEST_PASSED) {
+      UT_LOG_ERROR ("%d vCPUs: wrong MADT\n", (INT32) CpuCount);
+      return TestStatus;
+    }
+  }
+
+  return UNIT_TEST_PASSED;
+}
+
+/**
+  Test Case that checks that a multiprocessor wakeup structure already in the
+  MADT is replaced, wherever it is.
+
+  @param[in]  Context  Unit test case context
+**/
+UNIT_TEST_STATUS
+EFIAPI
+MadtWakeupReplaced (
+  IN UNIT_TEST_CONTEXT  Context
+  )
+{
+  STATIC CONST UINTN           CpuCounts[] = { 1, 2, 255, 256, TEST_MAX_CPU_COUNT };
+  EFI_ACPI_DESCRIPTION_HEADER  *Madt;
+  UINTN                        Index;
+  UNIT_TEST_STATUS             TestStatus;
+
+  for (Index = 0; Index < ARRAY_SIZE (CpuCounts); Index++) {
+    //
+    // The size of the MADT of the TD does not depend on the structure being
+    // there already.
+    //
+    Madt = GenerateQemuMadt (CpuCounts[Index], CpuCounts[Index] / 2);
+    UT_ASSERT_NOT_NULL (Madt);
+    UT_ASSERT_EQUAL (TdxMadtSize (Madt), Madt->Length);
+    FreePool (Madt);
+
+    TestStatus = BuildAndCheckTdMadt (CpuCounts[Index], 0);
+    UT_ASSERT_STATUS_EQUAL (TestStatus, UNIT_TEST_PASSED);
+    TestStatus = BuildAndCheckTdMadt (CpuCounts[Index], CpuCounts[Index] / 2);
+    UT_ASSERT_STATUS_EQUAL (TestStatus, UNIT_TEST_PASSED);
+    TestStatus = BuildAndCheckTdMadt (CpuCounts[Index], CpuCounts[Index] - 1);
+    UT_ASSERT_STATUS_EQUAL (TestStatus, UNIT_TEST_PASSED);
+  }
+
+  return UNIT_TEST_PASSED;
+}
+
+/**
+  Test Case that checks the errors returned for a small buffer and for
+  malformed MADTs.
+
+  @param[in]  Context  Unit test case context
+**/
+UNIT_TEST_STATUS
+EFIAPI
+MadtErrors (
+  IN UNIT_TEST_CONTEXT  Context
+  )
+{
+  EFI_ACPI_DESCRIPTION_HEADER  *Madt;
+  UINT8                        *Buffer;
+  UINTN                        Size;
+  UINTN                        BufferSize;
+  TEST_MADT_ENTRY_HEADER       *Entry;
+
+  Madt = GenerateQemuMadt (4, MAX_UINTN);
+  UT_ASSERT_NOT_NULL (Madt);
+  Size = TdxMadtSize (Madt);
+  UT_ASSERT_EQUAL (Size, Madt->Length + sizeof (ACPI_MADT_MPWK_STRUCT));
+
+  //
+  // A buffer one byte short is left alone.
+  //
+  Buffer = AllocatePool (Size);
+  UT_ASSERT_NOT_NULL (Buffer);
+  SetMem (Buffer, Size, 0xA5);
+  BufferSize = Size - 1;
+  UT_ASSERT_STATUS_EQUAL (
+    TdxBuildMadt (Madt, TEST_MAILBOX_ADDRESS, Buffer, &BufferSize),
+    EFI_BUFFER_TOO_SMALL
+    );
+  UT_ASSERT_EQUAL (BufferSize, Size);
+  UT_ASSERT_EQUAL (Buffer[0], 0xA5);
+
+  BufferSize = 0;
+  UT_ASSERT_STATUS_EQUAL (
+    TdxBuildMadt (Madt, TEST_MAILBOX_ADDRESS, NULL, &BufferSize),
+    EFI_BUFFER_TOO_SMALL
+    );
+  UT_ASSERT_EQUAL (BufferSize, Size);
+
+  //
+  // A structure that runs past the end of the table.
+  //
+  Entry = (TEST_MADT_ENTRY_HEADER *) ((UINT8 *) Madt + Madt->Length - sizeof (EFI_ACPI_1_0_LOCAL_APIC_NMI_STRUCTURE));
+  Entry->Length++;
+  BufferSize = Size;
+  UT_ASSERT_EQUAL (TdxMadtSize (Madt), 0);
+  UT_ASSERT_STATUS_EQUAL (
+    TdxBuildMadt (Madt, TEST_MAILBOX_ADDRESS, Buffer, &BufferSize),
+    EFI_INVALID_PARAMETER
+    );
+
+  //
+  // A structure with a length of 0 would loop forever.
+  //
+  Entry->Length = 0;
+  UT_ASSERT_EQUAL (TdxMadtSize (Madt), 0);
+  UT_ASSERT_STATUS_EQUAL (
+    TdxBuildMadt (Madt, TEST_MAILBOX_ADDRESS, Buffer, &BufferSize),
+    EFI_INVALID_PARAMETER
+    );
+
+  //
+  // A table shorter than the MADT header.
+  //
+  Madt->Length = sizeof (EFI_ACPI_DESCRIPTION_HEADER);
+  UT_ASSERT_EQUAL (TdxMadtSize (Madt), 0);
+  UT_ASSERT_STATUS_EQUAL (
+    TdxBuildMadt (Madt, TEST_MAILBOX_ADDRESS, Buffer, &BufferSize),
+    EFI_INVALID_PARAMETER
+    );
+
+  FreePool (Buffer);
+  FreePool (Madt);
+  return UNIT_TEST_PASSED;
+}
+
+#ifdef UNIT_TEST_BENCHMARK
+/**
+  Benchmark that measures the time needed to build the MADT of a TD, from the
+  size query to the checksum, for several vCPU counts.
+
+  @param[in]  Context  Unit test case context
+**/
+UNIT_TEST_STATUS
+EFIAPI
+MadtBenchmark (
+  IN UNIT_TEST_CONTEXT  Context
+  )
+{
+  STATIC CONST UINTN           CpuCounts[] = { 1, 64, 255, 256, 512, TEST_MAX_CPU_COUNT };
+  EFI_ACPI_DESCRIPTION_HEADER  *Madt;
+  VOID                         *Buffer;
+  UINTN                        BufferSize;
+  UINTN                        Index;
+  UINTN                        Round;
+  clock_t                      Ticks;
+  EFI_STATUS                   Status;
+
+  for (Index = 0; Index < ARRAY_SIZE (CpuCounts); Index++) {
+    Madt = GenerateQemuMadt (CpuCounts[Index], MAX_UINTN);
+    UT_ASSERT_NOT_NULL (Madt);
+
+    Ticks = clock ();
+    for (Round = 0; Round < TEST_BENCHMARK_ROUNDS; Round++) {
+      BufferSize = TdxMadtSize (Madt);
+      Buffer     = AllocatePool (BufferSize);
+      UT_ASSERT_NOT_NULL (Buffer);
+      Status = TdxBuildMadt (Madt, TEST_MAILBOX_ADDRESS, Buffer, &BufferSize);
+      UT_ASSERT_NOT_EFI_ERROR (Status);
+      FreePool (Buffer);
+    }
+    Ticks = clock () - Ticks;
+
+    UT_LOG_INFO (
+      "%d vCPUs, %d bytes: %d us per MADT\n",
+      (INT32) CpuCounts[Index],
+      (INT32) Madt->Length,
+      (INT32) ((UINT64) Ticks * 1000000 / CLOCKS_PER_SEC / TEST_BENCHMARK_ROUNDS)
+      );
+    FreePool (Madt);
+  }
+
+  return UNIT_TEST_PASSED;
+}
+#endif
+
+///=== TEST ENGINE ================================================================================
+
+/**
+  Main entry point for this unit test.
+**/
+VOID
+UnitTestMain (
+  VOID
+  )
+{
+  EFI_STATUS                  Status;
+  UNIT_TEST_FRAMEWORK_HANDLE  Framework;
+  UNIT_TEST_SUITE_HANDLE      MadtTests;
+
+  Framework = NULL;
+
+  DEBUG ((DEBUG_INFO, "%a v%a\n", UNIT_TEST_NAME, UNIT_TEST_VERSION));
+
+  //
+  // Start setting up the test framework for running the tests.
+  //
+  Status = InitUnitTestFramework (&Framework, UNIT_TEST_NAME, gEfiCallerBaseName, UNIT_TEST_VERSION);
+  if (EFI_ERROR (Status)) {
+    DEBUG ((DEBUG_ERROR, "Failed in InitUnitTestFramework. Status = %r\n", Status));
+    goto EXIT;
+  }
+
+  //
+  // Add all test suites and tests.
+  //
+  Status = CreateUnitTestSuite (
+             &MadtTests, Framework,
+             "TD MADT Tests", "TdxDxe.Madt", NULL, NULL
+             );
+  if (EFI_ERROR (Status)) {
+    DEBUG ((DEBUG_ERROR, "Failed in CreateUnitTestSuite for MadtTests\n"));
+    Status = EFI_OUT_OF_RESOURCES;
+    goto EXIT;
+  }
+  AddTestCase (
+    MadtTests,
+    "MADT should be correct for 1 to 1024 vCPUs", "Layout",
+    MadtLayoutForAllCpuCounts, NULL, NULL, NULL
+    );
+  AddTestCase (
+    MadtTests,
+    "Existing wakeup structure should be replaced", "WakeupReplaced",
+    MadtWakeupReplaced, NULL, NULL, NULL
+    );
+  AddTestCase (
+    MadtTests,
+    "Small buffer and malformed MADT should be reported", "Errors",
+    MadtErrors, NULL, NULL, NULL
+    );
+#ifdef UNIT_TEST_BENCHMARK
+  AddTestCase (
+    MadtTests,
+    "Benchmark the MADT construction", "Benchmark",
+    MadtBenchmark, NULL, NULL, NULL
+    );
+#endif
+
+  //
+  // Execute the tests.
+  //
+  Status = RunAllTestSuites (Framework);
+
+EXIT:
+  if (Framework != NULL) {
+    FreeUnitTestFramework (Framework);
+  }
+
+  return;
+}
+
+///
+/// Avoid ECC error for function name that starts with lower case letter
+///
+#define Main main
+
+/**
+  Standard POSIX C entry point for host based unit test execution.
+
+  @param[in] Argc  Number of arguments
+  @param[in] Argv  Array of pointers to arguments
+
+  @retval 0      Success
+  @retval other  Error
+**/
+INT32
+Main (
+  IN INT32  Argc,
+  IN CHAR8  *Argv[]
+  )
+{
+  UnitTestMain ();
+  return 0;
+}
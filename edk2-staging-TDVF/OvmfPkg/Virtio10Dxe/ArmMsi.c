@@ -0,0 +1,31 @@
+/** @file
+  MSI delivery of virtio-1.0 queue notifications on ARM and AARCH64.
+
+  Copyright (c) 2021, Intel Corporation. All rights reserved.<BR>
+
+  SPDX-License-Identifier: BSD-2-Clause-Patent
+**/
+
+#include "Virtio10.h"
+
+EFI_STATUS
+Virtio10GetMsiMessage (
+  OUT UINT64 *Address,
+  OUT UINT32 *Data
+  )
+{
+  //
+  // MSIs are not routed to the boot CPU in the firmware; queues are polled.
+  //
+  return EFI_UNSUPPORTED;
+}
+
+VOID
+Virtio10UninstallInterruptHandler (
+  VOID
+  )
+{
+  //
+  // Virtio10GetMsiMessage() never installs a handler.
+  //
+}
@@ -12,6 +12,7 @@
 #include <Protocol/PciIo.h>
 #include <Protocol/PciRootBridgeIo.h>
 #include <Protocol/VirtioDevice.h>
+#include <Library/BaseLib.h>
 #include <Library/BaseMemoryLib.h>
 #include <Library/DebugLib.h>
 #include <Library/MemoryAllocationLib.h>
@@ -23,6 +24,19 @@
 #include "Virtio10.h"
 
 
+//
+// Events registered with Virtio10SetQueueEvent(), across all devices. The
+// list is traversed in interrupt context; modify it at TPL_HIGH_LEVEL only.
+//
+STATIC LIST_ENTRY mQueueEvents = INITIALIZE_LIST_HEAD_VARIABLE (mQueueEvents);
+
+//
+// Devices that have MSI-X enabled, linked through VIRTIO_1_0_DEV.MsixLink.
+// MSI-X is disabled on them at ExitBootServices().
+//
+STATIC LIST_ENTRY mMsixDevices = INITIALIZE_LIST_HEAD_VARIABLE (mMsixDevices);
+
+
 //
 // Utility functions
 //
@@ -209,6 +223,7 @@ ParseCapabilities (
   PCI_CAP_LIST *CapList;
   UINT16       VendorInstance;
   PCI_CAP      *VendorCap;
+  PCI_CAP      *MsixCap;
 
   Status = PciCapPciIoDeviceInit (Device->PciIo, &PciDevice);
   if (EFI_ERROR (Status)) {
@@ -306,6 +321,32 @@ ParseCapabilities (
     ParsedConfig->Exists = TRUE;
   }
 
+  //
+  // Locate the MSI-X Table, for interrupt-driven completion.
+  //
+  if (!EFI_ERROR (PciCapListFindCap (CapList, PciCapNormal,
+                    VIRTIO_1_0_PCI_CAPABILITY_ID_MSIX, 0, &MsixCap))) {
+    VIRTIO_1_0_MSIX_CAP MsixCapData;
+    PCI_CAP_INFO        MsixCapInfo;
+
+    Status = PciCapRead (PciDevice, MsixCap, 0, &MsixCapData,
+               sizeof MsixCapData);
+    if (EFI_ERROR (Status)) {
+      goto UninitCapList;
+    }
+    Status = PciCapGetInfo (MsixCap, &MsixCapInfo);
+    if (EFI_ERROR (Status)) {
+      goto UninitCapList;
+    }
+
+    Device->Msix.CapOffset   = MsixCapInfo.Offset;
+    Device->Msix.TableBar    = (UINT8)(MsixCapData.TableOffsetBir &
+                                       VIRTIO_1_0_MSIX_TABLE_BIR_MASK);
+    Device->Msix.TableOffset = (MsixCapData.TableOffsetBir &
+                                ~(UINT32)VIRTIO_1_0_MSIX_TABLE_BIR_MASK);
+    Device->Msix.Exists      = TRUE;
+  }
+
   ASSERT_EFI_ERROR (Status);
 
 UninitCapList:
@@ -347,6 +388,273 @@ UpdateAttributes (
 }
 
 
+/**
+  Program MSI-X Table entry #0 of a virtio-1.0 device with the platform's MSI
+  message, and enable MSI-X on the device.
+
+  @param[in,out] Dev  The device to enable MSI-X on. Dev->Msix.Enabled is set
+                      on success.
+
+  @retval EFI_SUCCESS      MSI-X has been enabled, or had been enabled
+                           before.
+
+  @retval EFI_UNSUPPORTED  The device has no MSI-X capability.
+
+  @return                  Error codes from Virtio10GetMsiMessage() and
+                           EFI_PCI_IO_PROTOCOL.
+**/
+STATIC
+EFI_STATUS
+EnableMsix (
+  IN OUT VIRTIO_1_0_DEV *Dev
+  )
+{
+  EFI_STATUS                  Status;
+  UINT64                      Address;
+  UINT32                      Data;
+  VIRTIO_1_0_MSIX_TABLE_ENTRY Entry;
+  UINT16                      MessageControl;
+
+  if (Dev->Msix.Enabled) {
+    return EFI_SUCCESS;
+  }
+  if (!Dev->Msix.Exists) {
+    return EFI_UNSUPPORTED;
+  }
+
+  Status = Virtio10GetMsiMessage (&Address, &Data);
+  if (EFI_ERROR (Status)) {
+    return Status;
+  }
+
+  Entry.AddressLow    = (UINT32)Address;
+  Entry.AddressHigh   = (UINT32)RShiftU64 (Address, 32);
+  Entry.Data          = Data;
+  Entry.VectorControl = 0;           // unmasked
+  Status = Dev->PciIo->Mem.Write (Dev->PciIo, EfiPciIoWidthUint32,
+                             Dev->Msix.TableBar, Dev->Msix.TableOffset,
+                             sizeof Entry / sizeof (UINT32), &Entry);
+  if (EFI_ERROR (Status)) {
+    return Status;
+  }
+
+  Status = Dev->PciIo->Pci.Read (Dev->PciIo, EfiPciIoWidthUint16,
+                             Dev->Msix.CapOffset +
+                             OFFSET_OF (VIRTIO_1_0_MSIX_CAP, MessageControl),
+                             1, &MessageControl);
+  if (EFI_ERROR (Status)) {
+    return Status;
+  }
+  MessageControl |= VIRTIO_1_0_MSIX_CONTROL_ENABLE;
+  Status = Dev->PciIo->Pci.Write (Dev->PciIo, EfiPciIoWidthUint16,
+                             Dev->Msix.CapOffset +
+                             OFFSET_OF (VIRTIO_1_0_MSIX_CAP, MessageControl),
+                             1, &MessageControl);
+  if (EFI_ERROR (Status)) {
+    return Status;
+  }
+
+  Dev->Msix.Enabled = TRUE;
+  InsertTailList (&mMsixDevices, &Dev->MsixLink);
+  return EFI_SUCCESS;
+}
+
+
+/**
+  Mask MSI-X Table entry #0 of a virtio-1.0 device, and disable MSI-X on the
+  device.
+
+  The function only accesses the device; it neither allocates nor frees
+  memory, so it can be called at ExitBootServices().
+
+  @param[in] Dev  The device to disable MSI-X on. MSI-X must be enabled.
+**/
+STATIC
+VOID
+MaskMsix (
+  IN VIRTIO_1_0_DEV *Dev
+  )
+{
+  UINT64 VectorControlOffset;
+  UINT32 VectorControl;
+  UINT16 MessageControl;
+
+  VectorControlOffset = Dev->Msix.TableOffset +
+                        OFFSET_OF (VIRTIO_1_0_MSIX_TABLE_ENTRY, VectorControl);
+  VectorControl = VIRTIO_1_0_MSIX_VECTOR_MASKED;
+  Dev->PciIo->Mem.Write (Dev->PciIo, EfiPciIoWidthUint32, Dev->Msix.TableBar,
+                    VectorControlOffset, 1, &VectorControl);
+  //
+  // Read the entry back, so that any MSI that the device sent before the
+  // write is delivered before we return.
+  //
+  Dev->PciIo->Mem.Read (Dev->PciIo, EfiPciIoWidthUint32, Dev->Msix.TableBar,
+                    VectorControlOffset, 1, &VectorControl);
+
+  if (!EFI_ERROR (Dev->PciIo->Pci.Read (Dev->PciIo, EfiPciIoWidthUint16,
+                                  Dev->Msix.CapOffset +
+                                  OFFSET_OF (VIRTIO_1_0_MSIX_CAP,
+                                    MessageControl),
+                                  1, &MessageControl))) {
+    MessageControl &= (UINT16)~VIRTIO_1_0_MSIX_CONTROL_ENABLE;
+    Dev->PciIo->Pci.Write (Dev->PciIo, EfiPciIoWidthUint16,
+                      Dev->Msix.CapOffset +
+                      OFFSET_OF (VIRTIO_1_0_MSIX_CAP, MessageControl),
+                      1, &MessageControl);
+  }
+}
+
+
+/**
+  Disable MSI-X on a virtio-1.0 device, after releasing all events registered
+  for it.
+
+  @param[in,out] Dev  The device to disable MSI-X on.
+**/
+STATIC
+VOID
+DisableMsix (
+  IN OUT VIRTIO_1_0_DEV *Dev
+  )
+{
+  EFI_TPL                OldTpl;
+  LIST_ENTRY             *Entry;
+  LIST_ENTRY             *Next;
+  VIRTIO_1_0_QUEUE_EVENT *QueueEvent;
+
+  OldTpl = gBS->RaiseTPL (TPL_HIGH_LEVEL);
+  for (Entry = GetFirstNode (&mQueueEvents);
+       !IsNull (&mQueueEvents, Entry);
+       Entry = Next) {
+    Next = GetNextNode (&mQueueEvents, Entry);
+    QueueEvent = VIRTIO_1_0_QUEUE_EVENT_FROM_LINK (Entry);
+    if (QueueEvent->Dev == Dev) {
+      RemoveEntryList (Entry);
+      FreePool (QueueEvent);
+    }
+  }
+  gBS->RestoreTPL (OldTpl);
+
+  if (!Dev->Msix.Enabled) {
+    return;
+  }
+  MaskMsix (Dev);
+  RemoveEntryList (&Dev->MsixLink);
+  Dev->Msix.Enabled = FALSE;
+}
+
+
+/**
+  Disable MSI-X on all devices, and uninstall the interrupt handler, so that
+  the operating system finds no device that sends MSIs to a vector it has not
+  set up.
+
+  @param[in] Event    Event whose notification function is being invoked.
+
+  @param[in] Context  Not used.
+**/
+STATIC
+VOID
+EFIAPI
+Virtio10ExitBoot (
+  IN EFI_EVENT Event,
+  IN VOID      *Context
+  )
+{
+  LIST_ENTRY     *Entry;
+  VIRTIO_1_0_DEV *Dev;
+
+  for (Entry = GetFirstNode (&mMsixDevices);
+       !IsNull (&mMsixDevices, Entry);
+       Entry = GetNextNode (&mMsixDevices, Entry)) {
+    Dev = BASE_CR (Entry, VIRTIO_1_0_DEV, MsixLink);
+    MaskMsix (Dev);
+  }
+  Virtio10UninstallInterruptHandler ();
+}
+
+
+/**
+  Set the MSI-X vector of a queue.
+
+  @param[in] Dev         The virtio-1.0 device.
+
+  @param[in] QueueIndex  The queue to set the vector for.
+
+  @param[in] Vector      The MSI-X Table entry number, or
+                         VIRTIO_MSI_NO_VECTOR.
+
+  @retval EFI_SUCCESS      The vector has been set.
+
+  @retval EFI_UNSUPPORTED  The device failed to allocate the vector.
+
+  @return                  Error codes from Virtio10Transfer().
+**/
+STATIC
+EFI_STATUS
+SetQueueMsixVector (
+  IN VIRTIO_1_0_DEV *Dev,
+  IN UINT16         QueueIndex,
+  IN UINT16         Vector
+  )
+{
+  EFI_STATUS Status;
+  UINT16     SavedQueueSelect;
+  UINT16     ActualVector;
+
+  Status = Virtio10Transfer (Dev->PciIo, &Dev->CommonConfig, FALSE,
+             OFFSET_OF (VIRTIO_PCI_COMMON_CFG, QueueSelect),
+             sizeof SavedQueueSelect, &SavedQueueSelect);
+  if (EFI_ERROR (Status)) {
+    return Status;
+  }
+  Status = Virtio10Transfer (Dev->PciIo, &Dev->CommonConfig, TRUE,
+             OFFSET_OF (VIRTIO_PCI_COMMON_CFG, QueueSelect),
+             sizeof QueueIndex, &QueueIndex);
+  if (EFI_ERROR (Status)) {
+    return Status;
+  }
+
+  Status = Virtio10Transfer (Dev->PciIo, &Dev->CommonConfig, TRUE,
+             OFFSET_OF (VIRTIO_PCI_COMMON_CFG, QueueMsixVector),
+             sizeof Vector, &Vector);
+  if (!EFI_ERROR (Status)) {
+    //
+    // virtio-1.0, 4.1.5.1.2: the device reports VIRTIO_MSI_NO_VECTOR if it
+    // could not allocate the vector.
+    //
+    Status = Virtio10Transfer (Dev->PciIo, &Dev->CommonConfig, FALSE,
+               OFFSET_OF (VIRTIO_PCI_COMMON_CFG, QueueMsixVector),
+               sizeof ActualVector, &ActualVector);
+    if (!EFI_ERROR (Status) && ActualVector != Vector) {
+      Status = EFI_UNSUPPORTED;
+    }
+  }
+
+  Virtio10Transfer (Dev->PciIo, &Dev->CommonConfig, TRUE,
+    OFFSET_OF (VIRTIO_PCI_COMMON_CFG, QueueSelect),
+    sizeof SavedQueueSelect, &SavedQueueSelect);
+  return Status;
+}
+
+
+VOID
+Virtio10SignalQueueEvents (
+  VOID
+  )
+{
+  LIST_ENTRY             *Entry;
+  VIRTIO_1_0_QUEUE_EVENT *QueueEvent;
+
+  for (Entry = GetFirstNode (&mQueueEvents);
+       !IsNull (&mQueueEvents, Entry);
+       Entry = GetNextNode (&mQueueEvents, Entry)) {
+    QueueEvent = VIRTIO_1_0_QUEUE_EVENT_FROM_LINK (Entry);
+    gBS->SignalEvent (QueueEvent->Event);
+  }
+}
+
+
 //
 // VIRTIO_DEVICE_PROTOCOL member functions
 //
@@ -845,6 +1153,73 @@ Virtio10UnmapSharedBuffer (
   return Status;
 }
 
+STATIC
+EFI_STATUS
+EFIAPI
+Virtio10SetQueueEvent (
+  IN VIRTIO_DEVICE_PROTOCOL  *This,
+  IN UINT16                  QueueIndex,
+  IN EFI_EVENT               Event       OPTIONAL
+  )
+{
+  VIRTIO_1_0_DEV         *Dev;
+  EFI_STATUS             Status;
+  EFI_TPL                OldTpl;
+  LIST_ENTRY             *Entry;
+  VIRTIO_1_0_QUEUE_EVENT *QueueEvent;
+
+  Dev = VIRTIO_1_0_FROM_VIRTIO_DEVICE (This);
+
+  if (Event == NULL) {
+    OldTpl = gBS->RaiseTPL (TPL_HIGH_LEVEL);
+    for (Entry = GetFirstNode (&mQueueEvents);
+         !IsNull (&mQueueEvents, Entry);
+         Entry = GetNextNode (&mQueueEvents, Entry)) {
+      QueueEvent = VIRTIO_1_0_QUEUE_EVENT_FROM_LINK (Entry);
+      if (QueueEvent->Dev == Dev && QueueEvent->QueueIndex == QueueIndex) {
+        RemoveEntryList (Entry);
+        FreePool (QueueEvent);
+        break;
+      }
+    }
+    gBS->RestoreTPL (OldTpl);
+
+    //
+    // The device may have been reset already, in which case this is a no-op.
+    //
+    SetQueueMsixVector (Dev, QueueIndex, VIRTIO_MSI_NO_VECTOR);
+    return EFI_SUCCESS;
+  }
+
+  Status = EnableMsix (Dev);
+  if (EFI_ERROR (Status)) {
+    return Status;
+  }
+
+  QueueEvent = AllocatePool (sizeof *QueueEvent);
+  if (QueueEvent == NULL) {
+    return EFI_OUT_OF_RESOURCES;
+  }
+  QueueEvent->Dev        = Dev;
+  QueueEvent->QueueIndex = QueueIndex;
+  QueueEvent->Event      = Event;
+
+  //
+  // All queues share MSI-X Table entry #0.
+  //
+  Status = SetQueueMsixVector (Dev, QueueIndex, 0);
+  if (EFI_ERROR (Status)) {
+    FreePool (QueueEvent);
+    return Status;
+  }
+
+  OldTpl = gBS->RaiseTPL (TPL_HIGH_LEVEL);
+  InsertTailList (&mQueueEvents, &QueueEvent->Link);
+  gBS->RestoreTPL (OldTpl);
+  return EFI_SUCCESS;
+}
+
+
 STATIC CONST VIRTIO_DEVICE_PROTOCOL mVirtIoTemplate = {
   VIRTIO_SPEC_REVISION (1, 0, 0),
   0,                              // SubSystemDeviceId, filled in dynamically
@@ -864,7 +1239,8 @@ STATIC CONST VIRTIO_DEVICE_PROTOCOL mVirtIoTemplate = {
   Virtio10AllocateSharedPages,
   Virtio10FreeSharedPages,
   Virtio10MapSharedBuffer,
-  Virtio10UnmapSharedBuffer
+  Virtio10UnmapSharedBuffer,
+  Virtio10SetQueueEvent
 };
 
 
@@ -987,6 +1363,12 @@ Virtio10BindingStart (
   UpdateAttributes (&Device->CommonConfig, &SetAttributes);
   UpdateAttributes (&Device->NotifyConfig, &SetAttributes);
   UpdateAttributes (&Device->SpecificConfig, &SetAttributes);
+  if (Device->Msix.Exists) {
+    //
+    // The MSI-X Table always lives in memory space.
+    //
+    SetAttributes |= EFI_PCI_IO_ATTRIBUTE_MEMORY;
+  }
   Status = Device->PciIo->Attributes (Device->PciIo,
                             EfiPciIoAttributeOperationEnable, SetAttributes,
                             NULL);
@@ -1047,6 +1429,7 @@ Virtio10BindingStop (
     return Status;
   }
 
+  DisableMsix (Device);
   Device->PciIo->Attributes (Device->PciIo, EfiPciIoAttributeOperationSet,
                    Device->OriginalPciAttributes, NULL);
   gBS->CloseProtocol (DeviceHandle, &gEfiPciIoProtocolGuid,
@@ -1139,12 +1522,25 @@ Virtio10EntryPoint (
   IN EFI_SYSTEM_TABLE *SystemTable
   )
 {
-  return EfiLibInstallDriverBindingComponentName2 (
-           ImageHandle,
-           SystemTable,
-           &mDriverBinding,
-           ImageHandle,
-           &mComponentName,
-           &mComponentName2
-           );
+  EFI_STATUS Status;
+  EFI_EVENT  ExitBootEvent;
+
+  Status = gBS->CreateEvent (EVT_SIGNAL_EXIT_BOOT_SERVICES, TPL_CALLBACK,
+                  Virtio10ExitBoot, NULL, &ExitBootEvent);
+  if (EFI_ERROR (Status)) {
+    return Status;
+  }
+
+  Status = EfiLibInstallDriverBindingComponentName2 (
+             ImageHandle,
+             SystemTable,
+             &mDriverBinding,
+             ImageHandle,
+             &mComponentName,
+             &mComponentName2
+             );
+  if (EFI_ERROR (Status)) {
+    gBS->CloseEvent (ExitBootEvent);
+  }
+  return Status;
 }
@@ -9,6 +9,7 @@
 #ifndef _VIRTIO_1_0_DXE_H_
 #define _VIRTIO_1_0_DXE_H_
 
+#include <IndustryStandard/Pci.h>
 #include <Protocol/PciIo.h>
 #include <Protocol/VirtioDevice.h>
 
@@ -33,6 +34,42 @@ typedef struct {
   UINT32              Length;  // Length of structure in BAR.
 } VIRTIO_1_0_CONFIG;
 
+//
+// The parts of the MSI-X capability and of an MSI-X Table entry that we use
+// (PCI Local Bus Specification 3.0, 6.8.2).
+//
+#define VIRTIO_1_0_PCI_CAPABILITY_ID_MSIX 0x11
+#define VIRTIO_1_0_MSIX_CONTROL_ENABLE    BIT15
+#define VIRTIO_1_0_MSIX_TABLE_BIR_MASK    0x7
+#define VIRTIO_1_0_MSIX_VECTOR_MASKED     BIT0
+
+#pragma pack (1)
+typedef struct {
+  EFI_PCI_CAPABILITY_HDR Hdr;
+  UINT16                 MessageControl;
+  UINT32                 TableOffsetBir;
+  UINT32                 PbaOffsetBir;
+} VIRTIO_1_0_MSIX_CAP;
+
+typedef struct {
+  UINT32 AddressLow;
+  UINT32 AddressHigh;
+  UINT32 Data;
+  UINT32 VectorControl;
+} VIRTIO_1_0_MSIX_TABLE_ENTRY;
+#pragma pack ()
+
+//
+// The location of the MSI-X capability and of the MSI-X Table.
+//
+typedef struct {
+  BOOLEAN Exists;        // The device exposes the MSI-X capability
+  BOOLEAN Enabled;       // We have enabled MSI-X, using Table entry #0
+  UINT16  CapOffset;     // Offset of the capability in config space
+  UINT8   TableBar;
+  UINT32  TableOffset;   // Offset into TableBar where the Table starts
+} VIRTIO_1_0_MSIX;
+
 typedef struct {
   UINT32                 Signature;
   VIRTIO_DEVICE_PROTOCOL VirtIo;
@@ -42,9 +79,77 @@ typedef struct {
   VIRTIO_1_0_CONFIG      NotifyConfig;           // Notifications
   UINT32                 NotifyOffsetMultiplier;
   VIRTIO_1_0_CONFIG      SpecificConfig;         // Device specific settings
+  VIRTIO_1_0_MSIX        Msix;                   // Interrupt delivery
+  LIST_ENTRY             MsixLink;               // While Msix.Enabled
 } VIRTIO_1_0_DEV;
 
 #define VIRTIO_1_0_FROM_VIRTIO_DEVICE(Device) \
           CR (Device, VIRTIO_1_0_DEV, VirtIo, VIRTIO_1_0_SIGNATURE)
 
+//
+// An event registered with VIRTIO_DEVICE_PROTOCOL.SetQueueEvent().
+//
+typedef struct {
+  LIST_ENTRY     Link;
+  VIRTIO_1_0_DEV *Dev;
+  UINT16         QueueIndex;
+  EFI_EVENT      Event;
+} VIRTIO_1_0_QUEUE_EVENT;
+
+#define VIRTIO_1_0_QUEUE_EVENT_FROM_LINK(ListEntry) \
+          BASE_CR (ListEntry, VIRTIO_1_0_QUEUE_EVENT, Link)
+
+/**
+  Signal all events registered with VIRTIO_DEVICE_PROTOCOL.SetQueueEvent().
+
+  All virtio-1.0 devices share a single interrupt vector, hence the interrupt
+  handler cannot tell which queue the interrupt originates from. Spurious
+  signals are harmless, as the event owners check their Used Rings anyway.
+
+  The function must be called at TPL_HIGH_LEVEL.
+**/
+VOID
+Virtio10SignalQueueEvents (
+  VOID
+  );
+
+/**
+  Compose the MSI message that the virtio-1.0 devices should send, and make
+  sure the interrupt handler is installed.
+
+  This function is implemented per architecture.
+
+  @param[out] Address  The MSI message address.
+
+  @param[out] Data     The MSI message data.
+
+  @retval EFI_SUCCESS      The interrupt handler is installed, Address and
+                           Data have been output.
+
+  @retval EFI_UNSUPPORTED  Interrupt delivery is not supported on the
+                           platform, or it has been disabled with
+                           PcdVirtioInterruptVector.
+
+  @return                  Error codes from locating EFI_CPU_ARCH_PROTOCOL,
+                           and from
+                           EFI_CPU_ARCH_PROTOCOL.RegisterInterruptHandler().
+**/
+EFI_STATUS
+Virtio10GetMsiMessage (
+  OUT UINT64 *Address,
+  OUT UINT32 *Data
+  );
+
+/**
+  Uninstall the interrupt handler that Virtio10GetMsiMessage() installed, if
+  any.
+
+  This function is implemented per architecture. It is called at
+  ExitBootServices(), after MSI-X has been disabled on all devices.
+**/
+VOID
+Virtio10UninstallInterruptHandler (
+  VOID
+  );
+
 #endif // _VIRTIO_1_0_DXE_H_
@@ -0,0 +1,110 @@
+/** @file
+  MSI delivery of virtio-1.0 queue notifications on IA32 and X64.
+
+  Copyright (c) 2021, Intel Corporation. All rights reserved.<BR>
+
+  SPDX-License-Identifier: BSD-2-Clause-Patent
+**/
+
+#include <Library/LocalApicLib.h>
+#include <Library/PcdLib.h>
+#include <Library/UefiBootServicesTableLib.h>
+#include <Protocol/Cpu.h>
+
+#include "Virtio10.h"
+
+//
+// MSI address of the local APIC (Intel SDM Vol. 3, 10.11.1 Message Address
+// Register Format), with the destination ID in bits 19:12.
+//
+#define MSI_ADDRESS_BASE           0xFEE00000
+#define MSI_ADDRESS_DEST_ID_SHIFT  12
+
+STATIC EFI_CPU_ARCH_PROTOCOL *mCpu;
+
+/**
+  Interrupt handler shared by all virtio-1.0 queues that have an event
+  registered.
+
+  @param[in] InterruptType  The interrupt vector.
+
+  @param[in] SystemContext  The processor context at the time of the
+                            interrupt.
+**/
+STATIC
+VOID
+EFIAPI
+Virtio10InterruptHandler (
+  IN EFI_EXCEPTION_TYPE InterruptType,
+  IN EFI_SYSTEM_CONTEXT SystemContext
+  )
+{
+  EFI_TPL OriginalTpl;
+
+  OriginalTpl = gBS->RaiseTPL (TPL_HIGH_LEVEL);
+
+  SendApicEoi ();
+  Virtio10SignalQueueEvents ();
+
+  gBS->RestoreTPL (OriginalTpl);
+}
+
+EFI_STATUS
+Virtio10GetMsiMessage (
+  OUT UINT64 *Address,
+  OUT UINT32 *Data
+  )
+{
+  UINT8                 Vector;
+  UINT32                ApicId;
+  EFI_STATUS            Status;
+  EFI_CPU_ARCH_PROTOCOL *Cpu;
+
+  Vector = FixedPcdGet8 (PcdVirtioInterruptVector);
+  if (Vector == 0) {
+    return EFI_UNSUPPORTED;
+  }
+
+  //
+  // The interrupt is delivered to the processor that runs the boot services
+  // (the BSP). Destination IDs above 255 would require interrupt remapping.
+  //
+  ApicId = GetApicId ();
+  if (ApicId > MAX_UINT8) {
+    return EFI_UNSUPPORTED;
+  }
+
+  if (mCpu == NULL) {
+    Status = gBS->LocateProtocol (&gEfiCpuArchProtocolGuid, NULL,
+                    (VOID **)&Cpu);
+    if (EFI_ERROR (Status)) {
+      return Status;
+    }
+    Status = Cpu->RegisterInterruptHandler (Cpu, Vector,
+                    Virtio10InterruptHandler);
+    if (EFI_ERROR (Status)) {
+      return Status;
+    }
+    mCpu = Cpu;
+  }
+
+  //
+  // Fixed delivery mode, edge triggered.
+  //
+  *Address = MSI_ADDRESS_BASE | (ApicId << MSI_ADDRESS_DEST_ID_SHIFT);
+  *Data    = Vector;
+  return EFI_SUCCESS;
+}
+
+VOID
+Virtio10UninstallInterruptHandler (
+  VOID
+  )
+{
+  if (mCpu == NULL) {
+    return;
+  }
+  mCpu->RegisterInterruptHandler (mCpu,
+          FixedPcdGet8 (PcdVirtioInterruptVector), NULL);
+  mCpu = NULL;
+}
@@ -107,9 +107,10 @@ VirtioBlkReset (
     - 24.2.2. ReadBlocks() and ReadBlocksEx() Implementation
     - 24.2.3 WriteBlocks() and WriteBlockEx() Implementation
 
-  Request sizes are limited to 1 GB (checked). This is not a practical
-  limitation, just conformance to virtio-0.9.5, 2.3.2 Descriptor Table: "no
-  descriptor chain may be more than 2^32 bytes long in total".
+  Request sizes are not limited: ChunkedRequest() splits them into virtio
+  requests of at most Dev->MaxTransferSize bytes, which is at most 1 GB, for
+  conformance to virtio-0.9.5, 2.3.2 Descriptor Table: "no descriptor chain
+  may be more than 2^32 bytes long in total".
 
   Some Media characteristics are hardcoded in VirtioBlkInit() below (like
   non-removable media, no restriction on buffer alignment etc); we rely on
@@ -153,8 +154,7 @@ VerifyReadWriteRequest (
 
   ASSERT (PositiveBufferSize > 0);
 
-  if (PositiveBufferSize > SIZE_1GB ||
-      PositiveBufferSize % Media->BlockSize > 0) {
+  if (PositiveBufferSize % Media->BlockSize > 0) {
     return EFI_BAD_BUFFER_SIZE;
   }
   BlockCount = PositiveBufferSize / Media->BlockSize;
@@ -178,8 +178,66 @@ VerifyReadWriteRequest (
 
 /**
 
-  Format a read / write / flush request as three consecutive virtio
-  descriptors, push them to the host, and poll for the response.
+  Append a buffer of a virtio-blk request either to the indirect descriptor
+  table of the device, or directly to the virtio ring, dependent on whether
+  the device accepted VIRTIO_F_RING_INDIRECT_DESC.
+
+  @param[in,out] Dev                The virtio-blk device the request is
+                                    targeted at.
+
+  @param[in] BufferDeviceAddress    (Bus master device) start address of the
+                                    buffer.
+
+  @param[in] BufferSize             Number of bytes to transmit or receive.
+
+  @param[in] Flags                  A bitmask of VRING_DESC_F_NEXT and
+                                    VRING_DESC_F_WRITE.
+
+  @param[in,out] Indices            The descriptor indices of the request,
+                                    initialized with VirtioPrepareIndirect()
+                                    or VirtioPrepare(), respectively.
+
+**/
+STATIC
+VOID
+AppendRequestDesc (
+  IN OUT VBLK_DEV     *Dev,
+  IN     UINT64       BufferDeviceAddress,
+  IN     UINT32       BufferSize,
+  IN     UINT16       Flags,
+  IN OUT DESC_INDICES *Indices
+  )
+{
+  if (Dev->Indirect.Desc != NULL) {
+    VirtioAppendIndirectDesc (
+      &Dev->Indirect,
+      BufferDeviceAddress,
+      BufferSize,
+      Flags,
+      Indices
+      );
+  } else {
+    VirtioAppendDesc (
+      &Dev->Ring,
+      BufferDeviceAddress,
+      BufferSize,
+      Flags,
+      Indices
+      );
+  }
+}
+
+
+/**
+
+  Format a read / write / flush request as a chain of virtio descriptors,
+  push them to the host, and poll for the response.
+
+  The chain consists of the request header, the data buffer (split into
+  segments of at most Dev->SegSizeMax bytes), and the status byte. If the
+  device accepted VIRTIO_F_RING_INDIRECT_DESC, the chain is built in the
+  indirect descriptor table of the device, and it occupies a single entry in
+  the virtio ring.
 
   This is the main workhorse function. Two use cases are supported, read/write
   and flush. The function may only be called after the request parameters have
@@ -209,7 +267,8 @@ VerifyReadWriteRequest (
 
     @param[in] BufferSize      Size of buffer to transfer, in bytes. The caller
                                is responsible to ensure this parameter is
-                               positive.
+                               positive, and that it does not exceed
+                               Dev->MaxTransferSize.
 
     @param[in out] Buffer      The guest side area to read data from the device
                                into, or write data to the device from.
@@ -247,6 +306,10 @@ SynchronousRequest (
   volatile UINT8          *HostStatus;
   VOID                    *HostStatusBuffer;
   DESC_INDICES            Indices;
+  DESC_INDICES            RingIndices;
+  DESC_INDICES            *FlushIndices;
+  UINTN                   SegOffset;
+  UINTN                   SegSize;
   VOID                    *RequestMapping;
   VOID                    *StatusMapping;
   VOID                    *BufferMapping;
@@ -361,7 +424,11 @@ SynchronousRequest (
     goto UnmapDataBuffer;
   }
 
-  VirtioPrepare (&Dev->Ring, &Indices);
+  if (Dev->Indirect.Desc != NULL) {
+    VirtioPrepareIndirect (&Dev->Indirect, &Indices);
+  } else {
+    VirtioPrepare (&Dev->Ring, &Indices);
+  }
 
   //
   // ensured by VirtioBlkInit() -- this predicate, in combination with the
@@ -372,8 +439,8 @@ SynchronousRequest (
   //
   // virtio-blk header in first desc
   //
-  VirtioAppendDesc (
-    &Dev->Ring,
+  AppendRequestDesc (
+    Dev,
     RequestDeviceAddress,
     sizeof Request,
     VRING_DESC_F_NEXT,
@@ -395,32 +462,60 @@ SynchronousRequest (
     ASSERT (BufferSize <= SIZE_1GB);
 
     //
-    // VRING_DESC_F_WRITE is interpreted from the host's point of view.
+    // Honor VIRTIO_BLK_F_SIZE_MAX by splitting the data buffer into segments.
+    // The number of segments is bounded through Dev->MaxTransferSize, see
+    // VirtioBlkInit().
     //
-    VirtioAppendDesc (
-      &Dev->Ring,
-      BufferDeviceAddress,
-      (UINT32) BufferSize,
-      VRING_DESC_F_NEXT | (RequestIsWrite ? 0 : VRING_DESC_F_WRITE),
-      &Indices
-      );
+    ASSERT (BufferSize <= Dev->MaxTransferSize);
+
+    for (SegOffset = 0; SegOffset < BufferSize; SegOffset += SegSize) {
+      SegSize = MIN (BufferSize - SegOffset, Dev->SegSizeMax);
+
+      //
+      // VRING_DESC_F_WRITE is interpreted from the host's point of view.
+      //
+      AppendRequestDesc (
+        Dev,
+        BufferDeviceAddress + SegOffset,
+        (UINT32) SegSize,
+        VRING_DESC_F_NEXT | (RequestIsWrite ? 0 : VRING_DESC_F_WRITE),
+        &Indices
+        );
+    }
   }
 
   //
-  // host status in last (second or third) desc
+  // host status in last desc
   //
-  VirtioAppendDesc (
-    &Dev->Ring,
+  AppendRequestDesc (
+    Dev,
     HostStatusDeviceAddress,
     sizeof *HostStatus,
     VRING_DESC_F_WRITE,
     &Indices
     );
 
+  //
+  // With indirect descriptors, the ring carries a single descriptor that
+  // refers to the chain built above.
+  //
+  if (Dev->Indirect.Desc != NULL) {
+    VirtioPrepare (&Dev->Ring, &RingIndices);
+    VirtioAppendIndirectTable (
+      &Dev->Ring,
+      &Dev->Indirect,
+      &Indices,
+      &RingIndices
+      );
+    FlushIndices = &RingIndices;
+  } else {
+    FlushIndices = &Indices;
+  }
+
   //
   // virtio-blk's only virtqueue is #0, called "requestq" (see Appendix D).
   //
-  if (VirtioFlush (Dev->VirtIo, 0, &Dev->Ring, &Indices,
+  if (VirtioFlush (Dev->VirtIo, 0, &Dev->Ring, FlushIndices,
         NULL) == EFI_SUCCESS &&
       *HostStatus == VIRTIO_BLK_S_OK) {
     Status = EFI_SUCCESS;
@@ -455,6 +550,69 @@ FreeHostStatusBuffer:
 }
 
 
+/**
+
+  Transfer a read / write request of arbitrary (verified) size, by splitting
+  it into SynchronousRequest() calls of at most Dev->MaxTransferSize bytes.
+
+  @param[in] Dev             The virtio-blk device the request is targeted
+                             at.
+
+  @param[in] Lba             Logical Block Address: number of logical blocks
+                             to skip from the beginning of the device.
+
+  @param[in] BufferSize      Size of buffer to transfer, in bytes. The caller
+                             is responsible to ensure this parameter has been
+                             verified with VerifyReadWriteRequest().
+
+  @param[in out] Buffer      The guest side area to read data from the device
+                             into, or write data to the device from.
+
+  @param[in] RequestIsWrite  TRUE iff data transfer goes from guest to device.
+
+
+  @retval EFI_SUCCESS  Transfer complete.
+
+  @return              Error codes from SynchronousRequest().
+
+**/
+STATIC
+EFI_STATUS
+ChunkedRequest (
+  IN     VBLK_DEV *Dev,
+  IN     EFI_LBA  Lba,
+  IN     UINTN    BufferSize,
+  IN OUT UINT8    *Buffer,
+  IN     BOOLEAN  RequestIsWrite
+  )
+{
+  EFI_STATUS Status;
+  UINTN      ChunkSize;
+
+  ASSERT (Dev->MaxTransferSize % Dev->BlockIoMedia.BlockSize == 0);
+
+  while (BufferSize > 0) {
+    ChunkSize = MIN (BufferSize, Dev->MaxTransferSize);
+    Status = SynchronousRequest (
+               Dev,
+               Lba,
+               ChunkSize,
+               Buffer,
+               RequestIsWrite
+               );
+    if (EFI_ERROR (Status)) {
+      return Status;
+    }
+
+    Lba        += ChunkSize / Dev->BlockIoMedia.BlockSize;
+    Buffer     += ChunkSize;
+    BufferSize -= ChunkSize;
+  }
+
+  return EFI_SUCCESS;
+}
+
+
 /**
 
   ReadBlocks() operation for virtio-blk.
@@ -501,7 +659,7 @@ VirtioBlkReadBlocks (
     return Status;
   }
 
-  return SynchronousRequest (
+  return ChunkedRequest (
            Dev,
            Lba,
            BufferSize,
@@ -556,7 +714,7 @@ VirtioBlkWriteBlocks (
     return Status;
   }
 
-  return SynchronousRequest (
+  return ChunkedRequest (
            Dev,
            Lba,
            BufferSize,
@@ -721,12 +879,19 @@ VirtioBlkInit (
   UINT8      PhysicalBlockExp;
   UINT8      AlignmentOffset;
   UINT32     OptIoSize;
+  UINT32     SizeMax;
+  UINT32     SegMax;
   UINT16     QueueSize;
+  UINT16     NumDescs;
+  UINT32     MaxDataSegments;
+  UINT64     MaxTransferSize;
   UINT64     RingBaseShift;
 
   PhysicalBlockExp = 0;
   AlignmentOffset = 0;
   OptIoSize = 0;
+  SizeMax = SIZE_1GB;
+  SegMax = MAX_UINT32;
 
   //
   // Execute virtio-0.9.5, 2.2.1 Device Initialization Sequence.
@@ -815,9 +980,33 @@ VirtioBlkInit (
     }
   }
 
+  if (Features & VIRTIO_BLK_F_SIZE_MAX) {
+    Status = VIRTIO_CFG_READ (Dev, SizeMax, &SizeMax);
+    if (EFI_ERROR (Status)) {
+      goto Failed;
+    }
+    if (SizeMax == 0) {
+      Status = EFI_UNSUPPORTED;
+      goto Failed;
+    }
+    SizeMax = MIN (SizeMax, SIZE_1GB);
+  }
+
+  if (Features & VIRTIO_BLK_F_SEG_MAX) {
+    Status = VIRTIO_CFG_READ (Dev, SegMax, &SegMax);
+    if (EFI_ERROR (Status)) {
+      goto Failed;
+    }
+    if (SegMax == 0) {
+      Status = EFI_UNSUPPORTED;
+      goto Failed;
+    }
+  }
+
   Features &= VIRTIO_BLK_F_BLK_SIZE | VIRTIO_BLK_F_TOPOLOGY | VIRTIO_BLK_F_RO |
-              VIRTIO_BLK_F_FLUSH | VIRTIO_F_VERSION_1 |
-              VIRTIO_F_IOMMU_PLATFORM;
+              VIRTIO_BLK_F_FLUSH | VIRTIO_BLK_F_SIZE_MAX |
+              VIRTIO_BLK_F_SEG_MAX | VIRTIO_F_RING_INDIRECT_DESC |
+              VIRTIO_F_VERSION_1 | VIRTIO_F_IOMMU_PLATFORM;
 
   //
   // In virtio-1.0, feature negotiation is expected to complete before queue
@@ -841,10 +1030,32 @@ VirtioBlkInit (
   if (EFI_ERROR (Status)) {
     goto Failed;
   }
-  if (QueueSize < 3) { // SynchronousRequest() uses at most three descriptors
+  if (QueueSize < 3) { // SynchronousRequest() uses at least three descriptors
+    Status = EFI_UNSUPPORTED;
+    goto Failed;
+  }
+
+  //
+  // Work out the largest transfer that fits in one request. Two descriptors
+  // are taken by the request header and the status byte; the rest may carry
+  // data segments of at most SizeMax bytes each. With indirect descriptors,
+  // the chain lives outside of the ring, and its length is only limited by the
+  // queue size and the size of the table we allocate.
+  //
+  if (Features & VIRTIO_F_RING_INDIRECT_DESC) {
+    NumDescs = (UINT16) MIN (QueueSize, VBLK_INDIRECT_DESC_MAX);
+  } else {
+    NumDescs = QueueSize;
+  }
+  MaxDataSegments = MIN ((UINT32) NumDescs - 2, SegMax);
+  MaxTransferSize = MIN (MultU64x32 (SizeMax, MaxDataSegments), SIZE_1GB);
+  MaxTransferSize -= ModU64x32 (MaxTransferSize, BlockSize);
+  if (MaxTransferSize == 0) {
     Status = EFI_UNSUPPORTED;
     goto Failed;
   }
+  Dev->SegSizeMax      = SizeMax;
+  Dev->MaxTransferSize = (UINT32) MaxTransferSize;
 
   Status = VirtioRingInit (Dev->VirtIo, QueueSize, &Dev->Ring);
   if (EFI_ERROR (Status)) {
@@ -878,6 +1089,14 @@ VirtioBlkInit (
     goto UnmapQueue;
   }
 
+  //
+  // Request interrupt-driven completion, if the transport supports it.
+  //
+  Status = VirtioRingEnableEvent (Dev->VirtIo, 0, &Dev->Ring);
+  if (EFI_ERROR (Status)) {
+    goto UnmapQueue;
+  }
+
   //
   // step 4c -- Report GPFN (guest-physical frame number) of queue.
   //
@@ -902,13 +1121,24 @@ VirtioBlkInit (
     }
   }
 
+  //
+  // The indirect descriptor table is reused by every request, as we have at
+  // most one request in flight.
+  //
+  if (Features & VIRTIO_F_RING_INDIRECT_DESC) {
+    Status = VirtioIndirectTableInit (Dev->VirtIo, NumDescs, &Dev->Indirect);
+    if (EFI_ERROR (Status)) {
+      goto UnmapQueue;
+    }
+  }
+
   //
   // step 6 -- initialization complete
   //
   NextDevStat |= VSTAT_DRIVER_OK;
   Status = Dev->VirtIo->SetDeviceStatus (Dev->VirtIo, NextDevStat);
   if (EFI_ERROR (Status)) {
-    goto UnmapQueue;
+    goto ReleaseIndirect;
   }
 
   //
@@ -935,6 +1165,9 @@ VirtioBlkInit (
   DEBUG ((DEBUG_INFO, "%a: LbaSize=0x%x[B] NumBlocks=0x%Lx[Lba]\n",
     __FUNCTION__, Dev->BlockIoMedia.BlockSize,
     Dev->BlockIoMedia.LastBlock + 1));
+  DEBUG ((DEBUG_INFO, "%a: MaxTransferSize=0x%x[B] SegSizeMax=0x%x[B] "
+    "Indirect=%d\n", __FUNCTION__, Dev->MaxTransferSize, Dev->SegSizeMax,
+    Dev->Indirect.Desc != NULL));
 
   if (Features & VIRTIO_BLK_F_TOPOLOGY) {
     Dev->BlockIo.Revision = EFI_BLOCK_IO_PROTOCOL_REVISION3;
@@ -951,6 +1184,11 @@ VirtioBlkInit (
   }
   return EFI_SUCCESS;
 
+ReleaseIndirect:
+  if (Dev->Indirect.Desc != NULL) {
+    VirtioIndirectTableUninit (Dev->VirtIo, &Dev->Indirect);
+  }
+
 UnmapQueue:
   Dev->VirtIo->UnmapSharedBuffer (Dev->VirtIo, Dev->RingMap);
 
@@ -992,6 +1230,9 @@ VirtioBlkUninit (
   //
   Dev->VirtIo->SetDeviceStatus (Dev->VirtIo, 0);
 
+  if (Dev->Indirect.Desc != NULL) {
+    VirtioIndirectTableUninit (Dev->VirtIo, &Dev->Indirect);
+  }
   Dev->VirtIo->UnmapSharedBuffer (Dev->VirtIo, Dev->RingMap);
   VirtioRingUninit (Dev->VirtIo, &Dev->Ring);
 
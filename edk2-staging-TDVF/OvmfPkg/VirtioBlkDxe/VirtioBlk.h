@@ -17,6 +17,7 @@
 #include <Protocol/DriverBinding.h>
 
 #include <IndustryStandard/Virtio.h>
+#include <Library/VirtioLib.h>
 
 
 #define VBLK_SIG SIGNATURE_32 ('V', 'B', 'L', 'K')
@@ -36,8 +37,18 @@ typedef struct {
   EFI_BLOCK_IO_PROTOCOL  BlockIo;              // VirtioBlkInit       1
   EFI_BLOCK_IO_MEDIA     BlockIoMedia;         // VirtioBlkInit       1
   VOID                   *RingMap;             // VirtioRingMap       2
+  VRING_INDIRECT         Indirect;             // VirtioBlkInit       1
+  UINT32                 SegSizeMax;           // VirtioBlkInit       1
+  UINT32                 MaxTransferSize;      // VirtioBlkInit       1
 } VBLK_DEV;
 
+//
+// Upper limit on the number of indirect descriptors per request. One page of
+// descriptors is enough for the request header, the status byte, and 254 data
+// segments.
+//
+#define VBLK_INDIRECT_DESC_MAX  (EFI_PAGE_SIZE / sizeof (VRING_DESC))
+
 #define VIRTIO_BLK_FROM_BLOCK_IO(BlockIoPointer) \
         CR (BlockIoPointer, VBLK_DEV, BlockIo, VBLK_SIG)
 
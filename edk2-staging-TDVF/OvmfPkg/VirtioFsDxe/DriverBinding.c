@@ -88,6 +88,7 @@ VirtioFsBindingStart (
   if (EFI_ERROR (Status)) {
     goto UninitVirtioFs;
   }
+  VirtioFsReadCacheInit (VirtioFs);
 
   Status = gBS->CreateEvent (EVT_SIGNAL_EXIT_BOOT_SERVICES, TPL_CALLBACK,
                   VirtioFsExitBoot, VirtioFs, &VirtioFs->ExitBoot);
@@ -164,6 +165,7 @@ VirtioFsBindingStop (
   ASSERT_EFI_ERROR (Status);
 
   VirtioFsUninit (VirtioFs);
+  VirtioFsReadCacheUninit (VirtioFs);
 
   Status = gBS->CloseProtocol (ControllerHandle, &gVirtioDeviceProtocolGuid,
                   This->DriverBindingHandle, ControllerHandle);
@@ -25,6 +25,9 @@
                            "VirtioFs->RequestId" is set to 1 on output. The
                            maximum write buffer size exposed in the FUSE_INIT
                            response is saved in "VirtioFs->MaxWrite", on
+                           output. The maximum read buffer size, derived from
+                           the maximum number of pages per request negotiated
+                           in FUSE_INIT, is saved in "VirtioFs->MaxRead", on
                            output.
 
   @retval EFI_SUCCESS      The FUSE session has been started.
@@ -101,7 +104,8 @@ VirtioFsFuseInitSession (
   InitReq.Major        = VIRTIO_FS_FUSE_MAJOR;
   InitReq.Minor        = VIRTIO_FS_FUSE_MINOR;
   InitReq.MaxReadahead = 0;
-  InitReq.Flags        = VIRTIO_FS_FUSE_INIT_REQ_F_DO_READDIRPLUS;
+  InitReq.Flags        = VIRTIO_FS_FUSE_INIT_REQ_F_DO_READDIRPLUS |
+                         VIRTIO_FS_FUSE_INIT_REQ_F_MAX_PAGES;
 
   //
   // Submit the request.
@@ -138,5 +142,16 @@ VirtioFsFuseInitSession (
   // Save the maximum write buffer size for FUSE_WRITE requests.
   //
   VirtioFs->MaxWrite = InitResp.MaxWrite;
+
+  //
+  // Save the maximum read buffer size for FUSE_READ requests. If the server
+  // didn't negotiate the page limit, assume the FUSE default.
+  //
+  if ((InitResp.Flags & VIRTIO_FS_FUSE_INIT_REQ_F_MAX_PAGES) != 0 &&
+      InitResp.MaxPages > 0) {
+    VirtioFs->MaxRead = (UINT32)InitResp.MaxPages * EFI_PAGE_SIZE;
+  } else {
+    VirtioFs->MaxRead = VIRTIO_FS_FUSE_DEFAULT_MAX_PAGES * EFI_PAGE_SIZE;
+  }
   return EFI_SUCCESS;
 }
@@ -214,6 +214,12 @@ VirtioFsInit (
     goto ReleaseQueue;
   }
 
+  Status = VirtioRingEnableEvent (VirtioFs->Virtio, VIRTIO_FS_REQUEST_QUEUE,
+             &VirtioFs->Ring);
+  if (EFI_ERROR (Status)) {
+    goto UnmapQueue;
+  }
+
   Status = VirtioFs->Virtio->SetQueueAddress (VirtioFs->Virtio,
                                &VirtioFs->Ring, RingBaseShift);
   if (EFI_ERROR (Status)) {
@@ -2424,3 +2430,27 @@ VirtioFsGetFuseModeUpdate (
   *Update = TRUE;
   return EFI_SUCCESS;
 }
+
+/**
+  Release the directory stream buffers of a VIRTIO_FS_FILE object.
+
+  @param[in,out] VirtioFsFile  The VIRTIO_FS_FILE object whose DirentBuf and
+                               FileInfoArray should be released. Both fields
+                               are set to NULL on output.
+**/
+VOID
+VirtioFsFileFreeDirCache (
+  IN OUT VIRTIO_FS_FILE *VirtioFsFile
+  )
+{
+  if (VirtioFsFile->FileInfoArray != NULL) {
+    FreePool (VirtioFsFile->FileInfoArray);
+    VirtioFsFile->FileInfoArray = NULL;
+  }
+  if (VirtioFsFile->DirentBuf != NULL) {
+    FreePool (VirtioFsFile->DirentBuf);
+    VirtioFsFile->DirentBuf = NULL;
+  }
+  VirtioFsFile->NumFileInfo  = 0;
+  VirtioFsFile->NextFileInfo = 0;
+}
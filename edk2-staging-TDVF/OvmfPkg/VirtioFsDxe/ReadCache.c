@@ -0,0 +1,264 @@
+/** @file
+  Read cache for regular files, shared by all files open on a Virtio
+  Filesystem device.
+
+  Copyright (c) 2021, Intel Corporation. All rights reserved.<BR>
+
+  SPDX-License-Identifier: BSD-2-Clause-Patent
+**/
+
+#include <Library/BaseMemoryLib.h>       // ZeroMem()
+#include <Library/MemoryAllocationLib.h> // AllocatePool()
+
+#include "VirtioFsDxe.h"
+
+/**
+  Initialize the read cache of a Virtio Filesystem device.
+
+  The function may only be called after VirtioFsFuseInitSession() returns
+  successfully, as the block size of the read cache depends on
+  "VirtioFs->MaxRead".
+
+  @param[in,out] VirtioFs  The Virtio Filesystem device whose read cache
+                           should be initialized. No memory is allocated; the
+                           blocks are allocated on first use.
+**/
+VOID
+VirtioFsReadCacheInit (
+  IN OUT VIRTIO_FS *VirtioFs
+  )
+{
+  VirtioFs->ReadCacheBlockSize = MIN (VirtioFs->MaxRead,
+                                   VIRTIO_FS_READ_CACHE_BLOCK_SIZE);
+  VirtioFs->ReadCacheClock = 0;
+  ZeroMem (VirtioFs->ReadCache, sizeof VirtioFs->ReadCache);
+}
+
+/**
+  Release the memory allocated for the read cache of a Virtio Filesystem
+  device.
+
+  @param[in,out] VirtioFs  The Virtio Filesystem device whose read cache
+                           should be released.
+**/
+VOID
+VirtioFsReadCacheUninit (
+  IN OUT VIRTIO_FS *VirtioFs
+  )
+{
+  UINTN Index;
+
+  for (Index = 0; Index < ARRAY_SIZE (VirtioFs->ReadCache); Index++) {
+    if (VirtioFs->ReadCache[Index].Data != NULL) {
+      FreePool (VirtioFs->ReadCache[Index].Data);
+    }
+  }
+  ZeroMem (VirtioFs->ReadCache, sizeof VirtioFs->ReadCache);
+}
+
+/**
+  Drop all cached data of a file.
+
+  This function must be called whenever the contents of the file may change
+  (FUSE_WRITE, size update with FUSE_SETATTR), and when the inode number may
+  go stale (FUSE_FORGET, FUSE_UNLINK).
+
+  @param[in,out] VirtioFs  The Virtio Filesystem device that owns the read
+                           cache.
+
+  @param[in] NodeId        The inode number of the file.
+**/
+VOID
+VirtioFsReadCacheInvalidate (
+  IN OUT VIRTIO_FS *VirtioFs,
+  IN     UINT64    NodeId
+  )
+{
+  UINTN Index;
+
+  for (Index = 0; Index < ARRAY_SIZE (VirtioFs->ReadCache); Index++) {
+    if (VirtioFs->ReadCache[Index].NodeId == NodeId) {
+      VirtioFs->ReadCache[Index].NodeId = 0;
+      VirtioFs->ReadCache[Index].Size   = 0;
+    }
+  }
+}
+
+/**
+  Drop the cached data of a file that lies at or beyond a file size.
+
+  This function must be called whenever the file may have shrunk behind our
+  back: when FUSE_GETATTR reports its current size, and when a FUSE_READ
+  returns fewer bytes than requested, which marks the current end of file.
+
+  @param[in,out] VirtioFs  The Virtio Filesystem device that owns the read
+                           cache.
+
+  @param[in] NodeId        The inode number of the file.
+
+  @param[in] FileSize      The current size of the file.
+**/
+VOID
+VirtioFsReadCacheTruncate (
+  IN OUT VIRTIO_FS *VirtioFs,
+  IN     UINT64    NodeId,
+  IN     UINT64    FileSize
+  )
+{
+  UINTN                      Index;
+  VIRTIO_FS_READ_CACHE_BLOCK *Block;
+
+  for (Index = 0; Index < ARRAY_SIZE (VirtioFs->ReadCache); Index++) {
+    Block = &VirtioFs->ReadCache[Index];
+    if (Block->NodeId != NodeId || Block->Offset + Block->Size <= FileSize) {
+      continue;
+    }
+    if (Block->Offset >= FileSize) {
+      Block->NodeId = 0;
+      Block->Size   = 0;
+    } else {
+      Block->Size = (UINT32)(FileSize - Block->Offset);
+    }
+  }
+}
+
+/**
+  Look up the cache block that holds the byte at a particular file position.
+
+  @param[in,out] VirtioFs  The Virtio Filesystem device that owns the read
+                           cache. The use of the block found is recorded for
+                           the least-recently-used replacement policy.
+
+  @param[in] NodeId        The inode number of the file.
+
+  @param[in] Offset        The file position to look up.
+
+  @retval NULL  No cache block holds the byte at Offset.
+
+  @return       The cache block that holds the byte at Offset.
+**/
+VIRTIO_FS_READ_CACHE_BLOCK *
+VirtioFsReadCacheLookup (
+  IN OUT VIRTIO_FS *VirtioFs,
+  IN     UINT64    NodeId,
+  IN     UINT64    Offset
+  )
+{
+  UINTN                      Index;
+  VIRTIO_FS_READ_CACHE_BLOCK *Block;
+
+  for (Index = 0; Index < ARRAY_SIZE (VirtioFs->ReadCache); Index++) {
+    Block = &VirtioFs->ReadCache[Index];
+    if (Block->NodeId == NodeId &&
+        Offset >= Block->Offset &&
+        Offset - Block->Offset < Block->Size) {
+      Block->LastUse = ++VirtioFs->ReadCacheClock;
+      return Block;
+    }
+  }
+  return NULL;
+}
+
+/**
+  Read a chunk of a regular file into the least recently used block of the
+  read cache.
+
+  @param[in,out] VirtioFs  The Virtio Filesystem device to send the FUSE_READ
+                           request to.
+
+  @param[in] NodeId        The inode number of the regular file to read from.
+
+  @param[in] FuseHandle    The open handle to the regular file to read from.
+
+  @param[in] Offset        The absolute file position at which to start
+                           reading.
+
+  @param[in] Size          The number of bytes to read. Size is clamped to
+                           "VirtioFs->ReadCacheBlockSize".
+
+  @param[out] Block        On success, the cache block that has been filled
+                           in. If the read returned zero bytes (EOF), Block is
+                           set to NULL.
+
+  @retval EFI_SUCCESS           The read was successful.
+
+  @retval EFI_OUT_OF_RESOURCES  Failed to allocate memory for the cache block.
+
+  @return                       Error codes propagated from
+                                VirtioFsFuseReadFileOrDir().
+**/
+EFI_STATUS
+VirtioFsReadCacheFill (
+  IN OUT VIRTIO_FS                  *VirtioFs,
+  IN     UINT64                     NodeId,
+  IN     UINT64                     FuseHandle,
+  IN     UINT64                     Offset,
+  IN     UINT32                     Size,
+     OUT VIRTIO_FS_READ_CACHE_BLOCK **Block
+  )
+{
+  UINTN                      Index;
+  VIRTIO_FS_READ_CACHE_BLOCK *Victim;
+  EFI_STATUS                 Status;
+  UINT32                     Requested;
+
+  //
+  // Pick an unused block, or else the least recently used one.
+  //
+  Victim = &VirtioFs->ReadCache[0];
+  for (Index = 0; Index < ARRAY_SIZE (VirtioFs->ReadCache); Index++) {
+    if (VirtioFs->ReadCache[Index].NodeId == 0) {
+      Victim = &VirtioFs->ReadCache[Index];
+      break;
+    }
+    if (VirtioFs->ReadCache[Index].LastUse < Victim->LastUse) {
+      Victim = &VirtioFs->ReadCache[Index];
+    }
+  }
+
+  if (Victim->Data == NULL) {
+    Victim->Data = AllocatePool (VirtioFs->ReadCacheBlockSize);
+    if (Victim->Data == NULL) {
+      return EFI_OUT_OF_RESOURCES;
+    }
+  }
+
+  //
+  // Invalidate the block before reading into it, so that a failed read
+  // leaves no stale data behind.
+  //
+  Victim->NodeId = 0;
+  Victim->Size   = 0;
+
+  Size = MIN (Size, VirtioFs->ReadCacheBlockSize);
+  Requested = Size;
+  Status = VirtioFsFuseReadFileOrDir (
+             VirtioFs,
+             NodeId,
+             FuseHandle,
+             FALSE,        // IsDir
+             Offset,
+             &Size,
+             Victim->Data
+             );
+  if (EFI_ERROR (Status)) {
+    return Status;
+  }
+  if (Size < Requested) {
+    //
+    // The file ends at (Offset + Size); forget any cached data beyond.
+    //
+    VirtioFsReadCacheTruncate (VirtioFs, NodeId, Offset + Size);
+  }
+  if (Size == 0) {
+    *Block = NULL;
+    return EFI_SUCCESS;
+  }
+
+  Victim->NodeId  = NodeId;
+  Victim->Offset  = Offset;
+  Victim->Size    = Size;
+  Victim->LastUse = ++VirtioFs->ReadCacheClock;
+  *Block = Victim;
+  return EFI_SUCCESS;
+}
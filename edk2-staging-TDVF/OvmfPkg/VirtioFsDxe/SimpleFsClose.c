@@ -54,15 +54,20 @@ VirtioFsSimpleFileClose (
     VirtioFsFuseForget (VirtioFs, VirtioFsFile->NodeId);
   }
 
+  //
+  // Once forgotten, the NodeId may be reused for a different file.
+  //
+  if (!VirtioFsFile->IsDirectory) {
+    VirtioFsReadCacheInvalidate (VirtioFs, VirtioFsFile->NodeId);
+  }
+
   //
   // One fewer file left open for the owner filesystem.
   //
   RemoveEntryList (&VirtioFsFile->OpenFilesEntry);
 
   FreePool (VirtioFsFile->CanonicalPathname);
-  if (VirtioFsFile->FileInfoArray != NULL) {
-    FreePool (VirtioFsFile->FileInfoArray);
-  }
+  VirtioFsFileFreeDirCache (VirtioFsFile);
   FreePool (VirtioFsFile);
   return EFI_SUCCESS;
 }
@@ -95,6 +95,9 @@ VirtioFsSimpleFileDelete (
   if (VirtioFsFile->NodeId != VIRTIO_FS_FUSE_ROOT_DIR_NODE_ID) {
     VirtioFsFuseForget (VirtioFs, VirtioFsFile->NodeId);
   }
+  if (!VirtioFsFile->IsDirectory) {
+    VirtioFsReadCacheInvalidate (VirtioFs, VirtioFsFile->NodeId);
+  }
 
   //
   // One fewer file left open for the owner filesystem.
@@ -102,9 +105,7 @@ VirtioFsSimpleFileDelete (
   RemoveEntryList (&VirtioFsFile->OpenFilesEntry);
 
   FreePool (VirtioFsFile->CanonicalPathname);
-  if (VirtioFsFile->FileInfoArray != NULL) {
-    FreePool (VirtioFsFile->FileInfoArray);
-  }
+  VirtioFsFileFreeDirCache (VirtioFsFile);
   FreePool (VirtioFsFile);
   return Status;
 }
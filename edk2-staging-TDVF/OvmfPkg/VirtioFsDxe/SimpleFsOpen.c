@@ -486,6 +486,11 @@ VirtioFsSimpleFileOpen (
   NewVirtioFsFile->SingleFileInfoSize     = 0;
   NewVirtioFsFile->NumFileInfo            = 0;
   NewVirtioFsFile->NextFileInfo           = 0;
+  NewVirtioFsFile->DirentBuf              = NULL;
+  NewVirtioFsFile->DirentBufSize          = 0;
+  NewVirtioFsFile->Namelen                = 0;
+  NewVirtioFsFile->ReadAheadNext          = 0;
+  NewVirtioFsFile->ReadAheadWindow        = VIRTIO_FS_READ_AHEAD_MIN;
 
   //
   // One more file is now open for the filesystem.
@@ -79,6 +79,11 @@ VirtioFsOpenVolume (
   VirtioFsFile->SingleFileInfoSize     = 0;
   VirtioFsFile->NumFileInfo            = 0;
   VirtioFsFile->NextFileInfo           = 0;
+  VirtioFsFile->DirentBuf              = NULL;
+  VirtioFsFile->DirentBufSize          = 0;
+  VirtioFsFile->Namelen                = 0;
+  VirtioFsFile->ReadAheadNext          = 0;
+  VirtioFsFile->ReadAheadWindow        = VIRTIO_FS_READ_AHEAD_MIN;
 
   //
   // One more file open for the filesystem.
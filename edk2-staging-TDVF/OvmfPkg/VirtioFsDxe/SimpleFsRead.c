@@ -61,6 +61,10 @@ PopulateFileInfo (
 
 /**
   Refill the EFI_FILE_INFO cache from the directory stream.
+
+  The FUSE_READDIRPLUS receive buffer and the EFI_FILE_INFO cache are
+  allocated on the first refill, based on the maximum filename length
+  supported by the filesystem; later refills reuse them.
 **/
 STATIC
 EFI_STATUS
@@ -78,48 +82,71 @@ RefillFileInfoCache (
   UINT64                         DirStreamCookie;
   UINT64                         CacheEndsAtCookie;
   UINTN                          NumFileInfo;
+  UINT32                         Namelen;
 
-  //
-  // Allocate a DirentBuf that can receive at least
-  // VIRTIO_FS_FILE_MAX_FILE_INFO directory entries, based on the maximum
-  // filename length supported by the filesystem. Note that the multiplication
-  // is safe from overflow due to the VIRTIO_FS_FUSE_DIRENTPLUS_RESPONSE_SIZE()
-  // check.
-  //
   VirtioFs = VirtioFsFile->OwnerFs;
-  Status = VirtioFsFuseStatFs (VirtioFs, VirtioFsFile->NodeId, &FilesysAttr);
-  if (EFI_ERROR (Status)) {
-    return Status;
-  }
-  DirentBufSize = (UINT32)VIRTIO_FS_FUSE_DIRENTPLUS_RESPONSE_SIZE (
-                            FilesysAttr.Namelen);
-  if (DirentBufSize == 0) {
-    return EFI_UNSUPPORTED;
-  }
-  DirentBufSize *= VIRTIO_FS_FILE_MAX_FILE_INFO;
-  DirentBuf = AllocatePool (DirentBufSize);
-  if (DirentBuf == NULL) {
-    return EFI_OUT_OF_RESOURCES;
+  if (VirtioFsFile->DirentBuf == NULL) {
+    //
+    // Allocate a DirentBuf that can receive at least
+    // VIRTIO_FS_FILE_MAX_FILE_INFO directory entries, based on the maximum
+    // filename length supported by the filesystem. Note that the
+    // multiplication is safe from overflow due to the
+    // VIRTIO_FS_FUSE_DIRENTPLUS_RESPONSE_SIZE() check.
+    //
+    Status = VirtioFsFuseStatFs (VirtioFs, VirtioFsFile->NodeId,
+               &FilesysAttr);
+    if (EFI_ERROR (Status)) {
+      return Status;
+    }
+    DirentBufSize = (UINT32)VIRTIO_FS_FUSE_DIRENTPLUS_RESPONSE_SIZE (
+                              FilesysAttr.Namelen);
+    if (DirentBufSize == 0) {
+      return EFI_UNSUPPORTED;
+    }
+    DirentBufSize *= VIRTIO_FS_FILE_MAX_FILE_INFO;
+    DirentBuf = AllocatePool (DirentBufSize);
+    if (DirentBuf == NULL) {
+      return EFI_OUT_OF_RESOURCES;
+    }
+
+    //
+    // Allocate the EFI_FILE_INFO cache. A single EFI_FILE_INFO element is
+    // sized accordingly to the maximum filename length supported by the
+    // filesystem.
+    //
+    // Note that the calculation below cannot overflow, due to the filename
+    // limit imposed by the VIRTIO_FS_FUSE_DIRENTPLUS_RESPONSE_SIZE() check
+    // above. The calculation takes the L'\0' character that we'll need to
+    // append into account.
+    //
+    SingleFileInfoSize = (OFFSET_OF (EFI_FILE_INFO, FileName) +
+                          ((UINTN)FilesysAttr.Namelen + 1) * sizeof (CHAR16));
+    FileInfoArray = AllocatePool (
+                      VIRTIO_FS_FILE_MAX_FILE_INFO * SingleFileInfoSize
+                      );
+    if (FileInfoArray == NULL) {
+      FreePool (DirentBuf);
+      return EFI_OUT_OF_RESOURCES;
+    }
+
+    VirtioFsFile->DirentBuf          = DirentBuf;
+    VirtioFsFile->DirentBufSize      = DirentBufSize;
+    VirtioFsFile->Namelen            = FilesysAttr.Namelen;
+    VirtioFsFile->FileInfoArray      = FileInfoArray;
+    VirtioFsFile->SingleFileInfoSize = SingleFileInfoSize;
   }
+  DirentBuf          = VirtioFsFile->DirentBuf;
+  DirentBufSize      = VirtioFsFile->DirentBufSize;
+  Namelen            = VirtioFsFile->Namelen;
+  FileInfoArray      = VirtioFsFile->FileInfoArray;
+  SingleFileInfoSize = VirtioFsFile->SingleFileInfoSize;
 
   //
-  // Allocate the EFI_FILE_INFO cache. A single EFI_FILE_INFO element is sized
-  // accordingly to the maximum filename length supported by the filesystem.
-  //
-  // Note that the calculation below cannot overflow, due to the filename limit
-  // imposed by the VIRTIO_FS_FUSE_DIRENTPLUS_RESPONSE_SIZE() check above. The
-  // calculation takes the L'\0' character that we'll need to append into
-  // account.
+  // The cache is being overwritten in place. Until the refill succeeds, it
+  // must be considered empty.
   //
-  SingleFileInfoSize = (OFFSET_OF (EFI_FILE_INFO, FileName) +
-                        ((UINTN)FilesysAttr.Namelen + 1) * sizeof (CHAR16));
-  FileInfoArray = AllocatePool (
-                    VIRTIO_FS_FILE_MAX_FILE_INFO * SingleFileInfoSize
-                    );
-  if (FileInfoArray == NULL) {
-    Status = EFI_OUT_OF_RESOURCES;
-    goto FreeDirentBuf;
-  }
+  VirtioFsFile->NumFileInfo  = 0;
+  VirtioFsFile->NextFileInfo = 0;
 
   //
   // Pick up reading the directory stream where the previous cache ended.
@@ -148,7 +175,7 @@ RefillFileInfoCache (
                DirentBuf                 // Data
                );
     if (EFI_ERROR (Status)) {
-      goto FreeFileInfoArray;
+      return Status;
     }
 
     if (Remaining == 0) {
@@ -176,11 +203,10 @@ RefillFileInfoCache (
         // This means one of two things: (a) Dirent->Namelen is zero, or (b)
         // (b) Dirent->Namelen is unsupportably large. (a) is just invalid for
         // the Virtio Filesystem device to send, while (b) shouldn't happen
-        // because "FilesysAttr.Namelen" -- the maximum filename length
-        // supported by the filesystem -- proved acceptable above.
+        // because "Namelen" -- the maximum filename length supported by the
+        // filesystem -- proved acceptable when DirentBuf was allocated.
         //
-        Status = EFI_PROTOCOL_ERROR;
-        goto FreeFileInfoArray;
+        return EFI_PROTOCOL_ERROR;
       }
       if (DirentSize > Remaining) {
         //
@@ -188,18 +214,16 @@ RefillFileInfoCache (
         // padding) are truncated. This should never happen; the Virtio
         // Filesystem device is supposed to send complete entries only.
         //
-        Status = EFI_PROTOCOL_ERROR;
-        goto FreeFileInfoArray;
+        return EFI_PROTOCOL_ERROR;
       }
-      if (Dirent->Namelen > FilesysAttr.Namelen) {
+      if (Dirent->Namelen > Namelen) {
         //
         // This is possible without tripping the truncation check above, due to
         // how entries are padded. The condition means that Dirent->Namelen is
         // reportedly larger than the filesystem limit, without spilling into
         // the next alignment bucket. Should never happen.
         //
-        Status = EFI_PROTOCOL_ERROR;
-        goto FreeFileInfoArray;
+        return EFI_PROTOCOL_ERROR;
       }
 
       //
@@ -254,8 +278,7 @@ RefillFileInfoCache (
       // truncated. This should never happen; the Virtio Filesystem device is
       // supposed to send complete entries only.
       //
-      Status = EFI_PROTOCOL_ERROR;
-      goto FreeFileInfoArray;
+      return EFI_PROTOCOL_ERROR;
     }
     //
     // Fetch another DirentBuf from the directory stream, unless we've filled
@@ -266,25 +289,9 @@ RefillFileInfoCache (
   //
   // Commit the results. (Note that the result may be an empty cache.)
   //
-  if (VirtioFsFile->FileInfoArray != NULL) {
-    FreePool (VirtioFsFile->FileInfoArray);
-  }
-  VirtioFsFile->FileInfoArray      = FileInfoArray;
-  VirtioFsFile->SingleFileInfoSize = SingleFileInfoSize;
-  VirtioFsFile->NumFileInfo        = NumFileInfo;
-  VirtioFsFile->NextFileInfo       = 0;
-  VirtioFsFile->FilePosition       = CacheEndsAtCookie;
-
-  FreePool (DirentBuf);
+  VirtioFsFile->NumFileInfo  = NumFileInfo;
+  VirtioFsFile->FilePosition = CacheEndsAtCookie;
   return EFI_SUCCESS;
-
-FreeFileInfoArray:
-  FreePool (FileInfoArray);
-
-FreeDirentBuf:
-  FreePool (DirentBuf);
-
-  return Status;
 }
 
 /**
@@ -333,7 +340,7 @@ ReadFileInfoCache (
   //       VirtioFsFuseDirentPlusToEfiFileInfo()
   //
   // and VirtioFsFile->SingleFileInfoSize was computed from
-  // FilesysAttr.Namelen, which had been accepted by
+  // VirtioFsFile->Namelen, which had been accepted by
   // VIRTIO_FS_FUSE_DIRENTPLUS_RESPONSE_SIZE().)
   //
   CallerAllocated = *BufferSize;
@@ -351,6 +358,16 @@ ReadFileInfoCache (
 
 /**
   Read from a regular file.
+
+  Small reads are served from the read cache of the owner filesystem. On a
+  cache miss, a readahead window is fetched into the cache; the window grows
+  while the file is read sequentially. Reads that are at least as large as a
+  cache block are sent to the Virtio Filesystem device directly, in chunks of
+  "VirtioFs->MaxRead" bytes.
+
+  The file size is fetched with FUSE_GETATTR on every read, as the file may
+  have been truncated by the host. Cached data beyond the current end of file
+  is dropped before the cache is used.
 **/
 STATIC
 EFI_STATUS
@@ -374,35 +391,91 @@ ReadRegularFile (
   if (EFI_ERROR (Status) || VirtioFsFile->FilePosition > FuseAttr.Size) {
     return EFI_DEVICE_ERROR;
   }
+  VirtioFsReadCacheTruncate (VirtioFs, VirtioFsFile->NodeId, FuseAttr.Size);
 
   Status      = EFI_SUCCESS;
   Transferred = 0;
   Left        = *BufferSize;
   while (Left > 0) {
-    UINT32 ReadSize;
+    UINT64                     Position;
+    VIRTIO_FS_READ_CACHE_BLOCK *Block;
+    UINT32                     ReadSize;
+    UINTN                      BlockBytes;
 
-    //
-    // FUSE_READ cannot express a >=4GB buffer size.
-    //
-    ReadSize = (UINT32)MIN ((UINTN)MAX_UINT32, Left);
-    Status = VirtioFsFuseReadFileOrDir (
-               VirtioFs,
-               VirtioFsFile->NodeId,
-               VirtioFsFile->FuseHandle,
-               FALSE,                                    // IsDir
-               VirtioFsFile->FilePosition + Transferred,
-               &ReadSize,
-               (UINT8 *)Buffer + Transferred
-               );
-    if (EFI_ERROR (Status) || ReadSize == 0) {
-      break;
+    Position = VirtioFsFile->FilePosition + Transferred;
+    Block = VirtioFsReadCacheLookup (VirtioFs, VirtioFsFile->NodeId,
+              Position);
+
+    if (Block == NULL && Left >= VirtioFs->ReadCacheBlockSize) {
+      //
+      // Large read; bypass the cache.
+      //
+      ReadSize = (UINT32)MIN ((UINTN)VirtioFs->MaxRead, Left);
+      Status = VirtioFsFuseReadFileOrDir (
+                 VirtioFs,
+                 VirtioFsFile->NodeId,
+                 VirtioFsFile->FuseHandle,
+                 FALSE,                                    // IsDir
+                 Position,
+                 &ReadSize,
+                 (UINT8 *)Buffer + Transferred
+                 );
+      if (EFI_ERROR (Status) || ReadSize == 0) {
+        break;
+      }
+      if (ReadSize < MIN ((UINTN)VirtioFs->MaxRead, Left)) {
+        //
+        // Short read: the file ends at (Position + ReadSize).
+        //
+        VirtioFsReadCacheTruncate (VirtioFs, VirtioFsFile->NodeId,
+          Position + ReadSize);
+      }
+      Transferred += ReadSize;
+      Left        -= ReadSize;
+      continue;
+    }
+
+    if (Block == NULL) {
+      //
+      // Cache miss on a small read. Grow the readahead window if the file is
+      // being read sequentially, otherwise restart it from the minimum.
+      //
+      if (Position == VirtioFsFile->ReadAheadNext) {
+        VirtioFsFile->ReadAheadWindow = MIN (
+                                          VirtioFsFile->ReadAheadWindow * 2,
+                                          VirtioFs->ReadCacheBlockSize
+                                          );
+      } else {
+        VirtioFsFile->ReadAheadWindow = VIRTIO_FS_READ_AHEAD_MIN;
+      }
+      ReadSize = (UINT32)MAX ((UINTN)VirtioFsFile->ReadAheadWindow, Left);
+      Status = VirtioFsReadCacheFill (
+                 VirtioFs,
+                 VirtioFsFile->NodeId,
+                 VirtioFsFile->FuseHandle,
+                 Position,
+                 ReadSize,
+                 &Block
+                 );
+      if (EFI_ERROR (Status) || Block == NULL) {
+        break;
+      }
     }
-    Transferred += ReadSize;
-    Left        -= ReadSize;
+
+    BlockBytes = (UINTN)(Block->Offset + Block->Size - Position);
+    BlockBytes = MIN (BlockBytes, Left);
+    CopyMem (
+      (UINT8 *)Buffer + Transferred,
+      Block->Data + (UINTN)(Position - Block->Offset),
+      BlockBytes
+      );
+    Transferred += BlockBytes;
+    Left        -= BlockBytes;
   }
 
   *BufferSize = Transferred;
   VirtioFsFile->FilePosition += Transferred;
+  VirtioFsFile->ReadAheadNext = VirtioFsFile->FilePosition;
   //
   // If we managed to read some data, return success. If zero bytes were
   // transferred due to zero-sized buffer on input or due to EOF on first read,
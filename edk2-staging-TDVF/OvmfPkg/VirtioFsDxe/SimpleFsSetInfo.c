@@ -400,6 +400,12 @@ UpdateAttributes (
     return EFI_ACCESS_DENIED;
   }
   //
+  // Cached file data would go stale if the file were truncated.
+  //
+  if (UpdateFileSize) {
+    VirtioFsReadCacheInvalidate (VirtioFs, VirtioFsFile->NodeId);
+  }
+  //
   // Send the FUSE_SETATTR request now.
   //
   Status = VirtioFsFuseSetAttr (
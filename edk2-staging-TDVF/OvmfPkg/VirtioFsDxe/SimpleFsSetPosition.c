@@ -7,8 +7,6 @@
   SPDX-License-Identifier: BSD-2-Clause-Patent
 **/
 
-#include <Library/MemoryAllocationLib.h> // FreePool()
-
 #include "VirtioFsDxe.h"
 
 EFI_STATUS
@@ -32,14 +30,13 @@ VirtioFsSimpleFileSetPosition (
     if (Position != 0) {
       return EFI_UNSUPPORTED;
     }
+    //
+    // Empty the EFI_FILE_INFO cache, but keep its buffers for the next
+    // refill.
+    //
     VirtioFsFile->FilePosition = 0;
-    if (VirtioFsFile->FileInfoArray != NULL) {
-      FreePool (VirtioFsFile->FileInfoArray);
-      VirtioFsFile->FileInfoArray = NULL;
-    }
-    VirtioFsFile->SingleFileInfoSize = 0;
-    VirtioFsFile->NumFileInfo        = 0;
-    VirtioFsFile->NextFileInfo       = 0;
+    VirtioFsFile->NumFileInfo  = 0;
+    VirtioFsFile->NextFileInfo = 0;
     return EFI_SUCCESS;
   }
 
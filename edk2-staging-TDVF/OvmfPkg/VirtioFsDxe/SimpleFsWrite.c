@@ -32,6 +32,11 @@ VirtioFsSimpleFileWrite (
     return EFI_ACCESS_DENIED;
   }
 
+  //
+  // Cached file data would go stale.
+  //
+  VirtioFsReadCacheInvalidate (VirtioFs, VirtioFsFile->NodeId);
+
   Status      = EFI_SUCCESS;
   Transferred = 0;
   Left        = *BufferSize;
@@ -52,6 +52,26 @@
 //
 #define VIRTIO_FS_FILE_MAX_FILE_INFO 256
 
+//
+// Number of blocks in the read cache that is shared by all files open on a
+// VIRTIO_FS, and the upper limit on the size of a single block. A read
+// request that is at least as large as a block bypasses the cache.
+//
+#define VIRTIO_FS_READ_CACHE_BLOCKS     4
+#define VIRTIO_FS_READ_CACHE_BLOCK_SIZE SIZE_128KB
+
+//
+// The readahead window of a file starts at this size, and is doubled (up to
+// the block size of the read cache) whenever the file is read sequentially.
+//
+#define VIRTIO_FS_READ_AHEAD_MIN SIZE_16KB
+
+//
+// Number of pages in a FUSE_READ / FUSE_WRITE request that the FUSE server is
+// assumed to support if it does not negotiate VIRTIO_FS_FUSE_INIT_REQ_F_MAX_PAGES.
+//
+#define VIRTIO_FS_FUSE_DEFAULT_MAX_PAGES 32
+
 //
 // Filesystem label encoded in UCS-2, transformed from the UTF-8 representation
 // in "VIRTIO_FS_CONFIG.Tag", and NUL-terminated. Only the printable ASCII code
@@ -59,6 +79,19 @@
 //
 typedef CHAR16 VIRTIO_FS_LABEL[VIRTIO_FS_TAG_BYTES + 1];
 
+//
+// A block of file data in the read cache. A block is unused if its NodeId is
+// zero (the FUSE protocol never assigns that inode number). Data is allocated
+// on first use, with VIRTIO_FS.ReadCacheBlockSize bytes.
+//
+typedef struct {
+  UINT64 NodeId;
+  UINT64 Offset;
+  UINT32 Size;
+  UINT64 LastUse;
+  UINT8  *Data;
+} VIRTIO_FS_READ_CACHE_BLOCK;
+
 //
 // Main context structure, expressing an EFI_SIMPLE_FILE_SYSTEM_PROTOCOL
 // interface on top of the Virtio Filesystem device.
@@ -69,19 +102,24 @@ typedef struct {
   // at various call depths. The table to the right should make it easier to
   // track them.
   //
-  //                              field         init function       init depth
-  //                              -----------   ------------------  ----------
-  UINT64                          Signature; // DriverBindingStart  0
-  VIRTIO_DEVICE_PROTOCOL          *Virtio;   // DriverBindingStart  0
-  VIRTIO_FS_LABEL                 Label;     // VirtioFsInit        1
-  UINT16                          QueueSize; // VirtioFsInit        1
-  VRING                           Ring;      // VirtioRingInit      2
-  VOID                            *RingMap;  // VirtioRingMap       2
-  UINT64                          RequestId; // FuseInitSession     1
-  UINT32                          MaxWrite;  // FuseInitSession     1
-  EFI_EVENT                       ExitBoot;  // DriverBindingStart  0
-  LIST_ENTRY                      OpenFiles; // DriverBindingStart  0
-  EFI_SIMPLE_FILE_SYSTEM_PROTOCOL SimpleFs;  // DriverBindingStart  0
+  //                              field                   init function      init depth
+  //                              ------------------      ------------------ ----------
+  UINT64                          Signature;           // DriverBindingStart 0
+  VIRTIO_DEVICE_PROTOCOL          *Virtio;             // DriverBindingStart 0
+  VIRTIO_FS_LABEL                 Label;               // VirtioFsInit       1
+  UINT16                          QueueSize;           // VirtioFsInit       1
+  VRING                           Ring;                // VirtioRingInit     2
+  VOID                            *RingMap;            // VirtioRingMap      2
+  UINT64                          RequestId;           // FuseInitSession    1
+  UINT32                          MaxWrite;            // FuseInitSession    1
+  UINT32                          MaxRead;             // FuseInitSession    1
+  UINT32                          ReadCacheBlockSize;  // ReadCacheInit      1
+  UINT64                          ReadCacheClock;      // ReadCacheInit      1
+  VIRTIO_FS_READ_CACHE_BLOCK      ReadCache[VIRTIO_FS_READ_CACHE_BLOCKS];
+                                                       // ReadCacheInit      1
+  EFI_EVENT                       ExitBoot;            // DriverBindingStart 0
+  LIST_ENTRY                      OpenFiles;           // DriverBindingStart 0
+  EFI_SIMPLE_FILE_SYSTEM_PROTOCOL SimpleFs;            // DriverBindingStart 0
 } VIRTIO_FS;
 
 #define VIRTIO_FS_FROM_SIMPLE_FS(SimpleFsReference) \
@@ -170,10 +208,27 @@ typedef struct {
   // EFI_FILE_INFOs immediately. EFI_FILE_PROTOCOL.Read() invocations (on
   // directories) will be served from this EFI_FILE_INFO cache.
   //
-  UINT8 *FileInfoArray;
-  UINTN SingleFileInfoSize;
-  UINTN NumFileInfo;
-  UINTN NextFileInfo;
+  // DirentBuf (the receive buffer for FUSE_READDIRPLUS) and FileInfoArray are
+  // allocated on the first refill, and are reused for the lifetime of the
+  // VIRTIO_FS_FILE object, so that further refills cost a single
+  // FUSE_READDIRPLUS request.
+  //
+  UINT8  *FileInfoArray;
+  UINTN  SingleFileInfoSize;
+  UINTN  NumFileInfo;
+  UINTN  NextFileInfo;
+  UINT8  *DirentBuf;
+  UINT32 DirentBufSize;
+  UINT32 Namelen;
+  //
+  // Readahead state for a regular file. ReadAheadNext is the file position
+  // right after the last byte returned by EFI_FILE_PROTOCOL.Read(); a read
+  // starting at ReadAheadNext is considered sequential. ReadAheadWindow is the
+  // number of bytes to fetch into the read cache on the next sequential cache
+  // miss.
+  //
+  UINT64 ReadAheadNext;
+  UINT32 ReadAheadWindow;
 } VIRTIO_FS_FILE;
 
 #define VIRTIO_FS_FILE_FROM_SIMPLE_FILE(SimpleFileReference) \
@@ -234,6 +289,51 @@ VirtioFsFuseCheckResponse (
   OUT UINTN                         *TailBufferFill
   );
 
+VOID
+VirtioFsReadCacheInit (
+  IN OUT VIRTIO_FS *VirtioFs
+  );
+
+VOID
+VirtioFsReadCacheUninit (
+  IN OUT VIRTIO_FS *VirtioFs
+  );
+
+VOID
+VirtioFsReadCacheInvalidate (
+  IN OUT VIRTIO_FS *VirtioFs,
+  IN     UINT64    NodeId
+  );
+
+VOID
+VirtioFsReadCacheTruncate (
+  IN OUT VIRTIO_FS *VirtioFs,
+  IN     UINT64    NodeId,
+  IN     UINT64    FileSize
+  );
+
+VIRTIO_FS_READ_CACHE_BLOCK *
+VirtioFsReadCacheLookup (
+  IN OUT VIRTIO_FS *VirtioFs,
+  IN     UINT64    NodeId,
+  IN     UINT64    Offset
+  );
+
+EFI_STATUS
+VirtioFsReadCacheFill (
+  IN OUT VIRTIO_FS                  *VirtioFs,
+  IN     UINT64                     NodeId,
+  IN     UINT64                     FuseHandle,
+  IN     UINT64                     Offset,
+  IN     UINT32                     Size,
+     OUT VIRTIO_FS_READ_CACHE_BLOCK **Block
+  );
+
+VOID
+VirtioFsFileFreeDirCache (
+  IN OUT VIRTIO_FS_FILE *VirtioFsFile
+  );
+
 EFI_STATUS
 VirtioFsErrnoToEfiStatus (
   IN INT32 Errno
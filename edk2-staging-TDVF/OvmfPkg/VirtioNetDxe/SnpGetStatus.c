@@ -93,6 +93,20 @@ VirtioNetGetStatus (
       (BOOLEAN) ((LinkStatus & VIRTIO_NET_S_LINK_UP) != 0);
   }
 
+  //
+  // flush coalesced notifications (see VirtioNetKick())
+  //
+  Status = VirtioNetKick (Dev, VIRTIO_NET_Q_TX, &Dev->TxRing,
+             &Dev->TxUnkicked);
+  if (EFI_ERROR (Status)) {
+    goto Exit;
+  }
+  Status = VirtioNetKick (Dev, VIRTIO_NET_Q_RX, &Dev->RxRing,
+             &Dev->RxUnkicked);
+  if (EFI_ERROR (Status)) {
+    goto Exit;
+  }
+
   //
   // virtio-0.9.5, 2.4.2 Receiving Used Buffers From the Device
   //
@@ -14,6 +14,7 @@
 #include <Library/BaseLib.h>
 #include <Library/BaseMemoryLib.h>
 #include <Library/MemoryAllocationLib.h>
+#include <Library/PcdLib.h>
 #include <Library/UefiBootServicesTableLib.h>
 
 #include "VirtioNet.h"
@@ -68,7 +69,7 @@ VirtioNetInitRing (
   }
 
   //
-  // For each packet (RX and TX alike), we need two descriptors:
+  // For each packet (RX and TX alike), we need at most two descriptors:
   // one for the virtio-net request header, and another one for the data
   //
   if (QueueSize < 2) {
@@ -212,11 +213,10 @@ VirtioNetInitTx (
 
   //
   // In VirtIo 1.0, the NumBuffers field is mandatory. In 0.9.5, it depends on
-  // VIRTIO_NET_F_MRG_RXBUF, which we never negotiate.
+  // VIRTIO_NET_F_MRG_RXBUF. See VirtioNetInitialize().
   //
-  TxSharedReqSize = (Dev->VirtIo->Revision < VIRTIO_SPEC_REVISION (1, 0, 0)) ?
-                    sizeof (Dev->TxSharedReq->V0_9_5) :
-                    sizeof *Dev->TxSharedReq;
+  TxSharedReqSize = Dev->NetReqSize;
+  Dev->TxUnkicked = 0;
 
   for (PktIdx = 0; PktIdx < Dev->TxMaxPending; ++PktIdx) {
     UINT16 DescIdx;
@@ -293,7 +293,7 @@ FreeTxFreeStack:
     packet data into,
   - select polling over RX interrupt,
   - fully populate the RX queue with a static pattern of virtio descriptor
-    chains.
+    chains (or single descriptors, if Dev->RxSingleDesc is set).
 
   @param[in,out] Dev       The VNET_DEV driver instance about to enter the
                            EfiSimpleNetworkInitialized state.
@@ -316,6 +316,7 @@ VirtioNetInitRx (
   UINTN                 VirtioNetReqSize;
   UINTN                 RxBufSize;
   UINT16                RxAlwaysPending;
+  UINT16                RxDescPerPkt;
   UINTN                 PktIdx;
   UINT16                DescIdx;
   UINTN                 NumBytes;
@@ -324,26 +325,29 @@ VirtioNetInitRx (
 
   //
   // In VirtIo 1.0, the NumBuffers field is mandatory. In 0.9.5, it depends on
-  // VIRTIO_NET_F_MRG_RXBUF, which we never negotiate.
+  // VIRTIO_NET_F_MRG_RXBUF. See VirtioNetInitialize().
   //
-  VirtioNetReqSize = (Dev->VirtIo->Revision < VIRTIO_SPEC_REVISION (1, 0, 0)) ?
-                     sizeof (VIRTIO_NET_REQ) :
-                     sizeof (VIRTIO_1_0_NET_REQ);
+  VirtioNetReqSize = Dev->NetReqSize;
 
   //
-  // For each incoming packet we must supply two descriptors:
+  // For each incoming packet we must supply
   // - the recipient for the virtio-net request header, plus
   // - the recipient for the network data (which consists of Ethernet header
   //   and Ethernet payload).
   //
+  // In virtio-0.9.5, these have to be separate descriptors. VirtIo 1.0
+  // permits any descriptor layout, so there we cover both recipients with a
+  // single descriptor, and fit twice as many pending packets into the queue.
+  //
   RxBufSize = VirtioNetReqSize +
               (Dev->Snm.MediaHeaderSize + Dev->Snm.MaxPacketSize);
+  RxDescPerPkt = Dev->RxSingleDesc ? 1 : 2;
 
   //
-  // Limit the number of pending RX packets if the queue is big. The division
-  // by two is due to the above "two descriptors per packet" trait.
+  // Limit the number of pending RX packets if the queue is big.
   //
-  RxAlwaysPending = (UINT16) MIN (Dev->RxRing.QueueSize / 2, VNET_MAX_PENDING);
+  RxAlwaysPending = (UINT16) MIN (Dev->RxRing.QueueSize / RxDescPerPkt,
+                               MAX (FixedPcdGet16 (PcdVirtioNetRxMaxPending), 1));
 
   //
   // The RxBuf is shared between guest and hypervisor, use
@@ -384,6 +388,7 @@ VirtioNetInitRx (
   MemoryFence ();
   Dev->RxLastUsed = *Dev->RxRing.Used.Idx;
   ASSERT (Dev->RxLastUsed == 0);
+  Dev->RxUnkicked = 0;
 
   //
   // virtio-0.9.5, 2.4.2 Receiving Used Buffers From the Device:
@@ -393,8 +398,9 @@ VirtioNetInitRx (
   *Dev->RxRing.Avail.Flags = (UINT16) VRING_AVAIL_F_NO_INTERRUPT;
 
   //
-  // now set up a separate, two-part descriptor chain for each RX packet, and
-  // link each chain into (from) the available ring as well
+  // now set up a separate, two-part descriptor chain (or a single descriptor)
+  // for each RX packet, and link each chain into (from) the available ring as
+  // well
   //
   DescIdx = 0;
   RxBufDeviceAddress = Dev->RxBufDeviceBase;
@@ -408,16 +414,23 @@ VirtioNetInitRx (
     //
     // virtio-0.9.5, 2.4.1.1 Placing Buffers into the Descriptor Table
     //
-    Dev->RxRing.Desc[DescIdx].Addr  = RxBufDeviceAddress;
-    Dev->RxRing.Desc[DescIdx].Len   = (UINT32) VirtioNetReqSize;
-    Dev->RxRing.Desc[DescIdx].Flags = VRING_DESC_F_WRITE | VRING_DESC_F_NEXT;
-    Dev->RxRing.Desc[DescIdx].Next  = (UINT16) (DescIdx + 1);
-    RxBufDeviceAddress += Dev->RxRing.Desc[DescIdx++].Len;
-
-    Dev->RxRing.Desc[DescIdx].Addr  = RxBufDeviceAddress;
-    Dev->RxRing.Desc[DescIdx].Len   = (UINT32) (RxBufSize - VirtioNetReqSize);
-    Dev->RxRing.Desc[DescIdx].Flags = VRING_DESC_F_WRITE;
-    RxBufDeviceAddress += Dev->RxRing.Desc[DescIdx++].Len;
+    if (Dev->RxSingleDesc) {
+      Dev->RxRing.Desc[DescIdx].Addr  = RxBufDeviceAddress;
+      Dev->RxRing.Desc[DescIdx].Len   = (UINT32) RxBufSize;
+      Dev->RxRing.Desc[DescIdx].Flags = VRING_DESC_F_WRITE;
+      RxBufDeviceAddress += Dev->RxRing.Desc[DescIdx++].Len;
+    } else {
+      Dev->RxRing.Desc[DescIdx].Addr  = RxBufDeviceAddress;
+      Dev->RxRing.Desc[DescIdx].Len   = (UINT32) VirtioNetReqSize;
+      Dev->RxRing.Desc[DescIdx].Flags = VRING_DESC_F_WRITE | VRING_DESC_F_NEXT;
+      Dev->RxRing.Desc[DescIdx].Next  = (UINT16) (DescIdx + 1);
+      RxBufDeviceAddress += Dev->RxRing.Desc[DescIdx++].Len;
+
+      Dev->RxRing.Desc[DescIdx].Addr  = RxBufDeviceAddress;
+      Dev->RxRing.Desc[DescIdx].Len   = (UINT32) (RxBufSize - VirtioNetReqSize);
+      Dev->RxRing.Desc[DescIdx].Flags = VRING_DESC_F_WRITE;
+      RxBufDeviceAddress += Dev->RxRing.Desc[DescIdx++].Len;
+    }
   }
 
   //
@@ -556,9 +569,25 @@ VirtioNetInitialize (
   ASSERT (Dev->Snm.MediaPresentSupported ==
     !!(Features & VIRTIO_NET_F_STATUS));
 
-  Features &= VIRTIO_NET_F_MAC | VIRTIO_NET_F_STATUS | VIRTIO_F_VERSION_1 |
+  Features &= VIRTIO_NET_F_MAC | VIRTIO_NET_F_STATUS |
+              VIRTIO_NET_F_MRG_RXBUF | VIRTIO_F_VERSION_1 |
               VIRTIO_F_IOMMU_PLATFORM;
 
+  //
+  // With VIRTIO_NET_F_MRG_RXBUF, the virtio-net request header carries the
+  // NumBuffers field in virtio-0.9.5 too. Each of our receive buffers can
+  // accommodate a full frame, so the device should never need to merge
+  // buffers; VirtioNetReceive() drops packets for which it does nonetheless.
+  //
+  Dev->RxMergeable = (BOOLEAN) ((Features & VIRTIO_NET_F_MRG_RXBUF) != 0);
+  Dev->NetReqSize  = (Dev->VirtIo->Revision < VIRTIO_SPEC_REVISION (1, 0, 0) &&
+                      !Dev->RxMergeable) ?
+                     sizeof (VIRTIO_NET_REQ) :
+                     sizeof (VIRTIO_1_0_NET_REQ);
+  Dev->RxSingleDesc = (BOOLEAN) (Dev->VirtIo->Revision >=
+                                 VIRTIO_SPEC_REVISION (1, 0, 0));
+  Dev->NotifyBatch  = MAX (FixedPcdGet16 (PcdVirtioNetNotifyBatch), 1);
+
   //
   // In virtio-1.0, feature negotiation is expected to complete before queue
   // discovery, and the device can also reject the selected set of features.
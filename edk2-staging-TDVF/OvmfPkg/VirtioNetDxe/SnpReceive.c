@@ -77,6 +77,7 @@ VirtioNetReceive (
   UINT16     AvailIdx;
   EFI_STATUS NotifyStatus;
   UINTN      RxBufOffset;
+  UINT16     NumBuffers;
 
   if (This == NULL || BufferSize == NULL || Buffer == NULL) {
     return EFI_INVALID_PARAMETER;
@@ -103,23 +104,61 @@ VirtioNetReceive (
   MemoryFence ();
 
   if (Dev->RxLastUsed == RxCurUsed) {
-    Status = EFI_NOT_READY;
+    //
+    // The client is polling us; flush coalesced notifications (see
+    // VirtioNetKick()) in both directions.
+    //
+    Status = VirtioNetKick (Dev, VIRTIO_NET_Q_RX, &Dev->RxRing,
+               &Dev->RxUnkicked);
+    if (!EFI_ERROR (Status)) {
+      Status = VirtioNetKick (Dev, VIRTIO_NET_Q_TX, &Dev->TxRing,
+                 &Dev->TxUnkicked);
+    }
+    if (!EFI_ERROR (Status)) {
+      Status = EFI_NOT_READY;
+    }
     goto Exit;
   }
 
   UsedElemIdx = Dev->RxLastUsed % Dev->RxRing.QueueSize;
   DescIdx = Dev->RxRing.Used.UsedElem[UsedElemIdx].Id;
   RxLen   = Dev->RxRing.Used.UsedElem[UsedElemIdx].Len;
+  NumBuffers = 1;
+
+  //
+  // The virtio-net request header is located at the start of the head
+  // descriptor's buffer, and the network data follows it immediately, whether
+  // or not the packet uses a separate descriptor for the data. See
+  // VirtioNetInitRx().
+  //
+  RxBufOffset = (UINTN)(Dev->RxRing.Desc[DescIdx].Addr -
+                        Dev->RxBufDeviceBase);
+  RxPtr = Dev->RxBuf + RxBufOffset;
 
   //
   // the virtio-net request header must be complete; we skip it
   //
-  ASSERT (RxLen >= Dev->RxRing.Desc[DescIdx].Len);
-  RxLen -= Dev->RxRing.Desc[DescIdx].Len;
+  ASSERT (RxLen >= Dev->NetReqSize);
+  RxLen -= (UINT32) Dev->NetReqSize;
   //
   // the host must not have filled in more data than requested
   //
-  ASSERT (RxLen <= Dev->RxRing.Desc[DescIdx + 1].Len);
+  ASSERT (RxLen <= Dev->Snm.MediaHeaderSize + Dev->Snm.MaxPacketSize);
+
+  if (Dev->RxMergeable) {
+    NumBuffers = ((VIRTIO_1_0_NET_REQ *) RxPtr)->NumBuffers;
+    if (NumBuffers != 1) {
+      //
+      // The frame does not fit into one receive buffer. Drop it, together
+      // with the buffers the device merged into it (never more than what the
+      // device has returned).
+      //
+      NumBuffers = (UINT16) MIN (MAX (NumBuffers, 1),
+                              (UINT16) (RxCurUsed - Dev->RxLastUsed));
+      Status = EFI_DEVICE_ERROR;
+      goto RecycleDesc;
+    }
+  }
 
   OrigBufferSize = *BufferSize;
   *BufferSize = RxLen;
@@ -138,9 +177,7 @@ VirtioNetReceive (
     *HeaderSize = Dev->Snm.MediaHeaderSize;
   }
 
-  RxBufOffset = (UINTN)(Dev->RxRing.Desc[DescIdx + 1].Addr -
-                        Dev->RxBufDeviceBase);
-  RxPtr = Dev->RxBuf + RxBufOffset;
+  RxPtr += Dev->NetReqSize;
   CopyMem (Buffer, RxPtr, RxLen);
 
   if (DestAddr != NULL) {
@@ -161,22 +198,33 @@ VirtioNetReceive (
   Status = EFI_SUCCESS;
 
 RecycleDesc:
-  ++Dev->RxLastUsed;
-
   //
   // virtio-0.9.5, 2.4.1 Supplying Buffers to The Device
   //
   AvailIdx = *Dev->RxRing.Avail.Idx;
-  Dev->RxRing.Avail.Ring[AvailIdx++ % Dev->RxRing.QueueSize] =
-    (UINT16) DescIdx;
+  while (NumBuffers > 0) {
+    UsedElemIdx = Dev->RxLastUsed++ % Dev->RxRing.QueueSize;
+    DescIdx = Dev->RxRing.Used.UsedElem[UsedElemIdx].Id;
+    Dev->RxRing.Avail.Ring[AvailIdx++ % Dev->RxRing.QueueSize] =
+      (UINT16) DescIdx;
+    ++Dev->RxUnkicked;
+    --NumBuffers;
+  }
 
   MemoryFence ();
   *Dev->RxRing.Avail.Idx = AvailIdx;
 
-  MemoryFence ();
-  NotifyStatus = Dev->VirtIo->SetQueueNotify (Dev->VirtIo, VIRTIO_NET_Q_RX);
-  if (!EFI_ERROR (Status)) { // earlier error takes precedence
-    Status = NotifyStatus;
+  //
+  // Coalesce notifications, see VirtioNetKick(). Buffers that have been
+  // recycled but not announced to the device yet are flushed as soon as the
+  // client finds the Used Ring empty.
+  //
+  if (Dev->RxUnkicked >= Dev->NotifyBatch) {
+    NotifyStatus = VirtioNetKick (Dev, VIRTIO_NET_Q_RX, &Dev->RxRing,
+                     &Dev->RxUnkicked);
+    if (!EFI_ERROR (Status)) { // earlier error takes precedence
+      Status = NotifyStatus;
+    }
   }
 
 Exit:
@@ -8,6 +8,7 @@
 
 **/
 
+#include <Library/BaseLib.h>
 #include <Library/MemoryAllocationLib.h>
 
 #include "VirtioNet.h"
@@ -104,6 +105,53 @@ VirtioNetUninitRing (
 }
 
 
+/**
+  Notify the device about descriptor chains that have been placed on the
+  Available Ring of a queue since the last notification.
+
+  Notifications are coalesced: VirtioNetTransmit() and VirtioNetReceive() only
+  call this function when at least Dev->NotifyBatch chains are outstanding, or
+  (VirtioNetTransmit()) when the device has consumed all the chains it was
+  notified about, while VirtioNetGetStatus() and VirtioNetReceive() call it, as part of client
+  polling, whenever any chain is outstanding.
+
+  The notification is suppressed entirely if the device has set
+  VRING_USED_F_NO_NOTIFY (virtio-0.9.5, 2.4.1.4 Notifying the Device), that is,
+  if the device is processing the Available Ring anyway. Each suppressed
+  notification saves a VM exit (a TDVMCALL in a TD).
+
+  @param[in,out] Dev       The VNET_DEV driver instance in the
+                           EfiSimpleNetworkInitialized state.
+  @param[in]     Selector  Identifies the queue to notify.
+  @param[in]     Ring      The virtio ring corresponding to Selector.
+  @param[in,out] Unkicked  The number of chains placed on the Available Ring
+                           of Ring since the last notification. Reset to
+                           zero on output.
+
+  @return  Status codes from VirtIo->SetQueueNotify().
+*/
+EFI_STATUS
+EFIAPI
+VirtioNetKick (
+  IN OUT VNET_DEV *Dev,
+  IN     UINT16   Selector,
+  IN     VRING    *Ring,
+  IN OUT UINT16   *Unkicked
+  )
+{
+  if (*Unkicked == 0) {
+    return EFI_SUCCESS;
+  }
+  *Unkicked = 0;
+
+  MemoryFence ();
+  if ((*Ring->Used.Flags & VRING_USED_F_NO_NOTIFY) != 0) {
+    return EFI_SUCCESS;
+  }
+  return Dev->VirtIo->SetQueueNotify (Dev->VirtIo, Selector);
+}
+
+
 /**
   Map Caller-supplied TxBuf buffer to the device-mapped address
 
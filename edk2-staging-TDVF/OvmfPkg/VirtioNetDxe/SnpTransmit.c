@@ -169,8 +169,28 @@ VirtioNetTransmit (
   MemoryFence ();
   *Dev->TxRing.Avail.Idx = AvailIdx;
 
+  //
+  // Coalesce notifications, but only while the device has packets to work
+  // on: kick the device if it has already consumed all the packets it was
+  // notified about (so that a lone ARP request or TCP ACK is not delayed
+  // until the next poll), once per Dev->NotifyBatch packets, or when we run
+  // out of free descriptor chains. Any remainder is flushed when the client
+  // polls VirtioNetGetStatus() or VirtioNetReceive().
+  //
+  ++Dev->TxUnkicked;
   MemoryFence ();
-  Status = Dev->VirtIo->SetQueueNotify (Dev->VirtIo, VIRTIO_NET_Q_TX);
+  if (*Dev->TxRing.Used.Idx == (UINT16) (AvailIdx - Dev->TxUnkicked) ||
+      Dev->TxUnkicked >= Dev->NotifyBatch ||
+      Dev->TxCurPending == Dev->TxMaxPending) {
+    Status = VirtioNetKick (
+               Dev,
+               VIRTIO_NET_Q_TX,
+               &Dev->TxRing,
+               &Dev->TxUnkicked
+               );
+  } else {
+    Status = EFI_SUCCESS;
+  }
 
 Exit:
   gBS->RestoreTPL (OldTpl);
@@ -25,7 +25,8 @@
 #define VNET_SIG SIGNATURE_32 ('V', 'N', 'E', 'T')
 
 //
-// maximum number of pending packets, separately for each direction
+// maximum number of pending TX packets; the number of pending RX packets is
+// set with PcdVirtioNetRxMaxPending
 //
 #define VNET_MAX_PENDING 64
 
@@ -77,6 +78,11 @@ typedef struct {
   EFI_DEVICE_PATH_PROTOCOL    *MacDevicePath;    // VirtioNetDriverBindingStart
   EFI_HANDLE                  MacHandle;         // VirtioNetDriverBindingStart
 
+  UINTN                       NetReqSize;        // VirtioNetInitialize
+  BOOLEAN                     RxMergeable;       // VirtioNetInitialize
+  BOOLEAN                     RxSingleDesc;      // VirtioNetInitialize
+  UINT16                      NotifyBatch;       // VirtioNetInitialize
+
   VRING                       RxRing;            // VirtioNetInitRing
   VOID                        *RxRingMap;        // VirtioRingMap and
                                                  // VirtioNetInitRing
@@ -85,6 +91,7 @@ typedef struct {
   UINTN                       RxBufNrPages;      // VirtioNetInitRx
   EFI_PHYSICAL_ADDRESS        RxBufDeviceBase;   // VirtioNetInitRx
   VOID                        *RxBufMap;         // VirtioNetInitRx
+  UINT16                      RxUnkicked;        // VirtioNetInitRx
 
   VRING                       TxRing;            // VirtioNetInitRing
   VOID                        *TxRingMap;        // VirtioRingMap and
@@ -95,6 +102,7 @@ typedef struct {
   VIRTIO_1_0_NET_REQ          *TxSharedReq;      // VirtioNetInitTx
   VOID                        *TxSharedReqMap;   // VirtioNetInitTx
   UINT16                      TxLastUsed;        // VirtioNetInitTx
+  UINT16                      TxUnkicked;        // VirtioNetInitTx
   ORDERED_COLLECTION          *TxBufCollection;  // VirtioNetInitTx
 } VNET_DEV;
 
@@ -276,6 +284,15 @@ VirtioNetUninitRing (
   IN     VOID     *RingMap
   );
 
+EFI_STATUS
+EFIAPI
+VirtioNetKick (
+  IN OUT VNET_DEV *Dev,
+  IN     UINT16   Selector,
+  IN     VRING    *Ring,
+  IN OUT UINT16   *Unkicked
+  );
+
 //
 // utility functions to map caller-supplied Tx buffer system physical address
 // to a device address and vice versa
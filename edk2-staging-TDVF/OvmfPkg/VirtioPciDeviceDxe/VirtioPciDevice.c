@@ -40,6 +40,7 @@ STATIC VIRTIO_DEVICE_PROTOCOL mDeviceProtocolTemplate = {
   VirtioPciFreeSharedPages,             // FreeSharedPages
   VirtioPciMapSharedBuffer,             // MapSharedBuffer
   VirtioPciUnmapSharedBuffer,           // UnmapSharedBuffer
+  VirtioPciSetQueueEvent,               // SetQueueEvent
 };
 
 /**
@@ -185,4 +185,13 @@ VirtioPciUnmapSharedBuffer (
   IN  VIRTIO_DEVICE_PROTOCOL        *This,
   IN  VOID                          *Mapping
   );
+
+EFI_STATUS
+EFIAPI
+VirtioPciSetQueueEvent (
+  IN  VIRTIO_DEVICE_PROTOCOL        *This,
+  IN  UINT16                        QueueIndex,
+  IN  EFI_EVENT                     Event       OPTIONAL
+  );
+
 #endif // _VIRTIO_PCI_DEVICE_DXE_H_
@@ -326,3 +326,19 @@ VirtioPciUnmapSharedBuffer (
 {
   return EFI_SUCCESS;
 }
+
+EFI_STATUS
+EFIAPI
+VirtioPciSetQueueEvent (
+  IN VIRTIO_DEVICE_PROTOCOL    *This,
+  IN UINT16                    QueueIndex,
+  IN EFI_EVENT                 Event       OPTIONAL
+  )
+{
+  //
+  // Enabling MSI-X on a legacy virtio-pci device would move the device
+  // specific configuration (see VirtioPciInit()), and INTx is not routed in
+  // the firmware; such devices are always polled.
+  //
+  return EFI_UNSUPPORTED;
+}
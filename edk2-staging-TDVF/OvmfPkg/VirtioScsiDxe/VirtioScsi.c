@@ -1084,6 +1084,15 @@ VirtioScsiInit (
     goto UnmapQueue;
   }
 
+  //
+  // Request interrupt-driven completion, if the transport supports it.
+  //
+  Status = VirtioRingEnableEvent (Dev->VirtIo, VIRTIO_SCSI_REQUEST_QUEUE,
+             &Dev->Ring);
+  if (EFI_ERROR (Status)) {
+    goto UnmapQueue;
+  }
+
   //
   // step 4c -- Report GPFN (guest-physical frame number) of queue.
   //
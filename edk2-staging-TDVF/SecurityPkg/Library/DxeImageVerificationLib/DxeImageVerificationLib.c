@@ -270,10 +270,58 @@ GetImageType (
   return IMAGE_UNKNOWN;
 }
 
+/**
+  Feed a range of the image to the hash contexts of several algorithms.
+
+  The range is fed in chunks small enough to stay in the processor caches, so
+  that the image is read from memory once, whatever the number of algorithms.
+
+  @param[in]  HashCtx       The hash contexts, indexed by hash algorithm type.
+  @param[in]  HashAlgMask   A bit mask of (1 << HashAlg) for each context to update.
+  @param[in]  HashBase      The start of the range.
+  @param[in]  HashSize      The size of the range in bytes.
+
+  @retval TRUE            The range has been hashed.
+  @retval FALSE           Fail in hash the range.
+
+**/
+STATIC
+BOOLEAN
+HashPeImageUpdate (
+  IN VOID         *HashCtx[HASHALG_MAX],
+  IN UINT32       HashAlgMask,
+  IN CONST UINT8  *HashBase,
+  IN UINTN        HashSize
+  )
+{
+  UINTN   ChunkSize;
+  UINT32  HashAlg;
+
+  while (HashSize != 0) {
+    ChunkSize = MIN (HashSize, HASH_CHUNK_SIZE);
+    for (HashAlg = 0; HashAlg < HASHALG_MAX; HashAlg++) {
+      if ((HashAlgMask & (1 << HashAlg)) == 0) {
+        continue;
+      }
+      if (!mHash[HashAlg].HashUpdate (HashCtx[HashAlg], HashBase, ChunkSize)) {
+        return FALSE;
+      }
+    }
+    HashBase += ChunkSize;
+    HashSize -= ChunkSize;
+  }
+  return TRUE;
+}
+
 /**
   Calculate hash of Pe/Coff image based on the authenticode image hashing in
   PE/COFF Specification 8.0 Appendix A
 
+  The digests the image measurement asked for through
+  EDKII_PE_IMAGE_DIGEST_CACHE_PROTOCOL are computed in the same pass, and all
+  of them are cached. A digest this function already computed for the same
+  image contents is not computed again, but the image is still validated.
+
   Caution: This function may receive untrusted input.
   PE/COFF image is external input, so this function will validate its data structure
   within this image buffer before use.
@@ -294,8 +342,10 @@ HashPeImage (
 {
   BOOLEAN                   Status;
   EFI_IMAGE_SECTION_HEADER  *Section;
-  VOID                      *HashCtx;
-  UINTN                     CtxSize;
+  VOID                      *HashCtx[HASHALG_MAX];
+  UINT32                    HashAlgMask;
+  UINT32                    Alg;
+  BOOLEAN                   Cached;
   UINT8                     *HashBase;
   UINTN                     HashSize;
   UINTN                     SumOfBytesHashed;
@@ -304,8 +354,9 @@ HashPeImage (
   UINTN                     Pos;
   UINT32                    CertSize;
   UINT32                    NumberOfRvaAndSizes;
+  UINT8                     Digests[HASHALG_MAX][MAX_DIGEST_SIZE];
 
-  HashCtx       = NULL;
+  ZeroMem (HashCtx, sizeof (HashCtx));
   SectionHeader = NULL;
   Status        = FALSE;
 
@@ -346,20 +397,58 @@ HashPeImage (
   }
 
   mHashTypeStr = mHash[HashAlg].Name;
-  CtxSize   = mHash[HashAlg].GetContextSize();
 
-  HashCtx = AllocatePool (CtxSize);
-  if (HashCtx == NULL) {
+  if (mNtHeader.Pe32->OptionalHeader.Magic == EFI_IMAGE_NT_OPTIONAL_HDR32_MAGIC) {
+    //
+    // Use PE32 offset.
+    //
+    NumberOfRvaAndSizes = mNtHeader.Pe32->OptionalHeader.NumberOfRvaAndSizes;
+  } else if (mNtHeader.Pe32->OptionalHeader.Magic == EFI_IMAGE_NT_OPTIONAL_HDR64_MAGIC) {
+    //
+    // Use PE32+ offset.
+    //
+    NumberOfRvaAndSizes = mNtHeader.Pe32Plus->OptionalHeader.NumberOfRvaAndSizes;
+  } else {
+    //
+    // Invalid header magic number.
+    //
     return FALSE;
   }
 
+  //
+  // The digest may have been computed for the same image contents by an
+  // earlier call, e.g. for another signature of the image. The image is still walked below, without
+  // hashing, so that it is validated as when the digest is computed.
+  // Otherwise compute the digests requested by the image measurement in the
+  // same pass.
+  //
+  Cached = GetCachedImageDigest (HashAlg, mImageDigest);
+  if (Cached) {
+    HashAlgMask = 0;
+  } else {
+    HashAlgMask = (1 << HashAlg) | GetRequestedImageDigests ();
+  }
+
   // 1.  Load the image header into memory.
 
   // 2.  Initialize a SHA hash context.
-  Status = mHash[HashAlg].HashInit(HashCtx);
-
-  if (!Status) {
-    goto Done;
+  for (Alg = 0; Alg < HASHALG_MAX; Alg++) {
+    if ((HashAlgMask & (1 << Alg)) == 0) {
+      continue;
+    }
+    if (mHash[Alg].GetContextSize == NULL) {
+      HashAlgMask &= ~(1 << Alg);
+      continue;
+    }
+    HashCtx[Alg] = AllocatePool (mHash[Alg].GetContextSize ());
+    if (HashCtx[Alg] == NULL) {
+      Status = FALSE;
+      goto Done;
+    }
+    Status = mHash[Alg].HashInit (HashCtx[Alg]);
+    if (!Status) {
+      goto Done;
+    }
   }
 
   //
@@ -377,22 +466,14 @@ HashPeImage (
     // Use PE32 offset.
     //
     HashSize = (UINTN) (&mNtHeader.Pe32->OptionalHeader.CheckSum) - (UINTN) HashBase;
-    NumberOfRvaAndSizes = mNtHeader.Pe32->OptionalHeader.NumberOfRvaAndSizes;
-  } else if (mNtHeader.Pe32->OptionalHeader.Magic == EFI_IMAGE_NT_OPTIONAL_HDR64_MAGIC) {
+  } else {
     //
     // Use PE32+ offset.
     //
     HashSize = (UINTN) (&mNtHeader.Pe32Plus->OptionalHeader.CheckSum) - (UINTN) HashBase;
-    NumberOfRvaAndSizes = mNtHeader.Pe32Plus->OptionalHeader.NumberOfRvaAndSizes;
-  } else {
-    //
-    // Invalid header magic number.
-    //
-    Status = FALSE;
-    goto Done;
   }
 
-  Status  = mHash[HashAlg].HashUpdate(HashCtx, HashBase, HashSize);
+  Status  = HashPeImageUpdate (HashCtx, HashAlgMask, HashBase, HashSize);
   if (!Status) {
     goto Done;
   }
@@ -420,7 +501,7 @@ HashPeImage (
     }
 
     if (HashSize != 0) {
-      Status  = mHash[HashAlg].HashUpdate(HashCtx, HashBase, HashSize);
+      Status  = HashPeImageUpdate (HashCtx, HashAlgMask, HashBase, HashSize);
       if (!Status) {
         goto Done;
       }
@@ -444,7 +525,7 @@ HashPeImage (
     }
 
     if (HashSize != 0) {
-      Status  = mHash[HashAlg].HashUpdate(HashCtx, HashBase, HashSize);
+      Status  = HashPeImageUpdate (HashCtx, HashAlgMask, HashBase, HashSize);
       if (!Status) {
         goto Done;
       }
@@ -469,7 +550,7 @@ HashPeImage (
     }
 
     if (HashSize != 0) {
-      Status  = mHash[HashAlg].HashUpdate(HashCtx, HashBase, HashSize);
+      Status  = HashPeImageUpdate (HashCtx, HashAlgMask, HashBase, HashSize);
       if (!Status) {
         goto Done;
       }
@@ -542,7 +623,7 @@ HashPeImage (
     HashBase  = mImageBase + Section->PointerToRawData;
     HashSize  = (UINTN) Section->SizeOfRawData;
 
-    Status  = mHash[HashAlg].HashUpdate(HashCtx, HashBase, HashSize);
+    Status  = HashPeImageUpdate (HashCtx, HashAlgMask, HashBase, HashSize);
     if (!Status) {
       goto Done;
     }
@@ -578,7 +659,7 @@ HashPeImage (
     if (mImageSize > CertSize + SumOfBytesHashed) {
       HashSize = (UINTN) (mImageSize - CertSize - SumOfBytesHashed);
 
-      Status  = mHash[HashAlg].HashUpdate(HashCtx, HashBase, HashSize);
+      Status  = HashPeImageUpdate (HashCtx, HashAlgMask, HashBase, HashSize);
       if (!Status) {
         goto Done;
       }
@@ -588,11 +669,26 @@ HashPeImage (
     }
   }
 
-  Status  = mHash[HashAlg].HashFinal(HashCtx, mImageDigest);
+  for (Alg = 0; Alg < HASHALG_MAX; Alg++) {
+    if ((HashAlgMask & (1 << Alg)) == 0) {
+      continue;
+    }
+    Status = mHash[Alg].HashFinal (HashCtx[Alg], Digests[Alg]);
+    if (!Status) {
+      goto Done;
+    }
+  }
+
+  if (!Cached) {
+    CopyMem (mImageDigest, Digests[HashAlg], mImageDigestSize);
+    CacheImageDigests (HashAlgMask, Digests);
+  }
 
 Done:
-  if (HashCtx != NULL) {
-    FreePool (HashCtx);
+  for (Alg = 0; Alg < HASHALG_MAX; Alg++) {
+    if (HashCtx[Alg] != NULL) {
+      FreePool (HashCtx[Alg]);
+    }
   }
   if (SectionHeader != NULL) {
     FreePool (SectionHeader);
@@ -825,8 +921,7 @@ AddImageExeInfo (
 
   @param[in]  Certificate       Pointer to X.509 Certificate that is searched for.
   @param[in]  CertSize          Size of X.509 Certificate.
-  @param[in]  SignatureList     Pointer to the Signature List in forbidden database.
-  @param[in]  SignatureListSize Size of Signature List.
+  @param[in]  Dbx               The forbidden database.
   @param[out] RevocationTime    Return the time that the certificate was revoked.
   @param[out] IsFound           Search result. Only valid if EFI_SUCCESS returned.
 
@@ -838,34 +933,36 @@ EFI_STATUS
 IsCertHashFoundInDbx (
   IN  UINT8               *Certificate,
   IN  UINTN               CertSize,
-  IN  EFI_SIGNATURE_LIST  *SignatureList,
-  IN  UINTN               SignatureListSize,
+  IN  SIGNATURE_DATABASE  *Dbx,
   OUT EFI_TIME            *RevocationTime,
   OUT BOOLEAN             *IsFound
   )
 {
   EFI_STATUS          Status;
-  EFI_SIGNATURE_LIST  *DbxList;
-  UINTN               DbxSize;
-  EFI_SIGNATURE_DATA  *CertHash;
-  UINTN               CertHashCount;
+  SIGNATURE_ENTRY     Entry;
+  SIGNATURE_ENTRY     FoundEntry;
   UINTN               Index;
   UINT32              HashAlg;
   VOID                *HashCtx;
   UINT8               CertDigest[MAX_DIGEST_SIZE];
-  UINT8               *DbxCertHash;
-  UINTN               SiglistHeaderSize;
   UINT8               *TBSCert;
   UINTN               TBSCertSize;
+  STATIC CONST struct {
+    EFI_GUID          *SignatureType;
+    UINT32            HashAlg;
+  } DbxHashTypes[] = {
+    { &gEfiCertX509Sha256Guid, HASHALG_SHA256 },
+    { &gEfiCertX509Sha384Guid, HASHALG_SHA384 },
+    { &gEfiCertX509Sha512Guid, HASHALG_SHA512 }
+  };
 
   Status   = EFI_ABORTED;
   *IsFound = FALSE;
-  DbxList  = SignatureList;
-  DbxSize  = SignatureListSize;
   HashCtx  = NULL;
-  HashAlg  = HASHALG_MAX;
+  FoundEntry.SignatureList = NULL;
+  FoundEntry.SignatureData = NULL;
 
-  if ((RevocationTime == NULL) || (DbxList == NULL)) {
+  if ((RevocationTime == NULL) || (Dbx == NULL)) {
     return EFI_INVALID_PARAMETER;
   }
 
@@ -876,21 +973,14 @@ IsCertHashFoundInDbx (
     return Status;
   }
 
-  while ((DbxSize > 0) && (SignatureListSize >= DbxList->SignatureListSize)) {
+  for (Index = 0; Index < ARRAY_SIZE (DbxHashTypes); Index++) {
     //
-    // Determine Hash Algorithm of Certificate in the forbidden database.
+    // Hash the TBSCertificate only for the algorithms the forbidden database uses.
     //
-    if (CompareGuid (&DbxList->SignatureType, &gEfiCertX509Sha256Guid)) {
-      HashAlg = HASHALG_SHA256;
-    } else if (CompareGuid (&DbxList->SignatureType, &gEfiCertX509Sha384Guid)) {
-      HashAlg = HASHALG_SHA384;
-    } else if (CompareGuid (&DbxList->SignatureType, &gEfiCertX509Sha512Guid)) {
-      HashAlg = HASHALG_SHA512;
-    } else {
-      DbxSize -= DbxList->SignatureListSize;
-      DbxList  = (EFI_SIGNATURE_LIST *) ((UINT8 *) DbxList + DbxList->SignatureListSize);
+    if (!FindSignatureInDatabase (Dbx, DbxHashTypes[Index].SignatureType, NULL, 0, FALSE, &Entry)) {
       continue;
     }
+    HashAlg = DbxHashTypes[Index].HashAlg;
 
     //
     // Calculate the hash value of current TBSCertificate for comparision.
@@ -916,32 +1006,26 @@ IsCertHashFoundInDbx (
     FreePool (HashCtx);
     HashCtx = NULL;
 
-    SiglistHeaderSize = sizeof (EFI_SIGNATURE_LIST) + DbxList->SignatureHeaderSize;
-    CertHash          = (EFI_SIGNATURE_DATA *) ((UINT8 *) DbxList + SiglistHeaderSize);
-    CertHashCount     = (DbxList->SignatureListSize - SiglistHeaderSize) / DbxList->SignatureSize;
-    for (Index = 0; Index < CertHashCount; Index++) {
+    if (!FindSignatureInDatabase (Dbx, DbxHashTypes[Index].SignatureType, CertDigest, mHash[HashAlg].DigestLength, FALSE, &Entry)) {
+      continue;
+    }
+
+    //
+    // Hash of Certificate is found in forbidden database. Keep the first
+    // entry of the database, whatever its algorithm.
+    //
+    if (!*IsFound || ((UINTN) Entry.SignatureData < (UINTN) FoundEntry.SignatureData)) {
+      FoundEntry = Entry;
+      *IsFound   = TRUE;
+
       //
-      // Iterate each Signature Data Node within this CertList for verify.
+      // Return the revocation time.
       //
-      DbxCertHash = CertHash->SignatureData;
-      if (CompareMem (DbxCertHash, CertDigest, mHash[HashAlg].DigestLength) == 0) {
-        //
-        // Hash of Certificate is found in forbidden database.
-        //
-        Status   = EFI_SUCCESS;
-        *IsFound = TRUE;
-
-        //
-        // Return the revocation time.
-        //
-        CopyMem (RevocationTime, (EFI_TIME *)(DbxCertHash + mHash[HashAlg].DigestLength), sizeof (EFI_TIME));
-        goto Done;
+      ZeroMem (RevocationTime, sizeof (EFI_TIME));
+      if (Entry.SignatureList->SignatureSize >= sizeof (EFI_GUID) + mHash[HashAlg].DigestLength + sizeof (EFI_TIME)) {
+        CopyMem (RevocationTime, (EFI_TIME *)(Entry.SignatureData->SignatureData + mHash[HashAlg].DigestLength), sizeof (EFI_TIME));
       }
-      CertHash = (EFI_SIGNATURE_DATA *) ((UINT8 *) CertHash + DbxList->SignatureSize);
     }
-
-    DbxSize -= DbxList->SignatureListSize;
-    DbxList  = (EFI_SIGNATURE_LIST *) ((UINT8 *) DbxList + DbxList->SignatureListSize);
   }
 
   Status = EFI_SUCCESS;
@@ -977,21 +1061,15 @@ IsSignatureFoundInDatabase (
   )
 {
   EFI_STATUS          Status;
-  EFI_SIGNATURE_LIST  *CertList;
-  EFI_SIGNATURE_DATA  *Cert;
-  UINTN               DataSize;
-  UINT8               *Data;
-  UINTN               Index;
-  UINTN               CertCount;
+  SIGNATURE_DATABASE  *Database;
+  SIGNATURE_ENTRY     Entry;
 
   //
   // Read signature database variable.
   //
   *IsFound  = FALSE;
-  Data      = NULL;
-  DataSize  = 0;
-  Status    = gRT->GetVariable (VariableName, &gEfiImageSecurityDatabaseGuid, NULL, &DataSize, NULL);
-  if (Status != EFI_BUFFER_TOO_SMALL) {
+  Status    = GetSignatureDatabase (VariableName, &Database);
+  if (EFI_ERROR (Status)) {
     if (Status == EFI_NOT_FOUND) {
       //
       // No database, no need to search.
@@ -1002,53 +1080,20 @@ IsSignatureFoundInDatabase (
     return Status;
   }
 
-  Data = (UINT8 *) AllocateZeroPool (DataSize);
-  if (Data == NULL) {
-    return EFI_OUT_OF_RESOURCES;
-  }
-
-  Status = gRT->GetVariable (VariableName, &gEfiImageSecurityDatabaseGuid, NULL, &DataSize, Data);
-  if (EFI_ERROR (Status)) {
-    goto Done;
-  }
   //
-  // Enumerate all signature data in SigDB to check if signature exists for executable.
+  // Search the signature data in SigDB to check if signature exists for executable.
   //
-  CertList = (EFI_SIGNATURE_LIST *) Data;
-  while ((DataSize > 0) && (DataSize >= CertList->SignatureListSize)) {
-    CertCount = (CertList->SignatureListSize - sizeof (EFI_SIGNATURE_LIST) - CertList->SignatureHeaderSize) / CertList->SignatureSize;
-    Cert      = (EFI_SIGNATURE_DATA *) ((UINT8 *) CertList + sizeof (EFI_SIGNATURE_LIST) + CertList->SignatureHeaderSize);
-    if ((CertList->SignatureSize == sizeof(EFI_SIGNATURE_DATA) - 1 + SignatureSize) && (CompareGuid(&CertList->SignatureType, CertType))) {
-      for (Index = 0; Index < CertCount; Index++) {
-        if (CompareMem (Cert->SignatureData, Signature, SignatureSize) == 0) {
-          //
-          // Find the signature in database.
-          //
-          *IsFound = TRUE;
-          //
-          // Entries in UEFI_IMAGE_SECURITY_DATABASE that are used to validate image should be measured
-          //
-          if (StrCmp(VariableName, EFI_IMAGE_SECURITY_DATABASE) == 0) {
-            SecureBootHook (VariableName, &gEfiImageSecurityDatabaseGuid, CertList->SignatureSize, Cert);
-          }
-          break;
-        }
-
-        Cert = (EFI_SIGNATURE_DATA *) ((UINT8 *) Cert + CertList->SignatureSize);
-      }
-
-      if (*IsFound) {
-        break;
-      }
+  if (FindSignatureInDatabase (Database, CertType, Signature, SignatureSize, TRUE, &Entry)) {
+    //
+    // Find the signature in database.
+    //
+    *IsFound = TRUE;
+    //
+    // Entries in UEFI_IMAGE_SECURITY_DATABASE that are used to validate image should be measured
+    //
+    if (StrCmp(VariableName, EFI_IMAGE_SECURITY_DATABASE) == 0) {
+      SecureBootHook (VariableName, &gEfiImageSecurityDatabaseGuid, Entry.SignatureList->SignatureSize, Entry.SignatureData);
     }
-
-    DataSize -= CertList->SignatureListSize;
-    CertList = (EFI_SIGNATURE_LIST *) ((UINT8 *) CertList + CertList->SignatureListSize);
-  }
-
-Done:
-  if (Data != NULL) {
-    FreePool (Data);
   }
 
   return Status;
@@ -1130,23 +1175,16 @@ PassTimestampCheck (
 {
   EFI_STATUS                Status;
   BOOLEAN                   VerifyStatus;
-  EFI_SIGNATURE_LIST        *CertList;
-  EFI_SIGNATURE_DATA        *Cert;
-  UINT8                     *DbtData;
-  UINTN                     DbtDataSize;
+  SIGNATURE_DATABASE        *Dbt;
   UINT8                     *RootCert;
   UINTN                     RootCertSize;
   UINTN                     Index;
-  UINTN                     CertCount;
   EFI_TIME                  SigningTime;
 
   //
   // Variable Initialization
   //
   VerifyStatus      = FALSE;
-  DbtData           = NULL;
-  CertList          = NULL;
-  Cert              = NULL;
   RootCert          = NULL;
   RootCertSize      = 0;
 
@@ -1161,53 +1199,29 @@ PassTimestampCheck (
   // RevocationTime is non-zero, the certificate should be considered to be revoked from that time and onwards.
   // Using the dbt to get the trusted TSA certificates.
   //
-  DbtDataSize = 0;
-  Status   = gRT->GetVariable (EFI_IMAGE_SECURITY_DATABASE2, &gEfiImageSecurityDatabaseGuid, NULL, &DbtDataSize, NULL);
-  if (Status != EFI_BUFFER_TOO_SMALL) {
-    goto Done;
-  }
-  DbtData = (UINT8 *) AllocateZeroPool (DbtDataSize);
-  if (DbtData == NULL) {
-    goto Done;
-  }
-  Status = gRT->GetVariable (EFI_IMAGE_SECURITY_DATABASE2, &gEfiImageSecurityDatabaseGuid, NULL, &DbtDataSize, (VOID *) DbtData);
+  Status = GetSignatureDatabase (EFI_IMAGE_SECURITY_DATABASE2, &Dbt);
   if (EFI_ERROR (Status)) {
-    goto Done;
+    return VerifyStatus;
   }
 
-  CertList = (EFI_SIGNATURE_LIST *) DbtData;
-  while ((DbtDataSize > 0) && (DbtDataSize >= CertList->SignatureListSize)) {
-    if (CompareGuid (&CertList->SignatureType, &gEfiCertX509Guid)) {
-      Cert      = (EFI_SIGNATURE_DATA *) ((UINT8 *) CertList + sizeof (EFI_SIGNATURE_LIST) + CertList->SignatureHeaderSize);
-      CertCount = (CertList->SignatureListSize - sizeof (EFI_SIGNATURE_LIST) - CertList->SignatureHeaderSize) / CertList->SignatureSize;
-      for (Index = 0; Index < CertCount; Index++) {
-        //
-        // Iterate each Signature Data Node within this CertList for verify.
-        //
-        RootCert     = Cert->SignatureData;
-        RootCertSize = CertList->SignatureSize - sizeof (EFI_GUID);
-        //
-        // Get the signing time if the timestamp signature is valid.
-        //
-        if (ImageTimestampVerify (AuthData, AuthDataSize, RootCert, RootCertSize, &SigningTime)) {
-          //
-          // The signer signature is valid only when the signing time is earlier than revocation time.
-          //
-          if (IsValidSignatureByTimestamp (&SigningTime, RevocationTime)) {
-            VerifyStatus = TRUE;
-            goto Done;
-          }
-        }
-        Cert = (EFI_SIGNATURE_DATA *) ((UINT8 *) Cert + CertList->SignatureSize);
+  for (Index = 0; Index < Dbt->CertCount; Index++) {
+    //
+    // Iterate each X.509 certificate of the dbt for verify.
+    //
+    RootCert     = Dbt->Certs[Index].SignatureData->SignatureData;
+    RootCertSize = Dbt->Certs[Index].SignatureList->SignatureSize - sizeof (EFI_GUID);
+    //
+    // Get the signing time if the timestamp signature is valid.
+    //
+    if (ImageTimestampVerify (AuthData, AuthDataSize, RootCert, RootCertSize, &SigningTime)) {
+      //
+      // The signer signature is valid only when the signing time is earlier than revocation time.
+      //
+      if (IsValidSignatureByTimestamp (&SigningTime, RevocationTime)) {
+        VerifyStatus = TRUE;
+        break;
       }
     }
-    DbtDataSize -= CertList->SignatureListSize;
-    CertList = (EFI_SIGNATURE_LIST *) ((UINT8 *) CertList + CertList->SignatureListSize);
-  }
-
-Done:
-  if (DbtData != NULL) {
-    FreePool (DbtData);
   }
 
   return VerifyStatus;
@@ -1233,14 +1247,9 @@ IsForbiddenByDbx (
   EFI_STATUS                Status;
   BOOLEAN                   IsForbidden;
   BOOLEAN                   IsFound;
-  UINT8                     *Data;
-  UINTN                     DataSize;
-  EFI_SIGNATURE_LIST        *CertList;
-  UINTN                     CertListSize;
-  EFI_SIGNATURE_DATA        *CertData;
+  SIGNATURE_DATABASE        *Dbx;
   UINT8                     *RootCert;
   UINTN                     RootCertSize;
-  UINTN                     CertCount;
   UINTN                     Index;
   UINT8                     *CertBuffer;
   UINTN                     BufferLength;
@@ -1255,9 +1264,6 @@ IsForbiddenByDbx (
   // Variable Initialization
   //
   IsForbidden       = TRUE;
-  Data              = NULL;
-  CertList          = NULL;
-  CertData          = NULL;
   RootCert          = NULL;
   RootCertSize      = 0;
   Cert              = NULL;
@@ -1269,10 +1275,8 @@ IsForbiddenByDbx (
   //
   // The image will not be forbidden if dbx can't be got.
   //
-  DataSize = 0;
-  Status   = gRT->GetVariable (EFI_IMAGE_SECURITY_DATABASE1, &gEfiImageSecurityDatabaseGuid, NULL, &DataSize, NULL);
-  ASSERT (EFI_ERROR (Status));
-  if (Status != EFI_BUFFER_TOO_SMALL) {
+  Status = GetSignatureDatabase (EFI_IMAGE_SECURITY_DATABASE1, &Dbx);
+  if (EFI_ERROR (Status)) {
     if (Status == EFI_NOT_FOUND) {
       //
       // Evidently not in dbx if the database doesn't exist.
@@ -1281,56 +1285,33 @@ IsForbiddenByDbx (
     }
     return IsForbidden;
   }
-  Data = (UINT8 *) AllocateZeroPool (DataSize);
-  if (Data == NULL) {
-    return IsForbidden;
-  }
-
-  Status = gRT->GetVariable (EFI_IMAGE_SECURITY_DATABASE1, &gEfiImageSecurityDatabaseGuid, NULL, &DataSize, (VOID *) Data);
-  if (EFI_ERROR (Status)) {
-    goto Done;
-  }
 
   //
   // Verify image signature with RAW X509 certificates in DBX database.
   // If passed, the image will be forbidden.
   //
-  CertList     = (EFI_SIGNATURE_LIST *) Data;
-  CertListSize = DataSize;
-  while ((CertListSize > 0) && (CertListSize >= CertList->SignatureListSize)) {
-    if (CompareGuid (&CertList->SignatureType, &gEfiCertX509Guid)) {
-      CertData  = (EFI_SIGNATURE_DATA *) ((UINT8 *) CertList + sizeof (EFI_SIGNATURE_LIST) + CertList->SignatureHeaderSize);
-      CertCount = (CertList->SignatureListSize - sizeof (EFI_SIGNATURE_LIST) - CertList->SignatureHeaderSize) / CertList->SignatureSize;
-
-      for (Index = 0; Index < CertCount; Index++) {
-        //
-        // Iterate each Signature Data Node within this CertList for verify.
-        //
-        RootCert     = CertData->SignatureData;
-        RootCertSize = CertList->SignatureSize - sizeof (EFI_GUID);
-
-        //
-        // Call AuthenticodeVerify library to Verify Authenticode struct.
-        //
-        IsForbidden = AuthenticodeVerify (
-                        AuthData,
-                        AuthDataSize,
-                        RootCert,
-                        RootCertSize,
-                        mImageDigest,
-                        mImageDigestSize
-                        );
-        if (IsForbidden) {
-          DEBUG ((DEBUG_INFO, "DxeImageVerificationLib: Image is signed but signature is forbidden by DBX.\n"));
-          goto Done;
-        }
+  for (Index = 0; Index < Dbx->CertCount; Index++) {
+    //
+    // Iterate each X.509 certificate of the dbx for verify.
+    //
+    RootCert     = Dbx->Certs[Index].SignatureData->SignatureData;
+    RootCertSize = Dbx->Certs[Index].SignatureList->SignatureSize - sizeof (EFI_GUID);
 
-        CertData = (EFI_SIGNATURE_DATA *) ((UINT8 *) CertData + CertList->SignatureSize);
-      }
+    //
+    // Call AuthenticodeVerify library to Verify Authenticode struct.
+    //
+    IsForbidden = AuthenticodeVerify (
+                    AuthData,
+                    AuthDataSize,
+                    RootCert,
+                    RootCertSize,
+                    mImageDigest,
+                    mImageDigestSize
+                    );
+    if (IsForbidden) {
+      DEBUG ((DEBUG_INFO, "DxeImageVerificationLib: Image is signed but signature is forbidden by DBX.\n"));
+      goto Done;
     }
-
-    CertListSize -= CertList->SignatureListSize;
-    CertList      = (EFI_SIGNATURE_LIST *) ((UINT8 *) CertList + CertList->SignatureListSize);
   }
 
   //
@@ -1368,7 +1349,7 @@ IsForbiddenByDbx (
     //
     CertPtr = CertPtr + sizeof (UINT32) + CertSize;
 
-    Status = IsCertHashFoundInDbx (Cert, CertSize, (EFI_SIGNATURE_LIST *)Data, DataSize, &RevocationTime, &IsFound);
+    Status = IsCertHashFoundInDbx (Cert, CertSize, Dbx, &RevocationTime, &IsFound);
     if (EFI_ERROR (Status)) {
       //
       // Error in searching dbx. Consider it as 'found'. RevocationTime might
@@ -1398,10 +1379,6 @@ IsForbiddenByDbx (
   IsForbidden = FALSE;
 
 Done:
-  if (Data != NULL) {
-    FreePool (Data);
-  }
-
   Pkcs7FreeSigners (CertBuffer);
   Pkcs7FreeSigners (TrustedCert);
 
@@ -1428,23 +1405,16 @@ IsAllowedByDb (
   EFI_STATUS                Status;
   BOOLEAN                   VerifyStatus;
   BOOLEAN                   IsFound;
-  EFI_SIGNATURE_LIST        *CertList;
-  EFI_SIGNATURE_DATA        *CertData;
-  UINTN                     DataSize;
-  UINT8                     *Data;
+  SIGNATURE_DATABASE        *Db;
+  SIGNATURE_DATABASE        *Dbx;
+  SIGNATURE_ENTRY           *Cert;
   UINT8                     *RootCert;
   UINTN                     RootCertSize;
   UINTN                     Index;
-  UINTN                     CertCount;
-  UINTN                     DbxDataSize;
-  UINT8                     *DbxData;
   EFI_TIME                  RevocationTime;
 
-  Data              = NULL;
-  CertList          = NULL;
-  CertData          = NULL;
+  Cert              = NULL;
   RootCert          = NULL;
-  DbxData           = NULL;
   RootCertSize      = 0;
   VerifyStatus      = FALSE;
 
@@ -1452,21 +1422,9 @@ IsAllowedByDb (
   // Fetch 'db' content. If 'db' doesn't exist or encounters problem to get the
   // data, return not-allowed-by-db (FALSE).
   //
-  DataSize = 0;
-  Status   = gRT->GetVariable (EFI_IMAGE_SECURITY_DATABASE, &gEfiImageSecurityDatabaseGuid, NULL, &DataSize, NULL);
-  ASSERT (EFI_ERROR (Status));
-  if (Status != EFI_BUFFER_TOO_SMALL) {
-    return VerifyStatus;
-  }
-
-  Data = (UINT8 *) AllocateZeroPool (DataSize);
-  if (Data == NULL) {
-    return VerifyStatus;
-  }
-
-  Status = gRT->GetVariable (EFI_IMAGE_SECURITY_DATABASE, &gEfiImageSecurityDatabaseGuid, NULL, &DataSize, (VOID *) Data);
+  Status = GetSignatureDatabase (EFI_IMAGE_SECURITY_DATABASE, &Db);
   if (EFI_ERROR (Status)) {
-    goto Done;
+    return VerifyStatus;
   }
 
   //
@@ -1474,112 +1432,79 @@ IsAllowedByDb (
   // If any other errors occurred, no need to check 'db' but just return
   // not-allowed-by-db (FALSE) to avoid bypass.
   //
-  DbxDataSize = 0;
-  Status      = gRT->GetVariable (EFI_IMAGE_SECURITY_DATABASE1, &gEfiImageSecurityDatabaseGuid, NULL, &DbxDataSize, NULL);
-  ASSERT (EFI_ERROR (Status));
-  if (Status != EFI_BUFFER_TOO_SMALL) {
+  Status = GetSignatureDatabase (EFI_IMAGE_SECURITY_DATABASE1, &Dbx);
+  if (EFI_ERROR (Status)) {
     if (Status != EFI_NOT_FOUND) {
       goto Done;
     }
     //
     // 'dbx' does not exist. Continue to check 'db'.
     //
-  } else {
-    //
-    // 'dbx' exists. Get its content.
-    //
-    DbxData = (UINT8 *) AllocateZeroPool (DbxDataSize);
-    if (DbxData == NULL) {
-      goto Done;
-    }
-
-    Status = gRT->GetVariable (EFI_IMAGE_SECURITY_DATABASE1, &gEfiImageSecurityDatabaseGuid, NULL, &DbxDataSize, (VOID *) DbxData);
-    if (EFI_ERROR (Status)) {
-      goto Done;
-    }
+    Dbx = NULL;
   }
 
   //
-  // Find X509 certificate in Signature List to verify the signature in pkcs7 signed data.
+  // Find X509 certificate in 'db' to verify the signature in pkcs7 signed data.
   //
-  CertList = (EFI_SIGNATURE_LIST *) Data;
-  while ((DataSize > 0) && (DataSize >= CertList->SignatureListSize)) {
-    if (CompareGuid (&CertList->SignatureType, &gEfiCertX509Guid)) {
-      CertData  = (EFI_SIGNATURE_DATA *) ((UINT8 *) CertList + sizeof (EFI_SIGNATURE_LIST) + CertList->SignatureHeaderSize);
-      CertCount = (CertList->SignatureListSize - sizeof (EFI_SIGNATURE_LIST) - CertList->SignatureHeaderSize) / CertList->SignatureSize;
-
-      for (Index = 0; Index < CertCount; Index++) {
-        //
-        // Iterate each Signature Data Node within this CertList for verify.
-        //
-        RootCert     = CertData->SignatureData;
-        RootCertSize = CertList->SignatureSize - sizeof (EFI_GUID);
+  for (Index = 0; Index < Db->CertCount; Index++) {
+    //
+    // Iterate each X.509 certificate of the db for verify.
+    //
+    Cert         = &Db->Certs[Index];
+    RootCert     = Cert->SignatureData->SignatureData;
+    RootCertSize = Cert->SignatureList->SignatureSize - sizeof (EFI_GUID);
 
+    //
+    // Call AuthenticodeVerify library to Verify Authenticode struct.
+    //
+    VerifyStatus = AuthenticodeVerify (
+                     AuthData,
+                     AuthDataSize,
+                     RootCert,
+                     RootCertSize,
+                     mImageDigest,
+                     mImageDigestSize
+                     );
+    if (VerifyStatus) {
+      //
+      // The image is signed and its signature is found in 'db'.
+      //
+      if (Dbx != NULL) {
         //
-        // Call AuthenticodeVerify library to Verify Authenticode struct.
+        // Here We still need to check if this RootCert's Hash is revoked
         //
-        VerifyStatus = AuthenticodeVerify (
-                         AuthData,
-                         AuthDataSize,
-                         RootCert,
-                         RootCertSize,
-                         mImageDigest,
-                         mImageDigestSize
-                         );
-        if (VerifyStatus) {
+        Status = IsCertHashFoundInDbx (RootCert, RootCertSize, Dbx, &RevocationTime, &IsFound);
+        if (EFI_ERROR (Status)) {
           //
-          // The image is signed and its signature is found in 'db'.
+          // Error in searching dbx. Consider it as 'found'. RevocationTime might
+          // not be valid in such situation.
           //
-          if (DbxData != NULL) {
-            //
-            // Here We still need to check if this RootCert's Hash is revoked
-            //
-            Status = IsCertHashFoundInDbx (RootCert, RootCertSize, (EFI_SIGNATURE_LIST *)DbxData, DbxDataSize, &RevocationTime, &IsFound);
-            if (EFI_ERROR (Status)) {
-              //
-              // Error in searching dbx. Consider it as 'found'. RevocationTime might
-              // not be valid in such situation.
-              //
-              VerifyStatus = FALSE;
-            } else if (IsFound) {
-              //
-              // Check the timestamp signature and signing time to determine if the RootCert can be trusted.
-              //
-              VerifyStatus = PassTimestampCheck (AuthData, AuthDataSize, &RevocationTime);
-              if (!VerifyStatus) {
-                DEBUG ((DEBUG_INFO, "DxeImageVerificationLib: Image is signed and signature is accepted by DB, but its root cert failed the timestamp check.\n"));
-              }
-            }
-          }
-
+          VerifyStatus = FALSE;
+        } else if (IsFound) {
           //
-          // There's no 'dbx' to check revocation time against (must-be pass),
-          // or, there's revocation time found in 'dbx' and checked againt 'dbt'
-          // (maybe pass or fail, depending on timestamp compare result). Either
-          // way the verification job has been completed at this point.
+          // Check the timestamp signature and signing time to determine if the RootCert can be trusted.
           //
-          goto Done;
+          VerifyStatus = PassTimestampCheck (AuthData, AuthDataSize, &RevocationTime);
+          if (!VerifyStatus) {
+            DEBUG ((DEBUG_INFO, "DxeImageVerificationLib: Image is signed and signature is accepted by DB, but its root cert failed the timestamp check.\n"));
+          }
         }
-
-        CertData = (EFI_SIGNATURE_DATA *) ((UINT8 *) CertData + CertList->SignatureSize);
       }
-    }
 
-    DataSize -= CertList->SignatureListSize;
-    CertList = (EFI_SIGNATURE_LIST *) ((UINT8 *) CertList + CertList->SignatureListSize);
+      //
+      // There's no 'dbx' to check revocation time against (must-be pass),
+      // or, there's revocation time found in 'dbx' and checked againt 'dbt'
+      // (maybe pass or fail, depending on timestamp compare result). Either
+      // way the verification job has been completed at this point.
+      //
+      goto Done;
+    }
   }
 
 Done:
 
   if (VerifyStatus) {
-    SecureBootHook (EFI_IMAGE_SECURITY_DATABASE, &gEfiImageSecurityDatabaseGuid, CertList->SignatureSize, CertData);
-  }
-
-  if (Data != NULL) {
-    FreePool (Data);
-  }
-  if (DbxData != NULL) {
-    FreePool (DbxData);
+    SecureBootHook (EFI_IMAGE_SECURITY_DATABASE, &gEfiImageSecurityDatabaseGuid, Cert->SignatureList->SignatureSize, Cert->SignatureData);
   }
 
   return VerifyStatus;
@@ -1803,6 +1728,11 @@ DxeImageVerificationHandler (
     }
   }
 
+  //
+  // The signature databases may have been written since the last image.
+  //
+  RefreshSignatureDatabases ();
+
   //
   // Start Image Validation.
   //
@@ -2063,6 +1993,20 @@ DxeImageVerificationLibConstructor (
   )
 {
   EFI_EVENT            Event;
+  EFI_HANDLE           Handle;
+  EFI_STATUS           Status;
+
+  //
+  // Share the digests of the images with the image measurement.
+  //
+  Handle = NULL;
+  Status = gBS->InstallMultipleProtocolInterfaces (
+                  &Handle,
+                  &gEdkiiPeImageDigestCacheProtocolGuid,
+                  &mPeImageDigestCache,
+                  NULL
+                  );
+  ASSERT_EFI_ERROR (Status);
 
   //
   // Register the event to publish the image execution table.
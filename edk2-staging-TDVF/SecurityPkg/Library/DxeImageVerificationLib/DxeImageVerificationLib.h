@@ -28,6 +28,7 @@ SPDX-License-Identifier: BSD-2-Clause-Patent
 #include <Protocol/BlockIo.h>
 #include <Protocol/SimpleFileSystem.h>
 #include <Protocol/VariableWrite.h>
+#include <Protocol/PeImageDigestCache.h>
 #include <Guid/ImageAuthentication.h>
 #include <Guid/AuthenticatedVariableFormat.h>
 #include <IndustryStandard/PeImage.h>
@@ -73,6 +74,11 @@ SPDX-License-Identifier: BSD-2-Clause-Patent
 // Set max digest size as SHA512 Output (64 bytes) by far
 //
 #define MAX_DIGEST_SIZE    SHA512_DIGEST_SIZE
+
+//
+// The image is hashed by all algorithms this many bytes at a time.
+//
+#define HASH_CHUNK_SIZE    SIZE_64KB
 //
 //
 // PKCS7 Certificate definition
@@ -198,4 +204,162 @@ typedef struct {
   HASH_FINAL               HashFinal;
 } HASH_TABLE;
 
+//
+// One signature of a signature database, with the list that holds it.
+//
+typedef struct {
+  EFI_SIGNATURE_LIST       *SignatureList;
+  EFI_SIGNATURE_DATA       *SignatureData;
+} SIGNATURE_ENTRY;
+
+//
+// Parsed copy of a signature database variable (db, dbx or dbt).
+//
+typedef struct {
+  //
+  // Name of the variable
+  //
+  CHAR16                   *VariableName;
+  //
+  // TRUE if Data reflects the variable, though it may have been written since
+  //
+  BOOLEAN                  Loaded;
+  //
+  // TRUE if the variable must be read again before Data is used
+  //
+  BOOLEAN                  Stale;
+  //
+  // Copy of the variable, NULL if it does not exist
+  //
+  UINT8                    *Data;
+  UINTN                    DataSize;
+  //
+  // Buffer of DataSize bytes the variable is read into, to check Data
+  //
+  UINT8                    *Scratch;
+  //
+  // The signatures of all types but X.509 certificates, sorted by type and
+  // signature data
+  //
+  SIGNATURE_ENTRY          *Index;
+  UINTN                    IndexCount;
+  //
+  // The X.509 certificates, in the order of the variable
+  //
+  SIGNATURE_ENTRY          *Certs;
+  UINTN                    CertCount;
+} SIGNATURE_DATABASE;
+
+/**
+  Mark the cached signature databases to be checked against their variables
+  on their next use.
+
+**/
+VOID
+RefreshSignatureDatabases (
+  VOID
+  );
+
+/**
+  Get the parsed contents of a signature database variable.
+
+  The database is read and indexed on its first use. Afterwards the variable
+  is read again at most once between two calls to RefreshSignatureDatabases(),
+  and is only parsed again if its contents changed.
+
+  The returned database is valid until the next call to this function for the
+  same variable.
+
+  @param[in]  VariableName  Name of the database variable, EFI_IMAGE_SECURITY_DATABASE,
+                            EFI_IMAGE_SECURITY_DATABASE1 or EFI_IMAGE_SECURITY_DATABASE2.
+  @param[out] Database      Return the parsed database.
+
+  @retval EFI_SUCCESS           The database is returned.
+  @retval EFI_NOT_FOUND         The variable does not exist.
+  @retval EFI_OUT_OF_RESOURCES  There is not enough memory to read the variable.
+  @retval Others                The variable could not be read.
+
+**/
+EFI_STATUS
+GetSignatureDatabase (
+  IN  CHAR16              *VariableName,
+  OUT SIGNATURE_DATABASE  **Database
+  );
+
+/**
+  Search a signature database for a signature whose data starts with a key.
+
+  If several signatures match, the first one of the variable is returned.
+
+  @param[in]  Database        The database to search.
+  @param[in]  SignatureType   The type of the signature.
+  @param[in]  Key             The data to search.
+  @param[in]  KeySize         Size of Key in bytes.
+  @param[in]  ExactSize       TRUE if the signature data must be exactly KeySize bytes.
+  @param[out] Entry           Return the signature found.
+
+  @retval TRUE      A signature was found.
+  @retval FALSE     No signature matches.
+
+**/
+BOOLEAN
+FindSignatureInDatabase (
+  IN  SIGNATURE_DATABASE  *Database,
+  IN  EFI_GUID            *SignatureType,
+  IN  UINT8               *Key,
+  IN  UINTN               KeySize,
+  IN  BOOLEAN             ExactSize,
+  OUT SIGNATURE_ENTRY     *Entry
+  );
+
+extern UINTN                                 mImageSize;
+extern UINT8                                 *mImageBase;
+extern HASH_TABLE                            mHash[];
+extern EDKII_PE_IMAGE_DIGEST_CACHE_PROTOCOL  mPeImageDigestCache;
+
+/**
+  Return the hash algorithms that the users of the cache asked for, to compute
+  along with the one the verification needs.
+
+  @return A bit mask of (1 << HashAlg) for each algorithm.
+
+**/
+UINT32
+GetRequestedImageDigests (
+  VOID
+  );
+
+/**
+  Get the cached digest of the current image, mImageBase.
+
+  @param[in]  HashAlg   Hash algorithm type.
+  @param[out] Digest    Return the digest.
+
+  @retval TRUE      The digest is returned.
+  @retval FALSE     The digest is not cached.
+
+**/
+BOOLEAN
+GetCachedImageDigest (
+  IN  UINT32  HashAlg,
+  OUT UINT8   *Digest
+  );
+
+/**
+  Cache the digests computed for the current image, mImageBase.
+
+  The digests are added to the ones already cached for the same image, and
+  replace the ones of any other image. Nothing is cached when no user of the
+  cache asked for a digest.
+
+  @param[in]  HashAlgMask   A bit mask of (1 << HashAlg) for each digest.
+  @param[in]  Digests       The digests, indexed by hash algorithm type.
+
+**/
+VOID
+CacheImageDigests (
+  IN UINT32  HashAlgMask,
+  IN UINT8   Digests[HASHALG_MAX][MAX_DIGEST_SIZE]
+  );
+
 #endif
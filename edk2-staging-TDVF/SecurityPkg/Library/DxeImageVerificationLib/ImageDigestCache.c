@@ -0,0 +1,247 @@
+/** @file
+  Cache of the Authenticode digests of the last image hashed by the image
+  verification, readable by the image measurement through
+  EDKII_PE_IMAGE_DIGEST_CACHE_PROTOCOL.
+
+  Only the image verification writes the cache, with the digests it computed.
+  The digests are kept with a private copy of the image, and are returned only
+  for the same buffer with contents identical to the copy.
+
+Copyright (c) 2021, Intel Corporation. All rights reserved.<BR>
+SPDX-License-Identifier: BSD-2-Clause-Patent
+
+**/
+
+#include "DxeImageVerificationLib.h"
+
+//
+// Hash algorithms of mHash[], with their TPM algorithm and their bit in the
+// protocol HashMask.
+//
+typedef struct {
+  UINT32         HashAlg;
+  TPMI_ALG_HASH  TpmAlg;
+  UINT32         HashMask;
+} IMAGE_DIGEST_ALGORITHM;
+
+STATIC CONST IMAGE_DIGEST_ALGORITHM  mImageDigestAlgorithms[] = {
+  { HASHALG_SHA1,   TPM_ALG_SHA1,   EDKII_PE_IMAGE_DIGEST_SHA1   },
+  { HASHALG_SHA256, TPM_ALG_SHA256, EDKII_PE_IMAGE_DIGEST_SHA256 },
+  { HASHALG_SHA384, TPM_ALG_SHA384, EDKII_PE_IMAGE_DIGEST_SHA384 },
+  { HASHALG_SHA512, TPM_ALG_SHA512, EDKII_PE_IMAGE_DIGEST_SHA512 }
+};
+
+//
+// The image whose digests are cached: the buffer it was hashed in, and a
+// private copy of its contents.
+//
+CONST VOID          *mDigestCacheImageBuffer = NULL;
+UINT8               *mDigestCacheImage       = NULL;
+UINTN               mDigestCacheImageSize    = 0;
+TPML_DIGEST_VALUES  mDigestCacheDigestList;
+
+/**
+  Check whether an image is the one whose digests are cached.
+
+  The address and the size of the buffer are checked first, so that a miss
+  costs little. On a hit, the whole image is compared with the private copy.
+
+  @param[in]  ImageBuffer   The image, as read from its file.
+  @param[in]  ImageSize     The size of the image in bytes.
+
+  @retval TRUE      The digests of the image are cached.
+  @retval FALSE     The image is another one, or has changed.
+
+**/
+STATIC
+BOOLEAN
+IsCachedImage (
+  IN CONST VOID  *ImageBuffer,
+  IN UINTN       ImageSize
+  )
+{
+  return (BOOLEAN) ((mDigestCacheImage != NULL) &&
+                    (mDigestCacheImageBuffer == ImageBuffer) &&
+                    (mDigestCacheImageSize == ImageSize) &&
+                    (CompareMem (mDigestCacheImage, ImageBuffer, ImageSize) == 0));
+}
+
+/**
+  Get the Authenticode digests that the image verification computed for an
+  image.
+
+  @param[in]  This          This pointer for EDKII_PE_IMAGE_DIGEST_CACHE_PROTOCOL.
+  @param[in]  ImageBuffer   The image, as read from its file.
+  @param[in]  ImageSize     The size of the image in bytes.
+  @param[out] DigestList    Return the cached digests.
+
+  @retval EFI_SUCCESS             The digests of the image are returned.
+  @retval EFI_NOT_FOUND           No digest of the image is cached.
+  @retval EFI_INVALID_PARAMETER   ImageBuffer or DigestList is NULL.
+**/
+STATIC
+EFI_STATUS
+EFIAPI
+PeImageDigestCacheGetDigests (
+  IN  EDKII_PE_IMAGE_DIGEST_CACHE_PROTOCOL    *This,
+  IN  CONST VOID                              *ImageBuffer,
+  IN  UINTN                                   ImageSize,
+  OUT TPML_DIGEST_VALUES                      *DigestList
+  )
+{
+  if ((ImageBuffer == NULL) || (DigestList == NULL)) {
+    return EFI_INVALID_PARAMETER;
+  }
+
+  if (!IsCachedImage (ImageBuffer, ImageSize)) {
+    return EFI_NOT_FOUND;
+  }
+
+  CopyMem (DigestList, &mDigestCacheDigestList, sizeof (TPML_DIGEST_VALUES));
+  return EFI_SUCCESS;
+}
+
+EDKII_PE_IMAGE_DIGEST_CACHE_PROTOCOL  mPeImageDigestCache = {
+  0,
+  PeImageDigestCacheGetDigests
+};
+
+/**
+  Return the entry of mImageDigestAlgorithms[] of a hash algorithm.
+
+  @param[in]  HashAlg   Hash algorithm type.
+
+  @return The entry, or NULL if the digest of HashAlg is never cached.
+
+**/
+STATIC
+CONST IMAGE_DIGEST_ALGORITHM *
+GetImageDigestAlgorithm (
+  IN UINT32  HashAlg
+  )
+{
+  UINTN  Index;
+
+  for (Index = 0; Index < ARRAY_SIZE (mImageDigestAlgorithms); Index++) {
+    if (mImageDigestAlgorithms[Index].HashAlg == HashAlg) {
+      return &mImageDigestAlgorithms[Index];
+    }
+  }
+  return NULL;
+}
+
+/**
+  Return the hash algorithms that the users of the cache asked for, to compute
+  along with the one the verification needs.
+
+  @return A bit mask of (1 << HashAlg) for each algorithm.
+
+**/
+UINT32
+GetRequestedImageDigests (
+  VOID
+  )
+{
+  UINTN   Index;
+  UINT32  HashAlgMask;
+
+  HashAlgMask = 0;
+  for (Index = 0; Index < ARRAY_SIZE (mImageDigestAlgorithms); Index++) {
+    if ((mPeImageDigestCache.HashMask & mImageDigestAlgorithms[Index].HashMask) != 0) {
+      HashAlgMask |= 1 << mImageDigestAlgorithms[Index].HashAlg;
+    }
+  }
+  return HashAlgMask;
+}
+
+/**
+  Get the cached digest of the current image, mImageBase.
+
+  @param[in]  HashAlg   Hash algorithm type.
+  @param[out] Digest    Return the digest.
+
+  @retval TRUE      The digest is returned.
+  @retval FALSE     The digest is not cached.
+
+**/
+BOOLEAN
+GetCachedImageDigest (
+  IN  UINT32  HashAlg,
+  OUT UINT8   *Digest
+  )
+{
+  CONST IMAGE_DIGEST_ALGORITHM  *Algorithm;
+  UINT32                        Index;
+
+  Algorithm = GetImageDigestAlgorithm (HashAlg);
+  if ((Algorithm == NULL) || !IsCachedImage (mImageBase, mImageSize)) {
+    return FALSE;
+  }
+
+  for (Index = 0; Index < mDigestCacheDigestList.count; Index++) {
+    if (mDigestCacheDigestList.digests[Index].hashAlg == Algorithm->TpmAlg) {
+      CopyMem (Digest, &mDigestCacheDigestList.digests[Index].digest, mHash[HashAlg].DigestLength);
+      return TRUE;
+    }
+  }
+  return FALSE;
+}
+
+/**
+  Cache the digests computed for the current image, mImageBase.
+
+  The digests are added to the ones already cached for the same image, and
+  replace the ones of any other image. Nothing is cached when no user of the
+  cache asked for a digest.
+
+  @param[in]  HashAlgMask   A bit mask of (1 << HashAlg) for each digest.
+  @param[in]  Digests       The digests, indexed by hash algorithm type.
+
+**/
+VOID
+CacheImageDigests (
+  IN UINT32  HashAlgMask,
+  IN UINT8   Digests[HASHALG_MAX][MAX_DIGEST_SIZE]
+  )
+{
+  UINTN   Index;
+  UINT32  CachedIndex;
+  UINT32  HashAlg;
+
+  if (GetRequestedImageDigests () == 0) {
+    return;
+  }
+
+  if (!IsCachedImage (mImageBase, mImageSize)) {
+    if (mDigestCacheImage != NULL) {
+      FreePool (mDigestCacheImage);
+    }
+    mDigestCacheImageBuffer = mImageBase;
+    mDigestCacheImageSize   = mImageSize;
+    mDigestCacheImage       = AllocateCopyPool (mImageSize, mImageBase);
+    ZeroMem (&mDigestCacheDigestList, sizeof (TPML_DIGEST_VALUES));
+    if (mDigestCacheImage == NULL) {
+      return;
+    }
+  }
+
+  for (Index = 0; Index < ARRAY_SIZE (mImageDigestAlgorithms); Index++) {
+    HashAlg = mImageDigestAlgorithms[Index].HashAlg;
+    if ((HashAlgMask & (1 << HashAlg)) == 0) {
+      continue;
+    }
+    for (CachedIndex = 0; CachedIndex < mDigestCacheDigestList.count; CachedIndex++) {
+      if (mDigestCacheDigestList.digests[CachedIndex].hashAlg == mImageDigestAlgorithms[Index].TpmAlg) {
+        break;
+      }
+    }
+    if (CachedIndex == HASH_COUNT) {
+      break;
+    }
+    mDigestCacheDigestList.digests[CachedIndex].hashAlg = mImageDigestAlgorithms[Index].TpmAlg;
+    CopyMem (&mDigestCacheDigestList.digests[CachedIndex].digest, Digests[HashAlg], mHash[HashAlg].DigestLength);
+    if (CachedIndex == mDigestCacheDigestList.count) {
+      mDigestCacheDigestList.count++;
+    }
+  }
+}
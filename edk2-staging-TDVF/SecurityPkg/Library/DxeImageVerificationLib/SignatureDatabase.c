@@ -0,0 +1,447 @@
+/** @file
+  Parsed and indexed copies of the image signature databases db, dbx and dbt.
+
+  Every image verification searches db and dbx for the image hash and for
+  certificates, so the variables are parsed once and kept. Hash signatures are
+  kept sorted for binary search. Before a database is used for an image, the
+  variable is read again and compared with the copy, and it is parsed again
+  only if it has changed.
+
+Copyright (c) 2021, Intel Corporation. All rights reserved.<BR>
+SPDX-License-Identifier: BSD-2-Clause-Patent
+
+**/
+
+#include "DxeImageVerificationLib.h"
+
+SIGNATURE_DATABASE  mSignatureDatabases[] = {
+  { EFI_IMAGE_SECURITY_DATABASE,  FALSE, TRUE, NULL, 0, NULL, NULL, 0, NULL, 0 },
+  { EFI_IMAGE_SECURITY_DATABASE1, FALSE, TRUE, NULL, 0, NULL, NULL, 0, NULL, 0 },
+  { EFI_IMAGE_SECURITY_DATABASE2, FALSE, TRUE, NULL, 0, NULL, NULL, 0, NULL, 0 }
+};
+
+/**
+  Compare a signature with a signature type and a key.
+
+  Signatures are ordered by type, then by their data. A signature whose data
+  starts with the key is not less than the key.
+
+  @param[in]  Entry           The signature to compare.
+  @param[in]  SignatureType   The signature type to compare with.
+  @param[in]  Key             The signature data to compare with.
+  @param[in]  KeySize         Size of Key in bytes.
+
+  @retval <0    The signature is ordered before the key.
+  @retval 0     The signature data is the key.
+  @retval >0    The signature is ordered after the key, or its data starts
+                with the key and is longer.
+
+**/
+STATIC
+INTN
+CompareSignatureWithKey (
+  IN SIGNATURE_ENTRY  *Entry,
+  IN EFI_GUID         *SignatureType,
+  IN UINT8            *Key,
+  IN UINTN            KeySize
+  )
+{
+  INTN   Result;
+  UINTN  DataSize;
+
+  Result = CompareMem (&Entry->SignatureList->SignatureType, SignatureType, sizeof (EFI_GUID));
+  if (Result != 0) {
+    return Result;
+  }
+
+  DataSize = Entry->SignatureList->SignatureSize - sizeof (EFI_GUID);
+  Result   = CompareMem (Entry->SignatureData->SignatureData, Key, MIN (DataSize, KeySize));
+  if (Result != 0) {
+    return Result;
+  }
+
+  if (DataSize < KeySize) {
+    return -1;
+  }
+  return (DataSize > KeySize) ? 1 : 0;
+}
+
+/**
+  Return the number of signatures of the index ordered before a key.
+
+  @param[in]  Index           The sorted signatures.
+  @param[in]  Count           The number of signatures in Index.
+  @param[in]  SignatureType   The signature type of the key.
+  @param[in]  Key             The signature data of the key.
+  @param[in]  KeySize         Size of Key in bytes.
+  @param[in]  OrEqual         TRUE to also count the signatures equal to the key.
+
+  @return The position of the key in the index.
+
+**/
+STATIC
+UINTN
+SearchSignatureIndex (
+  IN SIGNATURE_ENTRY  *Index,
+  IN UINTN            Count,
+  IN EFI_GUID         *SignatureType,
+  IN UINT8            *Key,
+  IN UINTN            KeySize,
+  IN BOOLEAN          OrEqual
+  )
+{
+  UINTN  Low;
+  UINTN  High;
+  UINTN  Middle;
+  INTN   Result;
+
+  Low  = 0;
+  High = Count;
+  while (Low < High) {
+    Middle = Low + (High - Low) / 2;
+    Result = CompareSignatureWithKey (&Index[Middle], SignatureType, Key, KeySize);
+    if ((Result < 0) || (OrEqual && (Result == 0))) {
+      Low = Middle + 1;
+    } else {
+      High = Middle;
+    }
+  }
+  return Low;
+}
+
+/**
+  Free the copy and the index of a signature database.
+
+  @param[in, out]  Database   The database to free.
+
+**/
+STATIC
+VOID
+FreeSignatureDatabase (
+  IN OUT SIGNATURE_DATABASE  *Database
+  )
+{
+  if (Database->Data != NULL) {
+    FreePool (Database->Data);
+  }
+  if (Database->Scratch != NULL) {
+    FreePool (Database->Scratch);
+  }
+  if (Database->Index != NULL) {
+    FreePool (Database->Index);
+  }
+  if (Database->Certs != NULL) {
+    FreePool (Database->Certs);
+  }
+  Database->Loaded     = FALSE;
+  Database->Data       = NULL;
+  Database->DataSize   = 0;
+  Database->Scratch    = NULL;
+  Database->Index      = NULL;
+  Database->IndexCount = 0;
+  Database->Certs      = NULL;
+  Database->CertCount  = 0;
+}
+
+/**
+  Walk the signature lists of a database, and count or record its signatures.
+
+  @param[in, out]  Database   The database whose Data is walked. If Index and
+                              Certs are not NULL, the signatures are recorded,
+                              and IndexCount and CertCount are updated.
+  @param[out]      Count      Return the number of signatures of all types but
+                              X.509 certificates.
+  @param[out]      CertCount  Return the number of X.509 certificates.
+
+**/
+STATIC
+VOID
+WalkSignatureDatabase (
+  IN OUT SIGNATURE_DATABASE  *Database,
+  OUT    UINTN               *Count,
+  OUT    UINTN               *CertCount
+  )
+{
+  EFI_SIGNATURE_LIST  *CertList;
+  EFI_SIGNATURE_DATA  *Cert;
+  UINTN               DataSize;
+  UINTN               Index;
+  UINTN               SignatureCount;
+  UINTN               Position;
+  SIGNATURE_ENTRY     Entry;
+
+  *Count     = 0;
+  *CertCount = 0;
+  CertList   = (EFI_SIGNATURE_LIST *) Database->Data;
+  DataSize   = Database->DataSize;
+  while ((DataSize >= sizeof (EFI_SIGNATURE_LIST)) && (DataSize >= CertList->SignatureListSize)) {
+    if ((CertList->SignatureListSize < sizeof (EFI_SIGNATURE_LIST) + CertList->SignatureHeaderSize) ||
+        (CertList->SignatureSize < sizeof (EFI_GUID))) {
+      break;
+    }
+
+    SignatureCount = (CertList->SignatureListSize - sizeof (EFI_SIGNATURE_LIST) - CertList->SignatureHeaderSize) / CertList->SignatureSize;
+    Cert           = (EFI_SIGNATURE_DATA *) ((UINT8 *) CertList + sizeof (EFI_SIGNATURE_LIST) + CertList->SignatureHeaderSize);
+    for (Index = 0; Index < SignatureCount; Index++) {
+      Entry.SignatureList = CertList;
+      Entry.SignatureData = Cert;
+      if (CompareGuid (&CertList->SignatureType, &gEfiCertX509Guid)) {
+        if (Database->Certs != NULL) {
+          Database->Certs[Database->CertCount++] = Entry;
+        }
+        (*CertCount)++;
+      } else {
+        if (Database->Index != NULL) {
+          //
+          // Signatures are walked in the order of the variable, so inserting
+          // after the equal ones keeps the first one of the variable first.
+          //
+          Position = SearchSignatureIndex (
+                       Database->Index,
+                       Database->IndexCount,
+                       &CertList->SignatureType,
+                       Cert->SignatureData,
+                       CertList->SignatureSize - sizeof (EFI_GUID),
+                       TRUE
+                       );
+          CopyMem (
+            &Database->Index[Position + 1],
+            &Database->Index[Position],
+            (Database->IndexCount - Position) * sizeof (SIGNATURE_ENTRY)
+            );
+          Database->Index[Position] = Entry;
+          Database->IndexCount++;
+        }
+        (*Count)++;
+      }
+      Cert = (EFI_SIGNATURE_DATA *) ((UINT8 *) Cert + CertList->SignatureSize);
+    }
+
+    DataSize -= CertList->SignatureListSize;
+    CertList = (EFI_SIGNATURE_LIST *) ((UINT8 *) CertList + CertList->SignatureListSize);
+  }
+}
+
+/**
+  Read a signature database variable and index its signatures.
+
+  @param[in, out]  Database   The database to load.
+
+  @retval EFI_SUCCESS           The database is loaded.
+  @retval EFI_NOT_FOUND         The variable does not exist. The database is
+                                loaded, and empty.
+  @retval EFI_OUT_OF_RESOURCES  There is not enough memory to read the variable.
+  @retval Others                The variable could not be read.
+
+**/
+STATIC
+EFI_STATUS
+LoadSignatureDatabase (
+  IN OUT SIGNATURE_DATABASE  *Database
+  )
+{
+  EFI_STATUS  Status;
+  UINTN       DataSize;
+  UINTN       Count;
+  UINTN       CertCount;
+
+  FreeSignatureDatabase (Database);
+
+  DataSize = 0;
+  Status   = gRT->GetVariable (Database->VariableName, &gEfiImageSecurityDatabaseGuid, NULL, &DataSize, NULL);
+  if (Status != EFI_BUFFER_TOO_SMALL) {
+    if (Status == EFI_NOT_FOUND) {
+      Database->Loaded = TRUE;
+    }
+    return Status;
+  }
+
+  Database->Data    = AllocatePool (DataSize);
+  Database->Scratch = AllocatePool (DataSize);
+  if ((Database->Data == NULL) || (Database->Scratch == NULL)) {
+    Status = EFI_OUT_OF_RESOURCES;
+    goto Error;
+  }
+
+  Status = gRT->GetVariable (Database->VariableName, &gEfiImageSecurityDatabaseGuid, NULL, &DataSize, Database->Data);
+  if (EFI_ERROR (Status)) {
+    goto Error;
+  }
+  Database->DataSize = DataSize;
+
+  WalkSignatureDatabase (Database, &Count, &CertCount);
+  Database->Index = AllocatePool (MAX (Count, 1) * sizeof (SIGNATURE_ENTRY));
+  Database->Certs = AllocatePool (MAX (CertCount, 1) * sizeof (SIGNATURE_ENTRY));
+  if ((Database->Index == NULL) || (Database->Certs == NULL)) {
+    Status = EFI_OUT_OF_RESOURCES;
+    goto Error;
+  }
+  WalkSignatureDatabase (Database, &Count, &CertCount);
+
+  Database->Loaded = TRUE;
+  return EFI_SUCCESS;
+
+Error:
+  FreeSignatureDatabase (Database);
+  return Status;
+}
+
+/**
+  Mark the cached signature databases to be checked against their variables
+  on their next use.
+
+**/
+VOID
+RefreshSignatureDatabases (
+  VOID
+  )
+{
+  UINTN  Index;
+
+  for (Index = 0; Index < ARRAY_SIZE (mSignatureDatabases); Index++) {
+    mSignatureDatabases[Index].Stale = TRUE;
+  }
+}
+
+/**
+  Get the parsed contents of a signature database variable.
+
+  The database is read and indexed on its first use. Afterwards the variable
+  is read again at most once between two calls to RefreshSignatureDatabases(),
+  and is only parsed again if its contents changed.
+
+  The returned database is valid until the next call to this function for the
+  same variable.
+
+  @param[in]  VariableName  Name of the database variable, EFI_IMAGE_SECURITY_DATABASE,
+                            EFI_IMAGE_SECURITY_DATABASE1 or EFI_IMAGE_SECURITY_DATABASE2.
+  @param[out] Database      Return the parsed database.
+
+  @retval EFI_SUCCESS           The database is returned.
+  @retval EFI_NOT_FOUND         The variable does not exist.
+  @retval EFI_OUT_OF_RESOURCES  There is not enough memory to read the variable.
+  @retval Others                The variable could not be read.
+
+**/
+EFI_STATUS
+GetSignatureDatabase (
+  IN  CHAR16              *VariableName,
+  OUT SIGNATURE_DATABASE  **Database
+  )
+{
+  EFI_STATUS          Status;
+  SIGNATURE_DATABASE  *Db;
+  UINTN               Index;
+  UINTN               DataSize;
+
+  Db = NULL;
+  for (Index = 0; Index < ARRAY_SIZE (mSignatureDatabases); Index++) {
+    if (StrCmp (VariableName, mSignatureDatabases[Index].VariableName) == 0) {
+      Db = &mSignatureDatabases[Index];
+      break;
+    }
+  }
+  ASSERT (Db != NULL);
+  if (Db == NULL) {
+    return EFI_INVALID_PARAMETER;
+  }
+
+  if (Db->Loaded && Db->Stale) {
+    //
+    // Keep the copy if the variable is unchanged. A variable that grew does
+    // not fit in Scratch, and one that was created does not fit in no buffer.
+    //
+    DataSize = Db->DataSize;
+    Status   = gRT->GetVariable (Db->VariableName, &gEfiImageSecurityDatabaseGuid, NULL, &DataSize, Db->Scratch);
+    if (Db->Data == NULL) {
+      Db->Loaded = (BOOLEAN) (Status == EFI_NOT_FOUND);
+    } else {
+      Db->Loaded = (BOOLEAN) (!EFI_ERROR (Status) &&
+                              (DataSize == Db->DataSize) &&
+                              (CompareMem (Db->Scratch, Db->Data, DataSize) == 0));
+    }
+  }
+
+  if (!Db->Loaded) {
+    Status = LoadSignatureDatabase (Db);
+    if (EFI_ERROR (Status) && (Status != EFI_NOT_FOUND)) {
+      return Status;
+    }
+  }
+  Db->Stale = FALSE;
+
+  *Database = Db;
+  return (Db->Data == NULL) ? EFI_NOT_FOUND : EFI_SUCCESS;
+}
+
+/**
+  Search a signature database for a signature whose data starts with a key.
+
+  If several signatures match, the first one of the variable is returned.
+
+  @param[in]  Database        The database to search.
+  @param[in]  SignatureType   The type of the signature.
+  @param[in]  Key             The data to search.
+  @param[in]  KeySize         Size of Key in bytes.
+  @param[in]  ExactSize       TRUE if the signature data must be exactly KeySize bytes.
+  @param[out] Entry           Return the signature found.
+
+  @retval TRUE      A signature was found.
+  @retval FALSE     No signature matches.
+
+**/
+BOOLEAN
+FindSignatureInDatabase (
+  IN  SIGNATURE_DATABASE  *Database,
+  IN  EFI_GUID            *SignatureType,
+  IN  UINT8               *Key,
+  IN  UINTN               KeySize,
+  IN  BOOLEAN             ExactSize,
+  OUT SIGNATURE_ENTRY     *Entry
+  )
+{
+  SIGNATURE_ENTRY  *Found;
+  SIGNATURE_ENTRY  *Last;
+  UINTN            Position;
+  UINTN            DataSize;
+
+  Position = SearchSignatureIndex (Database->Index, Database->IndexCount, SignatureType, Key, KeySize, FALSE);
+  if (Position == Database->IndexCount) {
+    return FALSE;
+  }
+
+  //
+  // The signatures starting with the key follow it, the shortest first.
+  //
+  Found = &Database->Index[Position];
+  if (!CompareGuid (&Found->SignatureList->SignatureType, SignatureType)) {
+    return FALSE;
+  }
+  DataSize = Found->SignatureList->SignatureSize - sizeof (EFI_GUID);
+  if ((DataSize < KeySize) ||
+      (CompareMem (Found->SignatureData->SignatureData, Key, KeySize) != 0) ||
+      (ExactSize && (DataSize != KeySize))) {
+    return FALSE;
+  }
+
+  //
+  // Longer signatures starting with the key may be ordered before Found in
+  // the variable.
+  //
+  if (!ExactSize) {
+    for (Last = Found + 1; Last < &Database->Index[Database->IndexCount]; Last++) {
+      DataSize = Last->SignatureList->SignatureSize - sizeof (EFI_GUID);
+      if (!CompareGuid (&Last->SignatureList->SignatureType, SignatureType) ||
+          (DataSize < KeySize) ||
+          (CompareMem (Last->SignatureData->SignatureData, Key, KeySize) != 0)) {
+        break;
+      }
+      if ((UINTN) Last->SignatureData < (UINTN) Found->SignatureData) {
+        Found = Last;
+      }
+    }
+  }
+
+  *Entry = *Found;
+  return TRUE;
+}